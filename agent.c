@@ -0,0 +1,375 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tiny crash agent, preloaded into the child in lazy attach mode.
+ *
+ * It installs handlers for the fatal signals, and keeps them installed by
+ * interposing sigaction() and signal(): what the program asks for is
+ * only recorded, and the agent's handler chains to it.  So a program
+ * catching SIGSEGV for its garbage collector or guard pages handles every
+ * fault itself, in process, and only a signal left at its default action
+ * makes the faulting thread tell the supervisor and park until it has
+ * been attached to and dumped.  Other signals are not touched at all.
+ *
+ * Every thread, the main one and those from pthread_create(), gets an
+ * alternate stack, so that stack overflows are reported too.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/ucontext.h>
+
+#include "agent.h"
+
+
+static int g_Fd = -1;
+
+/* The supervised process; children forked without exec are not. */
+static pid_t g_Pid = 0;
+
+static const int g_Signals[] = {
+   SIGQUIT, SIGILL, SIGTRAP, SIGABRT, SIGBUS, SIGFPE, SIGSEGV, SIGXCPU, SIGXFSZ, SIGSYS
+};
+
+#define SIGNAL_COUNT (sizeof g_Signals / sizeof g_Signals[0])
+
+typedef int (*SigactionFunc)(int, const struct sigaction *, struct sigaction *);
+typedef int (*CreateFunc)(pthread_t *, const pthread_attr_t *, void *(*)(void *), void *);
+
+static SigactionFunc g_RealSigaction = NULL;
+
+/* Actions the program asked for, by signal, for the signals we handle. */
+static struct sigaction g_Actions[NSIG];
+static int g_Handled[NSIG];
+
+/* Alternate stacks, to survive stack overflows. */
+#define ALT_STACK_SIZE (64*1024)
+
+static char g_AltStack[ALT_STACK_SIZE];      /* main thread's */
+
+struct ThreadStart
+{
+   void *(*Routine)(void *);
+   void *Arg;
+};
+
+
+static int
+RealSigaction(int sig, const struct sigaction *act, struct sigaction *oldact)
+{
+   if (!g_RealSigaction) {
+      g_RealSigaction = (SigactionFunc)dlsym(RTLD_NEXT, "sigaction");
+      if (!g_RealSigaction) {
+         errno = ENOSYS;
+         return -1;
+      }
+   }
+   return g_RealSigaction(sig, act, oldact);
+}
+
+
+/*
+ * Run the program's handler as the kernel would have, with its mask.  The
+ * interrupted mask is restored by the kernel once we return.
+ */
+static void
+Chain(int sig, const struct sigaction *action, siginfo_t *info, void *context)
+{
+   const ucontext_t *uc = (const ucontext_t *)context;
+   sigset_t mask;
+
+   sigorset(&mask, &uc->uc_sigmask, &action->sa_mask);
+   if (!(action->sa_flags & SA_NODEFER)) {
+      sigaddset(&mask, sig);
+   }
+   if (action->sa_flags & SA_RESETHAND) {
+      g_Actions[sig].sa_handler = SIG_DFL;
+      g_Actions[sig].sa_flags &= ~SA_SIGINFO;
+   }
+   sigprocmask(SIG_SETMASK, &mask, NULL);
+
+   if (action->sa_flags & SA_SIGINFO) {
+      action->sa_sigaction(sig, info, context);
+   } else {
+      action->sa_handler(sig);
+   }
+}
+
+
+static void
+Handler(int sig, siginfo_t *info, void *context)
+{
+   struct AgentMessage message;
+   struct sigaction action = g_Actions[sig];
+   char reply;
+   int saved;
+
+   if (action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+      /* The program's to handle, never the supervisor's. */
+      Chain(sig, &action, info, context);
+      return;
+   }
+
+   saved = errno;
+
+   memset(&message, 0, sizeof message);
+   message.Tid = (pid_t)syscall(SYS_gettid);
+   message.SigInfo = *info;
+   message.Context = (uintptr_t)context;
+
+   if (getpid() == g_Pid &&
+       send(g_Fd, &message, sizeof message, MSG_NOSIGNAL) == (ssize_t)sizeof message) {
+      /* Park until the supervisor is done with us. */
+      while (recv(g_Fd, &reply, sizeof reply, 0) < 0 && errno == EINTR)
+         ;
+   }
+
+   /*
+    * No supervisor (anymore), or a forked child the supervisor knows nothing
+    * about: fall back to the default action.  Faults will
+    * simply happen again once the handler returns.
+    */
+   memset(&action, 0, sizeof action);
+   action.sa_handler = SIG_DFL;
+   RealSigaction(sig, &action, NULL);
+   g_Handled[sig] = 0;
+   if (info->si_code <= 0) {
+      raise(sig);
+   }
+
+   errno = saved;
+}
+
+
+/*
+ * Point the kernel at our handler, or at SIG_IGN if the program ignores
+ * the signal, so that ignoring it stays free.  Only our own report runs on
+ * the alternate stack, to survive stack overflows; the program's handlers
+ * run on whichever stack they asked for.
+ */
+static int
+Install(int sig)
+{
+   const struct sigaction *action = &g_Actions[sig];
+   struct sigaction sa;
+
+   if (action->sa_handler == SIG_IGN && !(action->sa_flags & SA_SIGINFO)) {
+      return RealSigaction(sig, action, NULL);
+   }
+
+   memset(&sa, 0, sizeof sa);
+   sa.sa_sigaction = Handler;
+   sa.sa_flags = SA_SIGINFO | (action->sa_flags & (SA_RESTART | SA_ONSTACK));
+   if (action->sa_handler == SIG_DFL) {
+      sa.sa_flags |= SA_ONSTACK;
+   }
+   sigfillset(&sa.sa_mask);
+   return RealSigaction(sig, &sa, NULL);
+}
+
+
+int
+sigaction(int sig, const struct sigaction *act, struct sigaction *oldact)
+{
+   struct sigaction old;
+   sigset_t mask, saved;
+   int ret = 0;
+
+   if (sig <= 0 || sig >= NSIG || !g_Handled[sig]) {
+      return RealSigaction(sig, act, oldact);
+   }
+
+   /*
+    * The program sees its own actions only.  Keep the signal out of this
+    * thread while its action is half updated.
+    */
+   sigemptyset(&mask);
+   sigaddset(&mask, sig);
+   pthread_sigmask(SIG_BLOCK, &mask, &saved);
+
+   old = g_Actions[sig];
+   if (act) {
+      g_Actions[sig] = *act;
+      if (Install(sig) != 0) {
+         g_Actions[sig] = old;
+         ret = -1;
+      }
+   }
+
+   pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+   if (ret == 0 && oldact) {
+      *oldact = old;
+   }
+   return ret;
+}
+
+
+/*
+ * glibc's signal() calls sigaction internally, bypassing the above.
+ */
+sighandler_t
+signal(int sig, sighandler_t handler)
+{
+   struct sigaction act, old;
+
+   memset(&act, 0, sizeof act);
+   act.sa_handler = handler;
+   act.sa_flags = SA_RESTART;
+   sigemptyset(&act.sa_mask);
+   sigaddset(&act.sa_mask, sig);
+
+   if (sigaction(sig, &act, &old) != 0) {
+      return SIG_ERR;
+   }
+   return old.sa_handler;
+}
+
+
+static void
+FreeAltStack(void *stack)
+{
+   stack_t ss;
+
+   /* Unless the program installed its own meanwhile. */
+   if (sigaltstack(NULL, &ss) == 0 && ss.ss_sp == stack) {
+      memset(&ss, 0, sizeof ss);
+      ss.ss_flags = SS_DISABLE;
+      sigaltstack(&ss, NULL);
+   }
+   munmap(stack, ALT_STACK_SIZE);
+}
+
+
+static void *
+ThreadMain(void *param)
+{
+   struct ThreadStart start = *(struct ThreadStart *)param;
+   void *stack;
+   void *ret;
+   stack_t ss;
+
+   free(param);
+
+   stack = mmap(NULL, ALT_STACK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (stack == MAP_FAILED) {
+      return start.Routine(start.Arg);
+   }
+
+   ss.ss_sp = stack;
+   ss.ss_size = ALT_STACK_SIZE;
+   ss.ss_flags = 0;
+   sigaltstack(&ss, NULL);
+
+   /* Also freed on pthread_exit() and cancellation. */
+   pthread_cleanup_push(FreeAltStack, stack);
+   ret = start.Routine(start.Arg);
+   pthread_cleanup_pop(1);
+
+   return ret;
+}
+
+
+/*
+ * Start threads through ThreadMain, for their alternate stacks.
+ */
+int
+pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+               void *(*routine)(void *), void *arg)
+{
+   static CreateFunc realCreate = NULL;
+   struct ThreadStart *start;
+   int ret;
+
+   if (!realCreate) {
+      realCreate = (CreateFunc)dlsym(RTLD_NEXT, "pthread_create");
+      if (!realCreate) {
+         return ENOSYS;
+      }
+   }
+
+   if (g_Fd < 0 || (start = malloc(sizeof *start)) == NULL) {
+      return realCreate(thread, attr, routine, arg);
+   }
+
+   start->Routine = routine;
+   start->Arg = arg;
+   ret = realCreate(thread, attr, ThreadMain, start);
+   if (ret != 0) {
+      free(start);
+   }
+   return ret;
+}
+
+
+static void __attribute__((constructor))
+AgentInit(void)
+{
+   const char *value = getenv(AGENT_FD_ENV);
+   stack_t ss;
+   unsigned i;
+
+   if (!value) {
+      return;
+   }
+
+   /* Only the direct child is supervised, not what it executes or forks. */
+   g_Fd = atoi(value);
+   g_Pid = getpid();
+   unsetenv(AGENT_FD_ENV);
+   fcntl(g_Fd, F_SETFD, FD_CLOEXEC);
+
+   ss.ss_sp = g_AltStack;
+   ss.ss_size = sizeof g_AltStack;
+   ss.ss_flags = 0;
+   sigaltstack(&ss, NULL);
+
+   /* Whatever was inherited, e.g., SIG_IGN, becomes the program's. */
+   for (i = 0; i < SIGNAL_COUNT; ++i) {
+      int sig = g_Signals[i];
+      if (RealSigaction(sig, NULL, &g_Actions[sig]) == 0 &&
+          Install(sig) == 0) {
+         g_Handled[sig] = 1;
+      }
+   }
+}
+
+
+/* vim:set sw=3 et: */
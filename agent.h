@@ -0,0 +1,61 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Protocol between the supervisor and the preloaded crash agent.
+ */
+
+#ifndef _AGENT_H_
+#define _AGENT_H_
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+/* Environment variable with the agent's end of the notification socket. */
+#define AGENT_FD_ENV "STACKDUMP_AGENT_FD"
+
+/* Name of the agent library, installed next to the stackdump executable. */
+#define AGENT_LIBRARY "libstackdump_agent.so"
+
+
+/*
+ * Sent by a thread about to die from a fatal signal.  The thread then
+ * waits for a reply, so that the supervisor can attach and inspect it.
+ */
+struct AgentMessage
+{
+   pid_t Tid;
+   siginfo_t SigInfo;
+   uint64_t Context;    /* address of the ucontext_t in the target */
+};
+
+
+#endif /* _AGENT_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,280 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * LZ4 block format codec.
+ *
+ * See https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md .  This
+ * is the plain greedy single hash compressor, which is what makes LZ4 fast;
+ * the output decodes with any LZ4 implementation.
+ */
+
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "compress.h"
+
+
+#define MIN_MATCH 4
+
+/* The last match must start this far from the end of the block... */
+#define MF_LIMIT 12
+
+/* ...and the last bytes are always literals. */
+#define LAST_LITERALS 5
+
+#define MAX_DISTANCE 65535
+
+#define HASH_LOG 12
+
+
+static inline uint32_t
+Read32(const uint8_t *p)
+{
+   uint32_t value;
+   memcpy(&value, p, sizeof value);
+   return value;
+}
+
+
+static inline uint64_t
+Read64(const uint8_t *p)
+{
+   uint64_t value;
+   memcpy(&value, p, sizeof value);
+   return value;
+}
+
+
+static inline uint32_t
+Hash(uint32_t Sequence)
+{
+   return (Sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+/* Number of equal leading bytes, given two differing little endian words. */
+static inline unsigned
+CommonBytes(uint64_t Diff)
+{
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward64(&index, Diff);
+   return index >> 3;
+#else
+   return __builtin_ctzll(Diff) >> 3;
+#endif
+}
+
+
+static inline uint8_t *
+WriteLength(uint8_t *op, size_t Length)
+{
+   while (Length >= 255) {
+      *op++ = 255;
+      Length -= 255;
+   }
+   *op++ = (uint8_t)Length;
+   return op;
+}
+
+
+static uint8_t *
+WriteSequence(uint8_t *op, const uint8_t *Literals, size_t LiteralCount,
+              size_t Distance, size_t MatchLength)
+{
+   uint8_t *token = op++;
+   size_t matchCode = MatchLength - MIN_MATCH;
+
+   if (LiteralCount >= 15) {
+      *token = 15 << 4;
+      op = WriteLength(op, LiteralCount - 15);
+   } else {
+      *token = (uint8_t)(LiteralCount << 4);
+   }
+   memcpy(op, Literals, LiteralCount);
+   op += LiteralCount;
+
+   if (!MatchLength) {
+      return op;
+   }
+
+   *op++ = (uint8_t)Distance;
+   *op++ = (uint8_t)(Distance >> 8);
+
+   if (matchCode >= 15) {
+      *token |= 15;
+      op = WriteLength(op, matchCode - 15);
+   } else {
+      *token |= (uint8_t)matchCode;
+   }
+   return op;
+}
+
+
+size_t
+LZ4Compress(const void *Src, size_t SrcSize, void *Dst)
+{
+   const uint8_t *src = (const uint8_t *)Src;
+   uint8_t *op = (uint8_t *)Dst;
+   size_t anchor = 0;
+
+   if (SrcSize > MF_LIMIT) {
+      /* Positions are 32-bit; the writer's blocks are far smaller. */
+      uint32_t table[1 << HASH_LOG];
+      memset(table, 0, sizeof table);
+
+      size_t limit = SrcSize - MF_LIMIT;
+      size_t matchLimit = SrcSize - LAST_LITERALS;
+      size_t ip = 0;
+
+      while (ip < limit) {
+         uint32_t sequence = Read32(src + ip);
+         uint32_t hash = Hash(sequence);
+         size_t ref = table[hash];
+         table[hash] = (uint32_t)ip;
+
+         if (ref >= ip || ip - ref > MAX_DISTANCE || Read32(src + ref) != sequence) {
+            /* Skip faster through data that does not compress. */
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+         }
+
+         while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            --ip;
+            --ref;
+         }
+
+         size_t length = MIN_MATCH;
+         while (ip + length + 8 <= matchLimit) {
+            uint64_t diff = Read64(src + ip + length) ^ Read64(src + ref + length);
+            if (diff) {
+               length += CommonBytes(diff);
+               goto found;
+            }
+            length += 8;
+         }
+         while (ip + length < matchLimit && src[ip + length] == src[ref + length]) {
+            ++length;
+         }
+      found:
+
+         op = WriteSequence(op, src + anchor, ip - anchor, ip - ref, length);
+         ip += length;
+         anchor = ip;
+
+         if (ip < limit) {
+            table[Hash(Read32(src + ip - 2))] = (uint32_t)(ip - 2);
+         }
+      }
+   }
+
+   op = WriteSequence(op, src + anchor, SrcSize - anchor, 0, 0);
+   return op - (uint8_t *)Dst;
+}
+
+
+static inline bool
+ReadLength(const uint8_t *&ip, const uint8_t *end, size_t &Length)
+{
+   uint8_t byte;
+   do {
+      if (ip >= end) {
+         return false;
+      }
+      byte = *ip++;
+      Length += byte;
+   } while (byte == 255);
+   return true;
+}
+
+
+bool
+LZ4Decompress(const void *Src, size_t SrcSize, void *Dst, size_t DstSize)
+{
+   const uint8_t *ip = (const uint8_t *)Src;
+   const uint8_t *end = ip + SrcSize;
+   uint8_t *dst = (uint8_t *)Dst;
+   size_t op = 0;
+
+   while (ip < end) {
+      uint8_t token = *ip++;
+
+      size_t literals = token >> 4;
+      if (literals == 15 && !ReadLength(ip, end, literals)) {
+         return false;
+      }
+      if (literals > (size_t)(end - ip) || literals > DstSize - op) {
+         return false;
+      }
+      memcpy(dst + op, ip, literals);
+      ip += literals;
+      op += literals;
+
+      /* The last sequence has no match. */
+      if (ip == end) {
+         break;
+      }
+
+      if (end - ip < 2) {
+         return false;
+      }
+      size_t distance = ip[0] | (ip[1] << 8);
+      ip += 2;
+
+      size_t length = token & 15;
+      if (length == 15 && !ReadLength(ip, end, length)) {
+         return false;
+      }
+      length += MIN_MATCH;
+
+      if (!distance || distance > op || length > DstSize - op) {
+         return false;
+      }
+
+      uint8_t *out = dst + op;
+      const uint8_t *ref = out - distance;
+      if (distance >= length) {
+         memcpy(out, ref, length);
+      } else if (distance == 1) {
+         memset(out, *ref, length);
+      } else {
+         for (size_t i = 0; i < length; ++i) {
+            out[i] = ref[i];
+         }
+      }
+      op += length;
+   }
+
+   return op == DstSize;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,98 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Block compressed minidumps.
+ *
+ * The dump is cut into fixed size blocks which are compressed independently
+ * with the LZ4 block format, so that they can be compressed on all cores as
+ * the dump is written, and a reader can inflate just the blocks backing the
+ * streams or memory ranges it looks at.  The layout is:
+ *
+ *    BlockHeader
+ *    compressed blocks, in any order
+ *    BlockIndexEntry[BlockCount], at IndexOffset
+ *
+ * Block i holds the uncompressed bytes [i*BlockSize, (i+1)*BlockSize) of
+ * the minidump; only the last block may be shorter.
+ */
+
+#ifndef _COMPRESS_H_
+#define _COMPRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define BLOCK_SIGNATURE 0x5a4c444d   /* 'MDLZ' */
+#define BLOCK_VERSION 1
+
+/* Uncompressed block size used by the writer. */
+#define BLOCK_SIZE (256*1024)
+
+struct BlockHeader
+{
+   uint32_t Signature;
+   uint32_t Version;
+   uint32_t BlockSize;
+   uint32_t BlockCount;
+   uint64_t Size;                 /* of the uncompressed minidump */
+   uint64_t IndexOffset;
+};
+
+/* BlockIndexEntry::Flags */
+#define BLOCK_STORED 0x1           /* kept as is, as it did not compress */
+
+struct BlockIndexEntry
+{
+   uint64_t Offset;
+   uint32_t Size;
+   uint32_t Flags;
+};
+
+
+/* Worst case size of LZ4Compress output. */
+#define LZ4_BOUND(Size) ((Size) + (Size)/255 + 16)
+
+/*
+ * Compress into the LZ4 block format.  Dst must hold LZ4_BOUND(SrcSize)
+ * bytes.  Returns the compressed size.
+ */
+size_t
+LZ4Compress(const void *Src, size_t SrcSize, void *Dst);
+
+/*
+ * Decompress an LZ4 block, which must inflate to exactly DstSize bytes.
+ * Malformed input is rejected rather than read or written out of bounds.
+ */
+bool
+LZ4Decompress(const void *Src, size_t SrcSize, void *Dst, size_t DstSize);
+
+
+#endif /* _COMPRESS_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,189 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Benchmark of full (-ma) dump writing: reads and writes made in line
+ * against the write pipeline.  The target is a child holding the given
+ * amount of memory; every run is timed up to fsync(), so that the page
+ * cache does not flatter the in line writes.
+ *
+ *    dumpbench <output-file> [megabytes] [runs]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "dumpwriter.h"
+#include "process.h"
+
+
+static double
+Now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+/*
+ * Start a child holding that much memory, stopped under ptrace.
+ */
+static pid_t
+StartTarget(size_t Megabytes)
+{
+   pid_t pid = fork();
+   if (pid == 0) {
+      size_t size = Megabytes << 20;
+      uint8_t *memory = (uint8_t *)malloc(size);
+      if (!memory) {
+         _exit(1);
+      }
+      /* Distinct contents, so no page is the zero page. */
+      for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+         *(uint64_t *)(memory + i) = i * 0x9e3779b97f4a7c15ULL;
+      }
+      ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+      raise(SIGSTOP);
+      _exit(0);
+   }
+
+   int status;
+   if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+      return -1;
+   }
+   return pid;
+}
+
+
+/*
+ * Write a full dump, up to fsync().  Returns the seconds taken, or a
+ * negative number on failure.
+ */
+static double
+TimeDump(const char *Path, Process *process, unsigned Writers, uint64_t *Size)
+{
+   double start = Now();
+   if (!WriteMinidump(Path, process, DUMP_FULL, 0, NULL,
+                      REACHABLE_DEPTH, REACHABLE_BUDGET, false, Writers)) {
+      return -1;
+   }
+
+   int fd = open(Path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      return -1;
+   }
+   fsync(fd);
+   double elapsed = Now() - start;
+
+   struct stat st;
+   fstat(fd, &st);
+   *Size = st.st_size;
+   close(fd);
+
+   return elapsed;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   if (argc < 2) {
+      fputs("usage: dumpbench <output-file> [megabytes] [runs]\n", stderr);
+      return 1;
+   }
+
+   const char *path = argv[1];
+   size_t megabytes = argc > 2 ? atoi(argv[2]) : 1024;
+   unsigned runs = argc > 3 ? atoi(argv[3]) : 3;
+
+   pid_t pid = StartTarget(megabytes);
+   if (pid < 0) {
+      fprintf(stderr, "error: failed to start the target (%s)\n", strerror(errno));
+      return 1;
+   }
+
+   Process process(pid);
+   process.AddThread(pid)->State = THREAD_STOPPED;
+   process.LoadModules(std::vector<std::string>());
+   process.GetThreadRegisters();
+
+   static const struct {
+      const char *Name;
+      unsigned Writers;
+   } modes[] = {
+      { "in line", 0 },
+      { "pipeline", DUMP_WRITERS },
+   };
+
+   int status = 0;
+   for (size_t m = 0; m < sizeof modes / sizeof modes[0]; ++m) {
+      double best = 0;
+      double total = 0;
+      uint64_t size = 0;
+
+      for (unsigned r = 0; r < runs; ++r) {
+         double elapsed = TimeDump(path, &process, modes[m].Writers, &size);
+         if (elapsed < 0) {
+            fprintf(stderr, "error: failed to write %s\n", path);
+            status = 1;
+            break;
+         }
+         if (!r || elapsed < best) {
+            best = elapsed;
+         }
+         total += elapsed;
+      }
+
+      if (runs && !status) {
+         printf("%-9s %8.1f MiB  best %7.3f s  %6.2f GB/s  mean %6.2f GB/s\n",
+                modes[m].Name, size / (1024.0 * 1024.0), best,
+                size / best * 1e-9, size / (total / runs) * 1e-9);
+      }
+   }
+
+   unlink(path);
+   kill(pid, SIGKILL);
+   waitpid(pid, NULL, 0);
+
+   return status;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,718 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "dumpserver.h"
+#include "signatures.h"
+
+
+/* Largest write at once, so that no dump holds up the others for long */
+#define SERVER_CHUNK (1024*1024)
+
+/* Period of the I/O budget, in ms */
+#define SERVER_TICK 100
+
+/* Name of the signature database within the spool */
+#define SERVER_SIGNATURES "signatures"
+
+/* Suffix of dumps being written */
+#define SERVER_PARTIAL ".part"
+
+/* How long a client waits for the reply, in s */
+#define SERVER_REPLY_TIMEOUT 10
+
+
+/**************************************************************************
+ *
+ * Client
+ *
+ **************************************************************************/
+
+static bool
+SocketAddress(const char *Socket, struct sockaddr_un *address)
+{
+   memset(address, 0, sizeof *address);
+   address->sun_family = AF_UNIX;
+   if (strlen(Socket) >= sizeof address->sun_path) {
+      errno = ENAMETOOLONG;
+      return false;
+   }
+   strcpy(address->sun_path, Socket);
+   return true;
+}
+
+
+int
+SubmitDump(const char *Socket, int Fd, pid_t Pid, const char *Name,
+           const std::string &Signature)
+{
+   struct sockaddr_un address;
+   if (!SocketAddress(Socket, &address)) {
+      return -1;
+   }
+
+   int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+   if (sock < 0) {
+      return -1;
+   }
+
+   if (connect(sock, (struct sockaddr *)&address, sizeof address) != 0) {
+      close(sock);
+      return -1;
+   }
+
+   /* The server answers straight away, unless it is stuck. */
+   struct timeval timeout;
+   timeout.tv_sec = SERVER_REPLY_TIMEOUT;
+   timeout.tv_usec = 0;
+   setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+   DumpRequest request;
+   memset(&request, 0, sizeof request);
+   request.Version = DUMP_SERVER_VERSION;
+   request.Pid = Pid;
+   strncpy(request.Name, Name, sizeof request.Name - 1);
+   strncpy(request.Signature, Signature.c_str(), sizeof request.Signature - 1);
+
+   struct iovec iov;
+   iov.iov_base = &request;
+   iov.iov_len = sizeof request;
+
+   union {
+      struct cmsghdr align;
+      char buffer[CMSG_SPACE(sizeof(int))];
+   } control;
+   memset(&control, 0, sizeof control);
+
+   struct msghdr msg;
+   memset(&msg, 0, sizeof msg);
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control.buffer;
+   msg.msg_controllen = sizeof control.buffer;
+
+   struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &Fd, sizeof Fd);
+
+   DumpReply reply;
+   ssize_t ret;
+   if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof request) {
+      close(sock);
+      return -1;
+   }
+   do {
+      ret = recv(sock, &reply, sizeof reply, 0);
+   } while (ret < 0 && errno == EINTR);
+   close(sock);
+
+   return ret == (ssize_t)sizeof reply ? reply.Status : -1;
+}
+
+
+/**************************************************************************
+ *
+ * Server
+ *
+ **************************************************************************/
+
+struct QueuedDump
+{
+   int Fd;                 /* memfd from the client */
+   uint64_t Size;
+   off_t Offset;           /* bytes written so far */
+   int OutFd;              /* -1 until started */
+   pid_t Pid;
+   std::string Name;       /* within the spool */
+};
+
+struct SpoolFile
+{
+   time_t Time;
+   std::string Name;
+   uint64_t Size;
+
+   bool
+   operator < (const SpoolFile &other) const {
+      return Time < other.Time;
+   }
+};
+
+static bool g_Verbose = false;
+static std::string g_SpoolDir;
+static std::string g_SignaturePath;
+static unsigned g_MaxWriters = 1;
+static uint64_t g_Budget = 0;                   /* bytes/s, or zero */
+static uint64_t g_SpoolLimit = 0;               /* bytes, or zero */
+static uint64_t g_QueueLimit = 1024ULL << 20;   /* bytes */
+static unsigned long g_DumpEvery = 0;
+
+static std::deque<QueuedDump *> g_Queue;
+static std::vector<QueuedDump *> g_Writing;
+static uint64_t g_QueuedBytes = 0;              /* in g_Queue and g_Writing */
+
+static std::deque<SpoolFile> g_Spool;           /* oldest first */
+static uint64_t g_SpoolBytes = 0;               /* including dumps being written */
+
+static uint64_t g_Tokens = 0;                   /* bytes which may be written now */
+static uint64_t g_LastRefill = 0;
+
+
+static uint64_t
+Now(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec*1000 + now.tv_nsec/1000000;
+}
+
+
+static std::string
+SpoolPath(const std::string &Name)
+{
+   return g_SpoolDir + "/" + Name;
+}
+
+
+/*
+ * Take stock of the dumps already in the spool, and remove the remains of
+ * unfinished ones.
+ */
+static void
+ScanSpool(void)
+{
+   DIR *dir = opendir(g_SpoolDir.c_str());
+   if (!dir) {
+      return;
+   }
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      std::string name = entry->d_name;
+      struct stat st;
+
+      if (name[0] == '.' || name.compare(0, strlen(SERVER_SIGNATURES), SERVER_SIGNATURES) == 0 ||
+          stat(SpoolPath(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+         continue;
+      }
+
+      size_t length = name.size();
+      size_t suffix = strlen(SERVER_PARTIAL);
+      if (length > suffix && name.compare(length - suffix, suffix, SERVER_PARTIAL) == 0) {
+         unlink(SpoolPath(name).c_str());
+         continue;
+      }
+
+      SpoolFile file;
+      file.Time = st.st_mtime;
+      file.Name = name;
+      file.Size = st.st_size;
+      g_Spool.push_back(file);
+      g_SpoolBytes += file.Size;
+   }
+   closedir(dir);
+
+   std::sort(g_Spool.begin(), g_Spool.end());
+}
+
+
+/*
+ * Delete the oldest dumps until Size more bytes fit under the cap.
+ */
+static bool
+MakeRoom(uint64_t Size)
+{
+   if (!g_SpoolLimit) {
+      return true;
+   }
+
+   while (g_SpoolBytes + Size > g_SpoolLimit && !g_Spool.empty()) {
+      const SpoolFile &file = g_Spool.front();
+      if (unlink(SpoolPath(file.Name).c_str()) == 0 && g_Verbose) {
+         fprintf(stderr, "info: removed %s to make room\n", file.Name.c_str());
+      }
+      g_SpoolBytes -= std::min(g_SpoolBytes, file.Size);
+      g_Spool.pop_front();
+   }
+
+   return g_SpoolBytes + Size <= g_SpoolLimit;
+}
+
+
+/*
+ * A name for a new dump, of the client's choosing if free.
+ */
+static std::string
+UniqueName(const char *Name, pid_t Pid)
+{
+   std::string name = Name;
+   size_t slash = name.rfind('/');
+   if (slash != std::string::npos) {
+      name = name.substr(slash + 1);
+   }
+   if (name.empty() || name[0] == '.' ||
+       name.compare(0, strlen(SERVER_SIGNATURES), SERVER_SIGNATURES) == 0) {
+      char buffer[64];
+      snprintf(buffer, sizeof buffer, "stackdump.%d.dmp", (int)Pid);
+      name = buffer;
+   }
+
+   std::string unique = name;
+   for (unsigned i = 1; ; ++i) {
+      if (access(SpoolPath(unique).c_str(), F_OK) != 0 &&
+          access(SpoolPath(unique + SERVER_PARTIAL).c_str(), F_OK) != 0) {
+         break;
+      }
+      char suffix[16];
+      snprintf(suffix, sizeof suffix, ".%u", i);
+      unique = name + suffix;
+   }
+   return unique;
+}
+
+
+static DumpStatus
+Enqueue(const DumpRequest &request, int Fd)
+{
+   struct stat st;
+   if (fstat(Fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      return DUMP_REFUSED;
+   }
+   uint64_t size = st.st_size;
+
+   /* A refused dump is not counted, so that the next one gets in. */
+   if (g_QueuedBytes + size > g_QueueLimit ||
+       (g_SpoolLimit && size > g_SpoolLimit)) {
+      fprintf(stderr, "warning: refused dump of process %d (%llu bytes), no room\n",
+              request.Pid, (unsigned long long)size);
+      return DUMP_REFUSED;
+   }
+
+   if (request.Signature[0]) {
+      long seen = CountSignature(g_SignaturePath.c_str(), request.Signature);
+      if (seen > 0 && !(g_DumpEvery && seen % g_DumpEvery == 0)) {
+         if (g_Verbose) {
+            fprintf(stderr, "info: dropped dump of process %d, seen %ld times before: %s\n",
+                    request.Pid, seen, request.Signature);
+         }
+         return DUMP_DUPLICATE;
+      }
+   }
+
+   QueuedDump *dump = new QueuedDump;
+   dump->Fd = Fd;
+   dump->Size = size;
+   dump->Offset = 0;
+   dump->OutFd = -1;
+   dump->Pid = request.Pid;
+   dump->Name = request.Name;
+   g_Queue.push_back(dump);
+   g_QueuedBytes += size;
+
+   if (g_Verbose) {
+      fprintf(stderr, "info: queued dump of process %d (%llu bytes)\n",
+              request.Pid, (unsigned long long)size);
+   }
+   return DUMP_QUEUED;
+}
+
+
+static void
+OnRequest(int Client)
+{
+   DumpRequest request;
+   struct iovec iov;
+   iov.iov_base = &request;
+   iov.iov_len = sizeof request;
+
+   union {
+      struct cmsghdr align;
+      char buffer[CMSG_SPACE(sizeof(int))];
+   } control;
+
+   struct msghdr msg;
+   memset(&msg, 0, sizeof msg);
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control.buffer;
+   msg.msg_controllen = sizeof control.buffer;
+
+   ssize_t ret = recvmsg(Client, &msg, MSG_CMSG_CLOEXEC);
+
+   int fd = -1;
+   if (ret >= 0) {
+      struct cmsghdr *cmsg;
+      for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&fd, CMSG_DATA(cmsg), sizeof fd);
+         }
+      }
+   }
+
+   DumpReply reply;
+   reply.Status = DUMP_REFUSED;
+   if (ret == (ssize_t)sizeof request && fd >= 0 &&
+       request.Version == DUMP_SERVER_VERSION) {
+      request.Name[sizeof request.Name - 1] = 0;
+      request.Signature[sizeof request.Signature - 1] = 0;
+      reply.Status = Enqueue(request, fd);
+   }
+   if (fd >= 0 && reply.Status != DUMP_QUEUED) {
+      close(fd);
+   }
+
+   send(Client, &reply, sizeof reply, MSG_NOSIGNAL);
+}
+
+
+/*
+ * Start writing queued dumps while below the concurrency limit.
+ */
+static void
+StartWrites(void)
+{
+   while (g_Writing.size() < g_MaxWriters && !g_Queue.empty()) {
+      QueuedDump *dump = g_Queue.front();
+      g_Queue.pop_front();
+
+      if (!MakeRoom(dump->Size)) {
+         fprintf(stderr, "warning: dropped dump of process %d, spool full\n", dump->Pid);
+      } else {
+         dump->Name = UniqueName(dump->Name.c_str(), dump->Pid);
+         std::string path = SpoolPath(dump->Name + SERVER_PARTIAL);
+         dump->OutFd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+         if (dump->OutFd >= 0) {
+            g_SpoolBytes += dump->Size;
+            g_Writing.push_back(dump);
+            continue;
+         }
+         fprintf(stderr, "warning: failed to create %s (%s)\n", path.c_str(), strerror(errno));
+      }
+
+      close(dump->Fd);
+      g_QueuedBytes -= dump->Size;
+      delete dump;
+   }
+}
+
+
+static void
+FinishWrite(QueuedDump *dump, bool Ok)
+{
+   std::string partial = SpoolPath(dump->Name + SERVER_PARTIAL);
+
+   if (close(dump->OutFd) != 0) {
+      Ok = false;
+   }
+   close(dump->Fd);
+
+   if (Ok && rename(partial.c_str(), SpoolPath(dump->Name).c_str()) == 0) {
+      SpoolFile file;
+      file.Time = time(NULL);
+      file.Name = dump->Name;
+      file.Size = dump->Size;
+      g_Spool.push_back(file);
+      if (g_Verbose) {
+         fprintf(stderr, "info: %s created\n", SpoolPath(dump->Name).c_str());
+      }
+   } else {
+      fprintf(stderr, "warning: failed to write %s (%s)\n", partial.c_str(), strerror(errno));
+      unlink(partial.c_str());
+      g_SpoolBytes -= std::min(g_SpoolBytes, dump->Size);
+   }
+
+   g_QueuedBytes -= dump->Size;
+   delete dump;
+}
+
+
+/*
+ * Write a chunk of every dump being written, as far as the budget goes.
+ * Returns how long to wait before being called again, in ms, or -1 if
+ * there is nothing to do.
+ */
+static int
+PumpWrites(void)
+{
+   StartWrites();
+   if (g_Writing.empty()) {
+      return -1;
+   }
+
+   if (g_Budget) {
+      /* Allow bursts of one tick at most. */
+      uint64_t now = Now();
+      uint64_t burst = std::max(g_Budget * SERVER_TICK / 1000, (uint64_t)64*1024);
+      g_Tokens = std::min(g_Tokens + g_Budget * (now - g_LastRefill) / 1000, burst);
+      g_LastRefill = now;
+   }
+
+   for (size_t i = 0; i < g_Writing.size(); ) {
+      QueuedDump *dump = g_Writing[i];
+      size_t size = (size_t)std::min(dump->Size - dump->Offset, (uint64_t)SERVER_CHUNK);
+      if (g_Budget) {
+         if (!g_Tokens) {
+            break;
+         }
+         size = (size_t)std::min((uint64_t)size, g_Tokens);
+      }
+
+      ssize_t ret = size ? sendfile(dump->OutFd, dump->Fd, &dump->Offset, size) : 0;
+      if (ret < 0 && errno == EINTR) {
+         continue;
+      }
+      if (ret > 0 && g_Budget) {
+         g_Tokens -= std::min(g_Tokens, (uint64_t)ret);
+      }
+      if (ret < 0 || (uint64_t)dump->Offset >= dump->Size || (ret == 0 && size)) {
+         FinishWrite(dump, ret >= 0 && (uint64_t)dump->Offset >= dump->Size);
+         g_Writing.erase(g_Writing.begin() + i);
+         continue;
+      }
+      ++i;
+   }
+
+   StartWrites();
+   if (g_Writing.empty()) {
+      return -1;
+   }
+   return g_Budget && !g_Tokens ? SERVER_TICK : 0;
+}
+
+
+static void
+ServerUsage(void)
+{
+   fputs("usage: stackdump server [options] <socket> <spool-dir>\n"
+         "\n"
+         "Writes the dumps of stackdump instances started with --server <socket>\n"
+         "into the spool directory.\n"
+         "\n"
+         "options:\n"
+         "  -b <megabytes> limits writing to that many megabytes per second\n"
+         "  -e <count> still writes every that many recurrences of a known crash\n"
+         "             (default only the first time)\n"
+         "  -j <writers> number of dumps written at once (default 1)\n"
+         "  -m <megabytes> caps the spool size, removing the oldest dumps (default no cap)\n"
+         "  -q <megabytes> caps the dumps waiting in memory (default 1024)\n"
+         "  -v enables verbose output\n",
+         stderr);
+}
+
+
+int
+ServerMain(int argc, char **argv)
+{
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         ServerUsage();
+         return 0;
+      } else if (!strcmp(*argv, "-v")) {
+         g_Verbose = true;
+      } else if (!strcmp(*argv, "-b") || !strcmp(*argv, "-e") ||
+                 !strcmp(*argv, "-j") || !strcmp(*argv, "-m") ||
+                 !strcmp(*argv, "-q")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: %s missing argument\n\n", *argv);
+            ServerUsage();
+            return 1;
+         }
+
+         const char *option = *argv;
+         ++argv;
+         --argc;
+
+         unsigned long value = strtoul(*argv, NULL, 0);
+         if (!value) {
+            fprintf(stderr, "error: invalid %s argument %s\n\n", option, *argv);
+            ServerUsage();
+            return 1;
+         }
+
+         switch (option[1]) {
+         case 'b': g_Budget = (uint64_t)value << 20; break;
+         case 'e': g_DumpEvery = value; break;
+         case 'j': g_MaxWriters = value; break;
+         case 'm': g_SpoolLimit = (uint64_t)value << 20; break;
+         case 'q': g_QueueLimit = (uint64_t)value << 20; break;
+         }
+      } else {
+         break;
+      }
+   }
+
+   if (argc != 2) {
+      ServerUsage();
+      return 1;
+   }
+
+   const char *socketPath = argv[0];
+   g_SpoolDir = argv[1];
+   g_SignaturePath = SpoolPath(SERVER_SIGNATURES);
+
+   if (mkdir(g_SpoolDir.c_str(), 0755) != 0 && errno != EEXIST) {
+      fprintf(stderr, "error: failed to create %s (%s)\n", g_SpoolDir.c_str(), strerror(errno));
+      return 1;
+   }
+   ScanSpool();
+
+   struct sockaddr_un address;
+   if (!SocketAddress(socketPath, &address)) {
+      fprintf(stderr, "error: socket name too long\n");
+      return 1;
+   }
+
+   int listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+   if (listenFd < 0) {
+      fprintf(stderr, "error: failed to create a socket (%s)\n", strerror(errno));
+      return 1;
+   }
+
+   /* A stale socket is replaced, a live one is not. */
+   if (connect(listenFd, (struct sockaddr *)&address, sizeof address) == 0) {
+      fprintf(stderr, "error: a server is already listening on %s\n", socketPath);
+      return 1;
+   }
+   close(listenFd);
+   listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+   unlink(socketPath);
+
+   if (bind(listenFd, (struct sockaddr *)&address, sizeof address) != 0 ||
+       listen(listenFd, SOMAXCONN) != 0) {
+      fprintf(stderr, "error: failed to listen on %s (%s)\n", socketPath, strerror(errno));
+      return 1;
+   }
+
+   /* Finish the queue on SIGINT or SIGTERM, without taking new dumps. */
+   sigset_t mask;
+   sigemptyset(&mask);
+   sigaddset(&mask, SIGINT);
+   sigaddset(&mask, SIGTERM);
+   sigprocmask(SIG_BLOCK, &mask, NULL);
+   int signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+   int epollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (epollFd < 0 || signalFd < 0) {
+      fprintf(stderr, "error: failed to create an epoll instance (%s)\n", strerror(errno));
+      return 1;
+   }
+
+   struct epoll_event event;
+   memset(&event, 0, sizeof event);
+   event.events = EPOLLIN;
+   event.data.fd = listenFd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+   event.data.fd = signalFd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+
+   if (g_Verbose) {
+      fprintf(stderr, "info: listening on %s\n", socketPath);
+   }
+
+   g_LastRefill = Now();
+
+   for (;;) {
+      int timeout = PumpWrites();
+      if (listenFd < 0 && timeout < 0) {
+         break;
+      }
+
+      int count = epoll_wait(epollFd, &event, 1, timeout);
+      if (count < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         fprintf(stderr, "error: unexpected error (%s)\n", strerror(errno));
+         break;
+      }
+      if (count == 0) {
+         continue;
+      }
+
+      if (event.data.fd == listenFd) {
+         int client;
+         while ((client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+            event.data.fd = client;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &event);
+         }
+      } else if (event.data.fd == signalFd) {
+         struct signalfd_siginfo si;
+         while (read(signalFd, &si, sizeof si) == sizeof si)
+            ;
+         if (listenFd >= 0) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, NULL);
+            close(listenFd);
+            listenFd = -1;
+            unlink(socketPath);
+         }
+      } else {
+         /* One request per connection. */
+         int client = event.data.fd;
+         if (event.events & EPOLLIN) {
+            OnRequest(client);
+         }
+         epoll_ctl(epollFd, EPOLL_CTL_DEL, client, NULL);
+         close(client);
+      }
+   }
+
+   if (listenFd >= 0) {
+      close(listenFd);
+      unlink(socketPath);
+   }
+   close(signalFd);
+   close(epollFd);
+
+   return 0;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,92 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Local dump server.  When a bad build goes out, hundreds of supervised
+ * processes on a host may crash at once; rather than each writing its
+ * dump file straight away, stackdump instances started with --server
+ * hand their dumps to a single "stackdump server", which writes them to a
+ * spool directory a few at a time, within an I/O budget and a size cap,
+ * and drops the ones with a signature already seen.
+ *
+ * A client writes the dump into a memfd while the target is frozen, which
+ * is no slower than writing a file (and the sooner done), and passes it
+ * over a unix socket with SCM_RIGHTS once the target is gone.  The server
+ * replies as soon as it has queued, dropped or refused it.
+ */
+
+#ifndef _DUMPSERVER_H_
+#define _DUMPSERVER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+
+#define DUMP_SERVER_VERSION 1
+
+struct DumpRequest
+{
+   uint32_t Version;
+   int32_t Pid;
+   char Name[256];         /* file name wanted, directories are ignored */
+   char Signature[1024];   /* crash signature, or empty */
+};
+
+enum DumpStatus {
+   DUMP_QUEUED = 0,
+   DUMP_DUPLICATE,         /* signature seen before, dropped */
+   DUMP_REFUSED            /* queue or spool full, or a bad request */
+};
+
+struct DumpReply
+{
+   int32_t Status;
+};
+
+
+/*
+ * Hand the dump file open in Fd to the server listening on Socket.
+ * Returns a DumpStatus, or -1 if the server could not be reached.
+ */
+int
+SubmitDump(const char *Socket, int Fd, pid_t Pid, const char *Name,
+           const std::string &Signature);
+
+
+/*
+ * Entry point of "stackdump server [options] <socket> <spool-dir>".
+ * Arguments start after the "server" word.
+ */
+int
+ServerMain(int argc, char **argv);
+
+
+#endif /* _DUMPSERVER_H_ */
+
+/* vim:set sw=3 et: */
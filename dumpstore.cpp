@@ -0,0 +1,855 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "compress.h"
+#include "minidumpreader.h"
+#include "dumpstore.h"
+
+
+/* Chunk boundaries within captured memory... */
+#define STORE_PAGE_SIZE 4096
+
+/* ...and the largest chunk anywhere else. */
+#define STORE_CHUNK_MAX (64*1024)
+
+/* New chunk data buffered before writing. */
+#define STORE_WRITE_SIZE (4*1024*1024)
+
+
+/**************************************************************************
+ *
+ * SHA-256 (FIPS 180-4)
+ *
+ **************************************************************************/
+
+static const uint32_t g_Sha256K[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+static inline uint32_t
+RotateRight(uint32_t x, unsigned n)
+{
+   return (x >> n) | (x << (32 - n));
+}
+
+
+static void
+Sha256Transform(uint32_t State[8], const uint8_t *Block)
+{
+   uint32_t w[64];
+
+   for (unsigned i = 0; i < 16; ++i) {
+      w[i] = ((uint32_t)Block[4*i] << 24) | ((uint32_t)Block[4*i + 1] << 16) |
+             ((uint32_t)Block[4*i + 2] << 8) | Block[4*i + 3];
+   }
+   for (unsigned i = 16; i < 64; ++i) {
+      uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+   }
+
+   uint32_t a = State[0], b = State[1], c = State[2], d = State[3];
+   uint32_t e = State[4], f = State[5], g = State[6], h = State[7];
+
+   for (unsigned i = 0; i < 64; ++i) {
+      uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + ch + g_Sha256K[i] + w[i];
+      uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + maj;
+
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+   }
+
+   State[0] += a;
+   State[1] += b;
+   State[2] += c;
+   State[3] += d;
+   State[4] += e;
+   State[5] += f;
+   State[6] += g;
+   State[7] += h;
+}
+
+
+static void
+Sha256(const void *Data, size_t Size, uint8_t Digest[STORE_DIGEST_SIZE])
+{
+   uint32_t state[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+   };
+   const uint8_t *p = (const uint8_t *)Data;
+   uint64_t bits = (uint64_t)Size * 8;
+
+   for (; Size >= 64; p += 64, Size -= 64) {
+      Sha256Transform(state, p);
+   }
+
+   /* Pad with a one bit, zeros, and the length in bits. */
+   uint8_t tail[128];
+   memset(tail, 0, sizeof tail);
+   memcpy(tail, p, Size);
+   tail[Size] = 0x80;
+   size_t tailSize = Size + 9 <= 64 ? 64 : 128;
+   for (unsigned i = 0; i < 8; ++i) {
+      tail[tailSize - 1 - i] = (uint8_t)(bits >> (8*i));
+   }
+   for (size_t i = 0; i < tailSize; i += 64) {
+      Sha256Transform(state, tail + i);
+   }
+
+   for (unsigned i = 0; i < 8; ++i) {
+      Digest[4*i] = (uint8_t)(state[i] >> 24);
+      Digest[4*i + 1] = (uint8_t)(state[i] >> 16);
+      Digest[4*i + 2] = (uint8_t)(state[i] >> 8);
+      Digest[4*i + 3] = (uint8_t)state[i];
+   }
+}
+
+
+/**************************************************************************
+ *
+ * Chunk store
+ *
+ **************************************************************************/
+
+static bool
+WriteAll(int Fd, const void *Data, size_t Size)
+{
+   const uint8_t *p = (const uint8_t *)Data;
+   while (Size) {
+      ssize_t ret = write(Fd, p, Size);
+      if (ret < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      p += ret;
+      Size -= ret;
+   }
+   return true;
+}
+
+
+static bool
+ReadAll(int Fd, void *Data, size_t Size, uint64_t Offset)
+{
+   uint8_t *p = (uint8_t *)Data;
+   while (Size) {
+      ssize_t ret = pread(Fd, p, Size, Offset);
+      if (ret <= 0) {
+         if (ret < 0 && errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      p += ret;
+      Size -= ret;
+      Offset += ret;
+   }
+   return true;
+}
+
+
+static uint64_t
+FileSize(const std::string &Path)
+{
+   struct stat st;
+   return stat(Path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+
+/*
+ * The data and index files, locked for as long as the object lives.
+ */
+class ChunkStore
+{
+public:
+   ChunkStore(const char *Path) :
+      m_Path(Path),
+      m_LockFd(-1),
+      m_DataFd(-1),
+      m_IndexFd(-1),
+      m_DataSize(0),
+      m_Error(false)
+   {}
+
+   ~ChunkStore()
+   {
+      if (m_IndexFd >= 0) {
+         close(m_IndexFd);
+      }
+      if (m_DataFd >= 0) {
+         close(m_DataFd);
+      }
+      /* Closing releases the lock. */
+      if (m_LockFd >= 0) {
+         close(m_LockFd);
+      }
+   }
+
+   const std::string &
+   Path(void) const { return m_Path; }
+
+   bool
+   Open(bool Write)
+   {
+      if (Write) {
+         if ((mkdir(m_Path.c_str(), 0755) != 0 && errno != EEXIST) ||
+             (mkdir((m_Path + "/dumps").c_str(), 0755) != 0 && errno != EEXIST)) {
+            fprintf(stderr, "error: failed to create %s (%s)\n", m_Path.c_str(), strerror(errno));
+            return false;
+         }
+      }
+
+      int flags = Write ? O_RDWR | O_CREAT : O_RDONLY;
+      m_LockFd = open((m_Path + "/lock").c_str(), flags | O_CLOEXEC, 0644);
+      m_DataFd = open((m_Path + "/data").c_str(), flags | O_CLOEXEC, 0644);
+      m_IndexFd = open((m_Path + "/index").c_str(), flags | O_CLOEXEC, 0644);
+      if (m_LockFd < 0 || m_DataFd < 0 || m_IndexFd < 0) {
+         fprintf(stderr, "error: failed to open store %s (%s)\n", m_Path.c_str(), strerror(errno));
+         return false;
+      }
+
+      int ret;
+      do {
+         ret = flock(m_LockFd, Write ? LOCK_EX : LOCK_SH);
+      } while (ret != 0 && errno == EINTR);
+      if (ret != 0) {
+         fprintf(stderr, "error: failed to lock store %s (%s)\n", m_Path.c_str(), strerror(errno));
+         return false;
+      }
+
+      return LoadIndex(Write);
+   }
+
+   const StoreRecord *
+   Find(const uint8_t Digest[STORE_DIGEST_SIZE]) const
+   {
+      std::unordered_map<std::string, StoreRecord>::const_iterator it =
+         m_Index.find(Key(Digest));
+      return it != m_Index.end() ? &it->second : NULL;
+   }
+
+   /*
+    * Add a chunk, unless already present.  Returns the bytes it takes in
+    * the store, zero when it was there already.
+    */
+   uint64_t
+   Add(const uint8_t Digest[STORE_DIGEST_SIZE], const void *Data, uint32_t Size)
+   {
+      std::string key = Key(Digest);
+      if (m_Index.find(key) != m_Index.end()) {
+         return 0;
+      }
+
+      m_Compressed.resize(LZ4_BOUND(Size));
+      size_t compressed = LZ4Compress(Data, Size, &m_Compressed[0]);
+
+      StoreRecord record;
+      memcpy(record.Digest, Digest, STORE_DIGEST_SIZE);
+      record.Offset = m_DataSize + m_Pending.size();
+      record.RawSize = Size;
+      if (compressed < Size) {
+         record.Size = (uint32_t)compressed;
+         m_Pending.insert(m_Pending.end(), m_Compressed.begin(), m_Compressed.begin() + compressed);
+      } else {
+         record.Size = Size;
+         m_Pending.insert(m_Pending.end(), (const uint8_t *)Data, (const uint8_t *)Data + Size);
+      }
+
+      m_Index[key] = record;
+      m_NewRecords.push_back(record);
+
+      if (m_Pending.size() >= STORE_WRITE_SIZE) {
+         FlushData();
+      }
+
+      return record.Size + sizeof record;
+   }
+
+   /*
+    * Write out the new chunks, then their index records.
+    */
+   bool
+   Flush(void)
+   {
+      if (!FlushData() || m_Error) {
+         return false;
+      }
+      if (!m_NewRecords.empty() &&
+          !WriteAll(m_IndexFd, &m_NewRecords[0], m_NewRecords.size() * sizeof m_NewRecords[0])) {
+         fprintf(stderr, "error: failed to write %s/index (%s)\n", m_Path.c_str(), strerror(errno));
+         return false;
+      }
+      m_NewRecords.clear();
+      return true;
+   }
+
+   bool
+   Read(const StoreRecord &Record, std::vector<uint8_t> &Data)
+   {
+      Data.resize(Record.RawSize);
+      if (Record.Size == Record.RawSize) {
+         return ReadAll(m_DataFd, &Data[0], Record.Size, Record.Offset);
+      }
+
+      m_Compressed.resize(Record.Size);
+      return ReadAll(m_DataFd, &m_Compressed[0], Record.Size, Record.Offset) &&
+             LZ4Decompress(&m_Compressed[0], Record.Size, &Data[0], Record.RawSize);
+   }
+
+private:
+   static std::string
+   Key(const uint8_t Digest[STORE_DIGEST_SIZE])
+   {
+      return std::string((const char *)Digest, STORE_DIGEST_SIZE);
+   }
+
+   bool
+   LoadIndex(bool Write)
+   {
+      struct stat st, data;
+      if (fstat(m_IndexFd, &st) != 0 || fstat(m_DataFd, &data) != 0) {
+         return false;
+      }
+      m_DataSize = data.st_size;
+
+      /* A writer died in the middle of a record: drop it. */
+      size_t count = st.st_size / sizeof(StoreRecord);
+      if (Write && (uint64_t)st.st_size != count * sizeof(StoreRecord)) {
+         if (ftruncate(m_IndexFd, count * sizeof(StoreRecord)) != 0) {
+            return false;
+         }
+      }
+      if (Write) {
+         lseek(m_IndexFd, count * sizeof(StoreRecord), SEEK_SET);
+         lseek(m_DataFd, m_DataSize, SEEK_SET);
+      }
+
+      std::vector<StoreRecord> records(count);
+      if (count && !ReadAll(m_IndexFd, &records[0], count * sizeof records[0], 0)) {
+         fprintf(stderr, "error: failed to read %s/index\n", m_Path.c_str());
+         return false;
+      }
+
+      m_Index.reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+         if (records[i].Offset + records[i].Size <= m_DataSize) {
+            m_Index[Key(records[i].Digest)] = records[i];
+         }
+      }
+      return true;
+   }
+
+   bool
+   FlushData(void)
+   {
+      if (!m_Pending.empty()) {
+         if (!WriteAll(m_DataFd, &m_Pending[0], m_Pending.size())) {
+            fprintf(stderr, "error: failed to write %s/data (%s)\n", m_Path.c_str(), strerror(errno));
+            m_Error = true;
+            return false;
+         }
+         m_DataSize += m_Pending.size();
+         m_Pending.clear();
+      }
+      return true;
+   }
+
+   std::string m_Path;
+   int m_LockFd;
+   int m_DataFd;
+   int m_IndexFd;
+   uint64_t m_DataSize;
+   bool m_Error;
+   std::unordered_map<std::string, StoreRecord> m_Index;
+   std::vector<StoreRecord> m_NewRecords;
+   std::vector<uint8_t> m_Pending;
+   std::vector<uint8_t> m_Compressed;
+};
+
+
+/**************************************************************************
+ *
+ * Dumps
+ *
+ **************************************************************************/
+
+static bool
+ValidName(const std::string &Name)
+{
+   return !Name.empty() && Name[0] != '.' && Name.find('/') == std::string::npos;
+}
+
+
+/*
+ * Offsets at which to cut a minidump into chunks: the page boundaries of
+ * every captured memory range, plus both ends of the file.
+ */
+static void
+GetCutPoints(const MinidumpFile *dump, std::vector<uint64_t> &Cuts)
+{
+   std::vector<MDMemoryDescriptor64> ranges;
+   std::vector<uint64_t> rvas;
+
+   MinidumpArray<MDMemoryDescriptor> ranges32 = dump->MemoryRanges();
+   for (size_t i = 0; i < ranges32.size(); ++i) {
+      MDMemoryDescriptor64 range;
+      range.StartOfMemoryRange = ranges32[i].StartOfMemoryRange;
+      range.DataSize = ranges32[i].Memory.DataSize;
+      ranges.push_back(range);
+      rvas.push_back(ranges32[i].Memory.Rva);
+   }
+
+   MinidumpArray<MDMemoryDescriptor64> ranges64 = dump->Memory64Ranges();
+   if (!ranges64.empty()) {
+      const MDRawMemory64List *list = (const MDRawMemory64List *)
+         dump->FindStream(MD_MEMORY_64_LIST_STREAM);
+      uint64_t rva = list->BaseRva;
+      for (size_t i = 0; i < ranges64.size(); ++i) {
+         ranges.push_back(ranges64[i]);
+         rvas.push_back(rva);
+         rva += ranges64[i].DataSize;
+      }
+   }
+
+   Cuts.push_back(0);
+   Cuts.push_back(dump->Size());
+
+   for (size_t i = 0; i < ranges.size(); ++i) {
+      uint64_t start = ranges[i].StartOfMemoryRange;
+      uint64_t size = ranges[i].DataSize;
+      if (rvas[i] > dump->Size() || size > dump->Size() - rvas[i]) {
+         continue;
+      }
+
+      Cuts.push_back(rvas[i]);
+      Cuts.push_back(rvas[i] + size);
+      uint64_t page = (start + STORE_PAGE_SIZE - 1) & ~(uint64_t)(STORE_PAGE_SIZE - 1);
+      for (; page < start + size; page += STORE_PAGE_SIZE) {
+         Cuts.push_back(rvas[i] + (page - start));
+      }
+   }
+
+   std::sort(Cuts.begin(), Cuts.end());
+   Cuts.erase(std::unique(Cuts.begin(), Cuts.end()), Cuts.end());
+}
+
+
+static bool
+WriteManifest(const std::string &Path, const ManifestHeader &Header,
+              const std::vector<ManifestEntry> &Entries)
+{
+   char suffix[32];
+   snprintf(suffix, sizeof suffix, ".%lu.tmp", (unsigned long)getpid());
+   std::string temp = Path + suffix;
+
+   int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      return false;
+   }
+   bool ok = WriteAll(fd, &Header, sizeof Header) &&
+             (Entries.empty() ||
+              WriteAll(fd, &Entries[0], Entries.size() * sizeof Entries[0]));
+   ok = close(fd) == 0 && ok;
+
+   if (!ok || rename(temp.c_str(), Path.c_str()) != 0) {
+      unlink(temp.c_str());
+      return false;
+   }
+   return true;
+}
+
+
+bool
+StoreDump(const char *Store, const char *DumpPath, const std::string &Name,
+          StoreStats *Stats)
+{
+   memset(Stats, 0, sizeof *Stats);
+
+   if (!ValidName(Name)) {
+      fprintf(stderr, "error: invalid dump name %s\n", Name.c_str());
+      return false;
+   }
+
+   MinidumpFile *dump = MinidumpFile::Open(DumpPath);
+   if (!dump) {
+      fprintf(stderr, "error: failed to read %s\n", DumpPath);
+      return false;
+   }
+
+   ChunkStore store(Store);
+   if (!store.Open(true)) {
+      delete dump;
+      return false;
+   }
+
+   std::vector<uint64_t> cuts;
+   GetCutPoints(dump, cuts);
+
+   ManifestHeader header;
+   memset(&header, 0, sizeof header);
+   header.Signature = MANIFEST_SIGNATURE;
+   header.Version = MANIFEST_VERSION;
+   header.Size = dump->Size();
+   Stats->Size = dump->Size();
+
+   std::vector<ManifestEntry> entries;
+   const void *previous = NULL;
+   bool ok = true;
+   for (size_t i = 0; ok && i + 1 < cuts.size(); ++i) {
+      for (uint64_t offset = cuts[i]; offset < cuts[i + 1]; offset += STORE_CHUNK_MAX) {
+         uint64_t remaining = cuts[i + 1] - offset;
+         uint32_t size = remaining < STORE_CHUNK_MAX ? (uint32_t)remaining : STORE_CHUNK_MAX;
+         const void *data = dump->GetData(offset, size);
+         if (!data) {
+            fprintf(stderr, "error: %s is corrupt at offset 0x%llx\n",
+                    DumpPath, (unsigned long long)offset);
+            ok = false;
+            break;
+         }
+
+         ++Stats->Chunks;
+
+         /* Runs of zero pages are common: spare hashing them all. */
+         if (previous && entries.back().Size == size && memcmp(previous, data, size) == 0) {
+            ++entries.back().Repeat;
+            continue;
+         }
+         previous = data;
+
+         uint8_t digest[STORE_DIGEST_SIZE];
+         Sha256(data, size, digest);
+
+         uint64_t added = store.Add(digest, data, size);
+         if (added) {
+            ++Stats->NewChunks;
+            Stats->NewBytes += added;
+         }
+
+         if (!entries.empty() &&
+             entries.back().Size == size &&
+             memcmp(entries.back().Digest, digest, STORE_DIGEST_SIZE) == 0) {
+            ++entries.back().Repeat;
+         } else {
+            ManifestEntry entry;
+            memcpy(entry.Digest, digest, STORE_DIGEST_SIZE);
+            entry.Size = size;
+            entry.Repeat = 1;
+            entries.push_back(entry);
+         }
+      }
+   }
+
+   delete dump;
+
+   header.Count = (uint32_t)entries.size();
+   Stats->NewBytes += sizeof header + entries.size() * sizeof entries[0];
+
+   /* The chunks must be there before a manifest refers to them. */
+   if (!ok || !store.Flush()) {
+      return false;
+   }
+
+   std::string path = store.Path() + "/dumps/" + Name;
+   if (!WriteManifest(path, header, entries)) {
+      fprintf(stderr, "error: failed to write %s (%s)\n", path.c_str(), strerror(errno));
+      return false;
+   }
+
+   return true;
+}
+
+
+bool
+RehydrateDump(const char *Store, const std::string &Name, const char *Output)
+{
+   if (!ValidName(Name)) {
+      fprintf(stderr, "error: invalid dump name %s\n", Name.c_str());
+      return false;
+   }
+
+   ChunkStore store(Store);
+   if (!store.Open(false)) {
+      return false;
+   }
+
+   std::string path = store.Path() + "/dumps/" + Name;
+   FILE *fp = fopen(path.c_str(), "rb");
+   if (!fp) {
+      fprintf(stderr, "error: failed to open %s (%s)\n", path.c_str(), strerror(errno));
+      return false;
+   }
+
+   ManifestHeader header;
+   std::vector<ManifestEntry> entries;
+   uint64_t manifestSize = FileSize(path);
+   bool ok = fread(&header, sizeof header, 1, fp) == 1 &&
+             header.Signature == MANIFEST_SIGNATURE &&
+             header.Version == MANIFEST_VERSION &&
+             header.Count <= (manifestSize - sizeof header) / sizeof(ManifestEntry);
+   if (ok) {
+      entries.resize(header.Count);
+      ok = entries.empty() || fread(&entries[0], sizeof entries[0], entries.size(), fp) == entries.size();
+   }
+   fclose(fp);
+   if (!ok) {
+      fprintf(stderr, "error: %s is not a dump manifest\n", path.c_str());
+      return false;
+   }
+
+   FILE *out = fopen(Output, "wb");
+   if (!out) {
+      fprintf(stderr, "error: failed to create %s (%s)\n", Output, strerror(errno));
+      return false;
+   }
+
+   uint64_t size = 0;
+   std::vector<uint8_t> data;
+   for (size_t i = 0; ok && i < entries.size(); ++i) {
+      const ManifestEntry &entry = entries[i];
+      const StoreRecord *record = store.Find(entry.Digest);
+      if (!record || record->RawSize != entry.Size || !store.Read(*record, data)) {
+         fprintf(stderr, "error: chunk %zu of %s missing from the store\n", i, Name.c_str());
+         ok = false;
+         break;
+      }
+      uint8_t digest[STORE_DIGEST_SIZE];
+      Sha256(&data[0], data.size(), digest);
+      if (memcmp(digest, entry.Digest, STORE_DIGEST_SIZE) != 0) {
+         fprintf(stderr, "error: chunk %zu of %s is corrupt in the store\n", i, Name.c_str());
+         ok = false;
+         break;
+      }
+      for (uint32_t j = 0; j < entry.Repeat; ++j) {
+         if (fwrite(&data[0], 1, data.size(), out) != data.size()) {
+            fprintf(stderr, "error: failed to write %s (%s)\n", Output, strerror(errno));
+            ok = false;
+            break;
+         }
+      }
+      size += (uint64_t)entry.Size * entry.Repeat;
+   }
+
+   if (ok && size != header.Size) {
+      fprintf(stderr, "error: manifest %s is inconsistent\n", path.c_str());
+      ok = false;
+   }
+
+   if (fclose(out) != 0 && ok) {
+      fprintf(stderr, "error: failed to write %s (%s)\n", Output, strerror(errno));
+      ok = false;
+   }
+   if (!ok) {
+      unlink(Output);
+   }
+   return ok;
+}
+
+
+/**************************************************************************
+ *
+ * Command line
+ *
+ **************************************************************************/
+
+static double
+MiB(uint64_t Bytes)
+{
+   return Bytes / (1024.0 * 1024.0);
+}
+
+
+/*
+ * Sizes of all dumps against what the store takes on disk.
+ */
+static void
+PrintTotals(const char *Store)
+{
+   std::string dir = std::string(Store) + "/dumps";
+   unsigned long count = 0;
+   uint64_t logical = 0;
+   uint64_t physical = FileSize(std::string(Store) + "/data") +
+                       FileSize(std::string(Store) + "/index");
+
+   DIR *dp = opendir(dir.c_str());
+   if (dp) {
+      struct dirent *entry;
+      while ((entry = readdir(dp)) != NULL) {
+         if (!ValidName(entry->d_name)) {
+            continue;
+         }
+
+         std::string path = dir + "/" + entry->d_name;
+         FILE *fp = fopen(path.c_str(), "rb");
+         if (!fp) {
+            continue;
+         }
+         ManifestHeader header;
+         if (fread(&header, sizeof header, 1, fp) == 1 &&
+             header.Signature == MANIFEST_SIGNATURE) {
+            ++count;
+            logical += header.Size;
+            physical += FileSize(path);
+         }
+         fclose(fp);
+      }
+      closedir(dp);
+   }
+
+   printf("%lu dumps, %.1f MiB stored in %.1f MiB, dedup ratio %.2fx\n",
+          count, MiB(logical), MiB(physical),
+          physical ? (double)logical / physical : 0.0);
+}
+
+
+static void
+StoreUsage(void)
+{
+   fputs("usage: stackdump store [-r] <store-dir> [dump...]\n"
+         "\n"
+         "Adds minidumps to a content addressed store, where the chunks dumps have\n"
+         "in common are kept once, then prints the dedup ratio of the store.\n"
+         "\n"
+         "options:\n"
+         "  -r removes each dump once stored\n",
+         stderr);
+}
+
+
+int
+StoreMain(int argc, char **argv)
+{
+   bool remove = false;
+
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         StoreUsage();
+         return 0;
+      } else if (!strcmp(*argv, "-r")) {
+         remove = true;
+      } else {
+         break;
+      }
+   }
+
+   if (argc < 1) {
+      fprintf(stderr, "error: no store directory given\n\n");
+      StoreUsage();
+      return 1;
+   }
+
+   const char *store = *argv;
+   int status = 0;
+
+   while (--argc > 0) {
+      ++argv;
+
+      const char *name = strrchr(*argv, '/');
+      name = name ? name + 1 : *argv;
+
+      StoreStats stats;
+      if (!StoreDump(store, *argv, name, &stats)) {
+         status = 1;
+         continue;
+      }
+
+      printf("%s: %.1f MiB, %llu chunks, %llu new taking %.1f MiB\n",
+             name, MiB(stats.Size),
+             (unsigned long long)stats.Chunks, (unsigned long long)stats.NewChunks,
+             MiB(stats.NewBytes));
+
+      if (remove && unlink(*argv) != 0) {
+         fprintf(stderr, "warning: failed to remove %s (%s)\n", *argv, strerror(errno));
+      }
+   }
+
+   PrintTotals(store);
+
+   return status;
+}
+
+
+static void
+RehydrateUsage(void)
+{
+   fputs("usage: stackdump rehydrate <store-dir> <name> <output>\n"
+         "\n"
+         "Rebuilds a minidump from a \"stackdump store\" store.\n",
+         stderr);
+}
+
+
+int
+RehydrateMain(int argc, char **argv)
+{
+   if (argc != 4) {
+      RehydrateUsage();
+      return 1;
+   }
+
+   return RehydrateDump(argv[1], argv[2], argv[3]) ? 0 : 1;
+}
+
+
+/* vim:set sw=3 et: */
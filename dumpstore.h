@@ -0,0 +1,125 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Content addressed store of minidumps.
+ *
+ * Successive dumps of the same programs share most of their bytes: module
+ * code and read-only data, and often much of the heap.  The store keeps
+ * every distinct chunk once, and each dump as a manifest of the chunks
+ * making it up, from which the minidump is rebuilt on demand.
+ *
+ * Chunks are cut at the page boundaries of the captured memory, so that a
+ * page hashes the same whatever its position in the file, and every
+ * 64 KiB elsewhere.  They are named by their SHA-256.  The layout is:
+ *
+ *    <store>/lock            flock()ed by writers, exclusively, and readers
+ *    <store>/data            chunk contents, LZ4 compressed when smaller
+ *    <store>/index           StoreRecord for every chunk in data
+ *    <store>/dumps/<name>    ManifestHeader, then ManifestEntry[Count]
+ *
+ * data and index are only ever appended to, data first, so a writer that
+ * dies leaves at worst unreferenced bytes behind.
+ */
+
+#ifndef _DUMPSTORE_H_
+#define _DUMPSTORE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+
+#define STORE_DIGEST_SIZE 32
+
+#define MANIFEST_SIGNATURE 0x464d444d   /* 'MDMF' */
+#define MANIFEST_VERSION 1
+
+struct StoreRecord
+{
+   uint8_t Digest[STORE_DIGEST_SIZE];
+   uint64_t Offset;
+   uint32_t Size;             /* in data; compressed if less than RawSize */
+   uint32_t RawSize;
+};
+
+struct ManifestHeader
+{
+   uint32_t Signature;
+   uint32_t Version;
+   uint64_t Size;             /* of the minidump */
+   uint32_t Count;
+   uint32_t Reserved;
+};
+
+/* Repeat consecutive copies of a chunk, as all zero pages come in runs. */
+struct ManifestEntry
+{
+   uint8_t Digest[STORE_DIGEST_SIZE];
+   uint32_t Size;
+   uint32_t Repeat;
+};
+
+
+struct StoreStats
+{
+   uint64_t Size;             /* of the minidump */
+   uint64_t Chunks;
+   uint64_t NewChunks;
+   uint64_t NewBytes;         /* added to the store, manifest included */
+};
+
+
+/*
+ * Add a minidump, plain or block compressed, to the store as Name.  An
+ * existing dump of that name is replaced.
+ */
+bool
+StoreDump(const char *Store, const char *DumpPath, const std::string &Name,
+          StoreStats *Stats);
+
+/*
+ * Rebuild the minidump stored as Name.
+ */
+bool
+RehydrateDump(const char *Store, const std::string &Name, const char *Output);
+
+/*
+ * Entry points of "stackdump store <store-dir> [dump...]" and of
+ * "stackdump rehydrate <store-dir> <name> <output>".  Arguments start
+ * after the subcommand.
+ */
+int
+StoreMain(int argc, char **argv);
+
+int
+RehydrateMain(int argc, char **argv);
+
+
+#endif /* _DUMPSTORE_H_ */
+
+/* vim:set sw=3 et: */
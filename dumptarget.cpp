@@ -0,0 +1,169 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "elfimage.h"
+#include "dumptarget.h"
+
+
+static bool
+CompareModules(const Module &a, const Module &b)
+{
+   return a.Base < b.Base;
+}
+
+
+DumpTarget::DumpTarget(const MinidumpFile *Dump, const std::vector<std::string> &DebugDirs) :
+   Dump(Dump)
+{
+   MinidumpArray<MDRawModule> modules = Dump->Modules();
+
+   for (size_t i = 0; i < modules.size(); ++i) {
+      const MDRawModule &raw = modules[i];
+      Module module;
+
+      module.Base = raw.BaseOfImage;
+      module.End = raw.BaseOfImage + raw.SizeOfImage;
+      module.Bias = 0;
+      module.Path = Dump->ModuleName(raw);
+      module.Name = ModuleNameFromPath(module.Path);
+      module.Image = NULL;
+
+      std::string buildId;
+      const uint8_t *cv = (const uint8_t *)Dump->GetData(raw.CvRecord);
+      if (cv && raw.CvRecord.DataSize > 4) {
+         uint32_t signature;
+         memcpy(&signature, cv, sizeof signature);
+         if (signature == MD_CVINFOELF_SIGNATURE) {
+            buildId.assign((const char *)cv + 4, raw.CvRecord.DataSize - 4);
+         }
+      }
+
+      /* Only ELF modules are of any use to the unwinder. */
+      if (!buildId.empty() || (!module.Path.empty() && module.Path[0] == '/')) {
+         module.Image = ElfImage::OpenShared(module.Path, buildId, DebugDirs);
+      }
+      if (module.Image) {
+         module.Bias = module.Base - module.Image->MinAddress();
+      }
+
+      Modules.push_back(module);
+   }
+
+   std::sort(Modules.begin(), Modules.end(), CompareModules);
+}
+
+
+DumpTarget::~DumpTarget()
+{
+   ReleaseModules(Modules);
+}
+
+
+bool
+DumpTarget::GetRegisters(const MDLocationDescriptor &Context, uint64_t Regs[DW_REG_COUNT]) const
+{
+   const MDRawContextAMD64 *context = Dump->ContextAMD64(Context);
+   if (!context) {
+      return false;
+   }
+
+   Regs[DW_REG_RAX] = context->Rax;
+   Regs[DW_REG_RDX] = context->Rdx;
+   Regs[DW_REG_RCX] = context->Rcx;
+   Regs[DW_REG_RBX] = context->Rbx;
+   Regs[DW_REG_RSI] = context->Rsi;
+   Regs[DW_REG_RDI] = context->Rdi;
+   Regs[DW_REG_RBP] = context->Rbp;
+   Regs[DW_REG_RSP] = context->Rsp;
+   Regs[DW_REG_R8] = context->R8;
+   Regs[DW_REG_R9] = context->R9;
+   Regs[DW_REG_R10] = context->R10;
+   Regs[DW_REG_R11] = context->R11;
+   Regs[DW_REG_R12] = context->R12;
+   Regs[DW_REG_R13] = context->R13;
+   Regs[DW_REG_R14] = context->R14;
+   Regs[DW_REG_R15] = context->R15;
+   Regs[DW_REG_RIP] = context->Rip;
+
+   return true;
+}
+
+
+bool
+DumpTarget::GetFaultingThread(uint32_t *ThreadId, MDLocationDescriptor *Context) const
+{
+   const MDRawExceptionStream *exception = Dump->Exception();
+   if (exception && exception->ThreadContext.DataSize) {
+      *ThreadId = exception->ThreadId;
+      *Context = exception->ThreadContext;
+      return true;
+   }
+
+   MinidumpArray<MDRawThread> threads = Dump->Threads();
+   if (threads.empty()) {
+      return false;
+   }
+
+   /* Without an exception, it's a time out: the main thread is our best bet. */
+   *ThreadId = threads[0].ThreadId;
+   *Context = threads[0].ThreadContext;
+   return true;
+}
+
+
+size_t
+DumpTarget::ReadMemory(uint64_t Address, void *Buffer, size_t Size)
+{
+   return Dump->ReadMemory(Address, Buffer, Size);
+}
+
+
+const Module *
+DumpTarget::FindModule(uint64_t Address)
+{
+   Module key;
+   key.Base = Address;
+
+   std::vector<Module>::const_iterator it =
+      std::upper_bound(Modules.begin(), Modules.end(), key, CompareModules);
+   if (it == Modules.begin()) {
+      return NULL;
+   }
+   --it;
+
+   if (Address >= it->End) {
+      return NULL;
+   }
+   return &*it;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,84 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * A minidump seen as a debug target, so that the unwinder and the
+ * symbolizer can work offline.
+ */
+
+#ifndef _DUMPTARGET_H_
+#define _DUMPTARGET_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "minidumpreader.h"
+#include "target.h"
+
+
+class DumpTarget : public Target
+{
+public:
+   /*
+    * Modules are matched against local ELF images by path and build-id,
+    * or by build-id alone within the debug directories.
+    */
+   DumpTarget(const MinidumpFile *Dump, const std::vector<std::string> &DebugDirs);
+
+   ~DumpTarget();
+
+   const MinidumpFile *Dump;
+   std::vector<Module> Modules;   /* sorted by base address */
+
+   /*
+    * Get the registers of a thread context in DWARF numbering.  Only AMD64
+    * contexts are supported.
+    */
+   bool
+   GetRegisters(const MDLocationDescriptor &Context, uint64_t Regs[DW_REG_COUNT]) const;
+
+   /*
+    * The faulting thread and its context, from the exception stream, or
+    * the first thread when there is none.  Returns false for empty dumps.
+    */
+   bool
+   GetFaultingThread(uint32_t *ThreadId, MDLocationDescriptor *Context) const;
+
+   /* Target */
+   size_t
+   ReadMemory(uint64_t Address, void *Buffer, size_t Size);
+
+   const Module *
+   FindModule(uint64_t Address);
+};
+
+
+#endif /* _DUMPTARGET_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,1229 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "compress.h"
+#include "elfimage.h"
+#include "minidump.h"
+#include "process.h"
+#include "threadpool.h"
+#include "dumpwriter.h"
+
+
+/* Bytes below the stack pointer that may be in use (the red zone). */
+#define STACK_RED_ZONE 128
+
+/* Upper bound on the stack memory captured per thread. */
+#define STACK_MAX_SIZE (8*1024*1024)
+
+#define COPY_CHUNK_SIZE (1024*1024)
+
+/* Granularity of the memory reachable from the stacks (DUMP_REACHABLE). */
+#define REACHABLE_PAGE_SIZE 4096
+
+/* Buffers of the write pipeline, and the alignment O_DIRECT needs. */
+#define PIPELINE_BUFFER_SIZE (1024*1024)
+#define PIPELINE_BUFFER_COUNT 8
+#define DIRECT_ALIGNMENT 4096
+
+
+/*
+ * Pipelined writes.  The dumping thread, which holds the target stopped,
+ * fills a pool of aligned buffers, reading target memory straight into
+ * them with process_vm_readv, while writer threads write the full ones
+ * out.  The dumping thread is the read stage: it has nothing else to do
+ * meanwhile, so a separate reader thread would only add a hand-off.  Full
+ * buffers are written with O_DIRECT when the file system allows it, which
+ * keeps the page cache out of the way of a large dump; anything unaligned
+ * goes through the page cache.
+ */
+class WritePipeline
+{
+public:
+   WritePipeline(int Fd, int DirectFd, unsigned Writers) :
+      m_Fd(Fd),
+      m_DirectFd(DirectFd),
+      m_Offset(0),
+      m_Busy(0),
+      m_Quit(false),
+      m_Error(false)
+   {
+      for (unsigned i = 0; i < PIPELINE_BUFFER_COUNT; ++i) {
+         Buffer *buffer = new Buffer;
+         buffer->Size = 0;
+         buffer->Offset = 0;
+         if (posix_memalign((void **)&buffer->Data, DIRECT_ALIGNMENT, PIPELINE_BUFFER_SIZE) != 0) {
+            delete buffer;
+            break;
+         }
+         m_Buffers.push_back(buffer);
+         m_Free.push_back(buffer);
+      }
+
+      /* See Ok(). */
+      if (m_Free.empty()) {
+         m_Current = NULL;
+         return;
+      }
+
+      m_Current = m_Free.back();
+      m_Free.pop_back();
+
+      for (unsigned i = 0; i < Writers; ++i) {
+         m_Threads.push_back(std::thread(&WritePipeline::WriterMain, this));
+      }
+   }
+
+   ~WritePipeline()
+   {
+      {
+         std::lock_guard<std::mutex> lock(m_Mutex);
+         m_Quit = true;
+      }
+      m_Cond.notify_all();
+      for (size_t i = 0; i < m_Threads.size(); ++i) {
+         m_Threads[i].join();
+      }
+      for (size_t i = 0; i < m_Buffers.size(); ++i) {
+         free(m_Buffers[i]->Data);
+         delete m_Buffers[i];
+      }
+   }
+
+   /* False if not even one buffer could be allocated. */
+   bool
+   Ok(void) const { return m_Current != NULL; }
+
+   void
+   Append(const void *Data, size_t Size)
+   {
+      const uint8_t *p = (const uint8_t *)Data;
+
+      while (Size) {
+         size_t chunk = std::min(Size, PIPELINE_BUFFER_SIZE - m_Current->Size);
+         memcpy(m_Current->Data + m_Current->Size, p, chunk);
+         Advance(chunk);
+         p += chunk;
+         Size -= chunk;
+      }
+   }
+
+   /* Append target memory, zero filling whatever cannot be read. */
+   void
+   AppendMemory(Process *process, uint64_t Address, uint64_t Size)
+   {
+      while (Size) {
+         size_t chunk = (size_t)std::min(Size, (uint64_t)(PIPELINE_BUFFER_SIZE - m_Current->Size));
+         uint8_t *out = m_Current->Data + m_Current->Size;
+         size_t read = process->ReadMemory(Address, out, chunk);
+         if (read < chunk) {
+            memset(out + read, 0, chunk - read);
+         }
+         Advance(chunk);
+         Address += chunk;
+         Size -= chunk;
+      }
+   }
+
+   /*
+    * Write out everything appended so far.  Returns false if any write
+    * failed.
+    */
+   bool
+   Flush(void)
+   {
+      if (m_Current->Size) {
+         Submit();
+      }
+
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Cond.wait(lock, [this] { return m_Ready.empty() && !m_Busy; });
+      return !m_Error;
+   }
+
+private:
+   struct Buffer
+   {
+      uint8_t *Data;
+      size_t Size;
+      uint64_t Offset;
+   };
+
+   void
+   Advance(size_t Size)
+   {
+      m_Current->Size += Size;
+      m_Offset += Size;
+      if (m_Current->Size == PIPELINE_BUFFER_SIZE) {
+         Submit();
+      }
+   }
+
+   /* Hand the current buffer to the writers, and wait for a free one. */
+   void
+   Submit(void)
+   {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Ready.push_back(m_Current);
+      m_Cond.notify_all();
+
+      m_Cond.wait(lock, [this] { return !m_Free.empty(); });
+      m_Current = m_Free.back();
+      m_Free.pop_back();
+      m_Current->Size = 0;
+      m_Current->Offset = m_Offset;
+   }
+
+   bool
+   WriteBuffer(const Buffer *buffer)
+   {
+      int fd = m_Fd;
+      if (m_DirectFd >= 0 &&
+          buffer->Offset % DIRECT_ALIGNMENT == 0 &&
+          buffer->Size % DIRECT_ALIGNMENT == 0) {
+         fd = m_DirectFd;
+      }
+
+      size_t done = 0;
+      while (done < buffer->Size) {
+         ssize_t ret = pwrite(fd, buffer->Data + done, buffer->Size - done,
+                              buffer->Offset + done);
+         if (ret < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            /* Some file systems refuse O_DIRECT only when writing. */
+            if (errno == EINVAL && fd != m_Fd) {
+               fd = m_Fd;
+               continue;
+            }
+            return false;
+         }
+         done += ret;
+      }
+      return true;
+   }
+
+   void
+   WriterMain(void)
+   {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+
+      for (;;) {
+         m_Cond.wait(lock, [this] { return m_Quit || !m_Ready.empty(); });
+         if (m_Ready.empty()) {
+            return;
+         }
+
+         Buffer *buffer = m_Ready.front();
+         m_Ready.pop_front();
+         ++m_Busy;
+
+         lock.unlock();
+         bool ok = WriteBuffer(buffer);
+         lock.lock();
+
+         --m_Busy;
+         if (!ok) {
+            m_Error = true;
+         }
+         m_Free.push_back(buffer);
+         m_Cond.notify_all();
+      }
+   }
+
+   int m_Fd;
+   int m_DirectFd;
+   uint64_t m_Offset;
+   Buffer *m_Current;
+   std::vector<Buffer *> m_Buffers;
+
+   std::mutex m_Mutex;
+   std::condition_variable m_Cond;
+   std::vector<Buffer *> m_Free;
+   std::deque<Buffer *> m_Ready;
+   unsigned m_Busy;
+   bool m_Quit;
+   bool m_Error;
+   std::vector<std::thread> m_Threads;
+};
+
+
+/*
+ * Sequential output file, tracking the RVA of everything written.
+ *
+ * When compressing, the RVAs are offsets into the uncompressed minidump.
+ * Full blocks are compressed by a thread pool while the next ones are
+ * filled, and written out in order as they complete.  The first block is
+ * held back until the end, as the header and the directory get patched.
+ *
+ * Otherwise the writes go through a WritePipeline, unless there are no
+ * writer threads, in which case they are made in line.
+ */
+class DumpFile
+{
+public:
+   DumpFile() :
+      m_Fd(-1),
+      m_DirectFd(-1),
+      m_Offset(0),
+      m_Error(false),
+      m_Pipeline(NULL),
+      m_Pool(NULL),
+      m_FileOffset(0),
+      m_BlockCount(0)
+   {}
+
+   ~DumpFile()
+   {
+      delete m_Pipeline;
+      if (m_DirectFd >= 0) {
+         close(m_DirectFd);
+      }
+
+      /* Let the workers finish with the blocks before freeing them. */
+      delete m_Pool;
+      for (size_t i = 0; i < m_Queue.size(); ++i) {
+         delete m_Queue[i];
+      }
+      if (m_Fd >= 0) {
+         close(m_Fd);
+      }
+   }
+
+   bool
+   Open(const char *Path, bool Compress, unsigned Writers)
+   {
+      m_Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (m_Fd < 0) {
+         return false;
+      }
+
+      if (Compress) {
+         BlockHeader header;
+         memset(&header, 0, sizeof header);
+         Write(&header, sizeof header);
+
+         m_Pool = new ThreadPool;
+         m_Block.reserve(BLOCK_SIZE);
+      } else if (Writers) {
+         /* Fails on file systems without O_DIRECT support, e.g. tmpfs. */
+         m_DirectFd = open(Path, O_WRONLY | O_DIRECT | O_CLOEXEC);
+         m_Pipeline = new WritePipeline(m_Fd, m_DirectFd, Writers);
+         if (!m_Pipeline->Ok()) {
+            /* Out of memory: write in line instead. */
+            delete m_Pipeline;
+            m_Pipeline = NULL;
+         }
+      }
+
+      return true;
+   }
+
+   bool
+   Close(void)
+   {
+      if (m_Pool) {
+         FinishBlocks();
+      }
+      if (m_Pipeline && !m_Pipeline->Flush()) {
+         m_Error = true;
+      }
+
+      bool ok = !m_Error && close(m_Fd) == 0;
+      m_Fd = -1;
+      return ok;
+   }
+
+   uint64_t
+   Offset(void) const { return m_Offset; }
+
+   uint32_t
+   Rva(void) const { return (uint32_t)m_Offset; }
+
+   /* Append data, returning its RVA. */
+   uint32_t
+   Append(const void *Data, size_t Size)
+   {
+      uint32_t rva = Rva();
+      const uint8_t *p = (const uint8_t *)Data;
+
+      m_Offset += Size;
+
+      if (m_Pipeline) {
+         m_Pipeline->Append(p, Size);
+         return rva;
+      }
+      if (!m_Pool) {
+         Write(p, Size);
+         return rva;
+      }
+
+      while (Size) {
+         size_t chunk = BLOCK_SIZE - m_Block.size();
+         if (chunk > Size) {
+            chunk = Size;
+         }
+         m_Block.insert(m_Block.end(), p, p + chunk);
+         p += chunk;
+         Size -= chunk;
+
+         if (m_Block.size() == BLOCK_SIZE) {
+            QueueBlock();
+         }
+      }
+
+      return rva;
+   }
+
+   void
+   Align(unsigned Alignment)
+   {
+      static const uint8_t zeros[16] = {0};
+      unsigned pad = (Alignment - m_Offset % Alignment) % Alignment;
+      if (pad) {
+         Append(zeros, pad);
+      }
+   }
+
+   void
+   WriteAt(uint32_t Rva, const void *Data, size_t Size)
+   {
+      if (m_Pipeline && !m_Pipeline->Flush()) {
+         m_Error = true;
+      }
+      if (!m_Pool) {
+         if (pwrite(m_Fd, Data, Size, Rva) != (ssize_t)Size) {
+            m_Error = true;
+         }
+         return;
+      }
+
+      /* Only blocks not compressed yet can be patched. */
+      uint64_t blockStart = m_Offset - m_Block.size();
+      if (Rva >= blockStart && Rva + Size <= m_Offset) {
+         memcpy(&m_Block[Rva - blockStart], Data, Size);
+      } else if (Rva + Size <= m_First.size()) {
+         memcpy(&m_First[Rva], Data, Size);
+      } else {
+         m_Error = true;
+      }
+   }
+
+   /* Append a MINIDUMP_STRING, converting from UTF-8 (ASCII really). */
+   uint32_t
+   AppendString(const std::string &s)
+   {
+      std::vector<uint16_t> utf16;
+      for (size_t i = 0; i < s.size(); ++i) {
+         utf16.push_back((uint8_t)s[i]);
+      }
+      utf16.push_back(0);
+
+      Align(4);
+      MDString header;
+      header.Length = (uint32_t)(s.size() * 2);
+      uint32_t rva = Append(&header, sizeof header);
+      Append(&utf16[0], utf16.size() * 2);
+      return rva;
+   }
+
+   /* Append target memory, zero filling whatever cannot be read. */
+   void
+   AppendMemory(Process *process, uint64_t Address, uint64_t Size)
+   {
+      if (m_Pipeline) {
+         m_Pipeline->AppendMemory(process, Address, Size);
+         m_Offset += Size;
+         return;
+      }
+
+      std::vector<uint8_t> buffer(COPY_CHUNK_SIZE);
+
+      while (Size) {
+         size_t chunk = Size < COPY_CHUNK_SIZE ? Size : COPY_CHUNK_SIZE;
+         size_t read = process->ReadMemory(Address, &buffer[0], chunk);
+         if (read < chunk) {
+            memset(&buffer[read], 0, chunk - read);
+         }
+         Append(&buffer[0], chunk);
+         Address += chunk;
+         Size -= chunk;
+      }
+   }
+
+private:
+   struct Block
+   {
+      uint32_t Number;
+      std::vector<uint8_t> Data;
+      std::vector<uint8_t> Compressed;
+      bool Done;
+   };
+
+   void
+   Write(const void *Data, size_t Size)
+   {
+      const uint8_t *p = (const uint8_t *)Data;
+
+      while (Size) {
+         ssize_t ret = write(m_Fd, p, Size);
+         if (ret < 0) {
+            if (errno == EINTR) {
+               continue;
+            }
+            m_Error = true;
+            break;
+         }
+         p += ret;
+         Size -= ret;
+         m_FileOffset += ret;
+      }
+   }
+
+   static void
+   CompressBlock(Block *block)
+   {
+      size_t size = block->Data.size();
+      block->Compressed.resize(LZ4_BOUND(size));
+      block->Compressed.resize(LZ4Compress(&block->Data[0], size, &block->Compressed[0]));
+   }
+
+   void
+   WriteBlock(Block *block)
+   {
+      BlockIndexEntry &entry = m_Index[block->Number];
+      entry.Offset = m_FileOffset;
+      if (block->Compressed.size() < block->Data.size()) {
+         entry.Size = (uint32_t)block->Compressed.size();
+         entry.Flags = 0;
+         Write(&block->Compressed[0], block->Compressed.size());
+      } else {
+         entry.Size = (uint32_t)block->Data.size();
+         entry.Flags = BLOCK_STORED;
+         Write(&block->Data[0], block->Data.size());
+      }
+   }
+
+   void
+   QueueBlock(void)
+   {
+      if (m_BlockCount++ == 0) {
+         m_First.swap(m_Block);
+         m_Block.reserve(BLOCK_SIZE);
+         return;
+      }
+
+      Block *block = new Block;
+      block->Number = m_BlockCount - 1;
+      block->Data.swap(m_Block);
+      block->Done = false;
+      m_Block.reserve(BLOCK_SIZE);
+      m_Index.resize(m_BlockCount);
+
+      {
+         std::lock_guard<std::mutex> lock(m_Mutex);
+         m_Queue.push_back(block);
+      }
+
+      m_Pool->Submit([this, block] {
+         CompressBlock(block);
+         std::lock_guard<std::mutex> lock(m_Mutex);
+         block->Done = true;
+         m_BlockDone.notify_all();
+      });
+
+      WriteBlocks(false);
+   }
+
+   /*
+    * Write the compressed blocks at the head of the queue.  Unless All is
+    * set, only wait for them when too many are in flight.
+    */
+   void
+   WriteBlocks(bool All)
+   {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+
+      while (!m_Queue.empty()) {
+         Block *block = m_Queue.front();
+         if (!block->Done) {
+            if (!All && m_Queue.size() <= 2 * m_Pool->Size()) {
+               break;
+            }
+            m_BlockDone.wait(lock, [block] { return block->Done; });
+         }
+         m_Queue.pop_front();
+
+         lock.unlock();
+         WriteBlock(block);
+         delete block;
+         lock.lock();
+      }
+   }
+
+   void
+   FinishBlocks(void)
+   {
+      if (!m_Block.empty()) {
+         QueueBlock();
+      }
+      WriteBlocks(true);
+
+      Block first;
+      first.Number = 0;
+      first.Data.swap(m_First);
+      m_Index.resize(m_BlockCount);
+      CompressBlock(&first);
+      WriteBlock(&first);
+
+      BlockHeader header;
+      header.Signature = BLOCK_SIGNATURE;
+      header.Version = BLOCK_VERSION;
+      header.BlockSize = BLOCK_SIZE;
+      header.BlockCount = m_BlockCount;
+      header.Size = m_Offset;
+      header.IndexOffset = m_FileOffset;
+      Write(&m_Index[0], m_Index.size() * sizeof m_Index[0]);
+
+      if (pwrite(m_Fd, &header, sizeof header, 0) != (ssize_t)sizeof header) {
+         m_Error = true;
+      }
+   }
+
+   int m_Fd;
+   int m_DirectFd;
+   uint64_t m_Offset;
+   bool m_Error;
+
+   WritePipeline *m_Pipeline;
+
+   /* Compression state, when m_Pool is set. */
+   ThreadPool *m_Pool;
+   uint64_t m_FileOffset;
+   uint32_t m_BlockCount;
+   std::vector<uint8_t> m_Block;
+   std::vector<uint8_t> m_First;
+   std::vector<BlockIndexEntry> m_Index;
+   std::deque<Block *> m_Queue;
+   std::mutex m_Mutex;
+   std::condition_variable m_BlockDone;
+};
+
+
+static void
+FillContext(const Thread &thread, MDRawContextAMD64 &context)
+{
+   const struct user_regs_struct &regs = thread.Regs;
+
+   memset(&context, 0, sizeof context);
+
+   context.ContextFlags = MD_CONTEXT_AMD64 | MD_CONTEXT_CONTROL | MD_CONTEXT_INTEGER |
+                          MD_CONTEXT_SEGMENTS | MD_CONTEXT_FLOATING_POINT;
+   context.SegCs = regs.cs;
+   context.SegDs = regs.ds;
+   context.SegEs = regs.es;
+   context.SegFs = regs.fs;
+   context.SegGs = regs.gs;
+   context.SegSs = regs.ss;
+   context.EFlags = (uint32_t)regs.eflags;
+   context.Rax = regs.rax;
+   context.Rcx = regs.rcx;
+   context.Rdx = regs.rdx;
+   context.Rbx = regs.rbx;
+   context.Rsp = regs.rsp;
+   context.Rbp = regs.rbp;
+   context.Rsi = regs.rsi;
+   context.Rdi = regs.rdi;
+   context.R8 = regs.r8;
+   context.R9 = regs.r9;
+   context.R10 = regs.r10;
+   context.R11 = regs.r11;
+   context.R12 = regs.r12;
+   context.R13 = regs.r13;
+   context.R14 = regs.r14;
+   context.R15 = regs.r15;
+   context.Rip = regs.rip;
+
+   /* user_fpregs_struct is the FXSAVE image, as is XMM_SAVE_AREA32. */
+   memcpy(&context.FltSave, &thread.FpRegs, sizeof context.FltSave);
+   context.MxCsr = context.FltSave.MxCsr;
+}
+
+
+/*
+ * Determine the stack memory range worth saving for a thread: from just
+ * below the stack pointer to the top of the mapping containing it.
+ */
+static bool
+GetStackRange(Process *process, uint64_t Sp, uint64_t *Start, uint64_t *Size)
+{
+   for (size_t i = 0; i < process->Regions.size(); ++i) {
+      const MemoryRegion &region = process->Regions[i];
+      if (region.Start <= Sp && Sp < region.End) {
+         uint64_t start = Sp - STACK_RED_ZONE;
+         if (start < region.Start) {
+            start = region.Start;
+         }
+         uint64_t size = region.End - start;
+         if (size > STACK_MAX_SIZE) {
+            size = STACK_MAX_SIZE;
+         }
+         *Start = start;
+         *Size = size;
+         return true;
+      }
+   }
+   return false;
+}
+
+
+static bool
+ReadFile(const char *Path, std::string &Contents)
+{
+   char buffer[4096];
+   FILE *fp;
+   size_t n;
+
+   fp = fopen(Path, "rb");
+   if (!fp) {
+      return false;
+   }
+   while ((n = fread(buffer, 1, sizeof buffer, fp)) > 0) {
+      Contents.append(buffer, n);
+   }
+   fclose(fp);
+   return true;
+}
+
+
+/*
+ * Whether a region should be part of a full memory dump.
+ */
+static bool
+IsDumpableRegion(const MemoryRegion &region)
+{
+   if (!(region.Protection & PROT_READ)) {
+      return false;
+   }
+   /* Kernel provided pages which cannot or should not be read. */
+   if (region.Path == "[vvar]" || region.Path == "[vsyscall]" ||
+       region.Path.compare(0, 5, "/dev/") == 0) {
+      return false;
+   }
+   return true;
+}
+
+
+/*
+ * Pages of heap and data reachable from the stacks and registers, by
+ * following whatever looks like a pointer, level by level, until Depth
+ * levels deep or Budget bytes are taken.  Pages within the stack ranges
+ * already captured are left out.
+ */
+class ReachableMemory
+{
+public:
+   ReachableMemory(Process *process, const std::vector<MDMemoryDescriptor> &Stacks,
+                   uint64_t Budget) :
+      m_Process(process),
+      m_Budget(Budget),
+      m_Size(0)
+   {
+      std::vector<std::pair<uint64_t, uint64_t> > stacks;
+      for (size_t i = 0; i < Stacks.size(); ++i) {
+         stacks.push_back(std::make_pair(Stacks[i].StartOfMemoryRange,
+                                         Stacks[i].StartOfMemoryRange +
+                                         Stacks[i].Memory.DataSize));
+      }
+      std::sort(stacks.begin(), stacks.end());
+
+      /* Merged, so that they can be binary searched. */
+      for (size_t i = 0; i < stacks.size(); ++i) {
+         if (!m_Stacks.empty() && stacks[i].first <= m_Stacks.back().second) {
+            m_Stacks.back().second = std::max(m_Stacks.back().second, stacks[i].second);
+         } else {
+            m_Stacks.push_back(stacks[i]);
+         }
+      }
+   }
+
+   void
+   AddValue(uint64_t Value)
+   {
+      if (m_Size + REACHABLE_PAGE_SIZE > m_Budget) {
+         return;
+      }
+
+      /* Most values point to pages already looked at. */
+      uint64_t page = Value & ~(uint64_t)(REACHABLE_PAGE_SIZE - 1);
+      if (!m_Seen.insert(page).second) {
+         return;
+      }
+
+      const MemoryRegion *region = m_Process->FindRegion(Value);
+      if (!region || !IsDumpableRegion(*region) || !(region->Protection & PROT_WRITE) ||
+          InStack(page)) {
+         return;
+      }
+
+      m_Pages.push_back(page);
+      m_Size += REACHABLE_PAGE_SIZE;
+      m_Next.push_back(page);
+   }
+
+   /* Treat every aligned word of a memory range as a potential pointer. */
+   void
+   AddMemory(uint64_t Address, uint64_t Size)
+   {
+      std::vector<uint64_t> words(COPY_CHUNK_SIZE / sizeof(uint64_t));
+
+      Address &= ~(uint64_t)7;
+      while (Size >= sizeof(uint64_t)) {
+         size_t chunk = (size_t)std::min(Size, (uint64_t)COPY_CHUNK_SIZE) & ~(size_t)7;
+         size_t read = m_Process->ReadMemory(Address, &words[0], chunk);
+         for (size_t i = 0; i < read / sizeof(uint64_t); ++i) {
+            AddValue(words[i]);
+         }
+         if (read < chunk) {
+            break;
+         }
+         Address += chunk;
+         Size -= chunk;
+      }
+   }
+
+   /*
+    * Scan the pages found in the last level for the next one.  Returns
+    * false when there are none.
+    */
+   bool
+   NextLevel(void)
+   {
+      std::vector<uint64_t> level;
+      level.swap(m_Next);
+      for (size_t i = 0; i < level.size(); ++i) {
+         AddMemory(level[i], REACHABLE_PAGE_SIZE);
+      }
+      return !m_Next.empty();
+   }
+
+   /* Contiguous pages as memory descriptors, in address order. */
+   void
+   GetRanges(std::vector<MDMemoryDescriptor> &Ranges) const
+   {
+      std::vector<uint64_t> pages(m_Pages);
+      std::sort(pages.begin(), pages.end());
+
+      std::vector<uint64_t>::const_iterator it = pages.begin();
+      while (it != pages.end()) {
+         uint64_t start = *it;
+         uint64_t end = start + REACHABLE_PAGE_SIZE;
+         for (++it; it != pages.end() && *it == end; ++it) {
+            end += REACHABLE_PAGE_SIZE;
+         }
+
+         MDMemoryDescriptor range;
+         memset(&range, 0, sizeof range);
+         range.StartOfMemoryRange = start;
+         range.Memory.DataSize = (uint32_t)(end - start);
+         Ranges.push_back(range);
+      }
+   }
+
+private:
+   Process *m_Process;
+   uint64_t m_Budget;
+   uint64_t m_Size;
+   std::vector<std::pair<uint64_t, uint64_t> > m_Stacks;     /* sorted, disjoint */
+   std::unordered_set<uint64_t> m_Seen;
+   std::vector<uint64_t> m_Pages;
+   std::vector<uint64_t> m_Next;
+
+   bool
+   InStack(uint64_t Page) const
+   {
+      /* The last stack starting before the end of the page. */
+      std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+         std::lower_bound(m_Stacks.begin(), m_Stacks.end(),
+                          std::make_pair(Page + REACHABLE_PAGE_SIZE, (uint64_t)0));
+      if (it == m_Stacks.begin()) {
+         return false;
+      }
+      --it;
+      return Page < it->second;
+   }
+};
+
+
+bool
+WriteMinidump(const char *Path, Process *process, DumpFormat Format,
+              pid_t ExceptionTid, const siginfo_t *SigInfo,
+              unsigned Depth, uint64_t Budget, bool Compress, unsigned Writers)
+{
+   DumpFile file;
+   std::vector<MDRawDirectory> directory;
+   std::map<pid_t, Thread>::iterator it;
+
+   if (!file.Open(Path, Compress, Writers)) {
+      fprintf(stderr, "warning: failed to create %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+
+   unsigned streamCount = 7;
+   if (ExceptionTid) {
+      ++streamCount;
+   }
+   if (Format == DUMP_FULL) {
+      ++streamCount;
+   }
+
+   /*
+    * Header and stream directory, filled in at the end.
+    */
+
+   MDRawHeader header;
+   memset(&header, 0, sizeof header);
+   file.Append(&header, sizeof header);
+
+   uint32_t directoryRva = file.Rva();
+   std::vector<MDRawDirectory> placeholder(streamCount);
+   memset(&placeholder[0], 0, streamCount * sizeof placeholder[0]);
+   file.Append(&placeholder[0], streamCount * sizeof placeholder[0]);
+
+   /*
+    * Thread contexts and stacks.
+    */
+
+   std::vector<MDRawThread> threads;
+   std::vector<MDMemoryDescriptor> memoryRanges;
+   MDLocationDescriptor exceptionContext = {0, 0};
+
+   for (it = process->Threads.begin(); it != process->Threads.end(); ++it) {
+      const Thread &thread = it->second;
+      MDRawThread raw;
+      memset(&raw, 0, sizeof raw);
+      raw.ThreadId = thread.Tid;
+
+      MDRawContextAMD64 context;
+      FillContext(thread, context);
+      file.Align(16);
+      raw.ThreadContext.DataSize = sizeof context;
+      raw.ThreadContext.Rva = file.Append(&context, sizeof context);
+
+      if (thread.Tid == ExceptionTid) {
+         exceptionContext = raw.ThreadContext;
+      }
+
+      uint64_t start, size;
+      if (GetStackRange(process, thread.Regs.rsp, &start, &size)) {
+         raw.Stack.StartOfMemoryRange = start;
+         raw.Stack.Memory.DataSize = (uint32_t)size;
+         raw.Stack.Memory.Rva = file.Rva();
+         file.AppendMemory(process, start, size);
+         memoryRanges.push_back(raw.Stack);
+      }
+
+      threads.push_back(raw);
+   }
+
+   /*
+    * Memory reachable from the stacks and registers.
+    */
+
+   if (Format == DUMP_REACHABLE && Depth) {
+      ReachableMemory reachable(process, memoryRanges, Budget);
+
+      for (it = process->Threads.begin(); it != process->Threads.end(); ++it) {
+         uint64_t regs[DW_REG_COUNT];
+         RegistersToDwarf(it->second.Regs, regs);
+         for (unsigned i = 0; i < DW_REG_COUNT; ++i) {
+            reachable.AddValue(regs[i]);
+         }
+      }
+      for (size_t i = 0; i < memoryRanges.size(); ++i) {
+         reachable.AddMemory(memoryRanges[i].StartOfMemoryRange,
+                             memoryRanges[i].Memory.DataSize);
+      }
+
+      for (unsigned level = 1; level < Depth && reachable.NextLevel(); ++level)
+         ;
+
+      std::vector<MDMemoryDescriptor> ranges;
+      reachable.GetRanges(ranges);
+      for (size_t i = 0; i < ranges.size(); ++i) {
+         ranges[i].Memory.Rva = file.Rva();
+         file.AppendMemory(process, ranges[i].StartOfMemoryRange, ranges[i].Memory.DataSize);
+         memoryRanges.push_back(ranges[i]);
+      }
+   }
+
+   MDRawDirectory entry;
+
+   MDRawThreadList threadList;
+   threadList.NumberOfThreads = (uint32_t)threads.size();
+   file.Align(8);
+   entry.StreamType = MD_THREAD_LIST_STREAM;
+   entry.Location.Rva = file.Append(&threadList, sizeof threadList);
+   if (!threads.empty()) {
+      file.Append(&threads[0], threads.size() * sizeof threads[0]);
+   }
+   entry.Location.DataSize = file.Rva() - entry.Location.Rva;
+   directory.push_back(entry);
+
+   /*
+    * Thread names.
+    */
+
+   std::vector<MDRawThreadName> names;
+   for (it = process->Threads.begin(); it != process->Threads.end(); ++it) {
+      char path[64];
+      std::string comm;
+      snprintf(path, sizeof path, "/proc/%d/task/%d/comm", process->Pid, it->first);
+      ReadFile(path, comm);
+      comm = comm.substr(0, comm.find('\n'));
+
+      MDRawThreadName name;
+      name.ThreadId = it->first;
+      name.RvaOfThreadName = file.AppendString(comm);
+      names.push_back(name);
+   }
+
+   MDRawThreadNameList nameList;
+   nameList.NumberOfThreadNames = (uint32_t)names.size();
+   file.Align(4);
+   entry.StreamType = MD_THREAD_NAME_LIST_STREAM;
+   entry.Location.Rva = file.Append(&nameList, sizeof nameList);
+   if (!names.empty()) {
+      file.Append(&names[0], names.size() * sizeof names[0]);
+   }
+   entry.Location.DataSize = file.Rva() - entry.Location.Rva;
+   directory.push_back(entry);
+
+   /*
+    * Modules.
+    */
+
+   std::vector<MDRawModule> modules;
+   for (size_t i = 0; i < process->Modules.size(); ++i) {
+      const Module &module = process->Modules[i];
+      MDRawModule raw;
+      memset(&raw, 0, sizeof raw);
+
+      raw.BaseOfImage = module.Base;
+      raw.SizeOfImage = (uint32_t)(module.End - module.Base);
+      raw.ModuleNameRva = file.AppendString(module.Path);
+
+      if (module.Image && !module.Image->BuildId().empty()) {
+         const std::string &buildId = module.Image->BuildId();
+         MDCVInfoELF cv;
+         cv.CvSignature = MD_CVINFOELF_SIGNATURE;
+         file.Align(4);
+         raw.CvRecord.Rva = file.Append(&cv, sizeof cv);
+         file.Append(buildId.data(), buildId.size());
+         raw.CvRecord.DataSize = (uint32_t)(sizeof cv + buildId.size());
+      }
+
+      modules.push_back(raw);
+   }
+
+   MDRawModuleList moduleList;
+   moduleList.NumberOfModules = (uint32_t)modules.size();
+   file.Align(8);
+   entry.StreamType = MD_MODULE_LIST_STREAM;
+   entry.Location.Rva = file.Append(&moduleList, sizeof moduleList);
+   if (!modules.empty()) {
+      file.Append(&modules[0], modules.size() * sizeof modules[0]);
+   }
+   entry.Location.DataSize = file.Rva() - entry.Location.Rva;
+   directory.push_back(entry);
+
+   /*
+    * Stack memory list.
+    */
+
+   MDRawMemoryList memoryList;
+   memoryList.NumberOfMemoryRanges = (uint32_t)memoryRanges.size();
+   file.Align(8);
+   entry.StreamType = MD_MEMORY_LIST_STREAM;
+   entry.Location.Rva = file.Append(&memoryList, sizeof memoryList);
+   if (!memoryRanges.empty()) {
+      file.Append(&memoryRanges[0], memoryRanges.size() * sizeof memoryRanges[0]);
+   }
+   entry.Location.DataSize = file.Rva() - entry.Location.Rva;
+   directory.push_back(entry);
+
+   /*
+    * Exception.
+    */
+
+   if (ExceptionTid) {
+      MDRawExceptionStream exception;
+      memset(&exception, 0, sizeof exception);
+      exception.ThreadId = ExceptionTid;
+      exception.ThreadContext = exceptionContext;
+      if (SigInfo) {
+         /* Same convention as Breakpad: signal number and si_code. */
+         exception.ExceptionRecord.ExceptionCode = SigInfo->si_signo;
+         exception.ExceptionRecord.ExceptionFlags = SigInfo->si_code;
+         exception.ExceptionRecord.ExceptionAddress = (uint64_t)(uintptr_t)SigInfo->si_addr;
+      }
+
+      file.Align(8);
+      entry.StreamType = MD_EXCEPTION_STREAM;
+      entry.Location.Rva = file.Append(&exception, sizeof exception);
+      entry.Location.DataSize = sizeof exception;
+      directory.push_back(entry);
+   }
+
+   /*
+    * System information.
+    */
+
+   MDRawSystemInfo systemInfo;
+   memset(&systemInfo, 0, sizeof systemInfo);
+   systemInfo.ProcessorArchitecture = MD_CPU_ARCHITECTURE_AMD64;
+   long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   systemInfo.NumberOfProcessors = cpus > 255 ? 255 : (uint8_t)cpus;
+   systemInfo.PlatformId = MD_OS_LINUX;
+
+   struct utsname uts;
+   if (uname(&uts) == 0) {
+      unsigned major = 0, minor = 0, build = 0;
+      sscanf(uts.release, "%u.%u.%u", &major, &minor, &build);
+      systemInfo.MajorVersion = major;
+      systemInfo.MinorVersion = minor;
+      systemInfo.BuildNumber = build;
+      systemInfo.CSDVersionRva = file.AppendString(std::string(uts.sysname) + " " +
+                                                   uts.release + " " + uts.version);
+   }
+
+   file.Align(8);
+   entry.StreamType = MD_SYSTEM_INFO_STREAM;
+   entry.Location.Rva = file.Append(&systemInfo, sizeof systemInfo);
+   entry.Location.DataSize = sizeof systemInfo;
+   directory.push_back(entry);
+
+   MDRawMiscInfo miscInfo;
+   memset(&miscInfo, 0, sizeof miscInfo);
+   miscInfo.SizeOfInfo = sizeof miscInfo;
+   miscInfo.Flags1 = MD_MISCINFO_FLAGS1_PROCESS_ID;
+   miscInfo.ProcessId = process->Pid;
+   entry.StreamType = MD_MISC_INFO_STREAM;
+   entry.Location.Rva = file.Append(&miscInfo, sizeof miscInfo);
+   entry.Location.DataSize = sizeof miscInfo;
+   directory.push_back(entry);
+
+   /*
+    * Linux specific: the memory map, which lets tools recover the module
+    * layout and the stack extents.
+    */
+
+   char path[64];
+   std::string maps;
+   snprintf(path, sizeof path, "/proc/%d/maps", process->Pid);
+   ReadFile(path, maps);
+   entry.StreamType = MD_LINUX_MAPS;
+   entry.Location.Rva = file.Append(maps.data(), maps.size());
+   entry.Location.DataSize = (uint32_t)maps.size();
+   directory.push_back(entry);
+
+   /*
+    * Full memory, last, as it is by far the largest stream.
+    */
+
+   if (Format == DUMP_FULL) {
+      std::vector<MDMemoryDescriptor64> ranges;
+      for (size_t i = 0; i < process->Regions.size(); ++i) {
+         const MemoryRegion &region = process->Regions[i];
+         if (IsDumpableRegion(region)) {
+            MDMemoryDescriptor64 range;
+            range.StartOfMemoryRange = region.Start;
+            range.DataSize = region.End - region.Start;
+            ranges.push_back(range);
+         }
+      }
+
+      MDRawMemory64List memory64List;
+      memory64List.NumberOfMemoryRanges = ranges.size();
+
+      file.Align(8);
+      memory64List.BaseRva = file.Offset() + sizeof memory64List +
+                             ranges.size() * sizeof(MDMemoryDescriptor64);
+      entry.StreamType = MD_MEMORY_64_LIST_STREAM;
+      entry.Location.Rva = file.Append(&memory64List, sizeof memory64List);
+      if (!ranges.empty()) {
+         file.Append(&ranges[0], ranges.size() * sizeof ranges[0]);
+      }
+      entry.Location.DataSize = file.Rva() - entry.Location.Rva;
+      directory.push_back(entry);
+
+      for (size_t i = 0; i < ranges.size(); ++i) {
+         file.AppendMemory(process, ranges[i].StartOfMemoryRange, ranges[i].DataSize);
+      }
+   }
+
+   /*
+    * Patch the header and the directory.
+    */
+
+   header.Signature = MD_HEADER_SIGNATURE;
+   header.Version = MD_HEADER_VERSION;
+   header.NumberOfStreams = (uint32_t)directory.size();
+   header.StreamDirectoryRva = directoryRva;
+   header.TimeDateStamp = (uint32_t)time(NULL);
+   file.WriteAt(0, &header, sizeof header);
+   file.WriteAt(directoryRva, &directory[0], directory.size() * sizeof directory[0]);
+
+   if (!file.Close()) {
+      fprintf(stderr, "warning: failed to write %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+
+   return true;
+}
+
+
+/* vim:set sw=3 et: */
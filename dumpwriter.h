@@ -0,0 +1,73 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Minidump writer for live Linux processes.
+ */
+
+#ifndef _DUMPWRITER_H_
+#define _DUMPWRITER_H_
+
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+class Process;
+
+
+enum DumpFormat {
+   DUMP_SMALL = 0,      /* threads, stacks and modules (DEBUG_DUMP_SMALL) */
+   DUMP_FULL,           /* plus all readable memory (-ma) */
+   DUMP_REACHABLE       /* plus the memory the stacks point to (-mi) */
+};
+
+/* Defaults for DUMP_REACHABLE: pointer levels followed, and bytes taken */
+#define REACHABLE_DEPTH 2
+#define REACHABLE_BUDGET (64*1024*1024)
+
+/* Threads writing the dump file while target memory is read */
+#define DUMP_WRITERS 2
+
+
+/*
+ * Write a minidump of a stopped process.  The thread registers and the
+ * module list must be up to date.  ExceptionTid and SigInfo describe the
+ * fatal signal, if any.  Depth and Budget bound DUMP_REACHABLE.  Compress
+ * writes a block compressed dump (see compress.h).  Otherwise that many
+ * Writers write the file as it is filled in, or none to write in line.
+ */
+bool
+WriteMinidump(const char *Path, Process *process, DumpFormat Format,
+              pid_t ExceptionTid, const siginfo_t *SigInfo,
+              unsigned Depth = REACHABLE_DEPTH, uint64_t Budget = REACHABLE_BUDGET,
+              bool Compress = false, unsigned Writers = DUMP_WRITERS);
+
+
+#endif /* _DUMPWRITER_H_ */
+
+/* vim:set sw=3 et: */
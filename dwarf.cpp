@@ -0,0 +1,1602 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * DWARF line number program decoding.
+ *
+ * See the DWARF Debugging Information Format, versions 2 to 5, section
+ * "Line Number Information".
+ */
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "elfimage.h"
+#include "dwarf.h"
+
+
+/**************************************************************************
+ *
+ * Defines
+ *
+ **************************************************************************/
+
+#define DW_LNS_copy               0x01
+#define DW_LNS_advance_pc         0x02
+#define DW_LNS_advance_line       0x03
+#define DW_LNS_set_file           0x04
+#define DW_LNS_set_column         0x05
+#define DW_LNS_negate_stmt        0x06
+#define DW_LNS_set_basic_block    0x07
+#define DW_LNS_const_add_pc       0x08
+#define DW_LNS_fixed_advance_pc   0x09
+
+#define DW_LNE_end_sequence       0x01
+#define DW_LNE_set_address        0x02
+#define DW_LNE_define_file        0x03
+
+#define DW_LNCT_path              0x1
+#define DW_LNCT_directory_index   0x2
+
+#define DW_FORM_addr              0x01
+#define DW_FORM_block2            0x03
+#define DW_FORM_block4            0x04
+#define DW_FORM_data2             0x05
+#define DW_FORM_data4             0x06
+#define DW_FORM_data8             0x07
+#define DW_FORM_string            0x08
+#define DW_FORM_block             0x09
+#define DW_FORM_block1            0x0a
+#define DW_FORM_data1             0x0b
+#define DW_FORM_flag              0x0c
+#define DW_FORM_sdata             0x0d
+#define DW_FORM_strp              0x0e
+#define DW_FORM_udata             0x0f
+#define DW_FORM_ref_addr          0x10
+#define DW_FORM_ref1              0x11
+#define DW_FORM_ref2              0x12
+#define DW_FORM_ref4              0x13
+#define DW_FORM_ref8              0x14
+#define DW_FORM_ref_udata         0x15
+#define DW_FORM_indirect          0x16
+#define DW_FORM_sec_offset        0x17
+#define DW_FORM_exprloc           0x18
+#define DW_FORM_flag_present      0x19
+#define DW_FORM_strx              0x1a
+#define DW_FORM_addrx             0x1b
+#define DW_FORM_ref_sup4          0x1c
+#define DW_FORM_strp_sup          0x1d
+#define DW_FORM_data16            0x1e
+#define DW_FORM_line_strp         0x1f
+#define DW_FORM_ref_sig8          0x20
+#define DW_FORM_implicit_const    0x21
+#define DW_FORM_loclistx          0x22
+#define DW_FORM_rnglistx          0x23
+#define DW_FORM_ref_sup8          0x24
+#define DW_FORM_strx1             0x25
+#define DW_FORM_strx2             0x26
+#define DW_FORM_strx3             0x27
+#define DW_FORM_strx4             0x28
+#define DW_FORM_addrx1            0x29
+#define DW_FORM_addrx2            0x2a
+#define DW_FORM_addrx3            0x2b
+#define DW_FORM_addrx4            0x2c
+#define DW_FORM_GNU_addr_index    0x1f01
+#define DW_FORM_GNU_str_index     0x1f02
+#define DW_FORM_GNU_ref_alt       0x1f20
+#define DW_FORM_GNU_strp_alt      0x1f21
+
+#define DW_UT_type                0x02
+#define DW_UT_skeleton            0x04
+#define DW_UT_split_compile       0x05
+#define DW_UT_split_type          0x06
+
+#define DW_TAG_inlined_subroutine 0x1d
+#define DW_TAG_subprogram         0x2e
+
+#define DW_AT_name                0x03
+#define DW_AT_stmt_list           0x10
+#define DW_AT_low_pc              0x11
+#define DW_AT_high_pc             0x12
+#define DW_AT_abstract_origin     0x31
+#define DW_AT_specification       0x47
+#define DW_AT_ranges              0x55
+#define DW_AT_call_file           0x58
+#define DW_AT_call_line           0x59
+#define DW_AT_linkage_name        0x6e
+#define DW_AT_str_offsets_base    0x72
+#define DW_AT_addr_base           0x73
+#define DW_AT_rnglists_base       0x74
+#define DW_AT_MIPS_linkage_name   0x2007
+#define DW_AT_GNU_ranges_base     0x2132
+#define DW_AT_GNU_addr_base       0x2133
+
+#define DW_RLE_end_of_list        0x00
+#define DW_RLE_base_addressx      0x01
+#define DW_RLE_startx_endx        0x02
+#define DW_RLE_startx_length      0x03
+#define DW_RLE_offset_pair        0x04
+#define DW_RLE_base_address       0x05
+#define DW_RLE_start_end          0x06
+#define DW_RLE_start_length       0x07
+
+
+/**************************************************************************
+ *
+ * Line program header
+ *
+ **************************************************************************/
+
+struct LineFile
+{
+   const char *Name;
+   uint64_t Directory;
+};
+
+
+struct LineProgram
+{
+   unsigned Version;
+   bool Is64;
+   uint8_t MinInstLength;
+   uint8_t DefaultIsStmt;
+   int8_t LineBase;
+   uint8_t LineRange;
+   uint8_t OpcodeBase;
+   const uint8_t *OpcodeLengths;
+   std::vector<const char *> Directories;
+   std::vector<LineFile> Files;
+   const uint8_t *Program;
+   const uint8_t *ProgramEnd;
+};
+
+
+struct LineSections
+{
+   ElfSection Line;
+   ElfSection Str;
+   ElfSection LineStr;
+   bool HaveStr;
+   bool HaveLineStr;
+};
+
+
+static const char *
+SectionString(const ElfSection &Section, bool Present, uint64_t Offset)
+{
+   if (!Present || Offset >= Section.Size) {
+      return "";
+   }
+   const char *s = (const char *)Section.Data + Offset;
+   if (strnlen(s, Section.Size - Offset) == Section.Size - Offset) {
+      return "";
+   }
+   return s;
+}
+
+
+/*
+ * Read a DWARF 5 entry attribute, returning it as a string or as an
+ * unsigned integer depending on the form.
+ */
+static bool
+ReadEntryForm(DwarfReader &r, const LineSections &Sections, const LineProgram &Prog,
+              uint64_t Form, const char **String, uint64_t *Value)
+{
+   *String = NULL;
+   *Value = 0;
+
+   switch (Form) {
+   case DW_FORM_string:
+      *String = r.String();
+      return true;
+   case DW_FORM_strp:
+      *String = SectionString(Sections.Str, Sections.HaveStr, r.SectionOffset(Prog.Is64));
+      return true;
+   case DW_FORM_line_strp:
+      *String = SectionString(Sections.LineStr, Sections.HaveLineStr, r.SectionOffset(Prog.Is64));
+      return true;
+   case DW_FORM_data1:
+      *Value = r.U8();
+      return true;
+   case DW_FORM_data2:
+      *Value = r.U16();
+      return true;
+   case DW_FORM_data4:
+      *Value = r.U32();
+      return true;
+   case DW_FORM_data8:
+      *Value = r.U64();
+      return true;
+   case DW_FORM_udata:
+      *Value = r.ULEB128();
+      return true;
+   case DW_FORM_sdata:
+      *Value = r.SLEB128();
+      return true;
+   case DW_FORM_data16:
+      return r.Skip(16);
+   case DW_FORM_block:
+      return r.Skip(r.ULEB128());
+   case DW_FORM_block1:
+      return r.Skip(r.U8());
+   case DW_FORM_block2:
+      return r.Skip(r.U16());
+   case DW_FORM_block4:
+      return r.Skip(r.U32());
+   default:
+      return false;
+   }
+}
+
+
+static bool
+ReadEntries(DwarfReader &r, const LineSections &Sections, LineProgram &Prog, bool IsFile)
+{
+   uint8_t formatCount = r.U8();
+   uint64_t formats[32][2];
+
+   if (formatCount > 32) {
+      return false;
+   }
+
+   for (unsigned i = 0; i < formatCount; ++i) {
+      formats[i][0] = r.ULEB128();
+      formats[i][1] = r.ULEB128();
+   }
+
+   uint64_t count = r.ULEB128();
+   for (uint64_t n = 0; n < count && !r.Overflow; ++n) {
+      LineFile entry = {"", 0};
+
+      for (unsigned i = 0; i < formatCount; ++i) {
+         const char *s;
+         uint64_t v;
+         if (!ReadEntryForm(r, Sections, Prog, formats[i][1], &s, &v)) {
+            return false;
+         }
+         if (formats[i][0] == DW_LNCT_path && s) {
+            entry.Name = s;
+         } else if (formats[i][0] == DW_LNCT_directory_index) {
+            entry.Directory = v;
+         }
+      }
+
+      if (IsFile) {
+         Prog.Files.push_back(entry);
+      } else {
+         Prog.Directories.push_back(entry.Name);
+      }
+   }
+
+   return !r.Overflow;
+}
+
+
+/*
+ * Parse a line program header at the reader's position, leaving the reader
+ * at the start of the next unit.
+ */
+static bool
+ParseLineProgram(DwarfReader &r, const LineSections &Sections, LineProgram &Prog)
+{
+   uint64_t length = r.InitialLength(&Prog.Is64);
+   if (r.Overflow || length > r.Remaining()) {
+      r.Ptr = r.End;
+      return false;
+   }
+
+   const uint8_t *unitEnd = r.Ptr + length;
+   DwarfReader u(r.Ptr, length);
+   u.Start = r.Start;
+   r.Ptr = unitEnd;
+
+   Prog.Version = u.U16();
+   if (Prog.Version < 2 || Prog.Version > 5) {
+      return false;
+   }
+
+   if (Prog.Version >= 5) {
+      u.U8();     /* address_size */
+      u.U8();     /* segment_selector_size */
+   }
+
+   uint64_t headerLength = u.SectionOffset(Prog.Is64);
+   if (headerLength > u.Remaining()) {
+      return false;
+   }
+   Prog.Program = u.Ptr + headerLength;
+   Prog.ProgramEnd = unitEnd;
+
+   Prog.MinInstLength = u.U8();
+   if (Prog.Version >= 4) {
+      u.U8();     /* maximum_operations_per_instruction */
+   }
+   Prog.DefaultIsStmt = u.U8();
+   Prog.LineBase = (int8_t)u.U8();
+   Prog.LineRange = u.U8();
+   Prog.OpcodeBase = u.U8();
+   Prog.OpcodeLengths = u.Ptr;
+   if (Prog.OpcodeBase == 0 || Prog.LineRange == 0) {
+      return false;
+   }
+   u.Skip(Prog.OpcodeBase - 1);
+
+   Prog.Directories.clear();
+   Prog.Files.clear();
+
+   if (Prog.Version >= 5) {
+      if (!ReadEntries(u, Sections, Prog, false) ||
+          !ReadEntries(u, Sections, Prog, true)) {
+         return false;
+      }
+   } else {
+      /* Index zero is the compilation directory, which is not recorded here. */
+      Prog.Directories.push_back("");
+      for (;;) {
+         const char *dir = u.String();
+         if (u.Overflow || !*dir) {
+            break;
+         }
+         Prog.Directories.push_back(dir);
+      }
+
+      /* File indices are one based. */
+      LineFile none = {"", 0};
+      Prog.Files.push_back(none);
+      for (;;) {
+         LineFile file;
+         file.Name = u.String();
+         if (u.Overflow || !*file.Name) {
+            break;
+         }
+         file.Directory = u.ULEB128();
+         u.ULEB128();   /* modification time */
+         u.ULEB128();   /* file length */
+         Prog.Files.push_back(file);
+      }
+   }
+
+   return !u.Overflow && Prog.Program <= Prog.ProgramEnd;
+}
+
+
+static std::string
+LineFileName(const LineProgram &Prog, uint64_t Index)
+{
+   if (Index >= Prog.Files.size()) {
+      return "";
+   }
+
+   const LineFile &file = Prog.Files[Index];
+   std::string name = file.Name;
+
+   if (name.empty() || name[0] == '/') {
+      return name;
+   }
+
+   if (file.Directory < Prog.Directories.size() && *Prog.Directories[file.Directory]) {
+      std::string dir = Prog.Directories[file.Directory];
+      if (dir[dir.size() - 1] != '/') {
+         dir += '/';
+      }
+      return dir + name;
+   }
+
+   return name;
+}
+
+
+/**************************************************************************
+ *
+ * Line program execution
+ *
+ **************************************************************************/
+
+struct LineRow
+{
+   uint64_t Address;
+   uint64_t File;
+   unsigned Line;
+   bool EndSequence;
+};
+
+
+/*
+ * Execute a line number program, invoking the callback for every row of the
+ * line table.  The callback returns false to stop early.
+ */
+template <class Callback>
+static void
+RunLineProgram(const LineProgram &Prog, Callback &cb)
+{
+   DwarfReader r(Prog.Program, Prog.ProgramEnd - Prog.Program);
+   LineRow row;
+
+   row.Address = 0;
+   row.File = 1;
+   row.Line = 1;
+   row.EndSequence = false;
+
+   while (!r.AtEnd() && !r.Overflow) {
+      uint8_t opcode = r.U8();
+
+      if (opcode >= Prog.OpcodeBase) {
+         unsigned adjusted = opcode - Prog.OpcodeBase;
+         row.Address += (adjusted / Prog.LineRange) * Prog.MinInstLength;
+         row.Line += Prog.LineBase + (int)(adjusted % Prog.LineRange);
+         if (!cb(row)) {
+            return;
+         }
+         continue;
+      }
+
+      switch (opcode) {
+      case 0: {
+         uint64_t length = r.ULEB128();
+         if (length == 0 || length > r.Remaining()) {
+            return;
+         }
+         const uint8_t *next = r.Ptr + length;
+         uint8_t sub = r.U8();
+         switch (sub) {
+         case DW_LNE_end_sequence:
+            row.EndSequence = true;
+            if (!cb(row)) {
+               return;
+            }
+            row.Address = 0;
+            row.File = 1;
+            row.Line = 1;
+            row.EndSequence = false;
+            break;
+         case DW_LNE_set_address:
+            if (length == 9) {
+               row.Address = r.U64();
+            } else if (length == 5) {
+               row.Address = r.U32();
+            }
+            break;
+         default:
+            break;
+         }
+         r.Ptr = next;
+         break;
+      }
+      case DW_LNS_copy:
+         if (!cb(row)) {
+            return;
+         }
+         break;
+      case DW_LNS_advance_pc:
+         row.Address += r.ULEB128() * Prog.MinInstLength;
+         break;
+      case DW_LNS_advance_line:
+         row.Line += (int)r.SLEB128();
+         break;
+      case DW_LNS_set_file:
+         row.File = r.ULEB128();
+         break;
+      case DW_LNS_const_add_pc:
+         row.Address += ((255 - Prog.OpcodeBase) / Prog.LineRange) * Prog.MinInstLength;
+         break;
+      case DW_LNS_fixed_advance_pc:
+         row.Address += r.U16();
+         break;
+      default:
+         /* Skip unknown standard opcodes, as described by the header. */
+         for (unsigned i = 0; i < Prog.OpcodeLengths[opcode - 1]; ++i) {
+            r.ULEB128();
+         }
+         break;
+      }
+   }
+}
+
+
+struct LineLookup
+{
+   uint64_t Address;
+   LineRow Prev;
+   bool HavePrev;
+   bool Found;
+   LineRow Match;
+
+   bool
+   operator () (const LineRow &row)
+   {
+      if (HavePrev && Prev.Address <= Address && Address < row.Address) {
+         Match = Prev;
+         Found = true;
+         return false;
+      }
+      Prev = row;
+      HavePrev = !row.EndSequence;
+      return true;
+   }
+};
+
+
+static void
+GetLineSections(const ElfImage *Image, LineSections &Sections)
+{
+   Sections.HaveStr = Image->FindSection(".debug_str", &Sections.Str);
+   Sections.HaveLineStr = Image->FindSection(".debug_line_str", &Sections.LineStr);
+}
+
+
+/*
+ * Collects the rows of one unit, a sequence at a time.
+ */
+struct LineCollector
+{
+   const LineProgram *Prog;
+   DwarfLineTable *Table;
+   std::map<std::string, uint32_t> *FileIndex;
+   std::map<uint64_t, uint32_t> UnitFiles;
+   std::vector<DwarfLine> Sequence;
+
+   uint32_t
+   FileId(uint64_t File)
+   {
+      std::map<uint64_t, uint32_t>::iterator it = UnitFiles.find(File);
+      if (it != UnitFiles.end()) {
+         return it->second;
+      }
+
+      std::string name = LineFileName(*Prog, File);
+      std::map<std::string, uint32_t>::iterator jt = FileIndex->find(name);
+      uint32_t id;
+      if (jt != FileIndex->end()) {
+         id = jt->second;
+      } else {
+         id = (uint32_t)Table->Files.size();
+         Table->Files.push_back(name);
+         (*FileIndex)[name] = id;
+      }
+      UnitFiles[File] = id;
+      return id;
+   }
+
+   bool
+   operator () (const LineRow &row)
+   {
+      DwarfLine line;
+      line.Address = row.Address;
+      line.File = row.EndSequence ? DWARF_LINE_END : FileId(row.File);
+      line.Line = row.Line;
+
+      /* Rows right at the end of a sequence cover nothing. */
+      while (row.EndSequence && !Sequence.empty() &&
+             Sequence.back().Address >= row.Address) {
+         Sequence.pop_back();
+      }
+      Sequence.push_back(line);
+
+      if (row.EndSequence) {
+         /* Sequences of discarded functions are relocated to address 0. */
+         if (Sequence.front().Address != 0) {
+            Table->Lines.insert(Table->Lines.end(), Sequence.begin(), Sequence.end());
+         }
+         Sequence.clear();
+      }
+      return true;
+   }
+};
+
+
+static bool
+CompareLines(const DwarfLine &a, const DwarfLine &b)
+{
+   if (a.Address != b.Address) {
+      return a.Address < b.Address;
+   }
+   /* A sequence may start right where another one ends. */
+   return a.File == DWARF_LINE_END && b.File != DWARF_LINE_END;
+}
+
+
+bool
+DwarfReadLineTable(const ElfImage *Image, DwarfLineTable &Table)
+{
+   LineSections sections;
+   std::map<std::string, uint32_t> fileIndex;
+
+   Table.Files.clear();
+   Table.Lines.clear();
+
+   if (!Image->FindSection(".debug_line", &sections.Line)) {
+      return false;
+   }
+   GetLineSections(Image, sections);
+
+   DwarfReader r(sections.Line.Data, sections.Line.Size);
+   while (!r.AtEnd()) {
+      LineProgram prog;
+      if (!ParseLineProgram(r, sections, prog)) {
+         continue;
+      }
+
+      LineCollector collector;
+      collector.Prog = &prog;
+      collector.Table = &Table;
+      collector.FileIndex = &fileIndex;
+      RunLineProgram(prog, collector);
+   }
+
+   std::stable_sort(Table.Lines.begin(), Table.Lines.end(), CompareLines);
+   return true;
+}
+
+
+/**************************************************************************
+ *
+ * Debugging information entries
+ *
+ **************************************************************************/
+
+/*
+ * Only as much of .debug_info is decoded as is needed to recover the
+ * address ranges of inlined subroutines, their names and call sites.
+ */
+
+struct InfoSections
+{
+   ElfSection Info;
+   ElfSection Abbrev;
+   ElfSection Str;
+   ElfSection LineStr;
+   ElfSection StrOffsets;
+   ElfSection Addr;
+   ElfSection Ranges;
+   ElfSection RngLists;
+   LineSections Line;
+   bool HaveLine;
+};
+
+
+struct AbbrevAttr
+{
+   uint64_t Name;
+   uint64_t Form;
+   int64_t Implicit;
+};
+
+
+struct Abbrev
+{
+   uint64_t Tag;
+   bool Children;
+   std::vector<AbbrevAttr> Attrs;
+};
+
+
+/* Abbreviations indexed by code, which compilers assign densely. */
+typedef std::vector<Abbrev> AbbrevTable;
+
+
+struct InfoUnit
+{
+   uint64_t Offset;           /* of the unit header */
+   uint64_t End;
+   uint64_t DiesOffset;
+   unsigned Version;
+   uint8_t AddrSize;
+   bool Is64;
+   const AbbrevTable *Abbrevs;
+   uint64_t StrOffsetsBase;
+   uint64_t AddrBase;
+   uint64_t RngListsBase;
+   uint64_t RangesBase;       /* DW_AT_GNU_ranges_base */
+   uint64_t LowPc;
+   uint64_t StmtList;
+   bool HaveStmtList;
+};
+
+
+struct AttrValue
+{
+   uint64_t Form;
+   uint64_t U;
+   const char *S;
+};
+
+
+static bool
+ParseAbbrevTable(const ElfSection &Section, uint64_t Offset, AbbrevTable &Table)
+{
+   if (Offset >= Section.Size) {
+      return false;
+   }
+
+   DwarfReader r(Section.Data + Offset, Section.Size - Offset);
+   for (;;) {
+      uint64_t code = r.ULEB128();
+      if (code == 0 || r.Overflow) {
+         break;
+      }
+      if (code > 0xffff) {
+         return false;
+      }
+      if (code >= Table.size()) {
+         Table.resize(code + 1);
+      }
+
+      Abbrev &abbrev = Table[code];
+      abbrev.Tag = r.ULEB128();
+      abbrev.Children = r.U8() != 0;
+      for (;;) {
+         AbbrevAttr attr;
+         attr.Name = r.ULEB128();
+         attr.Form = r.ULEB128();
+         attr.Implicit = attr.Form == DW_FORM_implicit_const ? r.SLEB128() : 0;
+         if ((attr.Name == 0 && attr.Form == 0) || r.Overflow) {
+            break;
+         }
+         abbrev.Attrs.push_back(attr);
+      }
+   }
+
+   return !r.Overflow;
+}
+
+
+static bool
+ReadAttr(DwarfReader &r, const InfoUnit &Unit, uint64_t Form, int64_t Implicit,
+         AttrValue &Value)
+{
+   Value.Form = Form;
+   Value.U = 0;
+   Value.S = NULL;
+
+   switch (Form) {
+   case DW_FORM_addr:
+      Value.U = Unit.AddrSize == 8 ? r.U64() : r.U32();
+      break;
+   case DW_FORM_data1:
+   case DW_FORM_ref1:
+   case DW_FORM_flag:
+   case DW_FORM_strx1:
+   case DW_FORM_addrx1:
+      Value.U = r.U8();
+      break;
+   case DW_FORM_data2:
+   case DW_FORM_ref2:
+   case DW_FORM_strx2:
+   case DW_FORM_addrx2:
+      Value.U = r.U16();
+      break;
+   case DW_FORM_strx3:
+   case DW_FORM_addrx3:
+      Value.U = r.U16();
+      Value.U |= (uint64_t)r.U8() << 16;
+      break;
+   case DW_FORM_data4:
+   case DW_FORM_ref4:
+   case DW_FORM_ref_sup4:
+   case DW_FORM_strx4:
+   case DW_FORM_addrx4:
+      Value.U = r.U32();
+      break;
+   case DW_FORM_data8:
+   case DW_FORM_ref8:
+   case DW_FORM_ref_sig8:
+   case DW_FORM_ref_sup8:
+      Value.U = r.U64();
+      break;
+   case DW_FORM_data16:
+      r.Skip(16);
+      break;
+   case DW_FORM_sdata:
+      Value.U = (uint64_t)r.SLEB128();
+      break;
+   case DW_FORM_udata:
+   case DW_FORM_ref_udata:
+   case DW_FORM_strx:
+   case DW_FORM_addrx:
+   case DW_FORM_loclistx:
+   case DW_FORM_rnglistx:
+   case DW_FORM_GNU_addr_index:
+   case DW_FORM_GNU_str_index:
+      Value.U = r.ULEB128();
+      break;
+   case DW_FORM_string:
+      Value.S = r.String();
+      break;
+   case DW_FORM_strp:
+   case DW_FORM_line_strp:
+   case DW_FORM_sec_offset:
+   case DW_FORM_strp_sup:
+   case DW_FORM_GNU_ref_alt:
+   case DW_FORM_GNU_strp_alt:
+      Value.U = r.SectionOffset(Unit.Is64);
+      break;
+   case DW_FORM_ref_addr:
+      if (Unit.Version <= 2) {
+         Value.U = Unit.AddrSize == 8 ? r.U64() : r.U32();
+      } else {
+         Value.U = r.SectionOffset(Unit.Is64);
+      }
+      break;
+   case DW_FORM_flag_present:
+      Value.U = 1;
+      break;
+   case DW_FORM_implicit_const:
+      Value.U = (uint64_t)Implicit;
+      break;
+   case DW_FORM_block1:
+      r.Skip(r.U8());
+      break;
+   case DW_FORM_block2:
+      r.Skip(r.U16());
+      break;
+   case DW_FORM_block4:
+      r.Skip(r.U32());
+      break;
+   case DW_FORM_block:
+   case DW_FORM_exprloc:
+      r.Skip(r.ULEB128());
+      break;
+   case DW_FORM_indirect:
+      return ReadAttr(r, Unit, r.ULEB128(), Implicit, Value);
+   default:
+      return false;
+   }
+
+   return !r.Overflow;
+}
+
+
+static uint64_t
+ReadSized(const ElfSection &Section, uint64_t Offset, unsigned Size)
+{
+   if (Offset >= Section.Size || Size > Section.Size - Offset) {
+      return 0;
+   }
+   uint64_t value = 0;
+   memcpy(&value, Section.Data + Offset, Size);
+   return value;
+}
+
+
+static const char *
+AttrString(const InfoSections &Sections, const InfoUnit &Unit, const AttrValue &Value)
+{
+   unsigned size = Unit.Is64 ? 8 : 4;
+
+   switch (Value.Form) {
+   case DW_FORM_string:
+      return Value.S;
+   case DW_FORM_strp:
+      return SectionString(Sections.Str, Sections.Str.Data != NULL, Value.U);
+   case DW_FORM_line_strp:
+      return SectionString(Sections.LineStr, Sections.LineStr.Data != NULL, Value.U);
+   case DW_FORM_strx:
+   case DW_FORM_strx1:
+   case DW_FORM_strx2:
+   case DW_FORM_strx3:
+   case DW_FORM_strx4:
+   case DW_FORM_GNU_str_index:
+      return SectionString(Sections.Str, Sections.Str.Data != NULL,
+                           ReadSized(Sections.StrOffsets, Unit.StrOffsetsBase + Value.U*size, size));
+   default:
+      return "";
+   }
+}
+
+
+static uint64_t
+AttrAddress(const InfoSections &Sections, const InfoUnit &Unit, const AttrValue &Value)
+{
+   switch (Value.Form) {
+   case DW_FORM_addrx:
+   case DW_FORM_addrx1:
+   case DW_FORM_addrx2:
+   case DW_FORM_addrx3:
+   case DW_FORM_addrx4:
+   case DW_FORM_GNU_addr_index:
+      return ReadSized(Sections.Addr, Unit.AddrBase + Value.U*Unit.AddrSize, Unit.AddrSize);
+   default:
+      return Value.U;
+   }
+}
+
+
+static bool
+IsConstantForm(uint64_t Form)
+{
+   return Form == DW_FORM_data1 || Form == DW_FORM_data2 ||
+          Form == DW_FORM_data4 || Form == DW_FORM_data8 ||
+          Form == DW_FORM_udata || Form == DW_FORM_sdata ||
+          Form == DW_FORM_implicit_const;
+}
+
+
+/*
+ * Decode a DW_AT_ranges list into [Low, High) pairs.
+ */
+static void
+ReadRanges(const InfoSections &Sections, const InfoUnit &Unit, const AttrValue &Value,
+           std::vector<std::pair<uint64_t, uint64_t> > &Ranges)
+{
+   uint64_t base = Unit.LowPc;
+
+   if (Unit.Version < 5) {
+      uint64_t offset = Value.U + Unit.RangesBase;
+      if (offset >= Sections.Ranges.Size) {
+         return;
+      }
+      DwarfReader r(Sections.Ranges.Data + offset, Sections.Ranges.Size - offset);
+      uint64_t selector = Unit.AddrSize == 8 ? ~(uint64_t)0 : 0xffffffff;
+      while (!r.AtEnd() && !r.Overflow) {
+         uint64_t begin = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         uint64_t end = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         if (begin == 0 && end == 0) {
+            break;
+         }
+         if (begin == selector) {
+            base = end;
+         } else if (begin < end) {
+            Ranges.push_back(std::make_pair(base + begin, base + end));
+         }
+      }
+      return;
+   }
+
+   uint64_t offset = Value.U;
+   if (Value.Form == DW_FORM_rnglistx) {
+      unsigned size = Unit.Is64 ? 8 : 4;
+      offset = Unit.RngListsBase + ReadSized(Sections.RngLists, Unit.RngListsBase + Value.U*size, size);
+   }
+   if (offset >= Sections.RngLists.Size) {
+      return;
+   }
+
+   DwarfReader r(Sections.RngLists.Data + offset, Sections.RngLists.Size - offset);
+   while (!r.AtEnd() && !r.Overflow) {
+      uint8_t kind = r.U8();
+      uint64_t begin, end;
+      AttrValue index;
+      index.Form = DW_FORM_addrx;
+
+      switch (kind) {
+      case DW_RLE_end_of_list:
+         return;
+      case DW_RLE_base_addressx:
+         index.U = r.ULEB128();
+         base = AttrAddress(Sections, Unit, index);
+         continue;
+      case DW_RLE_startx_endx:
+         index.U = r.ULEB128();
+         begin = AttrAddress(Sections, Unit, index);
+         index.U = r.ULEB128();
+         end = AttrAddress(Sections, Unit, index);
+         break;
+      case DW_RLE_startx_length:
+         index.U = r.ULEB128();
+         begin = AttrAddress(Sections, Unit, index);
+         end = begin + r.ULEB128();
+         break;
+      case DW_RLE_offset_pair:
+         begin = base + r.ULEB128();
+         end = base + r.ULEB128();
+         break;
+      case DW_RLE_base_address:
+         base = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         continue;
+      case DW_RLE_start_end:
+         begin = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         end = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         break;
+      case DW_RLE_start_length:
+         begin = Unit.AddrSize == 8 ? r.U64() : r.U32();
+         end = begin + r.ULEB128();
+         break;
+      default:
+         return;
+      }
+
+      if (begin < end) {
+         Ranges.push_back(std::make_pair(begin, end));
+      }
+   }
+}
+
+
+struct InlineRange
+{
+   uint64_t Low;
+   uint64_t High;
+   uint32_t Inline;
+   uint32_t Depth;
+};
+
+
+static bool
+CompareInlineRanges(const InlineRange &a, const InlineRange &b)
+{
+   if (a.Low != b.Low) {
+      return a.Low < b.Low;
+   }
+   /* Outer ranges first. */
+   return a.Depth < b.Depth;
+}
+
+
+static uint32_t
+InternString(std::vector<std::string> &Strings, std::map<std::string, uint32_t> &Index,
+             const std::string &String)
+{
+   std::map<std::string, uint32_t>::iterator it = Index.find(String);
+   if (it != Index.end()) {
+      return it->second;
+   }
+   uint32_t id = (uint32_t)Strings.size();
+   Strings.push_back(String);
+   Index[String] = id;
+   return id;
+}
+
+
+class InfoParser
+{
+public:
+   InfoParser(const InfoSections &Sections, DwarfLineTable &Table) :
+      m_Sections(Sections),
+      m_Table(Table)
+   {
+      for (size_t i = 0; i < Table.Files.size(); ++i) {
+         m_FileIndex[Table.Files[i]] = (uint32_t)i;
+      }
+   }
+
+   void
+   Parse(void);
+
+private:
+   const InfoUnit *
+   FindUnit(uint64_t Offset) const;
+
+   bool
+   ReadUnits(void);
+
+   void
+   ReadUnit(const InfoUnit &Unit);
+
+   uint32_t
+   InlineName(uint64_t Offset);
+
+   uint32_t
+   CallFile(const InfoUnit &Unit, uint64_t File);
+
+   void
+   BuildRanges(void);
+
+   const InfoSections &m_Sections;
+   DwarfLineTable &m_Table;
+
+   std::map<uint64_t, AbbrevTable> m_Abbrevs;
+   std::vector<InfoUnit> m_Units;
+
+   std::map<std::string, uint32_t> m_FileIndex;
+   std::map<std::string, uint32_t> m_NameIndex;
+   std::map<uint64_t, uint32_t> m_OriginNames;
+
+   /* Line program of the unit being read, for DW_AT_call_file. */
+   LineProgram m_Prog;
+   bool m_ProgRead;
+   bool m_HaveProg;
+   std::map<uint64_t, uint32_t> m_UnitFiles;
+
+   std::vector<InlineRange> m_Ranges;
+};
+
+
+const InfoUnit *
+InfoParser::FindUnit(uint64_t Offset) const
+{
+   size_t lo = 0;
+   size_t hi = m_Units.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (m_Units[mid].Offset <= Offset) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo == 0 || Offset >= m_Units[lo - 1].End) {
+      return NULL;
+   }
+   return &m_Units[lo - 1];
+}
+
+
+/*
+ * Read all unit headers, together with the attributes of the unit entry
+ * which other entries depend on.
+ */
+bool
+InfoParser::ReadUnits(void)
+{
+   DwarfReader r(m_Sections.Info.Data, m_Sections.Info.Size);
+
+   while (!r.AtEnd()) {
+      InfoUnit unit;
+      unit.Offset = r.Offset();
+
+      uint64_t length = r.InitialLength(&unit.Is64);
+      if (r.Overflow || length > r.Remaining()) {
+         break;
+      }
+      unit.End = r.Offset() + length;
+
+      DwarfReader u(r.Ptr, length);
+      u.Start = r.Start;
+      r.Ptr += length;
+
+      uint64_t abbrevOffset;
+      unit.Version = u.U16();
+      if (unit.Version >= 5) {
+         uint8_t type = u.U8();
+         unit.AddrSize = u.U8();
+         abbrevOffset = u.SectionOffset(unit.Is64);
+         if (type == DW_UT_skeleton || type == DW_UT_split_compile) {
+            u.U64();
+         } else if (type == DW_UT_type || type == DW_UT_split_type) {
+            u.U64();
+            u.SectionOffset(unit.Is64);
+         }
+      } else {
+         abbrevOffset = u.SectionOffset(unit.Is64);
+         unit.AddrSize = u.U8();
+      }
+      if (u.Overflow || unit.Version < 2 || unit.Version > 5 ||
+          (unit.AddrSize != 4 && unit.AddrSize != 8)) {
+         continue;
+      }
+      unit.DiesOffset = u.Offset() - unit.Offset;
+
+      std::map<uint64_t, AbbrevTable>::iterator it = m_Abbrevs.find(abbrevOffset);
+      if (it == m_Abbrevs.end()) {
+         it = m_Abbrevs.insert(std::make_pair(abbrevOffset, AbbrevTable())).first;
+         ParseAbbrevTable(m_Sections.Abbrev, abbrevOffset, it->second);
+      }
+      unit.Abbrevs = &it->second;
+
+      unit.StrOffsetsBase = unit.Version >= 5 ? (unit.Is64 ? 16 : 8) : 0;
+      unit.AddrBase = 0;
+      unit.RngListsBase = 0;
+      unit.RangesBase = 0;
+      unit.LowPc = 0;
+      unit.StmtList = 0;
+      unit.HaveStmtList = false;
+
+      uint64_t code = u.ULEB128();
+      if (code == 0 || code >= unit.Abbrevs->size()) {
+         m_Units.push_back(unit);
+         continue;
+      }
+
+      const Abbrev &abbrev = (*unit.Abbrevs)[code];
+      AttrValue lowPc;
+      lowPc.Form = 0;
+      for (size_t i = 0; i < abbrev.Attrs.size(); ++i) {
+         AttrValue value;
+         if (!ReadAttr(u, unit, abbrev.Attrs[i].Form, abbrev.Attrs[i].Implicit, value)) {
+            break;
+         }
+         switch (abbrev.Attrs[i].Name) {
+         case DW_AT_low_pc:
+            lowPc = value;
+            break;
+         case DW_AT_stmt_list:
+            unit.StmtList = value.U;
+            unit.HaveStmtList = true;
+            break;
+         case DW_AT_str_offsets_base:
+            unit.StrOffsetsBase = value.U;
+            break;
+         case DW_AT_addr_base:
+         case DW_AT_GNU_addr_base:
+            unit.AddrBase = value.U;
+            break;
+         case DW_AT_rnglists_base:
+            unit.RngListsBase = value.U;
+            break;
+         case DW_AT_GNU_ranges_base:
+            unit.RangesBase = value.U;
+            break;
+         }
+      }
+      if (lowPc.Form) {
+         unit.LowPc = AttrAddress(m_Sections, unit, lowPc);
+      }
+
+      m_Units.push_back(unit);
+   }
+
+   return !m_Units.empty();
+}
+
+
+/*
+ * Name of the subprogram an inlined subroutine (or concrete instance)
+ * refers to, following DW_AT_abstract_origin and DW_AT_specification.
+ * Linkage names are preferred, as symbol names are mangled too.
+ */
+uint32_t
+InfoParser::InlineName(uint64_t Offset)
+{
+   std::map<uint64_t, uint32_t>::iterator it = m_OriginNames.find(Offset);
+   if (it != m_OriginNames.end()) {
+      return it->second;
+   }
+
+   const char *name = "";
+   uint64_t offset = Offset;
+   for (unsigned hops = 0; hops < 8; ++hops) {
+      const InfoUnit *unit = FindUnit(offset);
+      if (!unit || offset < unit->Offset + unit->DiesOffset) {
+         break;
+      }
+
+      DwarfReader r(m_Sections.Info.Data + offset, unit->End - offset);
+      uint64_t code = r.ULEB128();
+      if (code == 0 || code >= unit->Abbrevs->size()) {
+         break;
+      }
+
+      const Abbrev &abbrev = (*unit->Abbrevs)[code];
+      const char *linkageName = NULL;
+      uint64_t next = 0;
+      for (size_t i = 0; i < abbrev.Attrs.size(); ++i) {
+         AttrValue value;
+         if (!ReadAttr(r, *unit, abbrev.Attrs[i].Form, abbrev.Attrs[i].Implicit, value)) {
+            break;
+         }
+         switch (abbrev.Attrs[i].Name) {
+         case DW_AT_name:
+            name = AttrString(m_Sections, *unit, value);
+            break;
+         case DW_AT_linkage_name:
+         case DW_AT_MIPS_linkage_name:
+            linkageName = AttrString(m_Sections, *unit, value);
+            break;
+         case DW_AT_abstract_origin:
+         case DW_AT_specification:
+            if (value.Form == DW_FORM_ref_addr) {
+               next = value.U;
+            } else if (value.Form != DW_FORM_GNU_ref_alt && value.Form != DW_FORM_ref_sig8) {
+               next = unit->Offset + value.U;
+            }
+            break;
+         }
+      }
+
+      if (linkageName && *linkageName) {
+         name = linkageName;
+         break;
+      }
+      if (*name || !next) {
+         break;
+      }
+      offset = next;
+   }
+
+   uint32_t id = InternString(m_Table.Names, m_NameIndex, name);
+   m_OriginNames[Offset] = id;
+   return id;
+}
+
+
+uint32_t
+InfoParser::CallFile(const InfoUnit &Unit, uint64_t File)
+{
+   std::map<uint64_t, uint32_t>::iterator it = m_UnitFiles.find(File);
+   if (it != m_UnitFiles.end()) {
+      return it->second;
+   }
+
+   if (!m_ProgRead) {
+      m_ProgRead = true;
+      if (Unit.HaveStmtList && m_Sections.HaveLine && Unit.StmtList < m_Sections.Line.Line.Size) {
+         DwarfReader r(m_Sections.Line.Line.Data, m_Sections.Line.Line.Size);
+         r.Ptr += Unit.StmtList;
+         m_HaveProg = ParseLineProgram(r, m_Sections.Line, m_Prog);
+      }
+   }
+
+   std::string name = m_HaveProg ? LineFileName(m_Prog, File) : std::string();
+   uint32_t id = InternString(m_Table.Files, m_FileIndex, name);
+   m_UnitFiles[File] = id;
+   return id;
+}
+
+
+void
+InfoParser::ReadUnit(const InfoUnit &Unit)
+{
+   /* Innermost inline record of each open entry. */
+   std::vector<uint32_t> stack;
+   std::vector<std::pair<uint64_t, uint64_t> > ranges;
+
+   m_ProgRead = false;
+   m_HaveProg = false;
+   m_UnitFiles.clear();
+
+   DwarfReader r(m_Sections.Info.Data + Unit.Offset, Unit.End - Unit.Offset);
+   r.Ptr += Unit.DiesOffset;
+
+   while (!r.AtEnd() && !r.Overflow) {
+      uint64_t code = r.ULEB128();
+      if (code == 0) {
+         if (stack.empty()) {
+            break;
+         }
+         stack.pop_back();
+         continue;
+      }
+      if (code >= Unit.Abbrevs->size()) {
+         return;
+      }
+
+      const Abbrev &abbrev = (*Unit.Abbrevs)[code];
+      bool isInline = abbrev.Tag == DW_TAG_inlined_subroutine;
+      uint32_t parent = stack.empty() ? DWARF_INLINE_NONE : stack.back();
+
+      AttrValue lowPc, highPc;
+      uint64_t origin = 0;
+      uint64_t callFile = 0;
+      uint64_t callLine = 0;
+      lowPc.Form = 0;
+      highPc.Form = 0;
+      ranges.clear();
+
+      for (size_t i = 0; i < abbrev.Attrs.size(); ++i) {
+         AttrValue value;
+         if (!ReadAttr(r, Unit, abbrev.Attrs[i].Form, abbrev.Attrs[i].Implicit, value)) {
+            return;
+         }
+         if (!isInline) {
+            continue;
+         }
+         switch (abbrev.Attrs[i].Name) {
+         case DW_AT_low_pc:
+            lowPc = value;
+            break;
+         case DW_AT_high_pc:
+            highPc = value;
+            break;
+         case DW_AT_ranges:
+            ReadRanges(m_Sections, Unit, value, ranges);
+            break;
+         case DW_AT_abstract_origin:
+            if (value.Form == DW_FORM_ref_addr) {
+               origin = value.U;
+            } else if (value.Form != DW_FORM_GNU_ref_alt && value.Form != DW_FORM_ref_sig8) {
+               origin = Unit.Offset + value.U;
+            }
+            break;
+         case DW_AT_call_file:
+            callFile = value.U;
+            break;
+         case DW_AT_call_line:
+            callLine = value.U;
+            break;
+         }
+      }
+
+      uint32_t record = parent;
+      if (isInline) {
+         if (lowPc.Form && highPc.Form) {
+            uint64_t low = AttrAddress(m_Sections, Unit, lowPc);
+            uint64_t high = IsConstantForm(highPc.Form) ? low + highPc.U
+                                                        : AttrAddress(m_Sections, Unit, highPc);
+            if (low < high) {
+               ranges.push_back(std::make_pair(low, high));
+            }
+         }
+
+         /* Out-of-line abstract instances have no code of their own. */
+         if (!ranges.empty()) {
+            DwarfInline inl;
+            inl.Parent = parent;
+            inl.Name = origin ? InlineName(origin) : InternString(m_Table.Names, m_NameIndex, "");
+            inl.CallFile = CallFile(Unit, callFile);
+            inl.CallLine = (uint32_t)callLine;
+            record = (uint32_t)m_Table.Inlines.size();
+            m_Table.Inlines.push_back(inl);
+
+            uint32_t depth = 0;
+            for (uint32_t p = parent; p != DWARF_INLINE_NONE; p = m_Table.Inlines[p].Parent) {
+               ++depth;
+            }
+            for (size_t i = 0; i < ranges.size(); ++i) {
+               InlineRange range;
+               range.Low = ranges[i].first;
+               range.High = ranges[i].second;
+               range.Inline = record;
+               range.Depth = depth;
+               m_Ranges.push_back(range);
+            }
+         }
+      }
+
+      if (abbrev.Children) {
+         /* Inlines within a subprogram are relative to it alone. */
+         stack.push_back(abbrev.Tag == DW_TAG_subprogram ? DWARF_INLINE_NONE : record);
+      }
+   }
+}
+
+
+/*
+ * Flatten the nested ranges into a partition of the address space, each
+ * part tagged with the innermost inline covering it.
+ */
+void
+InfoParser::BuildRanges(void)
+{
+   std::vector<DwarfInlineRange> &out = m_Table.InlineRanges;
+   std::vector<InlineRange> open;
+
+   std::sort(m_Ranges.begin(), m_Ranges.end(), CompareInlineRanges);
+
+   struct Emitter {
+      std::vector<DwarfInlineRange> &Out;
+
+      void
+      operator () (uint64_t Address, uint32_t Inline)
+      {
+         if (!Out.empty() && Out.back().Address == Address) {
+            Out.back().Inline = Inline;
+            if (Out.size() > 1 && Out[Out.size() - 2].Inline == Inline) {
+               Out.pop_back();
+            }
+            return;
+         }
+         if (!Out.empty() && Out.back().Inline == Inline) {
+            return;
+         }
+         DwarfInlineRange range;
+         range.Address = Address;
+         range.Inline = Inline;
+         range.Reserved = 0;
+         Out.push_back(range);
+      }
+   } emit = {out};
+
+   for (size_t i = 0; i <= m_Ranges.size(); ++i) {
+      uint64_t low = i < m_Ranges.size() ? m_Ranges[i].Low : ~(uint64_t)0;
+
+      while (!open.empty() && open.back().High <= low) {
+         uint64_t high = open.back().High;
+         open.pop_back();
+         emit(high, open.empty() ? DWARF_INLINE_NONE : open.back().Inline);
+      }
+
+      if (i == m_Ranges.size()) {
+         break;
+      }
+
+      InlineRange range = m_Ranges[i];
+      if (!open.empty() && range.High > open.back().High) {
+         /* Not properly nested; clip to the enclosing range. */
+         range.High = open.back().High;
+      }
+      if (range.Low < range.High) {
+         emit(range.Low, range.Inline);
+         open.push_back(range);
+      }
+   }
+
+   std::vector<InlineRange>().swap(m_Ranges);
+}
+
+
+void
+InfoParser::Parse(void)
+{
+   if (!ReadUnits()) {
+      return;
+   }
+
+   for (size_t i = 0; i < m_Units.size(); ++i) {
+      ReadUnit(m_Units[i]);
+   }
+
+   BuildRanges();
+}
+
+
+bool
+DwarfReadInlines(const ElfImage *Image, DwarfLineTable &Table)
+{
+   InfoSections sections;
+   memset(&sections, 0, sizeof sections);
+
+   Table.Names.clear();
+   Table.Inlines.clear();
+   Table.InlineRanges.clear();
+
+   if (!Image->FindSection(".debug_info", &sections.Info) ||
+       !Image->FindSection(".debug_abbrev", &sections.Abbrev)) {
+      return false;
+   }
+   Image->FindSection(".debug_str", &sections.Str);
+   Image->FindSection(".debug_line_str", &sections.LineStr);
+   Image->FindSection(".debug_str_offsets", &sections.StrOffsets);
+   Image->FindSection(".debug_addr", &sections.Addr);
+   Image->FindSection(".debug_ranges", &sections.Ranges);
+   Image->FindSection(".debug_rnglists", &sections.RngLists);
+   sections.HaveLine = Image->FindSection(".debug_line", &sections.Line.Line);
+   GetLineSections(Image, sections.Line);
+
+   InfoParser parser(sections, Table);
+   parser.Parse();
+   return true;
+}
+
+
+bool
+DwarfLookupLine(const ElfImage *Image, uint64_t Address,
+                std::string &FileName, unsigned *Line)
+{
+   LineSections sections;
+
+   if (!Image->FindSection(".debug_line", &sections.Line)) {
+      return false;
+   }
+   GetLineSections(Image, sections);
+
+   DwarfReader r(sections.Line.Data, sections.Line.Size);
+   while (!r.AtEnd()) {
+      LineProgram prog;
+      if (!ParseLineProgram(r, sections, prog)) {
+         continue;
+      }
+
+      LineLookup lookup;
+      lookup.Address = Address;
+      lookup.HavePrev = false;
+      lookup.Found = false;
+      RunLineProgram(prog, lookup);
+
+      if (lookup.Found) {
+         FileName = LineFileName(prog, lookup.Match.File);
+         *Line = lookup.Match.Line;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,258 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Minimal DWARF decoding helpers.
+ */
+
+#ifndef _DWARF_H_
+#define _DWARF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+
+class ElfImage;
+
+
+/*
+ * Bounds-checked little-endian byte stream.  Reads past the end yield
+ * zeros and set the Overflow flag, so that callers only need to check once.
+ */
+struct DwarfReader
+{
+   const uint8_t *Start;
+   const uint8_t *Ptr;
+   const uint8_t *End;
+   bool Overflow;
+
+   DwarfReader(const uint8_t *Data, size_t Size) :
+      Start(Data), Ptr(Data), End(Data + Size), Overflow(false)
+   {
+   }
+
+   size_t
+   Offset(void) const { return Ptr - Start; }
+
+   size_t
+   Remaining(void) const { return End - Ptr; }
+
+   bool
+   AtEnd(void) const { return Ptr >= End; }
+
+   bool
+   Skip(size_t Size)
+   {
+      if (Size > Remaining()) {
+         Ptr = End;
+         Overflow = true;
+         return false;
+      }
+      Ptr += Size;
+      return true;
+   }
+
+   bool
+   Read(void *Buffer, size_t Size)
+   {
+      if (Size > Remaining()) {
+         memset(Buffer, 0, Size);
+         Ptr = End;
+         Overflow = true;
+         return false;
+      }
+      memcpy(Buffer, Ptr, Size);
+      Ptr += Size;
+      return true;
+   }
+
+   uint8_t U8(void) { uint8_t v; Read(&v, sizeof v); return v; }
+   uint16_t U16(void) { uint16_t v; Read(&v, sizeof v); return v; }
+   uint32_t U32(void) { uint32_t v; Read(&v, sizeof v); return v; }
+   uint64_t U64(void) { uint64_t v; Read(&v, sizeof v); return v; }
+
+   uint64_t
+   ULEB128(void)
+   {
+      uint64_t result = 0;
+      unsigned shift = 0;
+      uint8_t byte;
+      do {
+         if (Ptr >= End) {
+            Overflow = true;
+            return result;
+         }
+         byte = *Ptr++;
+         if (shift < 64) {
+            result |= (uint64_t)(byte & 0x7f) << shift;
+         }
+         shift += 7;
+      } while (byte & 0x80);
+      return result;
+   }
+
+   int64_t
+   SLEB128(void)
+   {
+      int64_t result = 0;
+      unsigned shift = 0;
+      uint8_t byte;
+      do {
+         if (Ptr >= End) {
+            Overflow = true;
+            return result;
+         }
+         byte = *Ptr++;
+         if (shift < 64) {
+            result |= (int64_t)(byte & 0x7f) << shift;
+         }
+         shift += 7;
+      } while (byte & 0x80);
+      if (shift < 64 && (byte & 0x40)) {
+         result |= -((int64_t)1 << shift);
+      }
+      return result;
+   }
+
+   const char *
+   String(void)
+   {
+      const char *s = (const char *)Ptr;
+      size_t len = strnlen(s, Remaining());
+      if (len == Remaining()) {
+         Ptr = End;
+         Overflow = true;
+         return "";
+      }
+      Ptr += len + 1;
+      return s;
+   }
+
+   /*
+    * Read an initial length field, returning the unit length and whether
+    * the 64-bit DWARF format is in use.
+    */
+   uint64_t
+   InitialLength(bool *Is64)
+   {
+      uint64_t length = U32();
+      *Is64 = false;
+      if (length == 0xffffffff) {
+         length = U64();
+         *Is64 = true;
+      }
+      return length;
+   }
+
+   uint64_t
+   SectionOffset(bool Is64) { return Is64 ? U64() : U32(); }
+};
+
+
+/*
+ * A flattened line table: rows of all units, sorted by address.  Each row
+ * covers the addresses up to the next row; rows with File set to
+ * DWARF_LINE_END mark the end of a sequence.
+ */
+#define DWARF_LINE_END 0xffffffffU
+
+struct DwarfLine
+{
+   uint64_t Address;
+   uint32_t File;       /* index into DwarfLineTable::Files */
+   uint32_t Line;
+};
+
+/*
+ * An inlined subroutine.  Parent is the inline it was in turn inlined
+ * into, or DWARF_INLINE_NONE.
+ */
+#define DWARF_INLINE_NONE 0xffffffffU
+
+struct DwarfInline
+{
+   uint32_t Parent;
+   uint32_t Name;       /* index into DwarfLineTable::Names */
+   uint32_t CallFile;   /* index into DwarfLineTable::Files */
+   uint32_t CallLine;
+};
+
+/*
+ * Inline ranges partition the address space, sorted by address: each one
+ * covers the addresses up to the next and names the innermost inline
+ * there, or DWARF_INLINE_NONE.
+ */
+struct DwarfInlineRange
+{
+   uint64_t Address;
+   uint32_t Inline;
+   uint32_t Reserved;
+};
+
+struct DwarfLineTable
+{
+   std::vector<std::string> Files;
+   std::vector<DwarfLine> Lines;
+
+   std::vector<std::string> Names;
+   std::vector<DwarfInline> Inlines;
+   std::vector<DwarfInlineRange> InlineRanges;
+};
+
+
+/*
+ * Decode the whole .debug_line section.  Returns false when there is none.
+ */
+bool
+DwarfReadLineTable(const ElfImage *Image, DwarfLineTable &Table);
+
+
+/*
+ * Decode the inlined subroutines of .debug_info into the table, whose
+ * file names are shared with the line rows.  Returns false when there is
+ * no debugging information.
+ */
+bool
+DwarfReadInlines(const ElfImage *Image, DwarfLineTable &Table);
+
+
+/*
+ * Find the source file and line for the given link-time address, by
+ * scanning the .debug_line section.
+ */
+bool
+DwarfLookupLine(const ElfImage *Image, uint64_t Address,
+                std::string &FileName, unsigned *Line);
+
+
+#endif /* _DWARF_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,731 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <list>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "dwarf.h"
+#include "elfimage.h"
+#include "symcache.h"
+
+
+ElfImage::ElfImage() :
+   m_Data(NULL),
+   m_Size(0),
+   m_Mapped(false),
+   m_Sections(NULL),
+   m_SectionCount(0),
+   m_SectionNames(NULL),
+   m_SectionNamesSize(0),
+   m_MinAddress(0),
+   m_Cache(NULL),
+   m_Debug(NULL),
+   m_Refs(1),
+   m_UnwindData(NULL),
+   m_UnwindDestroy(NULL)
+{
+}
+
+
+ElfImage::~ElfImage()
+{
+   std::map<unsigned, std::pair<uint8_t *, size_t> >::iterator it;
+   for (it = m_Inflated.begin(); it != m_Inflated.end(); ++it) {
+      free(it->second.first);
+   }
+
+   if (m_UnwindData) {
+      m_UnwindDestroy(m_UnwindData);
+   }
+
+   delete m_Cache;
+   delete m_Debug;
+
+   if (m_Data) {
+      if (m_Mapped) {
+         munmap((void *)m_Data, m_Size);
+      } else {
+         free((void *)m_Data);
+      }
+   }
+}
+
+
+ElfImage *
+ElfImage::Open(const char *Path)
+{
+   struct stat st;
+   void *data;
+   int fd;
+
+   fd = open(Path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      return NULL;
+   }
+
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+      close(fd);
+      return NULL;
+   }
+
+   data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) {
+      return NULL;
+   }
+
+   ElfImage *image = new ElfImage;
+   image->m_Path = Path;
+   image->m_Data = (const uint8_t *)data;
+   image->m_Size = st.st_size;
+   image->m_Mapped = true;
+
+   if (!image->Parse()) {
+      delete image;
+      return NULL;
+   }
+
+   return image;
+}
+
+
+ElfImage *
+ElfImage::FromMemory(void *Buffer, size_t Size, const char *Name)
+{
+   ElfImage *image = new ElfImage;
+   image->m_Path = Name;
+   image->m_Data = (const uint8_t *)Buffer;
+   image->m_Size = Size;
+   image->m_Mapped = false;
+
+   if (Size < sizeof(Elf64_Ehdr) || !image->Parse()) {
+      delete image;
+      return NULL;
+   }
+
+   return image;
+}
+
+
+bool
+ElfImage::Parse(void)
+{
+   const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)m_Data;
+
+   if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+       ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+       ehdr->e_ident[EI_DATA] != ELFDATA2LSB) {
+      return false;
+   }
+
+   /*
+    * Program headers.
+    */
+
+   if (ehdr->e_phoff && ehdr->e_phentsize == sizeof(Elf64_Phdr) &&
+       ehdr->e_phoff + (uint64_t)ehdr->e_phnum * sizeof(Elf64_Phdr) <= m_Size) {
+      const Elf64_Phdr *phdrs = (const Elf64_Phdr *)(m_Data + ehdr->e_phoff);
+      bool first = true;
+
+      for (unsigned i = 0; i < ehdr->e_phnum; ++i) {
+         const Elf64_Phdr *phdr = &phdrs[i];
+
+         if (phdr->p_type == PT_LOAD) {
+            ElfSegment segment;
+            segment.VirtualAddress = phdr->p_vaddr;
+            segment.MemorySize = phdr->p_memsz;
+            segment.Offset = phdr->p_offset;
+            segment.FileSize = phdr->p_filesz;
+            segment.Flags = phdr->p_flags;
+            m_Segments.push_back(segment);
+
+            uint64_t start = phdr->p_vaddr & ~(uint64_t)0xfff;
+            if (first || start < m_MinAddress) {
+               m_MinAddress = start;
+               first = false;
+            }
+         }
+      }
+   }
+
+   /*
+    * Section headers.
+    */
+
+   if (ehdr->e_shoff && ehdr->e_shentsize == sizeof(Elf64_Shdr) &&
+       ehdr->e_shoff + (uint64_t)ehdr->e_shnum * sizeof(Elf64_Shdr) <= m_Size) {
+      const Elf64_Shdr *shdrs = (const Elf64_Shdr *)(m_Data + ehdr->e_shoff);
+
+      m_Sections = shdrs;
+      m_SectionCount = ehdr->e_shnum;
+
+      if (ehdr->e_shstrndx < m_SectionCount) {
+         const Elf64_Shdr *shdr = &shdrs[ehdr->e_shstrndx];
+         if (shdr->sh_offset + shdr->sh_size <= m_Size) {
+            m_SectionNames = (const char *)(m_Data + shdr->sh_offset);
+            m_SectionNamesSize = shdr->sh_size;
+         }
+      }
+   }
+
+   /*
+    * Build-id and debug link.
+    */
+
+   ElfSection section;
+   if (FindOwnSection(".note.gnu.build-id", &section)) {
+      const uint8_t *p = section.Data;
+      const uint8_t *end = section.Data + section.Size;
+
+      while (p + sizeof(Elf64_Nhdr) <= end) {
+         const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *)p;
+         const uint8_t *name = p + sizeof *nhdr;
+         const uint8_t *desc = name + ((nhdr->n_namesz + 3) & ~3);
+         if (desc + nhdr->n_descsz > end) {
+            break;
+         }
+         if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+             memcmp(name, "GNU", 4) == 0) {
+            m_BuildId.assign((const char *)desc, nhdr->n_descsz);
+            break;
+         }
+         p = desc + ((nhdr->n_descsz + 3) & ~3);
+      }
+   }
+
+   if (FindOwnSection(".gnu_debuglink", &section)) {
+      m_DebugLink.assign((const char *)section.Data, strnlen((const char *)section.Data, section.Size));
+   }
+
+   return true;
+}
+
+
+const uint8_t *
+ElfImage::Inflate(unsigned Index, const uint8_t *Data, size_t Size, size_t *InflatedSize) const
+{
+   std::lock_guard<std::mutex> lock(m_InflateMutex);
+
+   std::map<unsigned, std::pair<uint8_t *, size_t> >::const_iterator it = m_Inflated.find(Index);
+   if (it != m_Inflated.end()) {
+      *InflatedSize = it->second.second;
+      return it->second.first;
+   }
+
+#ifdef HAVE_ZLIB
+   const Elf64_Chdr *chdr = (const Elf64_Chdr *)Data;
+   if (Size < sizeof *chdr || chdr->ch_type != ELFCOMPRESS_ZLIB) {
+      return NULL;
+   }
+
+   uLongf destLen = chdr->ch_size;
+   uint8_t *dest = (uint8_t *)malloc(destLen ? destLen : 1);
+   if (!dest) {
+      return NULL;
+   }
+
+   if (uncompress(dest, &destLen, Data + sizeof *chdr, Size - sizeof *chdr) != Z_OK) {
+      free(dest);
+      return NULL;
+   }
+
+   m_Inflated[Index] = std::make_pair(dest, (size_t)destLen);
+   *InflatedSize = destLen;
+   return dest;
+#else
+   (void)Data;
+   (void)Size;
+   return NULL;
+#endif
+}
+
+
+bool
+ElfImage::FindOwnSection(const char *Name, ElfSection *Section) const
+{
+   const Elf64_Shdr *shdrs = (const Elf64_Shdr *)m_Sections;
+
+   if (!shdrs || !m_SectionNames) {
+      return false;
+   }
+
+   for (unsigned i = 0; i < m_SectionCount; ++i) {
+      const Elf64_Shdr *shdr = &shdrs[i];
+
+      if (shdr->sh_name >= m_SectionNamesSize ||
+          strcmp(m_SectionNames + shdr->sh_name, Name) != 0) {
+         continue;
+      }
+
+      if (shdr->sh_type == SHT_NOBITS ||
+          shdr->sh_offset + shdr->sh_size > m_Size) {
+         return false;
+      }
+
+      Section->Data = m_Data + shdr->sh_offset;
+      Section->Size = shdr->sh_size;
+      Section->Address = shdr->sh_addr;
+
+      if (shdr->sh_flags & SHF_COMPRESSED) {
+         Section->Data = Inflate(i, Section->Data, Section->Size, &Section->Size);
+         if (!Section->Data) {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   return false;
+}
+
+
+bool
+ElfImage::FindSection(const char *Name, ElfSection *Section) const
+{
+   if (FindOwnSection(Name, Section)) {
+      return true;
+   }
+
+   if (m_Debug && m_Debug->FindOwnSection(Name, Section)) {
+      return true;
+   }
+
+   return false;
+}
+
+
+void
+ElfImage::LoadSymbols(const ElfImage *Image, const char *SymTab, std::vector<ElfSymbol> &Symbols)
+{
+   const Elf64_Shdr *shdrs = (const Elf64_Shdr *)Image->m_Sections;
+   ElfSection symtab;
+   ElfSection strtab = {NULL, 0, 0};
+
+   if (!shdrs || !Image->FindOwnSection(SymTab, &symtab)) {
+      return;
+   }
+
+   /* The string table is the one linked from the symbol table. */
+   for (unsigned i = 0; i < Image->m_SectionCount; ++i) {
+      const Elf64_Shdr *shdr = &shdrs[i];
+      if (Image->m_SectionNames &&
+          shdr->sh_name < Image->m_SectionNamesSize &&
+          strcmp(Image->m_SectionNames + shdr->sh_name, SymTab) == 0) {
+         if (shdr->sh_link >= Image->m_SectionCount) {
+            return;
+         }
+         const Elf64_Shdr *link = &shdrs[shdr->sh_link];
+         if (link->sh_offset + link->sh_size > Image->m_Size) {
+            return;
+         }
+         strtab.Data = Image->m_Data + link->sh_offset;
+         strtab.Size = link->sh_size;
+         break;
+      }
+   }
+
+   if (!strtab.Data) {
+      return;
+   }
+
+   const Elf64_Sym *syms = (const Elf64_Sym *)symtab.Data;
+   size_t count = symtab.Size / sizeof(Elf64_Sym);
+
+   for (size_t i = 0; i < count; ++i) {
+      const Elf64_Sym *sym = &syms[i];
+      unsigned type = ELF64_ST_TYPE(sym->st_info);
+
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+          sym->st_shndx == SHN_UNDEF ||
+          sym->st_value == 0 ||
+          sym->st_name >= strtab.Size) {
+         continue;
+      }
+
+      ElfSymbol symbol;
+      symbol.Address = sym->st_value;
+      symbol.Size = sym->st_size;
+      symbol.Name = (const char *)strtab.Data + sym->st_name;
+      Symbols.push_back(symbol);
+   }
+}
+
+
+static bool
+CompareSymbols(const ElfSymbol &a, const ElfSymbol &b)
+{
+   if (a.Address != b.Address) {
+      return a.Address < b.Address;
+   }
+   /* Prefer sized symbols over zero sized aliases. */
+   return a.Size > b.Size;
+}
+
+
+void
+ElfImage::LoadSymbolTables(void) const
+{
+   /*
+    * The debug file may show up after the cache entry was written, so
+    * entries made without one are kept apart.
+    */
+   std::string key;
+   if (!m_BuildId.empty()) {
+      key = BuildIdToString(m_BuildId) + (m_Debug ? "" : "-nodebug");
+      m_Cache = SymbolCache::Open(key);
+      if (m_Cache) {
+         return;
+      }
+   }
+
+   std::vector<ElfSymbol> symbols;
+   if (m_Debug) {
+      /* The debug file's full symbol table supersedes .dynsym. */
+      LoadSymbols(m_Debug, ".symtab", symbols);
+   }
+   LoadSymbols(this, ".symtab", symbols);
+   if (symbols.empty()) {
+      LoadSymbols(this, ".dynsym", symbols);
+   }
+   std::sort(symbols.begin(), symbols.end(), CompareSymbols);
+
+   DwarfLineTable lines;
+   DwarfReadLineTable(this, lines);
+   DwarfReadInlines(this, lines);
+
+   m_Cache = SymbolCache::Create(key, symbols, lines);
+}
+
+
+bool
+ElfImage::LookupSymbol(uint64_t Address, ElfSymbol *Symbol) const
+{
+   std::call_once(m_SymbolsOnce, &ElfImage::LoadSymbolTables, this);
+
+   return m_Cache && m_Cache->LookupSymbol(Address, Symbol);
+}
+
+
+bool
+ElfImage::LookupLine(uint64_t Address, std::string &FileName, unsigned *Line) const
+{
+   std::call_once(m_SymbolsOnce, &ElfImage::LoadSymbolTables, this);
+
+   return m_Cache && m_Cache->LookupLine(Address, FileName, Line);
+}
+
+
+void
+ElfImage::LookupInlines(uint64_t Address, std::vector<ElfInline> &Inlines) const
+{
+   std::call_once(m_SymbolsOnce, &ElfImage::LoadSymbolTables, this);
+
+   Inlines.clear();
+   if (m_Cache) {
+      m_Cache->LookupInlines(Address, Inlines);
+   }
+}
+
+
+static bool
+FileExists(const std::string &Path)
+{
+   struct stat st;
+   return stat(Path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+void
+ElfImage::LoadDebugFile(const std::vector<std::string> &DebugDirs)
+{
+   std::vector<std::string> candidates;
+
+   if (m_Debug) {
+      return;
+   }
+
+   if (m_BuildId.size() >= 2) {
+      std::string hex = BuildIdToString(m_BuildId);
+      for (size_t i = 0; i < DebugDirs.size(); ++i) {
+         candidates.push_back(DebugDirs[i] + "/.build-id/" + hex.substr(0, 2) + "/" + hex.substr(2) + ".debug");
+      }
+   }
+
+   if (!m_DebugLink.empty() && !m_Path.empty() && m_Path[0] == '/') {
+      std::string dir = m_Path.substr(0, m_Path.rfind('/'));
+      candidates.push_back(dir + "/" + m_DebugLink);
+      candidates.push_back(dir + "/.debug/" + m_DebugLink);
+      for (size_t i = 0; i < DebugDirs.size(); ++i) {
+         candidates.push_back(DebugDirs[i] + dir + "/" + m_DebugLink);
+      }
+   }
+
+   for (size_t i = 0; i < candidates.size(); ++i) {
+      if (candidates[i] == m_Path || !FileExists(candidates[i])) {
+         continue;
+      }
+
+      ElfImage *debug = Open(candidates[i].c_str());
+      if (!debug) {
+         continue;
+      }
+
+      if (!m_BuildId.empty() && !debug->m_BuildId.empty() &&
+          debug->m_BuildId != m_BuildId) {
+         delete debug;
+         continue;
+      }
+
+      m_Debug = debug;
+      break;
+   }
+}
+
+
+/*
+ * Images are shared by all targets, as the same libraries show up over and
+ * over again.  Files are keyed by identity rather than path, so that a
+ * rebuilt binary is opened afresh, and the debug files found by build-id
+ * by that build-id.  Unreferenced images linger on the idle list, oldest
+ * first, until evicted.
+ */
+#define SHARED_IMAGES_IDLE_MAX 64
+
+static std::map<std::string, ElfImage *> g_SharedImages;
+static std::list<ElfImage *> g_IdleImages;
+static std::mutex g_SharedImagesMutex;
+
+
+static std::string
+FileKey(const std::string &Path)
+{
+   struct stat st;
+   char key[128];
+
+   if (stat(Path.c_str(), &st) != 0) {
+      return std::string();
+   }
+
+   snprintf(key, sizeof key, "file:%llx:%llx:%llx:%lld.%09ld",
+            (unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+            (unsigned long long)st.st_size,
+            (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+   return key;
+}
+
+
+ElfImage *
+ElfImage::OpenShared(const std::string &Path, const std::string &BuildId,
+                     const std::vector<std::string> &DebugDirs)
+{
+   std::string fileKey = FileKey(Path);
+   ElfImage *image = NULL;
+
+   if (!fileKey.empty()) {
+      {
+         std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+         image = FindShared(fileKey);
+      }
+
+      if (!image) {
+         image = Open(Path.c_str());
+         if (image) {
+            image->LoadDebugFile(DebugDirs);
+
+            std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+            /* Another thread may have been faster. */
+            ElfImage *other = FindShared(fileKey);
+            if (other) {
+               delete image;
+               image = other;
+            } else {
+               image->m_SharedKey = fileKey;
+               g_SharedImages[fileKey] = image;
+            }
+         }
+      }
+
+      if (image && !BuildId.empty() && image->m_BuildId != BuildId) {
+         Release(image);
+         image = NULL;
+      }
+   }
+
+   if (image || BuildId.size() < 2) {
+      return image;
+   }
+
+   /* The file is gone or was rebuilt: fall back to the debug file alone. */
+   std::string buildIdKey = "build-id:" + BuildId;
+   {
+      std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+      image = FindShared(buildIdKey);
+      if (image) {
+         return image;
+      }
+   }
+
+   std::string hex = BuildIdToString(BuildId);
+   for (size_t i = 0; i < DebugDirs.size() && !image; ++i) {
+      std::string path = DebugDirs[i] + "/.build-id/" + hex.substr(0, 2) + "/" + hex.substr(2);
+      const char *suffixes[] = {"", ".debug"};
+      for (unsigned j = 0; j < 2 && !image; ++j) {
+         std::string candidate = path + suffixes[j];
+         if (FileExists(candidate)) {
+            image = Open(candidate.c_str());
+            if (image && image->m_BuildId != BuildId) {
+               delete image;
+               image = NULL;
+            }
+         }
+      }
+   }
+
+   if (!image) {
+      return NULL;
+   }
+
+   image->LoadDebugFile(DebugDirs);
+
+   std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+   ElfImage *other = FindShared(buildIdKey);
+   if (other) {
+      delete image;
+      return other;
+   }
+   image->m_SharedKey = buildIdKey;
+   g_SharedImages[buildIdKey] = image;
+   return image;
+}
+
+
+ElfImage *
+ElfImage::Acquire(ElfImage *Image)
+{
+   if (Image) {
+      std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+      Image->Reference();
+   }
+   return Image;
+}
+
+
+void
+ElfImage::Release(ElfImage *Image)
+{
+   if (!Image) {
+      return;
+   }
+
+   std::lock_guard<std::mutex> lock(g_SharedImagesMutex);
+
+   if (--Image->m_Refs > 0) {
+      return;
+   }
+
+   if (Image->m_SharedKey.empty()) {
+      delete Image;
+      return;
+   }
+
+   g_IdleImages.push_back(Image);
+   while (g_IdleImages.size() > SHARED_IMAGES_IDLE_MAX) {
+      ElfImage *victim = g_IdleImages.front();
+      g_IdleImages.pop_front();
+      g_SharedImages.erase(victim->m_SharedKey);
+      delete victim;
+   }
+}
+
+
+/*
+ * Called with the shared images' lock held.
+ */
+void
+ElfImage::Reference(void)
+{
+   if (m_Refs++ == 0) {
+      g_IdleImages.remove(this);
+   }
+}
+
+
+ElfImage *
+ElfImage::FindShared(const std::string &Key)
+{
+   std::map<std::string, ElfImage *>::iterator it = g_SharedImages.find(Key);
+   if (it == g_SharedImages.end()) {
+      return NULL;
+   }
+   it->second->Reference();
+   return it->second;
+}
+
+
+void *
+ElfImage::UnwindData(void *(*Create)(const ElfImage *), void (*Destroy)(void *)) const
+{
+   std::call_once(m_UnwindOnce, [this, Create, Destroy]() {
+      m_UnwindData = Create(this);
+      m_UnwindDestroy = Destroy;
+   });
+   return m_UnwindData;
+}
+
+
+std::string
+BuildIdToString(const std::string &BuildId)
+{
+   static const char digits[] = "0123456789abcdef";
+   std::string hex;
+
+   hex.reserve(BuildId.size()*2);
+   for (size_t i = 0; i < BuildId.size(); ++i) {
+      uint8_t c = (uint8_t)BuildId[i];
+      hex += digits[c >> 4];
+      hex += digits[c & 0xf];
+   }
+
+   return hex;
+}
+
+
+/* vim:set sw=3 et: */
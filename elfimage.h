@@ -0,0 +1,260 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Read-only access to ELF images (executables, shared objects, separate
+ * debug files and the vDSO).
+ */
+
+#ifndef _ELFIMAGE_H_
+#define _ELFIMAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+class SymbolCache;
+
+
+struct ElfSection
+{
+   const uint8_t *Data;
+   size_t Size;
+   uint64_t Address;    /* link-time virtual address (sh_addr) */
+};
+
+
+struct ElfSymbol
+{
+   uint64_t Address;
+   uint64_t Size;
+   const char *Name;
+};
+
+
+/*
+ * A call inlined at some address.
+ */
+struct ElfInline
+{
+   const char *Name;
+   const char *CallFile;
+   unsigned CallLine;
+};
+
+
+struct ElfSegment
+{
+   uint64_t VirtualAddress;
+   uint64_t MemorySize;
+   uint64_t Offset;
+   uint64_t FileSize;
+   uint32_t Flags;
+};
+
+
+class ElfImage
+{
+public:
+   ~ElfImage();
+
+   /*
+    * Open an ELF file from disk.  Returns NULL on failure.
+    *
+    * Images start with one reference, for the caller to drop with
+    * Release() (or to delete, when the image was never shared).
+    */
+   static ElfImage *
+   Open(const char *Path);
+
+   /*
+    * Open an image together with its separate debug file, sharing it with
+    * all other users of the same file, as told by its device, inode, size
+    * and modification time.  When BuildId is given, the file must match
+    * it; failing that, the debug directories' .build-id trees are searched
+    * instead.  Failures are not remembered.  Returns a new reference.
+    * Thread-safe.
+    */
+   static ElfImage *
+   OpenShared(const std::string &Path, const std::string &BuildId,
+              const std::vector<std::string> &DebugDirs);
+
+   /*
+    * Take another reference to an image, which may be NULL.
+    */
+   static ElfImage *
+   Acquire(ElfImage *Image);
+
+   /*
+    * Drop a reference to an image, which may be NULL.  The most recently
+    * used unreferenced shared images are kept for reuse; others are freed.
+    */
+   static void
+   Release(ElfImage *Image);
+
+   /*
+    * Wrap an in-memory copy of an ELF image (e.g., the vDSO).  Takes
+    * ownership of the buffer, which must have been allocated with malloc.
+    */
+   static ElfImage *
+   FromMemory(void *Buffer, size_t Size, const char *Name);
+
+   const std::string &
+   Path(void) const { return m_Path; }
+
+   const std::string &
+   BuildId(void) const { return m_BuildId; }
+
+   /* Lowest link-time address of any loadable segment. */
+   uint64_t
+   MinAddress(void) const { return m_MinAddress; }
+
+   const std::vector<ElfSegment> &
+   Segments(void) const { return m_Segments; }
+
+   /*
+    * Look up a section by name, also searching the separate debug file (if
+    * any).  Returns false when the section is absent or has no contents.
+    */
+   bool
+   FindSection(const char *Name, ElfSection *Section) const;
+
+   /*
+    * Find the function symbol containing the given link-time address.
+    *
+    * Symbol, line and inline tables are indexed on first use, or loaded
+    * from the symbol cache when the image has a build-id (see symcache.h).
+    * Thread-safe.
+    */
+   bool
+   LookupSymbol(uint64_t Address, ElfSymbol *Symbol) const;
+
+   /*
+    * Find the source file and line of the given link-time address.
+    */
+   bool
+   LookupLine(uint64_t Address, std::string &FileName, unsigned *Line) const;
+
+   /*
+    * Calls inlined at the given link-time address, innermost first.
+    */
+   void
+   LookupInlines(uint64_t Address, std::vector<ElfInline> &Inlines) const;
+
+   /*
+    * Locate and attach the separate debug file, by build-id or
+    * .gnu_debuglink, within the given directories.
+    */
+   void
+   LoadDebugFile(const std::vector<std::string> &DebugDirs);
+
+   const ElfImage *
+   DebugImage(void) const { return m_Debug; }
+
+   /*
+    * The unwinder's index of this image, built with Create on first use
+    * and freed with Destroy together with the image.  Thread-safe.
+    */
+   void *
+   UnwindData(void *(*Create)(const ElfImage *), void (*Destroy)(void *)) const;
+
+private:
+   ElfImage();
+
+   bool
+   Parse(void);
+
+   /*
+    * Look up a shared image, or take a reference to this one.  Called with
+    * the shared images' lock held.
+    */
+   static ElfImage *
+   FindShared(const std::string &Key);
+
+   void
+   Reference(void);
+
+   bool
+   FindOwnSection(const char *Name, ElfSection *Section) const;
+
+   static void
+   LoadSymbols(const ElfImage *Image, const char *SymTab, std::vector<ElfSymbol> &Symbols);
+
+   void
+   LoadSymbolTables(void) const;
+
+   const uint8_t *
+   Inflate(unsigned Index, const uint8_t *Data, size_t Size, size_t *InflatedSize) const;
+
+   std::string m_Path;
+   const uint8_t *m_Data;
+   size_t m_Size;
+   bool m_Mapped;
+
+   const void *m_Sections;
+   unsigned m_SectionCount;
+   const char *m_SectionNames;
+   size_t m_SectionNamesSize;
+
+   std::vector<ElfSegment> m_Segments;
+   uint64_t m_MinAddress;
+   std::string m_BuildId;
+   std::string m_DebugLink;
+
+   mutable SymbolCache *m_Cache;
+   mutable std::once_flag m_SymbolsOnce;
+
+   /* Decompressed copies of SHF_COMPRESSED sections, by section index. */
+   mutable std::map<unsigned, std::pair<uint8_t *, size_t> > m_Inflated;
+   mutable std::mutex m_InflateMutex;
+
+   ElfImage *m_Debug;
+
+   unsigned m_Refs;           /* guarded by the shared images' mutex */
+   std::string m_SharedKey;   /* empty unless shared */
+
+   mutable void *m_UnwindData;
+   mutable void (*m_UnwindDestroy)(void *);
+   mutable std::once_flag m_UnwindOnce;
+};
+
+
+/*
+ * Format a build-id as a lower case hexadecimal string.
+ */
+std::string
+BuildIdToString(const std::string &BuildId);
+
+
+#endif /* _ELFIMAGE_H_ */
+
+/* vim:set sw=3 et: */
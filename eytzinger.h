@@ -0,0 +1,97 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Address lookup tables in Eytzinger (breadth first) order.
+ *
+ * The first levels of the implicit search tree share a few cache lines,
+ * and each step of the search only depends on one comparison, which the
+ * compiler turns into a conditional move, so lookups stay fast on tables
+ * far larger than the caches.  See Khuong and Morin, "Array layouts for
+ * comparison-based searching".
+ *
+ * Tables hold Count + 1 elements; element 0 is unused, so the children of
+ * element k are 2k and 2k + 1.  Elements must have an Address member.
+ */
+
+#ifndef _EYTZINGER_H_
+#define _EYTZINGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+template <class T>
+inline size_t
+EytzingerFill(const T *Sorted, size_t Count, T *Tree, size_t i, size_t k)
+{
+   if (k <= Count) {
+      i = EytzingerFill(Sorted, Count, Tree, i, 2*k);
+      Tree[k] = Sorted[i++];
+      i = EytzingerFill(Sorted, Count, Tree, i, 2*k + 1);
+   }
+   return i;
+}
+
+
+/*
+ * Lay out Count sorted elements into Tree[1..Count].
+ */
+template <class T>
+inline void
+EytzingerLayout(const T *Sorted, size_t Count, T *Tree)
+{
+   EytzingerFill(Sorted, Count, Tree, 0, 1);
+}
+
+
+/*
+ * Index of the last element (in sorted order) whose address is at or
+ * before the given one, or 0 when there is none.
+ */
+template <class T>
+inline size_t
+EytzingerFind(const T *Tree, size_t Count, uint64_t Address)
+{
+   size_t k = 1;
+   while (k <= Count) {
+      /* Fetch the great-grandchildren while comparing. */
+      __builtin_prefetch(Tree + 8*k);
+      k = 2*k + (Tree[k].Address <= Address);
+   }
+
+   /*
+    * The path taken is spelled by the bits of k, 1 meaning right; the
+    * answer is where the last right turn was made.
+    */
+   return k >> __builtin_ffsll(k);
+}
+
+
+#endif /* _EYTZINGER_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,163 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "jobs.h"
+
+
+/*
+ * Split a line into words, shell style, minus expansions.
+ */
+static bool
+SplitWords(const char *Line, std::vector<std::string> &Words)
+{
+   const char *p = Line;
+
+   Words.clear();
+
+   for (;;) {
+      while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+         ++p;
+      }
+      if (!*p) {
+         return true;
+      }
+
+      std::string word;
+      while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+         if (*p == '\'' || *p == '"') {
+            char quote = *p++;
+            while (*p && *p != quote) {
+               if (quote == '"' && *p == '\\' && p[1]) {
+                  ++p;
+               }
+               word += *p++;
+            }
+            if (!*p) {
+               return false;
+            }
+            ++p;
+         } else if (*p == '\\' && p[1]) {
+            word += p[1];
+            p += 2;
+         } else {
+            word += *p++;
+         }
+      }
+      Words.push_back(word);
+   }
+}
+
+
+bool
+ReadManifest(const char *Path, std::vector<JobSpec> &Jobs)
+{
+   FILE *fp = !strcmp(Path, "-") ? stdin : fopen(Path, "r");
+   if (!fp) {
+      fprintf(stderr, "error: failed to open %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+
+   bool ok = true;
+   unsigned number = 0;
+   char line[16384];
+   while (fgets(line, sizeof line, fp)) {
+      ++number;
+
+      /* Rather than running the rest as another job. */
+      size_t length = strlen(line);
+      if (length == sizeof line - 1 && line[length - 1] != '\n') {
+         int c = fgetc(fp);
+         if (c != EOF && c != '\n') {
+            fprintf(stderr, "error: %s:%u: line too long\n", Path, number);
+            ok = false;
+            while ((c = fgetc(fp)) != EOF && c != '\n') {
+            }
+            continue;
+         }
+      }
+
+      std::vector<std::string> words;
+      if (!SplitWords(line, words)) {
+         fprintf(stderr, "error: %s:%u: unterminated quote\n", Path, number);
+         ok = false;
+         continue;
+      }
+      if (words.empty() || words[0][0] == '#') {
+         continue;
+      }
+
+      JobSpec job;
+      job.HaveTimeOut = false;
+      job.TimeOut = 0;
+      job.FullDump = false;
+      job.ReachableDump = false;
+      job.Line = number;
+
+      size_t i = 0;
+      while (i < words.size()) {
+         if (words[i] == "-t" && i + 1 < words.size()) {
+            job.HaveTimeOut = true;
+            job.TimeOut = strtoul(words[i + 1].c_str(), NULL, 0);
+            i += 2;
+         } else if (words[i] == "-z" && i + 1 < words.size()) {
+            job.DumpPath = words[i + 1];
+            i += 2;
+         } else if (words[i] == "-ma") {
+            job.FullDump = true;
+            i += 1;
+         } else if (words[i] == "-mi") {
+            job.ReachableDump = true;
+            i += 1;
+         } else {
+            break;
+         }
+      }
+
+      if (i == words.size()) {
+         fprintf(stderr, "error: %s:%u: no command line given\n", Path, number);
+         ok = false;
+         continue;
+      }
+
+      job.Args.assign(words.begin() + i, words.end());
+      Jobs.push_back(job);
+   }
+
+   if (fp != stdin) {
+      fclose(fp);
+   }
+
+   return ok;
+}
+
+
+/* vim:set sw=3 et: */
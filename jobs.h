@@ -0,0 +1,79 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Job manifests for "stackdump --jobs N --manifest <file>".
+ *
+ * A manifest lists one command line per line.  Words are separated by
+ * blanks, and may be quoted with '...' or "..." or escaped with a
+ * backslash.  Blank lines and lines starting with # are ignored.  A line
+ * may start with options overriding the command line ones for that job:
+ *
+ *   -t <seconds>           time out
+ *   -z <crash-dump-file>   dump file, %p standing for the process id
+ *   -ma                    full dump
+ *   -mi                    dump with the memory the stacks point to
+ *
+ * e.g.:
+ *
+ *   # unit tests
+ *   ./test_foo --quick
+ *   -t 60 -z foo_slow.%p.dmp ./test_foo --slow
+ */
+
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <string>
+#include <vector>
+
+
+struct JobSpec
+{
+   std::vector<std::string> Args;
+
+   bool HaveTimeOut;
+   unsigned long TimeOut;     /* seconds */
+
+   std::string DumpPath;      /* empty for the default */
+   bool FullDump;
+   bool ReachableDump;
+
+   unsigned Line;             /* in the manifest, for messages */
+};
+
+
+/*
+ * Parse a manifest.  Errors are reported on stderr.
+ */
+bool
+ReadManifest(const char *Path, std::vector<JobSpec> &Jobs);
+
+
+#endif /* _JOBS_H_ */
+
+/* vim:set sw=3 et: */
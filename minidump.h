@@ -0,0 +1,405 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Minidump (MDMP) file format, as written by dbghelp's MiniDumpWriteDump
+ * and dbgeng's WriteDumpFile.
+ *
+ * The structures mirror those in dbghelp.h and winnt.h, but are given
+ * distinct names so that they can coexist with the Windows headers and be
+ * used on any platform.  Linux specific extensions follow Breakpad.
+ */
+
+#ifndef _MINIDUMP_H_
+#define _MINIDUMP_H_
+
+#include <stdint.h>
+
+
+#define MD_HEADER_SIGNATURE      0x504d444d  /* 'MDMP' */
+#define MD_HEADER_VERSION        0x0000a793
+
+/* MINIDUMP_STREAM_TYPE */
+#define MD_THREAD_LIST_STREAM       3
+#define MD_MODULE_LIST_STREAM       4
+#define MD_MEMORY_LIST_STREAM       5
+#define MD_EXCEPTION_STREAM         6
+#define MD_SYSTEM_INFO_STREAM       7
+#define MD_MEMORY_64_LIST_STREAM    9
+#define MD_MISC_INFO_STREAM         15
+#define MD_THREAD_NAME_LIST_STREAM  24
+
+/* Breakpad Linux extensions */
+#define MD_LINUX_CMD_LINE           0x47670007
+#define MD_LINUX_MAPS               0x47670009
+
+/* PROCESSOR_ARCHITECTURE_* */
+#define MD_CPU_ARCHITECTURE_X86     0
+#define MD_CPU_ARCHITECTURE_AMD64   9
+
+/* VER_PLATFORM_* and Breakpad extensions */
+#define MD_OS_WIN32_NT              2
+#define MD_OS_LINUX                 0x8201
+
+/* CONTEXT_* flags */
+#define MD_CONTEXT_X86              0x00010000
+#define MD_CONTEXT_AMD64            0x00100000
+#define MD_CONTEXT_CONTROL          0x00000001
+#define MD_CONTEXT_INTEGER          0x00000002
+#define MD_CONTEXT_SEGMENTS         0x00000004
+#define MD_CONTEXT_FLOATING_POINT   0x00000008
+
+/* CodeView record signatures */
+#define MD_CVINFOPDB70_SIGNATURE    0x53445352  /* 'RSDS' */
+#define MD_CVINFOELF_SIGNATURE      0x4270454c  /* 'BpEL' */
+
+#define MD_MISCINFO_FLAGS1_PROCESS_ID 0x00000001
+
+
+#pragma pack(push, 4)
+
+struct MDLocationDescriptor
+{
+   uint32_t DataSize;
+   uint32_t Rva;
+};
+
+struct MDRawHeader
+{
+   uint32_t Signature;
+   uint32_t Version;
+   uint32_t NumberOfStreams;
+   uint32_t StreamDirectoryRva;
+   uint32_t CheckSum;
+   uint32_t TimeDateStamp;
+   uint64_t Flags;
+};
+
+struct MDRawDirectory
+{
+   uint32_t StreamType;
+   MDLocationDescriptor Location;
+};
+
+struct MDMemoryDescriptor
+{
+   uint64_t StartOfMemoryRange;
+   MDLocationDescriptor Memory;
+};
+
+struct MDMemoryDescriptor64
+{
+   uint64_t StartOfMemoryRange;
+   uint64_t DataSize;
+};
+
+struct MDRawThread
+{
+   uint32_t ThreadId;
+   uint32_t SuspendCount;
+   uint32_t PriorityClass;
+   uint32_t Priority;
+   uint64_t Teb;
+   MDMemoryDescriptor Stack;
+   MDLocationDescriptor ThreadContext;
+};
+
+struct MDRawThreadList
+{
+   uint32_t NumberOfThreads;
+   /* MDRawThread Threads[]; */
+};
+
+struct MDVSFixedFileInfo
+{
+   uint32_t Signature;
+   uint32_t StrucVersion;
+   uint32_t FileVersionHi;
+   uint32_t FileVersionLo;
+   uint32_t ProductVersionHi;
+   uint32_t ProductVersionLo;
+   uint32_t FileFlagsMask;
+   uint32_t FileFlags;
+   uint32_t FileOS;
+   uint32_t FileType;
+   uint32_t FileSubtype;
+   uint32_t FileDateHi;
+   uint32_t FileDateLo;
+};
+
+struct MDRawModule
+{
+   uint64_t BaseOfImage;
+   uint32_t SizeOfImage;
+   uint32_t CheckSum;
+   uint32_t TimeDateStamp;
+   uint32_t ModuleNameRva;
+   MDVSFixedFileInfo VersionInfo;
+   MDLocationDescriptor CvRecord;
+   MDLocationDescriptor MiscRecord;
+   uint64_t Reserved0;
+   uint64_t Reserved1;
+};
+
+struct MDRawModuleList
+{
+   uint32_t NumberOfModules;
+   /* MDRawModule Modules[]; */
+};
+
+struct MDRawMemoryList
+{
+   uint32_t NumberOfMemoryRanges;
+   /* MDMemoryDescriptor MemoryRanges[]; */
+};
+
+struct MDRawMemory64List
+{
+   uint64_t NumberOfMemoryRanges;
+   uint64_t BaseRva;
+   /* MDMemoryDescriptor64 MemoryRanges[]; */
+};
+
+#define MD_EXCEPTION_MAXIMUM_PARAMETERS 15
+
+struct MDException
+{
+   uint32_t ExceptionCode;
+   uint32_t ExceptionFlags;
+   uint64_t ExceptionRecord;
+   uint64_t ExceptionAddress;
+   uint32_t NumberParameters;
+   uint32_t UnusedAlignment;
+   uint64_t ExceptionInformation[MD_EXCEPTION_MAXIMUM_PARAMETERS];
+};
+
+struct MDRawExceptionStream
+{
+   uint32_t ThreadId;
+   uint32_t Alignment;
+   MDException ExceptionRecord;
+   MDLocationDescriptor ThreadContext;
+};
+
+struct MDRawSystemInfo
+{
+   uint16_t ProcessorArchitecture;
+   uint16_t ProcessorLevel;
+   uint16_t ProcessorRevision;
+   uint8_t NumberOfProcessors;
+   uint8_t ProductType;
+   uint32_t MajorVersion;
+   uint32_t MinorVersion;
+   uint32_t BuildNumber;
+   uint32_t PlatformId;
+   uint32_t CSDVersionRva;
+   uint16_t SuiteMask;
+   uint16_t Reserved2;
+   uint32_t Cpu[6];
+};
+
+struct MDRawMiscInfo
+{
+   uint32_t SizeOfInfo;
+   uint32_t Flags1;
+   uint32_t ProcessId;
+   uint32_t ProcessCreateTime;
+   uint32_t ProcessUserTime;
+   uint32_t ProcessKernelTime;
+};
+
+struct MDRawThreadName
+{
+   uint32_t ThreadId;
+   uint64_t RvaOfThreadName;
+};
+
+struct MDRawThreadNameList
+{
+   uint32_t NumberOfThreadNames;
+   /* MDRawThreadName ThreadNames[]; */
+};
+
+/* Followed by the UTF-16 characters and a terminating NUL. */
+struct MDString
+{
+   uint32_t Length;     /* in bytes, excluding the terminator */
+};
+
+struct MDCVInfoPDB70
+{
+   uint32_t CvSignature;
+   uint8_t Signature[16];
+   uint32_t Age;
+   /* char PdbFileName[]; */
+};
+
+struct MDCVInfoELF
+{
+   uint32_t CvSignature;
+   /* uint8_t BuildId[]; */
+};
+
+struct MDM128
+{
+   uint64_t Low;
+   uint64_t High;
+};
+
+/* FXSAVE layout, shared by x86 and AMD64. */
+struct MDXSaveFormat
+{
+   uint16_t ControlWord;
+   uint16_t StatusWord;
+   uint8_t TagWord;
+   uint8_t Reserved1;
+   uint16_t ErrorOpcode;
+   uint32_t ErrorOffset;
+   uint16_t ErrorSelector;
+   uint16_t Reserved2;
+   uint32_t DataOffset;
+   uint16_t DataSelector;
+   uint16_t Reserved3;
+   uint32_t MxCsr;
+   uint32_t MxCsrMask;
+   MDM128 FloatRegisters[8];
+   MDM128 XmmRegisters[16];
+   uint8_t Reserved4[96];
+};
+
+/* CONTEXT for AMD64 */
+struct MDRawContextAMD64
+{
+   uint64_t P1Home;
+   uint64_t P2Home;
+   uint64_t P3Home;
+   uint64_t P4Home;
+   uint64_t P5Home;
+   uint64_t P6Home;
+   uint32_t ContextFlags;
+   uint32_t MxCsr;
+   uint16_t SegCs;
+   uint16_t SegDs;
+   uint16_t SegEs;
+   uint16_t SegFs;
+   uint16_t SegGs;
+   uint16_t SegSs;
+   uint32_t EFlags;
+   uint64_t Dr0;
+   uint64_t Dr1;
+   uint64_t Dr2;
+   uint64_t Dr3;
+   uint64_t Dr6;
+   uint64_t Dr7;
+   uint64_t Rax;
+   uint64_t Rcx;
+   uint64_t Rdx;
+   uint64_t Rbx;
+   uint64_t Rsp;
+   uint64_t Rbp;
+   uint64_t Rsi;
+   uint64_t Rdi;
+   uint64_t R8;
+   uint64_t R9;
+   uint64_t R10;
+   uint64_t R11;
+   uint64_t R12;
+   uint64_t R13;
+   uint64_t R14;
+   uint64_t R15;
+   uint64_t Rip;
+   MDXSaveFormat FltSave;
+   MDM128 VectorRegister[26];
+   uint64_t VectorControl;
+   uint64_t DebugControl;
+   uint64_t LastBranchToRip;
+   uint64_t LastBranchFromRip;
+   uint64_t LastExceptionToRip;
+   uint64_t LastExceptionFromRip;
+};
+
+/* CONTEXT for x86 */
+struct MDFloatingSaveAreaX86
+{
+   uint32_t ControlWord;
+   uint32_t StatusWord;
+   uint32_t TagWord;
+   uint32_t ErrorOffset;
+   uint32_t ErrorSelector;
+   uint32_t DataOffset;
+   uint32_t DataSelector;
+   uint8_t RegisterArea[80];
+   uint32_t Cr0NpxState;
+};
+
+struct MDRawContextX86
+{
+   uint32_t ContextFlags;
+   uint32_t Dr0;
+   uint32_t Dr1;
+   uint32_t Dr2;
+   uint32_t Dr3;
+   uint32_t Dr6;
+   uint32_t Dr7;
+   MDFloatingSaveAreaX86 FloatSave;
+   uint32_t SegGs;
+   uint32_t SegFs;
+   uint32_t SegEs;
+   uint32_t SegDs;
+   uint32_t Edi;
+   uint32_t Esi;
+   uint32_t Ebx;
+   uint32_t Edx;
+   uint32_t Ecx;
+   uint32_t Eax;
+   uint32_t Ebp;
+   uint32_t Eip;
+   uint32_t SegCs;
+   uint32_t EFlags;
+   uint32_t Esp;
+   uint32_t SegSs;
+   uint8_t ExtendedRegisters[512];
+};
+
+#pragma pack(pop)
+
+
+/*
+ * Compile time checks that the layouts match the on-disk format.
+ */
+typedef char MDAssertHeader[sizeof(MDRawHeader) == 32 ? 1 : -1];
+typedef char MDAssertThread[sizeof(MDRawThread) == 48 ? 1 : -1];
+typedef char MDAssertModule[sizeof(MDRawModule) == 108 ? 1 : -1];
+typedef char MDAssertException[sizeof(MDRawExceptionStream) == 168 ? 1 : -1];
+typedef char MDAssertSystemInfo[sizeof(MDRawSystemInfo) == 56 ? 1 : -1];
+typedef char MDAssertContextAMD64[sizeof(MDRawContextAMD64) == 1232 ? 1 : -1];
+typedef char MDAssertContextX86[sizeof(MDRawContextX86) == 716 ? 1 : -1];
+
+
+#endif /* _MINIDUMP_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,622 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <algorithm>
+
+#include "minidumpreader.h"
+
+
+MinidumpFile::MinidumpFile() :
+   m_File(NULL),
+   m_FileSize(0),
+   m_Data(NULL),
+   m_Size(0),
+   m_BlockHeader(NULL),
+   m_Index(NULL),
+#ifdef _WIN32
+   m_hFile(INVALID_HANDLE_VALUE),
+   m_hMapping(NULL),
+#endif
+   m_Header(NULL)
+{
+}
+
+
+MinidumpFile::~MinidumpFile()
+{
+#ifdef _WIN32
+   if (m_Index && m_Data) {
+      VirtualFree((void *)m_Data, 0, MEM_RELEASE);
+   }
+   if (m_File) {
+      UnmapViewOfFile(m_File);
+   }
+   if (m_hMapping) {
+      CloseHandle(m_hMapping);
+   }
+   if (m_hFile != INVALID_HANDLE_VALUE) {
+      CloseHandle(m_hFile);
+   }
+#else
+   if (m_Index && m_Data) {
+      munmap((void *)m_Data, m_Size);
+   }
+   if (m_File) {
+      munmap((void *)m_File, m_FileSize);
+   }
+#endif
+}
+
+
+MinidumpFile *
+MinidumpFile::Open(const char *Path)
+{
+   MinidumpFile *file = new MinidumpFile;
+   file->m_Path = Path;
+
+#ifdef _WIN32
+   LARGE_INTEGER size;
+
+   file->m_hFile = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+   if (file->m_hFile == INVALID_HANDLE_VALUE ||
+       !GetFileSizeEx(file->m_hFile, &size) ||
+       size.QuadPart < (LONGLONG)sizeof(MDRawHeader)) {
+      delete file;
+      return NULL;
+   }
+
+   file->m_hMapping = CreateFileMapping(file->m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (!file->m_hMapping) {
+      delete file;
+      return NULL;
+   }
+
+   file->m_File = (const uint8_t *)MapViewOfFile(file->m_hMapping, FILE_MAP_READ, 0, 0, 0);
+   file->m_FileSize = size.QuadPart;
+#else
+   struct stat st;
+   void *data;
+   int fd;
+
+   fd = open(Path, O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      delete file;
+      return NULL;
+   }
+
+   if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(MDRawHeader)) {
+      close(fd);
+      delete file;
+      return NULL;
+   }
+
+   data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data != MAP_FAILED) {
+      /* Accesses are scattered; readahead would just pull in unrelated pages. */
+      madvise(data, st.st_size, MADV_RANDOM);
+      file->m_File = (const uint8_t *)data;
+      file->m_FileSize = st.st_size;
+   }
+#endif
+
+   if (!file->m_File || !file->Parse()) {
+      delete file;
+      return NULL;
+   }
+
+   return file;
+}
+
+
+bool
+MinidumpFile::Parse(void)
+{
+   const BlockHeader *blockHeader = (const BlockHeader *)m_File;
+   if (blockHeader->Signature == BLOCK_SIGNATURE) {
+      m_BlockHeader = blockHeader;
+      if (!OpenBlocks()) {
+         return false;
+      }
+   } else {
+      m_Data = m_File;
+      m_Size = m_FileSize;
+   }
+
+   if (!GetData(0, sizeof(MDRawHeader))) {
+      return false;
+   }
+   m_Header = (const MDRawHeader *)m_Data;
+   if (m_Header->Signature != MD_HEADER_SIGNATURE ||
+       (m_Header->Version & 0xffff) != (MD_HEADER_VERSION & 0xffff)) {
+      return false;
+   }
+
+   const MDRawDirectory *directory = (const MDRawDirectory *)
+      GetData(m_Header->StreamDirectoryRva,
+              (uint64_t)m_Header->NumberOfStreams * sizeof(MDRawDirectory));
+   if (!directory) {
+      return false;
+   }
+   m_Directory = MinidumpArray<MDRawDirectory>(directory, m_Header->NumberOfStreams);
+
+   /*
+    * Index the memory blocks.  Only the descriptor tables are touched, not
+    * the memory contents.
+    */
+
+   MinidumpArray<MDMemoryDescriptor> ranges = MemoryRanges();
+   for (size_t i = 0; i < ranges.size(); ++i) {
+      MemoryBlock block;
+      block.Start = ranges[i].StartOfMemoryRange;
+      block.Size = ranges[i].Memory.DataSize;
+      block.Rva = ranges[i].Memory.Rva;
+      if (block.Size && Contains(block.Rva, block.Size)) {
+         m_Blocks.push_back(block);
+      }
+   }
+
+   MinidumpArray<MDMemoryDescriptor64> ranges64 = Memory64Ranges();
+   if (!ranges64.empty()) {
+      const MDRawMemory64List *list = (const MDRawMemory64List *)
+         FindStream(MD_MEMORY_64_LIST_STREAM);
+      uint64_t rva = list->BaseRva;
+      for (size_t i = 0; i < ranges64.size(); ++i) {
+         MemoryBlock block;
+         block.Start = ranges64[i].StartOfMemoryRange;
+         block.Size = ranges64[i].DataSize;
+         block.Rva = rva;
+         rva += block.Size;
+         if (block.Size && Contains(block.Rva, block.Size)) {
+            m_Blocks.push_back(block);
+         }
+      }
+   }
+
+   /*
+    * Ranges overlap, e.g., with -ma the stacks are inside larger regions.
+    * Clip them, so that each address is in one block at most: the first
+    * one listed among those starting at the same address, or else the one
+    * starting lowest.
+    */
+   std::stable_sort(m_Blocks.begin(), m_Blocks.end());
+
+   size_t count = 0;
+   uint64_t end = 0;
+   for (size_t i = 0; i < m_Blocks.size(); ++i) {
+      MemoryBlock block = m_Blocks[i];
+      if (count && block.Start < end) {
+         uint64_t overlap = end - block.Start;
+         if (overlap >= block.Size) {
+            continue;
+         }
+         block.Start += overlap;
+         block.Size -= overlap;
+         block.Rva += overlap;
+      }
+      end = block.Start + block.Size;
+      m_Blocks[count++] = block;
+   }
+   m_Blocks.resize(count);
+
+   return true;
+}
+
+
+bool
+MinidumpFile::OpenBlocks(void)
+{
+   /* Open() checked the file is as large as a minidump header, as is ours. */
+   const BlockHeader &header = *m_BlockHeader;
+   if (header.Version != BLOCK_VERSION ||
+       !header.BlockSize ||
+       header.Size < sizeof(MDRawHeader) ||
+       header.BlockCount != (header.Size + header.BlockSize - 1) / header.BlockSize ||
+       header.IndexOffset > m_FileSize ||
+       (uint64_t)header.BlockCount * sizeof(BlockIndexEntry) > m_FileSize - header.IndexOffset) {
+      return false;
+   }
+
+   m_Index = (const BlockIndexEntry *)(m_File + header.IndexOffset);
+   m_Inflated.resize(header.BlockCount);
+   m_Size = header.Size;
+
+#ifdef _WIN32
+   m_Data = (const uint8_t *)VirtualAlloc(NULL, (SIZE_T)m_Size, MEM_RESERVE | MEM_COMMIT,
+                                          PAGE_READWRITE);
+#else
+   /* Only the pages of the blocks inflated get backed. */
+   void *data = mmap(NULL, m_Size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   m_Data = data != MAP_FAILED ? (const uint8_t *)data : NULL;
+#endif
+
+   return m_Data != NULL;
+}
+
+
+bool
+MinidumpFile::Contains(uint64_t Rva, uint64_t Size) const
+{
+   return Rva <= m_Size && Size <= m_Size - Rva;
+}
+
+
+bool
+MinidumpFile::Inflate(uint64_t Rva, uint64_t Size) const
+{
+   if (!m_Index || !Size) {
+      return true;
+   }
+
+   uint64_t blockSize = m_BlockHeader->BlockSize;
+   uint64_t first = Rva / blockSize;
+   uint64_t last = (Rva + Size - 1) / blockSize;
+
+   std::lock_guard<std::mutex> lock(m_InflateMutex);
+
+   for (uint64_t i = first; i <= last; ++i) {
+      if (m_Inflated[i]) {
+         continue;
+      }
+
+      const BlockIndexEntry &entry = m_Index[i];
+      uint64_t offset = i * blockSize;
+      uint64_t size = m_Size - offset < blockSize ? m_Size - offset : blockSize;
+      uint8_t *out = (uint8_t *)m_Data + offset;
+
+      if (entry.Offset > m_FileSize || entry.Size > m_FileSize - entry.Offset) {
+         return false;
+      }
+      const uint8_t *in = m_File + entry.Offset;
+
+      if (entry.Flags & BLOCK_STORED) {
+         if (entry.Size != size) {
+            return false;
+         }
+         memcpy(out, in, size);
+      } else if (!LZ4Decompress(in, entry.Size, out, size)) {
+         return false;
+      }
+
+      m_Inflated[i] = true;
+   }
+
+   return true;
+}
+
+
+const void *
+MinidumpFile::GetData(uint64_t Rva, uint64_t Size) const
+{
+   if (!Contains(Rva, Size) || !Inflate(Rva, Size)) {
+      return NULL;
+   }
+   return m_Data + Rva;
+}
+
+
+const void *
+MinidumpFile::GetData(const MDLocationDescriptor &Location) const
+{
+   return GetData(Location.Rva, Location.DataSize);
+}
+
+
+const void *
+MinidumpFile::FindStream(uint32_t StreamType, uint32_t *Size) const
+{
+   for (size_t i = 0; i < m_Directory.size(); ++i) {
+      if (m_Directory[i].StreamType == StreamType) {
+         const void *data = GetData(m_Directory[i].Location);
+         if (data && Size) {
+            *Size = m_Directory[i].Location.DataSize;
+         }
+         return data;
+      }
+   }
+   return NULL;
+}
+
+
+/*
+ * Streams consisting of a 32-bit count followed by an array.  Some writers
+ * pad the count to 8 bytes, which shows in the stream size.
+ */
+template< class List, class T >
+static MinidumpArray<T>
+GetList(const MinidumpFile *file, uint32_t StreamType)
+{
+   uint32_t size = 0;
+   const uint8_t *data = (const uint8_t *)file->FindStream(StreamType, &size);
+   if (!data || size < sizeof(List)) {
+      return MinidumpArray<T>();
+   }
+
+   uint32_t count = *(const uint32_t *)data;
+   size_t header = sizeof(List);
+   if (size == 8 + (uint64_t)count * sizeof(T)) {
+      header = 8;
+   }
+   if ((uint64_t)count * sizeof(T) > size - header) {
+      return MinidumpArray<T>();
+   }
+
+   return MinidumpArray<T>((const T *)(data + header), count);
+}
+
+
+MinidumpArray<MDRawThread>
+MinidumpFile::Threads(void) const
+{
+   return GetList<MDRawThreadList, MDRawThread>(this, MD_THREAD_LIST_STREAM);
+}
+
+
+MinidumpArray<MDRawModule>
+MinidumpFile::Modules(void) const
+{
+   return GetList<MDRawModuleList, MDRawModule>(this, MD_MODULE_LIST_STREAM);
+}
+
+
+MinidumpArray<MDMemoryDescriptor>
+MinidumpFile::MemoryRanges(void) const
+{
+   return GetList<MDRawMemoryList, MDMemoryDescriptor>(this, MD_MEMORY_LIST_STREAM);
+}
+
+
+MinidumpArray<MDMemoryDescriptor64>
+MinidumpFile::Memory64Ranges(void) const
+{
+   uint32_t size = 0;
+   const MDRawMemory64List *list = (const MDRawMemory64List *)
+      FindStream(MD_MEMORY_64_LIST_STREAM, &size);
+   if (!list || size < sizeof *list ||
+       list->NumberOfMemoryRanges > (size - sizeof *list) / sizeof(MDMemoryDescriptor64)) {
+      return MinidumpArray<MDMemoryDescriptor64>();
+   }
+
+   return MinidumpArray<MDMemoryDescriptor64>((const MDMemoryDescriptor64 *)(list + 1),
+                                              (size_t)list->NumberOfMemoryRanges);
+}
+
+
+const MDRawExceptionStream *
+MinidumpFile::Exception(void) const
+{
+   uint32_t size = 0;
+   const void *data = FindStream(MD_EXCEPTION_STREAM, &size);
+   if (!data || size < sizeof(MDRawExceptionStream)) {
+      return NULL;
+   }
+   return (const MDRawExceptionStream *)data;
+}
+
+
+const MDRawSystemInfo *
+MinidumpFile::SystemInfo(void) const
+{
+   uint32_t size = 0;
+   const void *data = FindStream(MD_SYSTEM_INFO_STREAM, &size);
+   if (!data || size < sizeof(MDRawSystemInfo)) {
+      return NULL;
+   }
+   return (const MDRawSystemInfo *)data;
+}
+
+
+unsigned
+MinidumpFile::Architecture(void) const
+{
+   const MDRawSystemInfo *info = SystemInfo();
+   return info ? info->ProcessorArchitecture : ~0U;
+}
+
+
+const MDRawContextAMD64 *
+MinidumpFile::ContextAMD64(const MDLocationDescriptor &Location) const
+{
+   if (Location.DataSize < sizeof(MDRawContextAMD64)) {
+      return NULL;
+   }
+   const MDRawContextAMD64 *context = (const MDRawContextAMD64 *)GetData(Location);
+   if (!context || !(context->ContextFlags & MD_CONTEXT_AMD64)) {
+      return NULL;
+   }
+   return context;
+}
+
+
+const MDRawContextX86 *
+MinidumpFile::ContextX86(const MDLocationDescriptor &Location) const
+{
+   if (Location.DataSize < sizeof(MDRawContextX86)) {
+      return NULL;
+   }
+   const MDRawContextX86 *context = (const MDRawContextX86 *)GetData(Location);
+   if (!context || !(context->ContextFlags & MD_CONTEXT_X86)) {
+      return NULL;
+   }
+   return context;
+}
+
+
+std::string
+MinidumpFile::GetString(uint32_t Rva) const
+{
+   std::string result;
+
+   const MDString *header = (const MDString *)GetData(Rva, sizeof(MDString));
+   if (!header) {
+      return result;
+   }
+   const uint8_t *p = (const uint8_t *)GetData(Rva + sizeof(MDString), header->Length);
+   if (!p) {
+      return result;
+   }
+
+   size_t count = header->Length / 2;
+   for (size_t i = 0; i < count; ++i) {
+      uint32_t c = p[2*i] | (p[2*i + 1] << 8);
+
+      /* Surrogate pairs. */
+      if (c >= 0xd800 && c < 0xdc00 && i + 1 < count) {
+         uint32_t low = p[2*i + 2] | (p[2*i + 3] << 8);
+         if (low >= 0xdc00 && low < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+            ++i;
+         }
+      }
+
+      if (c < 0x80) {
+         result += (char)c;
+      } else if (c < 0x800) {
+         result += (char)(0xc0 | (c >> 6));
+         result += (char)(0x80 | (c & 0x3f));
+      } else if (c < 0x10000) {
+         result += (char)(0xe0 | (c >> 12));
+         result += (char)(0x80 | ((c >> 6) & 0x3f));
+         result += (char)(0x80 | (c & 0x3f));
+      } else {
+         result += (char)(0xf0 | (c >> 18));
+         result += (char)(0x80 | ((c >> 12) & 0x3f));
+         result += (char)(0x80 | ((c >> 6) & 0x3f));
+         result += (char)(0x80 | (c & 0x3f));
+      }
+   }
+
+   return result;
+}
+
+
+std::string
+MinidumpFile::ModuleName(const MDRawModule &Module) const
+{
+   return GetString(Module.ModuleNameRva);
+}
+
+
+std::string
+MinidumpFile::ThreadName(uint32_t ThreadId) const
+{
+   MinidumpArray<MDRawThreadName> names =
+      GetList<MDRawThreadNameList, MDRawThreadName>(this, MD_THREAD_NAME_LIST_STREAM);
+
+   for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i].ThreadId == ThreadId) {
+         return GetString((uint32_t)names[i].RvaOfThreadName);
+      }
+   }
+
+   return std::string();
+}
+
+
+const MinidumpFile::MemoryBlock *
+MinidumpFile::FindBlock(uint64_t Address) const
+{
+   MemoryBlock key;
+   key.Start = Address;
+
+   /* First block starting after the address, then step back. */
+   std::vector<MemoryBlock>::const_iterator it =
+      std::upper_bound(m_Blocks.begin(), m_Blocks.end(), key);
+   if (it == m_Blocks.begin()) {
+      return NULL;
+   }
+   --it;
+
+   if (Address - it->Start >= it->Size) {
+      return NULL;
+   }
+   return &*it;
+}
+
+
+const uint8_t *
+MinidumpFile::GetMemory(uint64_t Address, uint64_t Size) const
+{
+   const MemoryBlock *block = FindBlock(Address);
+   if (!block) {
+      return NULL;
+   }
+
+   uint64_t offset = Address - block->Start;
+   if (Size > block->Size - offset) {
+      return NULL;
+   }
+
+   return (const uint8_t *)GetData(block->Rva + offset, Size);
+}
+
+
+size_t
+MinidumpFile::ReadMemory(uint64_t Address, void *Buffer, size_t Size) const
+{
+   uint8_t *out = (uint8_t *)Buffer;
+   size_t done = 0;
+
+   while (done < Size) {
+      const MemoryBlock *block = FindBlock(Address + done);
+      if (!block) {
+         break;
+      }
+
+      uint64_t offset = Address + done - block->Start;
+      uint64_t available = block->Size - offset;
+      size_t chunk = Size - done;
+      if (chunk > available) {
+         chunk = (size_t)available;
+      }
+      if (!Inflate(block->Rva + offset, chunk)) {
+         break;
+      }
+
+      memcpy(out + done, m_Data + block->Rva + offset, chunk);
+      done += chunk;
+   }
+
+   return done;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,248 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Read-only, zero-copy access to minidump (MDMP) files.
+ *
+ * The file is memory mapped and every accessor returns a view into the
+ * mapping, so that opening even a multi-gigabyte full dump only touches
+ * the header, the stream directory and whatever is actually looked at.
+ *
+ * Block compressed dumps (see compress.h) are inflated into an anonymous
+ * mapping of the full minidump size, a block at a time as accessors touch
+ * them, so the views remain valid for the lifetime of the file.
+ */
+
+#ifndef _MINIDUMPREADER_H_
+#define _MINIDUMPREADER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "compress.h"
+#include "minidump.h"
+
+
+/*
+ * A counted array of records inside the mapping.
+ */
+template< class T >
+struct MinidumpArray
+{
+   const T *Data;
+   size_t Count;
+
+   MinidumpArray() : Data(NULL), Count(0) {}
+   MinidumpArray(const T *Data, size_t Count) : Data(Data), Count(Count) {}
+
+   size_t
+   size(void) const { return Count; }
+
+   bool
+   empty(void) const { return Count == 0; }
+
+   const T &
+   operator [] (size_t i) const { return Data[i]; }
+
+   const T *
+   begin(void) const { return Data; }
+
+   const T *
+   end(void) const { return Data + Count; }
+};
+
+
+class MinidumpFile
+{
+public:
+   ~MinidumpFile();
+
+   /*
+    * Map and validate a minidump.  Returns NULL on failure.
+    */
+   static MinidumpFile *
+   Open(const char *Path);
+
+   const std::string &
+   Path(void) const { return m_Path; }
+
+   /*
+    * Size of the minidump, after inflating it if compressed.
+    */
+   uint64_t
+   Size(void) const { return m_Size; }
+
+   bool
+   Compressed(void) const { return m_Index != NULL; }
+
+   const MDRawHeader &
+   Header(void) const { return *m_Header; }
+
+   MinidumpArray<MDRawDirectory>
+   Directory(void) const { return m_Directory; }
+
+   /*
+    * Find the first stream of the given type.  Returns NULL when absent.
+    */
+   const void *
+   FindStream(uint32_t StreamType, uint32_t *Size = NULL) const;
+
+   /*
+    * Resolve a location descriptor, or an RVA and size, into a pointer to
+    * the mapping.  Returns NULL when it falls outside the file.
+    */
+   const void *
+   GetData(const MDLocationDescriptor &Location) const;
+
+   const void *
+   GetData(uint64_t Rva, uint64_t Size) const;
+
+   MinidumpArray<MDRawThread>
+   Threads(void) const;
+
+   MinidumpArray<MDRawModule>
+   Modules(void) const;
+
+   MinidumpArray<MDMemoryDescriptor>
+   MemoryRanges(void) const;
+
+   MinidumpArray<MDMemoryDescriptor64>
+   Memory64Ranges(void) const;
+
+   const MDRawExceptionStream *
+   Exception(void) const;
+
+   const MDRawSystemInfo *
+   SystemInfo(void) const;
+
+   /*
+    * CPU architecture of the dump (MD_CPU_ARCHITECTURE_*), or ~0 if unknown.
+    */
+   unsigned
+   Architecture(void) const;
+
+   /*
+    * Thread contexts.  Each returns NULL if the context is missing or of
+    * another architecture.
+    */
+   const MDRawContextAMD64 *
+   ContextAMD64(const MDLocationDescriptor &Location) const;
+
+   const MDRawContextX86 *
+   ContextX86(const MDLocationDescriptor &Location) const;
+
+   /*
+    * Read a MINIDUMP_STRING, converting it to UTF-8.
+    */
+   std::string
+   GetString(uint32_t Rva) const;
+
+   std::string
+   ModuleName(const MDRawModule &Module) const;
+
+   std::string
+   ThreadName(uint32_t ThreadId) const;
+
+   /*
+    * Find captured memory.  Returns a pointer into the mapping when the
+    * whole range was captured in a single block, otherwise NULL.
+    */
+   const uint8_t *
+   GetMemory(uint64_t Address, uint64_t Size) const;
+
+   /*
+    * Copy captured memory, possibly spanning blocks.  Returns the number of
+    * contiguous bytes read from Address.
+    */
+   size_t
+   ReadMemory(uint64_t Address, void *Buffer, size_t Size) const;
+
+private:
+   MinidumpFile();
+
+   bool
+   Parse(void);
+
+   bool
+   OpenBlocks(void);
+
+   /* Whether a range lies within the minidump, without touching it. */
+   bool
+   Contains(uint64_t Rva, uint64_t Size) const;
+
+   /* Make sure the blocks backing a range are inflated. */
+   bool
+   Inflate(uint64_t Rva, uint64_t Size) const;
+
+   struct MemoryBlock
+   {
+      uint64_t Start;
+      uint64_t Size;
+      uint64_t Rva;
+
+      bool
+      operator < (const MemoryBlock &other) const { return Start < other.Start; }
+   };
+
+   const MemoryBlock *
+   FindBlock(uint64_t Address) const;
+
+   std::string m_Path;
+
+   /* The file mapping. */
+   const uint8_t *m_File;
+   uint64_t m_FileSize;
+
+   /* The minidump: the file mapping itself, unless compressed. */
+   const uint8_t *m_Data;
+   uint64_t m_Size;
+
+   /* Compressed blocks, and which of them were inflated already. */
+   const BlockHeader *m_BlockHeader;
+   const BlockIndexEntry *m_Index;
+   mutable std::vector<bool> m_Inflated;
+   mutable std::mutex m_InflateMutex;
+#ifdef _WIN32
+   void *m_hFile;
+   void *m_hMapping;
+#endif
+
+   const MDRawHeader *m_Header;
+   MinidumpArray<MDRawDirectory> m_Directory;
+
+   /* All memory blocks, from both memory lists, sorted by address. */
+   std::vector<MemoryBlock> m_Blocks;
+};
+
+
+#endif /* _MINIDUMPREADER_H_ */
+
+/* vim:set sw=3 et: */
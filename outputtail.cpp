@@ -0,0 +1,151 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "outputtail.h"
+#include "report.h"
+
+
+#define OUTPUT_REPORT_PIECE (64*1024)
+
+
+OutputTail::OutputTail(size_t Capacity) :
+   m_Capacity(Capacity ? Capacity : 1),
+   m_Head(0)
+{
+}
+
+
+/*
+ * Forget the output before the given offset.
+ */
+void
+OutputTail::Forget(uint64_t Limit)
+{
+   while (!m_Pieces.empty() && m_Pieces.front().Offset < Limit) {
+      Piece &piece = m_Pieces.front();
+      if (piece.Offset + piece.Size <= Limit) {
+         m_Pieces.pop_front();
+      } else {
+         piece.Size -= (size_t)(Limit - piece.Offset);
+         piece.Offset = Limit;
+      }
+   }
+}
+
+
+char *
+OutputTail::Reserve(size_t *Size)
+{
+   size_t capacity = m_Capacity;
+   size_t offset = (size_t)(m_Head % capacity);
+
+   if (*Size > capacity - offset) {
+      *Size = capacity - offset;
+   }
+
+   /* Grown as output arrives, as most programs never fill it. */
+   if (offset + *Size > m_Buffer.size()) {
+      m_Buffer.resize(std::min(capacity, std::max(offset + *Size, 2*m_Buffer.size())));
+   }
+
+   /* Whatever is there gets overwritten. */
+   if (m_Head + *Size > capacity) {
+      Forget(m_Head + *Size - capacity);
+   }
+
+   return &m_Buffer[offset];
+}
+
+
+void
+OutputTail::Commit(OutputStream Stream, uint64_t Time, size_t Size)
+{
+   if (!Size) {
+      return;
+   }
+
+   /* Merge with the previous piece, unless that ended at the wrap. */
+   if (!m_Pieces.empty()) {
+      Piece &last = m_Pieces.back();
+      if (last.Stream == Stream && last.Time == Time &&
+          last.Offset + last.Size == m_Head && m_Head % m_Capacity != 0) {
+         last.Size += Size;
+         m_Head += Size;
+         return;
+      }
+   }
+
+   Piece piece;
+   piece.Time = Time;
+   piece.Stream = Stream;
+   piece.Offset = m_Head;
+   piece.Size = Size;
+   m_Pieces.push_back(piece);
+
+   m_Head += Size;
+}
+
+
+void
+OutputTail::Append(OutputStream Stream, uint64_t Time, const char *Data, size_t Size)
+{
+   while (Size) {
+      size_t size = Size;
+      char *space = Reserve(&size);
+      memcpy(space, Data, size);
+      Commit(Stream, Time, size);
+      Data += size;
+      Size -= size;
+   }
+}
+
+
+void
+OutputTail::Report(ReportWriter *writer) const
+{
+   std::deque<Piece>::const_iterator it;
+   for (it = m_Pieces.begin(); it != m_Pieces.end(); ++it) {
+      /* Pieces never wrap. */
+      const char *data = &m_Buffer[(size_t)(it->Offset % m_Capacity)];
+
+      /* Report records are kept small. */
+      for (size_t done = 0; done < it->Size; done += OUTPUT_REPORT_PIECE) {
+         size_t size = it->Size - done;
+         if (size > OUTPUT_REPORT_PIECE) {
+            size = OUTPUT_REPORT_PIECE;
+         }
+         writer->Output(it->Time, it->Stream, data + done, size);
+      }
+   }
+}
+
+
+/* vim:set sw=3 et: */
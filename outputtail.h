@@ -0,0 +1,106 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * The last few megabytes of a program's output, with the time each piece
+ * arrived, for crash reports.
+ *
+ * Bytes go into a fixed ring buffer, overwriting the oldest, and pieces
+ * (chunks of one stream received together) are tracked alongside.  Reads
+ * can go straight into the ring with Reserve and Commit, so keeping the
+ * tail costs no copy beyond the one needed to have the bytes at all.
+ */
+
+#ifndef _OUTPUTTAIL_H_
+#define _OUTPUTTAIL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+
+class ReportWriter;
+
+
+enum OutputStream {
+   OUTPUT_STDOUT = 1,
+   OUTPUT_STDERR = 2,
+   OUTPUT_DEBUG = 3        /* OutputDebugString */
+};
+
+
+class OutputTail
+{
+public:
+   OutputTail(size_t Capacity);
+
+   /*
+    * Contiguous space for up to Size bytes, the oldest output it takes
+    * up being forgotten.  Returns the space actually available in *Size.
+    */
+   char *
+   Reserve(size_t *Size);
+
+   /*
+    * Keep Size bytes written into the space last reserved.
+    */
+   void
+   Commit(OutputStream Stream, uint64_t Time, size_t Size);
+
+   void
+   Append(OutputStream Stream, uint64_t Time, const char *Data, size_t Size);
+
+   /*
+    * Pass the pieces kept on to a report, oldest first.
+    */
+   void
+   Report(ReportWriter *writer) const;
+
+private:
+   struct Piece
+   {
+      uint64_t Time;       /* ms */
+      OutputStream Stream;
+      uint64_t Offset;     /* bytes written before it */
+      size_t Size;
+   };
+
+   size_t m_Capacity;
+   std::vector<char> m_Buffer;
+   uint64_t m_Head;        /* bytes written so far */
+   std::deque<Piece> m_Pieces;
+
+   void
+   Forget(uint64_t Limit);
+};
+
+
+#endif /* _OUTPUTTAIL_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,453 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/ucontext.h>
+#include <sys/wait.h>
+
+#include "elfimage.h"
+#include "process.h"
+
+
+Process::Process(pid_t Pid) :
+   Pid(Pid),
+   Memory(Pid)
+{
+}
+
+
+Process::~Process()
+{
+   ReleaseModules(Modules);
+}
+
+
+Thread *
+Process::FindThread(pid_t Tid)
+{
+   std::map<pid_t, Thread>::iterator it = Threads.find(Tid);
+   if (it == Threads.end()) {
+      return NULL;
+   }
+   return &it->second;
+}
+
+
+Thread *
+Process::AddThread(pid_t Tid)
+{
+   Thread *thread = FindThread(Tid);
+   if (!thread) {
+      thread = &Threads[Tid];
+      memset(thread, 0, sizeof *thread);
+      thread->Tid = Tid;
+      thread->State = THREAD_RUNNING;
+   }
+   return thread;
+}
+
+
+void
+Process::RemoveThread(pid_t Tid)
+{
+   Threads.erase(Tid);
+}
+
+
+void
+Process::GetThreadRegisters(void)
+{
+   std::map<pid_t, Thread>::iterator it;
+
+   Memory.Invalidate();
+
+   for (it = Threads.begin(); it != Threads.end(); ++it) {
+      Thread &thread = it->second;
+
+      if (thread.State == THREAD_RUNNING) {
+         continue;
+      }
+
+      if (ptrace(PTRACE_GETREGS, thread.Tid, NULL, &thread.Regs) != 0) {
+         fprintf(stderr, "warning: failed to get registers of thread %d (%s)\n",
+                 thread.Tid, strerror(errno));
+      }
+      ptrace(PTRACE_GETFPREGS, thread.Tid, NULL, &thread.FpRegs);
+   }
+}
+
+
+bool
+Process::ReadSignalContext(Thread *thread, uint64_t Context)
+{
+   ucontext_t uc;
+
+   if (ReadMemory(Context, &uc, sizeof uc) != sizeof uc) {
+      return false;
+   }
+
+   const greg_t *gregs = uc.uc_mcontext.gregs;
+   struct user_regs_struct &regs = thread->Regs;
+
+   regs.r8 = gregs[REG_R8];
+   regs.r9 = gregs[REG_R9];
+   regs.r10 = gregs[REG_R10];
+   regs.r11 = gregs[REG_R11];
+   regs.r12 = gregs[REG_R12];
+   regs.r13 = gregs[REG_R13];
+   regs.r14 = gregs[REG_R14];
+   regs.r15 = gregs[REG_R15];
+   regs.rdi = gregs[REG_RDI];
+   regs.rsi = gregs[REG_RSI];
+   regs.rbp = gregs[REG_RBP];
+   regs.rbx = gregs[REG_RBX];
+   regs.rdx = gregs[REG_RDX];
+   regs.rax = gregs[REG_RAX];
+   regs.rcx = gregs[REG_RCX];
+   regs.rsp = gregs[REG_RSP];
+   regs.rip = gregs[REG_RIP];
+   regs.eflags = gregs[REG_EFL];
+   regs.cs = gregs[REG_CSGSFS] & 0xffff;
+
+   if (uc.uc_mcontext.fpregs) {
+      ReadMemory((uintptr_t)uc.uc_mcontext.fpregs, &thread->FpRegs, sizeof thread->FpRegs);
+   }
+
+   return true;
+}
+
+
+/* x86-64 syscall instruction */
+#define SYSCALL_INSN 0x050f
+
+
+pid_t
+Process::ForkSnapshot(pid_t Tid)
+{
+   Thread *thread = FindThread(Tid);
+   if (!thread || thread->State != THREAD_STOPPED) {
+      return -1;
+   }
+
+   struct user_regs_struct saved;
+   if (ptrace(PTRACE_GETREGS, Tid, NULL, &saved) != 0) {
+      return -1;
+   }
+
+   /*
+    * Borrow the code at the current PC for a syscall instruction.  The other
+    * threads are stopped, so none of them can trip on it.
+    */
+   errno = 0;
+   long word = ptrace(PTRACE_PEEKTEXT, Tid, (void *)saved.rip, NULL);
+   if (errno != 0) {
+      return -1;
+   }
+   long patched = (word & ~0xffffL) | SYSCALL_INSN;
+   if (ptrace(PTRACE_POKETEXT, Tid, (void *)saved.rip, (void *)patched) != 0) {
+      return -1;
+   }
+
+   /*
+    * CLONE_PTRACE keeps the child traced, and stopped from the start.  With
+    * CLONE_PARENT and no exit signal it stays out of sight of the target's
+    * own wait() calls.  A negative orig_rax stops the kernel from restarting
+    * an interrupted system call on our behalf.
+    */
+   struct user_regs_struct regs = saved;
+   regs.rax = SYS_clone;
+   regs.orig_rax = (unsigned long long)-1;
+   regs.rdi = CLONE_PTRACE | CLONE_PARENT;
+   regs.rsi = 0;
+   regs.rdx = 0;
+   regs.r10 = 0;
+   regs.r8 = 0;
+
+   pid_t child = -1;
+   bool alive = true;
+
+   if (ptrace(PTRACE_SETREGS, Tid, NULL, &regs) == 0) {
+      for (;;) {
+         int status;
+         if (ptrace(PTRACE_SINGLESTEP, Tid, NULL, NULL) != 0 ||
+             waitpid(Tid, &status, __WALL) != Tid ||
+             !WIFSTOPPED(status)) {
+            alive = false;
+            break;
+         }
+
+         /* Event stops, e.g. PTRACE_EVENT_FORK when following forks, just
+          * precede the trap. */
+         if (status >> 16) {
+            continue;
+         }
+
+         int sig = WSTOPSIG(status);
+         if (sig == SIGTRAP) {
+            if (ptrace(PTRACE_GETREGS, Tid, NULL, &regs) == 0 &&
+                regs.rip == saved.rip + 2 &&
+                (long long)regs.rax > 0) {
+               child = (pid_t)regs.rax;
+            }
+            break;
+         }
+
+         /* Signal which arrived meanwhile; deliver it once resumed. */
+         thread->PendingSignal = sig;
+      }
+   }
+
+   if (!alive) {
+      /* Killed under our feet, so there is nothing left to restore. */
+      return -1;
+   }
+
+   ptrace(PTRACE_POKETEXT, Tid, (void *)saved.rip, (void *)word);
+   if (ptrace(PTRACE_SETREGS, Tid, NULL, &saved) != 0) {
+      fprintf(stderr, "warning: failed to restore registers of thread %d (%s)\n",
+              Tid, strerror(errno));
+   }
+
+   if (child > 0) {
+      int status;
+      if (waitpid(child, &status, __WALL) != child || !WIFSTOPPED(status)) {
+         ReleaseSnapshot(child);
+         return -1;
+      }
+      /* The snapshot got a copy of the patched code too. */
+      ptrace(PTRACE_POKETEXT, child, (void *)saved.rip, (void *)word);
+   }
+
+   return child;
+}
+
+
+void
+Process::ReleaseSnapshot(pid_t Pid)
+{
+   kill(Pid, SIGKILL);
+
+   int status;
+   while (waitpid(Pid, &status, __WALL) == Pid) {
+      if (WIFEXITED(status) || WIFSIGNALED(status)) {
+         break;
+      }
+      /* Exit stop */
+      ptrace(PTRACE_CONT, Pid, NULL, NULL);
+   }
+}
+
+
+/*
+ * Compute the load bias of a module from one of its file mappings.
+ */
+static uint64_t
+ComputeBias(const ElfImage *Image, uint64_t Start, uint64_t Offset, uint64_t Base)
+{
+   const std::vector<ElfSegment> &segments = Image->Segments();
+
+   for (size_t i = 0; i < segments.size(); ++i) {
+      if ((segments[i].Offset & ~(uint64_t)0xfff) == Offset) {
+         return Start - (segments[i].VirtualAddress & ~(uint64_t)0xfff);
+      }
+   }
+
+   return Base - Image->MinAddress();
+}
+
+
+void
+Process::LoadModules(const std::vector<std::string> &DebugDirs)
+{
+   char path[64];
+   FILE *fp;
+
+   /* Released last, so that the images still in use are not evicted. */
+   std::vector<Module> old;
+   old.swap(Modules);
+   Regions.clear();
+
+   snprintf(path, sizeof path, "/proc/%d/maps", Pid);
+   fp = fopen(path, "r");
+   if (!fp) {
+      fprintf(stderr, "warning: failed to open %s (%s)\n", path, strerror(errno));
+      ReleaseModules(old);
+      return;
+   }
+
+   char line[4096 + 128];
+   while (fgets(line, sizeof line, fp)) {
+      unsigned long long start, end, offset;
+      char perms[8];
+      int nameOffset = 0;
+
+      if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n",
+                 &start, &end, perms, &offset, &nameOffset) < 4) {
+         continue;
+      }
+
+      char *name = line + nameOffset;
+      name[strcspn(name, "\n")] = 0;
+
+      MemoryRegion region;
+      region.Start = start;
+      region.End = end;
+      region.Offset = offset;
+      region.Protection = (perms[0] == 'r' ? PROT_READ : 0) |
+                          (perms[1] == 'w' ? PROT_WRITE : 0) |
+                          (perms[2] == 'x' ? PROT_EXEC : 0);
+      region.Path = name;
+      Regions.push_back(region);
+
+      if (name[0] != '/' && strcmp(name, "[vdso]") != 0) {
+         continue;
+      }
+
+      /* Mappings of the same file are contiguous. */
+      if (!Modules.empty() && Modules.back().Path == name) {
+         Module &module = Modules.back();
+         if (end > module.End) {
+            module.End = end;
+         }
+         continue;
+      }
+
+      Module module;
+      module.Base = start;
+      module.End = end;
+      module.Path = name;
+      module.Name = ModuleNameFromPath(name);
+      module.Image = NULL;
+      module.Bias = 0;
+
+      if (module.Path == "[vdso]") {
+         size_t size = end - start;
+         void *buffer = malloc(size);
+         if (buffer && ReadMemory(start, buffer, size) == size) {
+            module.Image = ElfImage::FromMemory(buffer, size, name);
+         } else {
+            free(buffer);
+         }
+      } else {
+         module.Image = ElfImage::OpenShared(module.Path, std::string(), DebugDirs);
+      }
+
+      if (module.Image) {
+         module.Bias = ComputeBias(module.Image, start, offset, start);
+      }
+
+      Modules.push_back(module);
+   }
+
+   fclose(fp);
+
+   ReleaseModules(old);
+}
+
+
+size_t
+Process::ReadMemory(uint64_t Address, void *Buffer, size_t Size)
+{
+   return Memory.Read(Address, Buffer, Size);
+}
+
+
+const Module *
+Process::FindModule(uint64_t Address)
+{
+   /* /proc/<pid>/maps lists mappings in address order. */
+   size_t lo = 0;
+   size_t hi = Modules.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (Modules[mid].Base <= Address) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo == 0 || Address >= Modules[lo - 1].End) {
+      return NULL;
+   }
+   return &Modules[lo - 1];
+}
+
+
+const MemoryRegion *
+Process::FindRegion(uint64_t Address) const
+{
+   size_t lo = 0;
+   size_t hi = Regions.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (Regions[mid].Start <= Address) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo == 0 || Address >= Regions[lo - 1].End) {
+      return NULL;
+   }
+   return &Regions[lo - 1];
+}
+
+
+void
+RegistersToDwarf(const struct user_regs_struct &Regs, uint64_t Dwarf[DW_REG_COUNT])
+{
+   Dwarf[DW_REG_RAX] = Regs.rax;
+   Dwarf[DW_REG_RDX] = Regs.rdx;
+   Dwarf[DW_REG_RCX] = Regs.rcx;
+   Dwarf[DW_REG_RBX] = Regs.rbx;
+   Dwarf[DW_REG_RSI] = Regs.rsi;
+   Dwarf[DW_REG_RDI] = Regs.rdi;
+   Dwarf[DW_REG_RBP] = Regs.rbp;
+   Dwarf[DW_REG_RSP] = Regs.rsp;
+   Dwarf[DW_REG_R8] = Regs.r8;
+   Dwarf[DW_REG_R9] = Regs.r9;
+   Dwarf[DW_REG_R10] = Regs.r10;
+   Dwarf[DW_REG_R11] = Regs.r11;
+   Dwarf[DW_REG_R12] = Regs.r12;
+   Dwarf[DW_REG_R13] = Regs.r13;
+   Dwarf[DW_REG_R14] = Regs.r14;
+   Dwarf[DW_REG_R15] = Regs.r15;
+   Dwarf[DW_REG_RIP] = Regs.rip;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,162 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * A live Linux process, traced with ptrace.
+ */
+
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "remotememory.h"
+#include "target.h"
+
+
+enum ThreadState {
+   THREAD_RUNNING = 0,
+   THREAD_STOPPED,         /* in some ptrace-stop, registers accessible */
+   THREAD_EXITING          /* stopped at PTRACE_EVENT_EXIT */
+};
+
+
+struct Thread
+{
+   pid_t Tid;
+   ThreadState State;
+   bool HaveSigInfo;
+   siginfo_t SigInfo;      /* last potentially fatal signal */
+   int PendingSignal;      /* to deliver once resumed */
+   struct user_regs_struct Regs;
+   struct user_fpregs_struct FpRegs;
+};
+
+
+/*
+ * A writable or executable mapping of the target address space.
+ */
+struct MemoryRegion
+{
+   uint64_t Start;
+   uint64_t End;
+   uint64_t Offset;
+   unsigned Protection;    /* PROT_* flags */
+   std::string Path;
+};
+
+
+class Process : public Target
+{
+public:
+   Process(pid_t Pid);
+   ~Process();
+
+   pid_t Pid;
+   std::map<pid_t, Thread> Threads;
+   std::vector<Module> Modules;
+   std::vector<MemoryRegion> Regions;
+
+   /* Shared by everything reading the target: unwinder, dump writer, etc. */
+   RemoteMemory Memory;
+
+   Thread *
+   FindThread(pid_t Tid);
+
+   Thread *
+   AddThread(pid_t Tid);
+
+   void
+   RemoveThread(pid_t Tid);
+
+   /*
+    * Fetch the registers of all stopped threads.  As the threads may have
+    * run since last time, this also drops the memory cache.
+    */
+   void
+   GetThreadRegisters(void);
+
+   /*
+    * Replace the registers of a thread parked in a signal handler with the
+    * ones at the time the signal was raised, from the handler's ucontext_t.
+    */
+   bool
+   ReadSignalContext(Thread *thread, uint64_t Context);
+
+   /*
+    * Make the stopped thread Tid fork the process, by injecting a clone
+    * system call, into a frozen copy-on-write snapshot which is left
+    * ptrace-stopped.  The thread's registers are restored, but signals
+    * received meanwhile go to its PendingSignal.  Returns the snapshot pid,
+    * or -1.
+    */
+   pid_t
+   ForkSnapshot(pid_t Tid);
+
+   /*
+    * Kill and reap a snapshot from ForkSnapshot.
+    */
+   static void
+   ReleaseSnapshot(pid_t Pid);
+
+   /*
+    * (Re)read /proc/<pid>/maps and load the images of all mapped modules.
+    */
+   void
+   LoadModules(const std::vector<std::string> &DebugDirs);
+
+   /*
+    * Find the mapping containing the given address, or NULL.
+    */
+   const MemoryRegion *
+   FindRegion(uint64_t Address) const;
+
+   /* Target */
+   size_t
+   ReadMemory(uint64_t Address, void *Buffer, size_t Size);
+
+   const Module *
+   FindModule(uint64_t Address);
+};
+
+
+/*
+ * Convert ptrace registers to DWARF numbering.
+ */
+void
+RegistersToDwarf(const struct user_regs_struct &Regs, uint64_t Dwarf[DW_REG_COUNT]);
+
+
+#endif /* _PROCESS_H_ */
+
+/* vim:set sw=3 et: */
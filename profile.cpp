@@ -0,0 +1,184 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "profile.h"
+#include "symbolize.h"
+
+
+/* FNV-1a */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+
+
+static inline uint64_t
+HashBytes(uint64_t Hash, const void *Data, size_t Size)
+{
+   const uint8_t *bytes = (const uint8_t *)Data;
+   for (size_t i = 0; i < Size; ++i) {
+      Hash = (Hash ^ bytes[i]) * FNV_PRIME;
+   }
+   return Hash;
+}
+
+
+static bool
+SameStack(const std::vector<StackFrame> &A, const std::vector<StackFrame> &B)
+{
+   if (A.size() != B.size()) {
+      return false;
+   }
+   for (size_t i = 0; i < A.size(); ++i) {
+      if (A[i].Pc != B[i].Pc || A[i].Signal != B[i].Signal) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
+Profile::Profile() :
+   m_Samples(0)
+{
+}
+
+
+void
+Profile::Add(const std::string &Thread, const std::vector<StackFrame> &Frames)
+{
+   uint64_t hash = HashBytes(FNV_OFFSET, Thread.data(), Thread.size());
+   for (size_t i = 0; i < Frames.size(); ++i) {
+      uint64_t pc = Frames[i].Pc | (uint64_t)Frames[i].Signal << 63;
+      hash = HashBytes(hash, &pc, sizeof pc);
+   }
+
+   ++m_Samples;
+
+   std::vector<Stack> &chain = m_Stacks[hash];
+   for (size_t i = 0; i < chain.size(); ++i) {
+      if (chain[i].Thread == Thread && SameStack(chain[i].Frames, Frames)) {
+         ++chain[i].Count;
+         return;
+      }
+   }
+
+   Stack stack;
+   stack.Thread = Thread;
+   stack.Frames = Frames;
+   stack.Count = 1;
+   chain.push_back(stack);
+}
+
+
+/*
+ * Reduce "module!function+0x12 [file @ line]" to "module!function", so
+ * that samples anywhere in a function add up.
+ */
+static std::string
+FoldedName(const std::string &Site)
+{
+   std::string name = Site.substr(0, Site.find(" ["));
+
+   size_t plus = name.rfind("+0x");
+   if (plus != std::string::npos &&
+       name.find_first_not_of("0123456789abcdef", plus + 3) == std::string::npos) {
+      name.resize(plus);
+   }
+
+   /* Semicolons separate frames. */
+   for (size_t i = 0; i < name.size(); ++i) {
+      if (name[i] == ';') {
+         name[i] = ':';
+      }
+   }
+   return name;
+}
+
+
+void
+Profile::Fold(Target *target, FoldedStacks &Folded)
+{
+   /* Folded frames, outermost first, per distinct address. */
+   std::map<std::pair<uint64_t, bool>, std::string> names;
+   std::vector<std::string> sites;
+
+   std::unordered_map<uint64_t, std::vector<Stack> >::const_iterator it;
+   for (it = m_Stacks.begin(); it != m_Stacks.end(); ++it) {
+      for (size_t i = 0; i < it->second.size(); ++i) {
+         const Stack &stack = it->second[i];
+         std::string line = FoldedName(stack.Thread);
+
+         for (size_t j = stack.Frames.size(); j-- > 0; ) {
+            const StackFrame &frame = stack.Frames[j];
+            bool exact = j == 0 || frame.Signal;
+
+            std::string &name = names[std::make_pair(frame.Pc, exact)];
+            if (name.empty()) {
+               SymbolizeFrames(target, frame.Pc, exact, sites);
+               for (size_t k = sites.size(); k-- > 0; ) {
+                  name += ';';
+                  name += FoldedName(sites[k]);
+               }
+            }
+            line += name;
+         }
+
+         Folded[line] += stack.Count;
+      }
+   }
+
+   m_Stacks.clear();
+   m_Samples = 0;
+}
+
+
+bool
+WriteFoldedStacks(const char *Path, const FoldedStacks &Folded)
+{
+   FILE *fp = fopen(Path, "wt");
+   if (!fp) {
+      fprintf(stderr, "error: failed to create %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+
+   FoldedStacks::const_iterator it;
+   for (it = Folded.begin(); it != Folded.end(); ++it) {
+      fprintf(fp, "%s %lu\n", it->first.c_str(), it->second);
+   }
+
+   if (fclose(fp) != 0) {
+      fprintf(stderr, "error: failed to write %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+   return true;
+}
+
+
+/* vim:set sw=3 et: */
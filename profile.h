@@ -0,0 +1,98 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Sampling profiles of a traced process, as folded stacks.
+ *
+ * Samples are aggregated by hashed stack as raw PCs, so that taking one
+ * costs no symbol lookups.  Stacks are only symbolized when the profile
+ * is folded, once per distinct PC, into the one line per stack format of
+ * flamegraph.pl:
+ *
+ *   thread;outer!function;inner!function <count>
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "target.h"
+#include "unwind.h"
+
+
+typedef std::map<std::string, unsigned long> FoldedStacks;
+
+
+class Profile
+{
+public:
+   Profile();
+
+   /*
+    * Count one sample of a thread, frames innermost first.
+    */
+   void
+   Add(const std::string &Thread, const std::vector<StackFrame> &Frames);
+
+   unsigned long
+   Samples(void) const { return m_Samples; }
+
+   /*
+    * Symbolize the samples against the modules of target, which must be
+    * those the samples were taken with, merge them into Folded, and start
+    * over.
+    */
+   void
+   Fold(Target *target, FoldedStacks &Folded);
+
+private:
+   struct Stack
+   {
+      std::string Thread;
+      std::vector<StackFrame> Frames;
+      unsigned long Count;
+   };
+
+   /* Distinct stacks by hash, colliding ones chained. */
+   std::unordered_map<uint64_t, std::vector<Stack> > m_Stacks;
+   unsigned long m_Samples;
+};
+
+
+bool
+WriteFoldedStacks(const char *Path, const FoldedStacks &Folded);
+
+
+#endif /* _PROFILE_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,338 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+
+#include "remotememory.h"
+
+
+/* Reads spanning more pages than this go straight to the target. */
+#define REMOTE_MEMORY_DIRECT_PAGES 64
+
+
+RemoteMemory::RemoteMemory(pid_t Pid, size_t MaxPages) :
+   Hits(0),
+   Misses(0),
+   Syscalls(0),
+   m_Pid(Pid),
+   m_MaxPagesPerShard(std::max<size_t>(MaxPages / SHARD_COUNT, 1)),
+   m_MemFd(-1)
+{
+}
+
+
+RemoteMemory::~RemoteMemory()
+{
+   Invalidate();
+   if (m_MemFd >= 0) {
+      close(m_MemFd);
+   }
+}
+
+
+void
+RemoteMemory::Invalidate(void)
+{
+   for (unsigned i = 0; i < SHARD_COUNT; ++i) {
+      Shard &shard = m_Shards[i];
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+      std::list<Page *>::iterator it;
+      for (it = shard.Lru.begin(); it != shard.Lru.end(); ++it) {
+         delete *it;
+      }
+      shard.Lru.clear();
+      shard.Pages.clear();
+   }
+}
+
+
+void
+RemoteMemory::Retarget(pid_t Pid)
+{
+   Invalidate();
+
+   std::lock_guard<std::mutex> lock(m_MemFdMutex);
+   if (m_MemFd >= 0) {
+      close(m_MemFd);
+      m_MemFd = -1;
+   }
+   m_Pid = Pid;
+}
+
+
+/*
+ * Read through /proc/<pid>/mem, which, unlike process_vm_readv, can also
+ * access pages without read permission on behalf of the tracer.
+ */
+size_t
+RemoteMemory::ReadProcMem(uint64_t Address, void *Buffer, size_t Size)
+{
+   {
+      std::lock_guard<std::mutex> lock(m_MemFdMutex);
+      if (m_MemFd < 0) {
+         char path[64];
+         snprintf(path, sizeof path, "/proc/%d/mem", m_Pid);
+         m_MemFd = open(path, O_RDONLY | O_CLOEXEC);
+         if (m_MemFd < 0) {
+            return 0;
+         }
+      }
+   }
+
+   ++Syscalls;
+   ssize_t ret = pread(m_MemFd, Buffer, Size, (off_t)Address);
+   return ret > 0 ? ret : 0;
+}
+
+
+size_t
+RemoteMemory::ReadDirect(uint64_t Address, void *Buffer, size_t Size)
+{
+   struct iovec local;
+   struct iovec remote;
+
+   local.iov_base = Buffer;
+   local.iov_len = Size;
+   remote.iov_base = (void *)(uintptr_t)Address;
+   remote.iov_len = Size;
+
+   ++Syscalls;
+   ssize_t ret = process_vm_readv(m_Pid, &local, 1, &remote, 1, 0);
+   if (ret == (ssize_t)Size) {
+      return Size;
+   }
+
+   size_t size = ReadProcMem(Address, Buffer, Size);
+   return std::max(size, ret > 0 ? (size_t)ret : (size_t)0);
+}
+
+
+/*
+ * Fill in the given pages, as many per syscall as possible.
+ */
+void
+RemoteMemory::Fetch(std::vector<Page *> &Pages)
+{
+   std::vector<struct iovec> local(Pages.size());
+   std::vector<struct iovec> remote(Pages.size());
+
+   for (size_t i = 0; i < Pages.size(); ++i) {
+      local[i].iov_base = Pages[i]->Data;
+      local[i].iov_len = REMOTE_PAGE_SIZE;
+      remote[i].iov_base = (void *)(uintptr_t)Pages[i]->Address;
+      remote[i].iov_len = REMOTE_PAGE_SIZE;
+      Pages[i]->Valid = false;
+   }
+
+   /* A failing page ends the transfer; carry on after it. */
+   size_t next = 0;
+   while (next < Pages.size()) {
+      size_t count = std::min<size_t>(Pages.size() - next, IOV_MAX);
+
+      ++Syscalls;
+      ssize_t ret = process_vm_readv(m_Pid, &local[next], count, &remote[next], count, 0);
+      size_t done = ret > 0 ? ret / REMOTE_PAGE_SIZE : 0;
+
+      for (size_t i = 0; i < done; ++i) {
+         Pages[next + i]->Valid = true;
+      }
+      next += done;
+
+      if (done < count) {
+         Page *page = Pages[next];
+         page->Valid = ReadProcMem(page->Address, page->Data, REMOTE_PAGE_SIZE) == REMOTE_PAGE_SIZE;
+         ++next;
+      }
+   }
+
+   Misses += Pages.size();
+}
+
+
+/*
+ * Hand fetched pages over to the cache, evicting the least recently used
+ * ones.  Pages someone else cached meanwhile are dropped.
+ */
+void
+RemoteMemory::Insert(std::vector<Page *> &Pages)
+{
+   for (size_t i = 0; i < Pages.size(); ++i) {
+      Page *page = Pages[i];
+      Shard &shard = ShardFor(page->Address);
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+
+      if (shard.Pages.count(page->Address)) {
+         delete page;
+         continue;
+      }
+
+      shard.Lru.push_front(page);
+      page->Lru = shard.Lru.begin();
+      shard.Pages[page->Address] = page;
+
+      while (shard.Pages.size() > m_MaxPagesPerShard) {
+         Page *victim = shard.Lru.back();
+         shard.Lru.pop_back();
+         shard.Pages.erase(victim->Address);
+         delete victim;
+      }
+   }
+   Pages.clear();
+}
+
+
+size_t
+RemoteMemory::Read(uint64_t Address, void *Buffer, size_t Size)
+{
+   if (!Size) {
+      return 0;
+   }
+
+   uint64_t first = Address & ~(uint64_t)(REMOTE_PAGE_SIZE - 1);
+   uint64_t last = (Address + Size - 1) & ~(uint64_t)(REMOTE_PAGE_SIZE - 1);
+   if (last < first) {
+      return 0;
+   }
+   size_t count = (last - first) / REMOTE_PAGE_SIZE + 1;
+   if (count > REMOTE_MEMORY_DIRECT_PAGES) {
+      return ReadDirect(Address, Buffer, Size);
+   }
+
+   /*
+    * Copy out the cached pages, and fetch the missing ones in one go.
+    * Pages are copied while the shard is locked, as they may be evicted
+    * any time after.
+    */
+   uint8_t *out = (uint8_t *)Buffer;
+   size_t readable = count;
+   std::vector<Page *> missing;
+   std::vector<size_t> missingIndex;
+
+   for (size_t i = 0; i < count; ++i) {
+      uint64_t pageAddress = first + i * REMOTE_PAGE_SIZE;
+      Shard &shard = ShardFor(pageAddress);
+      std::lock_guard<std::mutex> lock(shard.Mutex);
+
+      std::unordered_map<uint64_t, Page *>::iterator it = shard.Pages.find(pageAddress);
+      if (it == shard.Pages.end()) {
+         Page *page = new Page;
+         page->Address = pageAddress;
+         missing.push_back(page);
+         missingIndex.push_back(i);
+         continue;
+      }
+
+      Page *page = it->second;
+      if (page->Lru != shard.Lru.begin()) {
+         shard.Lru.splice(shard.Lru.begin(), shard.Lru, page->Lru);
+      }
+      ++Hits;
+
+      if (!page->Valid) {
+         readable = std::min(readable, i);
+         break;
+      }
+
+      uint64_t start = std::max(Address, pageAddress);
+      uint64_t end = std::min(Address + Size, pageAddress + REMOTE_PAGE_SIZE);
+      memcpy(out + (start - Address), page->Data + (start - pageAddress), end - start);
+   }
+
+   if (!missing.empty()) {
+      Fetch(missing);
+
+      for (size_t j = 0; j < missing.size(); ++j) {
+         Page *page = missing[j];
+         size_t i = missingIndex[j];
+         if (!page->Valid) {
+            readable = std::min(readable, i);
+            continue;
+         }
+         uint64_t start = std::max(Address, page->Address);
+         uint64_t end = std::min(Address + Size, page->Address + REMOTE_PAGE_SIZE);
+         memcpy(out + (start - Address), page->Data + (start - page->Address), end - start);
+      }
+
+      Insert(missing);
+   }
+
+   if (readable == count) {
+      return Size;
+   }
+   uint64_t end = first + readable * REMOTE_PAGE_SIZE;
+   return end > Address ? (size_t)(end - Address) : 0;
+}
+
+
+void
+RemoteMemory::Prefetch(const std::vector<MemoryRange> &Ranges)
+{
+   std::vector<Page *> missing;
+
+   for (size_t r = 0; r < Ranges.size(); ++r) {
+      if (!Ranges[r].Size) {
+         continue;
+      }
+      uint64_t first = Ranges[r].Address & ~(uint64_t)(REMOTE_PAGE_SIZE - 1);
+      uint64_t last = (Ranges[r].Address + Ranges[r].Size - 1) & ~(uint64_t)(REMOTE_PAGE_SIZE - 1);
+
+      for (uint64_t address = first; address <= last && address >= first; address += REMOTE_PAGE_SIZE) {
+         Shard &shard = ShardFor(address);
+         std::lock_guard<std::mutex> lock(shard.Mutex);
+         if (!shard.Pages.count(address)) {
+            Page *page = new Page;
+            page->Address = address;
+            missing.push_back(page);
+         }
+      }
+   }
+
+   /* Ranges may overlap. */
+   std::sort(missing.begin(), missing.end(),
+             [](const Page *a, const Page *b) { return a->Address < b->Address; });
+   std::vector<Page *> unique;
+   for (size_t i = 0; i < missing.size(); ++i) {
+      if (!unique.empty() && unique.back()->Address == missing[i]->Address) {
+         delete missing[i];
+      } else {
+         unique.push_back(missing[i]);
+      }
+   }
+
+   Fetch(unique);
+   Insert(unique);
+}
+
+
+/* vim:set sw=3 et: */
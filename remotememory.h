@@ -0,0 +1,151 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Page cache over the memory of a stopped process.
+ *
+ * Stack walking reads a word at a time, which would otherwise cost a
+ * syscall per word.  Here reads are served from whole pages, fetched with
+ * scatter/gather process_vm_readv calls and kept in an LRU cache, and
+ * known hot ranges (the thread stacks) can be prefetched in one batch.
+ * Thread-safe.
+ */
+
+#ifndef _REMOTEMEMORY_H_
+#define _REMOTEMEMORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+#define REMOTE_PAGE_SIZE 4096
+
+/* 256 MiB; enough for the hot part of thousands of stacks. */
+#define REMOTE_MEMORY_MAX_PAGES 65536
+
+
+struct MemoryRange
+{
+   uint64_t Address;
+   size_t Size;
+};
+
+
+class RemoteMemory
+{
+public:
+   RemoteMemory(pid_t Pid, size_t MaxPages = REMOTE_MEMORY_MAX_PAGES);
+   ~RemoteMemory();
+
+   /*
+    * Read target memory.  Returns the number of bytes actually read, up to
+    * the first unreadable page.  Large reads (e.g., the dump writer's)
+    * bypass the cache, so as not to flush it.
+    */
+   size_t
+   Read(uint64_t Address, void *Buffer, size_t Size);
+
+   /*
+    * Fetch all pages of the given ranges that are not cached yet.
+    */
+   void
+   Prefetch(const std::vector<MemoryRange> &Ranges);
+
+   /*
+    * Forget all pages.  Must be called whenever the target ran.
+    */
+   void
+   Invalidate(void);
+
+   /*
+    * Read another process from now on, e.g. a copy-on-write snapshot of the
+    * original.  Drops the memory cache.
+    */
+   void
+   Retarget(pid_t Pid);
+
+   /* Statistics */
+   std::atomic<unsigned long> Hits;
+   std::atomic<unsigned long> Misses;
+   std::atomic<unsigned long> Syscalls;
+
+private:
+   struct Page
+   {
+      uint64_t Address;
+      bool Valid;
+      std::list<Page *>::iterator Lru;
+      uint8_t Data[REMOTE_PAGE_SIZE];
+   };
+
+   /* Pages are spread over shards, so that readers rarely contend. */
+   struct Shard
+   {
+      std::mutex Mutex;
+      std::unordered_map<uint64_t, Page *> Pages;
+      std::list<Page *> Lru;     /* most recently used first */
+   };
+
+   enum { SHARD_COUNT = 16 };
+
+   Shard &
+   ShardFor(uint64_t PageAddress)
+   {
+      return m_Shards[(PageAddress / REMOTE_PAGE_SIZE) % SHARD_COUNT];
+   }
+
+   void
+   Fetch(std::vector<Page *> &Pages);
+
+   void
+   Insert(std::vector<Page *> &Pages);
+
+   size_t
+   ReadDirect(uint64_t Address, void *Buffer, size_t Size);
+
+   size_t
+   ReadProcMem(uint64_t Address, void *Buffer, size_t Size);
+
+   pid_t m_Pid;
+   size_t m_MaxPagesPerShard;
+   Shard m_Shards[SHARD_COUNT];
+
+   int m_MemFd;
+   std::mutex m_MemFdMutex;
+};
+
+
+#endif /* _REMOTEMEMORY_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,700 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "outputtail.h"
+#include "report.h"
+
+
+/**************************************************************************
+ *
+ * JSON
+ *
+ **************************************************************************/
+
+class JsonReportWriter : public ReportWriter
+{
+public:
+   JsonReportWriter(FILE *fp) :
+      m_fp(fp),
+      m_State(STATE_PROCESS),
+      m_First(true)
+   {
+   }
+
+   void
+   BeginProcess(uint32_t Pid, const char *Name)
+   {
+      fprintf(m_fp, "{\"pid\": %u, \"name\": ", Pid);
+      String(Name);
+      m_State = STATE_PROCESS;
+   }
+
+   void
+   Exception(const ReportException &exception)
+   {
+      fprintf(m_fp, ",\n\"exception\": {\"code\": %u, \"chance\": %u, \"address\": ",
+              exception.Code, exception.Chance);
+      Address(exception.Address);
+      fputs(", \"reason\": ", m_fp);
+      String(exception.Reason);
+      fputc('}', m_fp);
+   }
+
+   void
+   Module(const ReportModule &module)
+   {
+      Enter(STATE_MODULES, ",\n\"modules\": [");
+      Separate("\n");
+      fputs("{\"base\": ", m_fp);
+      Address(module.Base);
+      fputs(", \"end\": ", m_fp);
+      Address(module.End);
+      fputs(", \"name\": ", m_fp);
+      String(module.Name);
+      fputs(", \"path\": ", m_fp);
+      String(module.Path);
+      fputs(", \"build_id\": ", m_fp);
+      String(module.BuildId);
+      fputc('}', m_fp);
+   }
+
+   void
+   Output(uint64_t Time, unsigned Stream, const char *Text, size_t Size)
+   {
+      Enter(STATE_OUTPUT, ",\n\"output\": [");
+      Separate("\n");
+      fprintf(m_fp, "{\"time\": %llu, \"stream\": ", (unsigned long long)Time);
+      String(StreamName(Stream));
+      fputs(", \"text\": ", m_fp);
+      String(Text, Size);
+      fputc('}', m_fp);
+   }
+
+   void
+   BeginThread(uint32_t Tid, const char *Name, bool Current)
+   {
+      Enter(STATE_THREADS, ",\n\"threads\": [");
+      Separate("\n");
+      fprintf(m_fp, "{\"tid\": %u, \"name\": ", Tid);
+      String(Name);
+      fprintf(m_fp, ", \"current\": %s", Current ? "true" : "false");
+      m_State = STATE_THREAD;
+   }
+
+   void
+   Register(const char *Name, uint64_t Value)
+   {
+      Enter(STATE_REGISTERS, ",\n \"registers\": {");
+      Separate(" ");
+      String(Name);
+      fputs(": ", m_fp);
+      Address(Value);
+   }
+
+   void
+   Frame(const ReportFrame &frame)
+   {
+      Enter(STATE_FRAMES, ",\n \"frames\": [");
+      Separate("\n  ");
+      fputs("{\"pc\": ", m_fp);
+      Address(frame.Pc);
+      fputs(", \"sp\": ", m_fp);
+      Address(frame.Sp);
+      fputs(", \"module\": ", m_fp);
+      String(frame.Module);
+      fputs(", \"offset\": ", m_fp);
+      Address(frame.Offset);
+      fputs(", \"function\": ", m_fp);
+      String(frame.Function);
+      fputs(", \"displacement\": ", m_fp);
+      Address(frame.Displacement);
+      fputs(", \"file\": ", m_fp);
+      String(frame.File);
+      fprintf(m_fp, ", \"line\": %u, \"inline\": %s}", frame.Line,
+              frame.Inline ? "true" : "false");
+   }
+
+   void
+   EndThread(void)
+   {
+      Leave();
+      fputc('}', m_fp);
+      m_State = STATE_THREADS;
+      m_First = false;
+   }
+
+   void
+   EndProcess(int ExitCode)
+   {
+      Leave();
+      fprintf(m_fp, ",\n\"exit_code\": %d}\n", ExitCode);
+      fflush(m_fp);
+   }
+
+private:
+   enum State {
+      STATE_PROCESS,
+      STATE_MODULES,     /* in "modules" */
+      STATE_OUTPUT,      /* in "output" */
+      STATE_THREADS,     /* in "threads", between threads */
+      STATE_THREAD,      /* in a thread object */
+      STATE_REGISTERS,   /* in a thread's "registers" */
+      STATE_FRAMES       /* in a thread's "frames" */
+   };
+
+   FILE *m_fp;
+   State m_State;
+   bool m_First;        /* no element written yet in the current list */
+
+   /*
+    * Open a list, closing the one before, unless already in it.
+    */
+   void
+   Enter(State state, const char *Opening)
+   {
+      if (m_State == state) {
+         return;
+      }
+      Leave();
+      fputs(Opening, m_fp);
+      m_State = state;
+      m_First = true;
+   }
+
+   void
+   Leave(void)
+   {
+      switch (m_State) {
+      case STATE_MODULES:
+      case STATE_OUTPUT:
+      case STATE_THREADS:
+      case STATE_FRAMES:
+         fputc(']', m_fp);
+         break;
+      case STATE_REGISTERS:
+         fputc('}', m_fp);
+         break;
+      default:
+         break;
+      }
+      m_State = m_State == STATE_REGISTERS || m_State == STATE_FRAMES ?
+                STATE_THREAD : STATE_PROCESS;
+   }
+
+   void
+   Separate(const char *Space)
+   {
+      if (!m_First) {
+         fputc(',', m_fp);
+      }
+      fputs(Space, m_fp);
+      m_First = false;
+   }
+
+   void
+   Address(uint64_t Value)
+   {
+      fprintf(m_fp, "\"0x%llx\"", (unsigned long long)Value);
+   }
+
+   static const char *
+   StreamName(unsigned Stream)
+   {
+      switch (Stream) {
+      case OUTPUT_STDOUT: return "stdout";
+      case OUTPUT_STDERR: return "stderr";
+      case OUTPUT_DEBUG:  return "debug";
+      default:            return NULL;
+      }
+   }
+
+   void
+   String(const char *s)
+   {
+      if (!s) {
+         fputs("null", m_fp);
+         return;
+      }
+      String(s, strlen(s));
+   }
+
+   void
+   String(const char *s, size_t Size)
+   {
+      fputc('"', m_fp);
+      for (const char *end = s + Size; s < end; ++s) {
+         unsigned char c = *s;
+         switch (c) {
+         case '"':  fputs("\\\"", m_fp); break;
+         case '\\': fputs("\\\\", m_fp); break;
+         case '\n': fputs("\\n", m_fp); break;
+         case '\r': fputs("\\r", m_fp); break;
+         case '\t': fputs("\\t", m_fp); break;
+         default:
+            if (c < 0x20) {
+               fprintf(m_fp, "\\u%04x", c);
+            } else {
+               fputc(c, m_fp);
+            }
+            break;
+         }
+      }
+      fputc('"', m_fp);
+   }
+};
+
+
+/**************************************************************************
+ *
+ * Binary
+ *
+ **************************************************************************/
+
+class BinaryReportWriter : public ReportWriter
+{
+public:
+   BinaryReportWriter(FILE *fp) :
+      m_fp(fp)
+   {
+      fwrite(REPORT_MAGIC, 1, 4, m_fp);
+      fputc(REPORT_VERSION, m_fp);
+   }
+
+   void
+   BeginProcess(uint32_t Pid, const char *Name)
+   {
+      Varint(Pid);
+      String(Name);
+      Flush(REPORT_TAG_PROCESS);
+   }
+
+   void
+   Exception(const ReportException &exception)
+   {
+      Varint(exception.Code);
+      Varint(exception.Chance);
+      Varint(exception.Address);
+      String(exception.Reason);
+      Flush(REPORT_TAG_EXCEPTION);
+   }
+
+   void
+   Module(const ReportModule &module)
+   {
+      Varint(module.Base);
+      Varint(module.End);
+      String(module.Name);
+      String(module.Path);
+      String(module.BuildId);
+      Flush(REPORT_TAG_MODULE);
+   }
+
+   void
+   Output(uint64_t Time, unsigned Stream, const char *Text, size_t Size)
+   {
+      Varint(Time);
+      Varint(Stream);
+      Varint(Size);
+      m_Record.append(Text, Size);
+      Flush(REPORT_TAG_OUTPUT);
+   }
+
+   void
+   BeginThread(uint32_t Tid, const char *Name, bool Current)
+   {
+      Varint(Tid);
+      String(Name);
+      Varint(Current);
+      Flush(REPORT_TAG_THREAD);
+   }
+
+   void
+   Register(const char *Name, uint64_t Value)
+   {
+      String(Name);
+      Varint(Value);
+      Flush(REPORT_TAG_REGISTER);
+   }
+
+   void
+   Frame(const ReportFrame &frame)
+   {
+      Varint(frame.Pc);
+      Varint(frame.Sp);
+      String(frame.Module);
+      Varint(frame.Offset);
+      String(frame.Function);
+      Varint(frame.Displacement);
+      String(frame.File);
+      Varint(frame.Line);
+      Varint(frame.Inline);
+      Flush(REPORT_TAG_FRAME);
+   }
+
+   void
+   EndThread(void)
+   {
+      Flush(REPORT_TAG_END_THREAD);
+   }
+
+   void
+   EndProcess(int ExitCode)
+   {
+      Varint((uint32_t)ExitCode);
+      Flush(REPORT_TAG_END);
+      fflush(m_fp);
+   }
+
+private:
+   FILE *m_fp;
+   std::string m_Record;   /* payload of the record being encoded */
+
+   void
+   Varint(uint64_t Value)
+   {
+      while (Value >= 0x80) {
+         m_Record += (char)(Value | 0x80);
+         Value >>= 7;
+      }
+      m_Record += (char)Value;
+   }
+
+   /*
+    * Unknown strings are encoded as empty ones.
+    */
+   void
+   String(const char *s)
+   {
+      size_t length = s ? strlen(s) : 0;
+      Varint(length);
+      m_Record.append(s ? s : "", length);
+   }
+
+   void
+   Flush(ReportTag Tag)
+   {
+      std::string payload;
+      payload.swap(m_Record);
+
+      /* The header is encoded in the emptied record buffer. */
+      m_Record += (char)Tag;
+      Varint(payload.size());
+      fwrite(m_Record.data(), 1, m_Record.size(), m_fp);
+      fwrite(payload.data(), 1, payload.size(), m_fp);
+      m_Record.clear();
+   }
+};
+
+
+ReportWriter *
+ReportWriter::Create(FILE *fp, ReportFormat Format)
+{
+   if (Format == REPORT_JSON) {
+      return new JsonReportWriter(fp);
+   }
+   return new BinaryReportWriter(fp);
+}
+
+
+/**************************************************************************
+ *
+ * Decoding
+ *
+ **************************************************************************/
+
+#define REPORT_MAX_RECORD (1024*1024)
+
+
+static bool
+ReadVarint(FILE *fp, uint64_t *Value)
+{
+   *Value = 0;
+   for (unsigned shift = 0; shift < 64; shift += 7) {
+      int c = fgetc(fp);
+      if (c == EOF) {
+         return false;
+      }
+      *Value |= (uint64_t)(c & 0x7f) << shift;
+      if (!(c & 0x80)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+
+/*
+ * Cursor over a record payload.  Reading past the end yields zeros and
+ * empty strings, i.e., fields added by later versions are optional.
+ */
+class RecordReader
+{
+public:
+   RecordReader(const std::vector<char> &Payload) :
+      m_Payload(Payload),
+      m_Offset(0)
+   {
+   }
+
+   uint64_t
+   Varint(void)
+   {
+      uint64_t value = 0;
+      for (unsigned shift = 0; shift < 64 && m_Offset < m_Payload.size(); shift += 7) {
+         unsigned char c = m_Payload[m_Offset++];
+         value |= (uint64_t)(c & 0x7f) << shift;
+         if (!(c & 0x80)) {
+            break;
+         }
+      }
+      return value;
+   }
+
+   std::string
+   String(void)
+   {
+      uint64_t length = Varint();
+      if (length > m_Payload.size() - m_Offset) {
+         length = m_Payload.size() - m_Offset;
+      }
+      std::string s(m_Payload.begin() + m_Offset, m_Payload.begin() + m_Offset + length);
+      m_Offset += length;
+      return s;
+   }
+
+private:
+   const std::vector<char> &m_Payload;
+   size_t m_Offset;
+};
+
+
+static const char *
+OptionalString(const std::string &s)
+{
+   return s.empty() ? NULL : s.c_str();
+}
+
+
+bool
+ReadReport(FILE *fp, ReportWriter *writer)
+{
+   char magic[5];
+   if (fread(magic, 1, sizeof magic, fp) != sizeof magic ||
+       memcmp(magic, REPORT_MAGIC, 4) != 0) {
+      fprintf(stderr, "error: not a stackdump report\n");
+      return false;
+   }
+   if (magic[4] != REPORT_VERSION) {
+      fprintf(stderr, "error: unsupported report version %u\n", (unsigned char)magic[4]);
+      return false;
+   }
+
+   std::vector<char> payload;
+   int tag;
+   while ((tag = fgetc(fp)) != EOF) {
+      uint64_t size;
+      if (!ReadVarint(fp, &size) || size > REPORT_MAX_RECORD) {
+         fprintf(stderr, "error: corrupt report\n");
+         return false;
+      }
+      payload.resize(size);
+      if (size && fread(&payload[0], 1, size, fp) != size) {
+         fprintf(stderr, "error: truncated report\n");
+         return false;
+      }
+
+      RecordReader record(payload);
+      switch (tag) {
+      case REPORT_TAG_PROCESS: {
+         uint32_t pid = (uint32_t)record.Varint();
+         std::string name = record.String();
+         writer->BeginProcess(pid, OptionalString(name));
+         break;
+      }
+      case REPORT_TAG_EXCEPTION: {
+         ReportException exception;
+         exception.Code = (uint32_t)record.Varint();
+         exception.Chance = (unsigned)record.Varint();
+         exception.Address = record.Varint();
+         std::string reason = record.String();
+         exception.Reason = OptionalString(reason);
+         writer->Exception(exception);
+         break;
+      }
+      case REPORT_TAG_MODULE: {
+         ReportModule module;
+         module.Base = record.Varint();
+         module.End = record.Varint();
+         std::string name = record.String();
+         std::string path = record.String();
+         std::string buildId = record.String();
+         module.Name = OptionalString(name);
+         module.Path = OptionalString(path);
+         module.BuildId = OptionalString(buildId);
+         writer->Module(module);
+         break;
+      }
+      case REPORT_TAG_THREAD: {
+         uint32_t tid = (uint32_t)record.Varint();
+         std::string name = record.String();
+         bool current = record.Varint() != 0;
+         writer->BeginThread(tid, OptionalString(name), current);
+         break;
+      }
+      case REPORT_TAG_REGISTER: {
+         std::string name = record.String();
+         writer->Register(name.c_str(), record.Varint());
+         break;
+      }
+      case REPORT_TAG_FRAME: {
+         ReportFrame frame;
+         frame.Pc = record.Varint();
+         frame.Sp = record.Varint();
+         std::string module = record.String();
+         frame.Offset = record.Varint();
+         std::string function = record.String();
+         frame.Displacement = record.Varint();
+         std::string file = record.String();
+         frame.Line = (unsigned)record.Varint();
+         frame.Inline = record.Varint() != 0;
+         frame.Module = OptionalString(module);
+         frame.Function = OptionalString(function);
+         frame.File = OptionalString(file);
+         writer->Frame(frame);
+         break;
+      }
+      case REPORT_TAG_OUTPUT: {
+         uint64_t time = record.Varint();
+         unsigned stream = (unsigned)record.Varint();
+         std::string text = record.String();
+         writer->Output(time, stream, text.data(), text.size());
+         break;
+      }
+      case REPORT_TAG_END_THREAD:
+         writer->EndThread();
+         break;
+      case REPORT_TAG_END:
+         writer->EndProcess((int)(uint32_t)record.Varint());
+         return true;
+      default:
+         /* From a later version. */
+         break;
+      }
+   }
+
+   fprintf(stderr, "error: truncated report\n");
+   return false;
+}
+
+
+/**************************************************************************
+ *
+ * Command line
+ *
+ **************************************************************************/
+
+static void
+ReportUsage(void)
+{
+   fputs("usage: stackdump report [options] <report>\n"
+         "\n"
+         "Converts a binary report, as written by --report, to JSON.\n"
+         "\n"
+         "options:\n"
+         "  -o <file> writes the JSON to a file instead of stdout\n",
+         stderr);
+}
+
+
+int
+ReportMain(int argc, char **argv)
+{
+   const char *output = NULL;
+
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         ReportUsage();
+         return 0;
+      } else if (!strcmp(*argv, "-o")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -o missing argument\n\n");
+            ReportUsage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         output = *argv;
+      } else {
+         break;
+      }
+   }
+
+   if (argc != 1) {
+      ReportUsage();
+      return 1;
+   }
+
+   FILE *in = fopen(*argv, "rb");
+   if (!in) {
+      fprintf(stderr, "error: failed to open %s (%s)\n", *argv, strerror(errno));
+      return 1;
+   }
+
+   FILE *out = stdout;
+   if (output) {
+      out = fopen(output, "wt");
+      if (!out) {
+         fprintf(stderr, "error: failed to create %s (%s)\n", output, strerror(errno));
+         fclose(in);
+         return 1;
+      }
+   }
+
+   ReportWriter *writer = ReportWriter::Create(out, REPORT_JSON);
+   bool ok = ReadReport(in, writer);
+   delete writer;
+
+   fclose(in);
+   if (out != stdout) {
+      fclose(out);
+   }
+
+   return ok ? 0 : 1;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,194 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Structured crash reports, for machines rather than people.
+ *
+ * A report describes one dumped process: the exception or signal, the
+ * modules, and for each thread its registers and frames, symbolized
+ * into module and offset, function, file and line.  It is produced as a
+ * stream of calls on a ReportWriter, which encodes each item as it comes,
+ * so that no report is ever held in memory whole.
+ *
+ * The JSON encoding is a single object:
+ *
+ *   {"pid": 1234, "name": "foo",
+ *    "exception": {"code": 11, "chance": 0, "address": "0x0", "reason": "..."},
+ *    "modules": [{"base": "0x...", "end": "0x...", "name": "foo",
+ *                 "path": "/usr/bin/foo", "build_id": "..."}, ...],
+ *    "output": [{"time": 1234, "stream": "stderr", "text": "..."}, ...],
+ *    "threads": [{"tid": 1234, "name": "foo", "current": true,
+ *                 "registers": {"rax": "0x...", ...},
+ *                 "frames": [{"pc": "0x...", "sp": "0x...", "module": "foo",
+ *                             "offset": "0x...", "function": "main",
+ *                             "displacement": "0x...", "file": "foo.c",
+ *                             "line": 12, "inline": false}, ...]}, ...],
+ *    "exit_code": 1}
+ *
+ * Addresses are strings, as JSON numbers cannot hold 64 bits.  Output is
+ * the tail of what the program printed, with times in milliseconds since
+ * it started.
+ *
+ * The binary encoding is the magic "SDRP" and a version byte, followed by
+ * records of a tag byte, the payload size, and the payload.  Integers are
+ * LEB128 varints, strings a varint size followed by the bytes.  Readers
+ * skip tags they do not know, and fields past the ones they know.
+ */
+
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+
+
+#define REPORT_MAGIC "SDRP"
+#define REPORT_VERSION 1
+
+
+enum ReportFormat {
+   REPORT_BINARY = 0,
+   REPORT_JSON
+};
+
+
+/* Record tags of the binary encoding */
+enum ReportTag {
+   REPORT_TAG_PROCESS = 1,    /* pid, name */
+   REPORT_TAG_EXCEPTION,      /* code, chance, address, reason */
+   REPORT_TAG_MODULE,         /* base, end, name, path, build id */
+   REPORT_TAG_THREAD,         /* tid, name, current */
+   REPORT_TAG_REGISTER,       /* name, value */
+   REPORT_TAG_FRAME,          /* pc, sp, module, offset, function,
+                                 displacement, file, line, inline */
+   REPORT_TAG_END_THREAD,
+   REPORT_TAG_END,            /* exit code */
+   REPORT_TAG_OUTPUT          /* time, stream, text */
+};
+
+
+/* Strings may be NULL when unknown. */
+
+struct ReportException
+{
+   uint32_t Code;          /* signal number or exception code */
+   unsigned Chance;        /* 1 or 2 for first or second chance exceptions */
+   uint64_t Address;       /* faulting address, if any */
+   const char *Reason;     /* e.g., "Segmentation fault", "time out" */
+};
+
+struct ReportModule
+{
+   uint64_t Base;
+   uint64_t End;
+   const char *Name;
+   const char *Path;
+   const char *BuildId;
+};
+
+struct ReportFrame
+{
+   uint64_t Pc;
+   uint64_t Sp;
+   const char *Module;
+   uint64_t Offset;        /* from the module base */
+   const char *Function;
+   uint64_t Displacement;  /* from the function start */
+   const char *File;
+   unsigned Line;          /* zero if unknown */
+   bool Inline;            /* a call inlined at the next frame's pc */
+};
+
+
+/*
+ * Writers expect calls in the order of the encoding: BeginProcess, at most
+ * one Exception, Modules, Output, then for each thread BeginThread,
+ * Registers, Frames and EndThread, and finally EndProcess.
+ */
+class ReportWriter
+{
+public:
+   static ReportWriter *
+   Create(FILE *fp, ReportFormat Format);
+
+   virtual ~ReportWriter() {}
+
+   virtual void
+   BeginProcess(uint32_t Pid, const char *Name) = 0;
+
+   virtual void
+   Exception(const ReportException &exception) = 0;
+
+   virtual void
+   Module(const ReportModule &module) = 0;
+
+   /*
+    * A piece of the program's output.  Stream is an OutputStream.
+    */
+   virtual void
+   Output(uint64_t Time, unsigned Stream, const char *Text, size_t Size) = 0;
+
+   virtual void
+   BeginThread(uint32_t Tid, const char *Name, bool Current) = 0;
+
+   virtual void
+   Register(const char *Name, uint64_t Value) = 0;
+
+   virtual void
+   Frame(const ReportFrame &frame) = 0;
+
+   virtual void
+   EndThread(void) = 0;
+
+   /*
+    * ExitCode is the status stackdump reports for the process.
+    */
+   virtual void
+   EndProcess(int ExitCode) = 0;
+};
+
+
+/*
+ * Decode a binary report, replaying it on a writer, e.g., to convert it
+ * to JSON.
+ */
+bool
+ReadReport(FILE *fp, ReportWriter *writer);
+
+
+/*
+ * Entry point of "stackdump report [options] <report>".  Arguments start
+ * after the "report" word.
+ */
+int
+ReportMain(int argc, char **argv);
+
+
+#endif /* _REPORT_H_ */
+
+/* vim:set sw=3 et: */
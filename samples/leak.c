@@ -26,11 +26,19 @@
  **************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 int main()
 {
    for (;;) {
-      malloc(1024*1024);
+      void *p = malloc(1024*1024);
+      if (!p) {
+         /* Out of memory: fail in a defined way, not with a NULL write. */
+         abort();
+      }
+
+      /* Touch the memory, as untouched pages are never committed. */
+      memset(p, 0, 1024*1024);
    }
 }
@@ -0,0 +1,102 @@
+/**************************************************************************
+ *
+ * Copyright 2009 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+
+/*
+ * Stack dump benchmark: starts many threads with deep stacks, waits for
+ * all of them to park, and then crashes.
+ *
+ *    many_threads [threads [depth]]
+ *
+ * e.g., "time stackdump -v many_threads 4000 64 2>/dev/null".
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+static unsigned depth = 64;
+static pthread_barrier_t barrier;
+
+
+static unsigned __attribute__((noinline))
+recurse(unsigned level)
+{
+   volatile char frame[64];
+
+   frame[0] = (char)level;
+   if (level < depth) {
+      return recurse(level + 1) + frame[0];
+   }
+
+   pthread_barrier_wait(&barrier);
+   for ( ; ; )
+      pause();
+
+   return frame[0];
+}
+
+
+static void *
+thread_main(void *arg)
+{
+   (void)arg;
+   recurse(0);
+   return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+   unsigned threads = argc > 1 ? atoi(argv[1]) : 1000;
+   unsigned i;
+   pthread_attr_t attr;
+
+   if (argc > 2)
+      depth = atoi(argv[2]);
+
+   pthread_barrier_init(&barrier, NULL, threads + 1);
+
+   pthread_attr_init(&attr);
+   pthread_attr_setstacksize(&attr, 256 * 1024);
+
+   for (i = 0; i < threads; ++i) {
+      pthread_t thread;
+      if (pthread_create(&thread, &attr, thread_main, NULL) != 0) {
+         fprintf(stderr, "failed to create thread %u\n", i);
+         return 1;
+      }
+   }
+
+   pthread_barrier_wait(&barrier);
+
+   *(volatile int *)0 = 0;
+
+   return 0;
+}
@@ -0,0 +1,263 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "signatures.h"
+
+
+struct SignatureEntry
+{
+   unsigned long long Count;
+   unsigned long long FirstSeen;
+   unsigned long long LastSeen;
+   std::string Signature;
+};
+
+
+/*
+ * Exclusive lock over a database, held for as long as the object lives.
+ */
+class DatabaseLock
+{
+public:
+   DatabaseLock(const std::string &Path)
+   {
+#ifdef _WIN32
+      m_hFile = CreateFileA(Path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_ALWAYS, 0, NULL);
+      if (m_hFile != INVALID_HANDLE_VALUE) {
+         OVERLAPPED overlapped;
+         memset(&overlapped, 0, sizeof overlapped);
+         if (!LockFileEx(m_hFile, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+            CloseHandle(m_hFile);
+            m_hFile = INVALID_HANDLE_VALUE;
+         }
+      }
+#else
+      m_Fd = open(Path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+      if (m_Fd >= 0) {
+         int ret;
+         do {
+            ret = flock(m_Fd, LOCK_EX);
+         } while (ret != 0 && errno == EINTR);
+         if (ret != 0) {
+            close(m_Fd);
+            m_Fd = -1;
+         }
+      }
+#endif
+   }
+
+   ~DatabaseLock()
+   {
+      /* Closing releases the lock. */
+#ifdef _WIN32
+      if (m_hFile != INVALID_HANDLE_VALUE) {
+         CloseHandle(m_hFile);
+      }
+#else
+      if (m_Fd >= 0) {
+         close(m_Fd);
+      }
+#endif
+   }
+
+   bool
+   Held(void) const
+   {
+#ifdef _WIN32
+      return m_hFile != INVALID_HANDLE_VALUE;
+#else
+      return m_Fd >= 0;
+#endif
+   }
+
+private:
+#ifdef _WIN32
+   HANDLE m_hFile;
+#else
+   int m_Fd;
+#endif
+};
+
+
+/*
+ * Read all entries.  A missing database is an empty one.
+ */
+static bool
+ReadDatabase(const char *Path, std::vector<SignatureEntry> &Entries)
+{
+   FILE *fp = fopen(Path, "rt");
+   if (!fp) {
+      return errno == ENOENT;
+   }
+
+   std::string line;
+   char buffer[1024];
+   while (fgets(buffer, sizeof buffer, fp)) {
+      line += buffer;
+      if (line.empty() || line[line.size() - 1] != '\n') {
+         if (!feof(fp)) {
+            continue;
+         }
+      } else {
+         line.resize(line.size() - 1);
+      }
+
+      /* Exactly one blank precedes the signature, which may start with more. */
+      SignatureEntry entry;
+      int offset = 0;
+      if (sscanf(line.c_str(), "%llu %llu %llu%n",
+                 &entry.Count, &entry.FirstSeen, &entry.LastSeen, &offset) == 3 &&
+          offset > 0 && line[offset] == ' ') {
+         entry.Signature = line.substr(offset + 1);
+         Entries.push_back(entry);
+      }
+      line.clear();
+   }
+
+   bool ok = !ferror(fp);
+   fclose(fp);
+   return ok;
+}
+
+
+/*
+ * Replace the database with a new file, so that it is never seen half
+ * written.
+ */
+static bool
+WriteDatabase(const char *Path, const std::vector<SignatureEntry> &Entries)
+{
+   char suffix[32];
+#ifdef _WIN32
+   _snprintf(suffix, sizeof suffix, ".%lu.tmp", (unsigned long)GetCurrentProcessId());
+   suffix[sizeof suffix - 1] = 0;
+#else
+   snprintf(suffix, sizeof suffix, ".%lu.tmp", (unsigned long)getpid());
+#endif
+   std::string temp = std::string(Path) + suffix;
+
+   FILE *fp = fopen(temp.c_str(), "wt");
+   if (!fp) {
+      return false;
+   }
+
+   for (size_t i = 0; i < Entries.size(); ++i) {
+      const SignatureEntry &entry = Entries[i];
+      fprintf(fp, "%llu %llu %llu %s\n",
+              entry.Count, entry.FirstSeen, entry.LastSeen, entry.Signature.c_str());
+   }
+
+   if (fclose(fp) != 0) {
+      remove(temp.c_str());
+      return false;
+   }
+
+#ifdef _WIN32
+   if (!MoveFileExA(temp.c_str(), Path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+   if (rename(temp.c_str(), Path) != 0) {
+#endif
+      remove(temp.c_str());
+      return false;
+   }
+   return true;
+}
+
+
+long
+CountSignature(const char *Path, const std::string &Signature)
+{
+   /* One line per signature. */
+   std::string signature(Signature);
+   for (size_t i = 0; i < signature.size(); ++i) {
+      if (signature[i] == '\n' || signature[i] == '\r') {
+         signature[i] = ' ';
+      }
+   }
+
+   DatabaseLock lock(std::string(Path) + ".lock");
+   if (!lock.Held()) {
+      fprintf(stderr, "warning: failed to lock %s.lock (%s)\n", Path, strerror(errno));
+      return -1;
+   }
+
+   std::vector<SignatureEntry> entries;
+   if (!ReadDatabase(Path, entries)) {
+      fprintf(stderr, "warning: failed to read %s (%s)\n", Path, strerror(errno));
+      return -1;
+   }
+
+   unsigned long long now = (unsigned long long)time(NULL);
+   long seen = 0;
+   size_t i;
+   for (i = 0; i < entries.size(); ++i) {
+      if (entries[i].Signature == signature) {
+         break;
+      }
+   }
+   if (i < entries.size()) {
+      seen = (long)entries[i].Count;
+      ++entries[i].Count;
+      entries[i].LastSeen = now;
+   } else {
+      SignatureEntry entry;
+      entry.Count = 1;
+      entry.FirstSeen = now;
+      entry.LastSeen = now;
+      entry.Signature = signature;
+      entries.push_back(entry);
+   }
+
+   if (!WriteDatabase(Path, entries)) {
+      fprintf(stderr, "warning: failed to update %s (%s)\n", Path, strerror(errno));
+      return -1;
+   }
+
+   return seen;
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,63 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Persistent counts of crash signatures, so that a crash seen before
+ * need not be dumped all over again.
+ *
+ * The database is a text file with a line per signature:
+ *
+ *    <count> <first seen> <last seen> <signature>
+ *
+ * times being in seconds since the epoch.  Any number of stackdump
+ * processes may share one: updates hold an exclusive lock on
+ * "<file>.lock", and rename a new file over the old one, so that readers
+ * never see it half written.
+ */
+
+#ifndef _SIGNATURES_H_
+#define _SIGNATURES_H_
+
+#include <string>
+
+
+/* Frames making up a signature, from the top of the crashing thread. */
+#define SIGNATURE_FRAMES 5
+
+
+/*
+ * Count one more occurrence of a signature.  Returns how many times it
+ * had been seen before, zero for a new one, or -1 if the database could
+ * not be updated.
+ */
+long
+CountSignature(const char *Path, const std::string &Signature);
+
+
+#endif /* _SIGNATURES_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,843 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "elfimage.h"
+#include "outputtail.h"
+#include "process.h"
+#include "report.h"
+#include "snapshot.h"
+#include "symbolize.h"
+#include "symcache.h"
+#include "threadpool.h"
+
+
+/**************************************************************************
+ *
+ * File format
+ *
+ **************************************************************************/
+
+#define SNAPSHOT_MAGIC     "SDSNAP\0"
+#define SNAPSHOT_VERSION   1
+
+#define SNAPSHOT_CODE_SIZE 16
+
+#define SNAPSHOT_FRAME_SIGNAL 0x1
+
+/* Stack bytes prefetched per thread; deeper pages are fetched on demand. */
+#define SNAPSHOT_STACK_SIZE (64*1024)
+#define SNAPSHOT_RED_ZONE 128
+
+/* Below this many threads a thread pool is not worth starting. */
+#define SNAPSHOT_PARALLEL_THREADS 8
+
+/*
+ * The header is followed by the modules, the threads and the code bytes.
+ * Strings are not terminated.
+ */
+struct SnapshotHeader
+{
+   char Magic[8];
+   uint32_t Version;
+   int32_t Pid;
+   int32_t CurrentTid;
+   uint32_t HaveSigInfo;
+   uint32_t ModuleCount;
+   uint32_t ThreadCount;
+   uint64_t CodeAddress;
+   uint32_t CodeSize;
+   uint32_t Reserved;
+   uint8_t SigInfo[128];
+};
+
+struct SnapshotModuleRecord
+{
+   uint64_t Base;
+   uint64_t End;
+   uint64_t Bias;
+   uint32_t PathSize;         /* followed by the path */
+   uint32_t BuildIdSize;      /* and the raw build-id */
+};
+
+struct SnapshotThreadRecord
+{
+   int32_t Tid;
+   uint32_t NameSize;         /* followed by the name */
+   uint32_t FrameCount;       /* and the frames */
+   uint32_t Reserved;
+   struct user_regs_struct Regs;
+};
+
+struct SnapshotFrameRecord
+{
+   uint64_t Pc;
+   uint64_t Sp;
+   uint32_t Flags;
+   uint32_t Reserved;
+};
+
+
+/**************************************************************************
+ *
+ * Capture
+ *
+ **************************************************************************/
+
+Snapshot::Snapshot() :
+   Pid(0),
+   CurrentTid(0),
+   HaveSigInfo(false),
+   CodeAddress(0)
+{
+   memset(&SigInfo, 0, sizeof SigInfo);
+}
+
+
+Snapshot::~Snapshot()
+{
+   ReleaseModules(Modules);
+}
+
+
+static std::string
+ThreadName(pid_t Pid, pid_t Tid)
+{
+   char path[64];
+   char name[64] = "";
+   FILE *fp;
+
+   snprintf(path, sizeof path, "/proc/%d/task/%d/comm", Pid, Tid);
+   fp = fopen(path, "r");
+   if (fp) {
+      if (fgets(name, sizeof name, fp)) {
+         name[strcspn(name, "\n")] = 0;
+      }
+      fclose(fp);
+   }
+   return name;
+}
+
+
+/*
+ * Prefetch the live part of every thread's stack, from just below the
+ * stack pointer (the red zone) towards the top of its mapping, in as few
+ * syscalls as possible.
+ */
+static void
+PrefetchStacks(Process *process, const std::vector<const Thread *> &Threads)
+{
+   std::vector<MemoryRange> ranges;
+
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      uint64_t sp = Threads[i]->Regs.rsp;
+      const MemoryRegion *region = process->FindRegion(sp);
+      if (!region) {
+         continue;
+      }
+      MemoryRange range;
+      range.Address = sp - std::min<uint64_t>(sp - region->Start, SNAPSHOT_RED_ZONE);
+      range.Size = (size_t)std::min<uint64_t>(region->End - range.Address, SNAPSHOT_STACK_SIZE);
+      ranges.push_back(range);
+   }
+
+   process->Memory.Prefetch(ranges);
+}
+
+
+Snapshot *
+Snapshot::Capture(Process *process, pid_t CurrentTid, const siginfo_t *SigInfo,
+                  ThreadPool *Pool)
+{
+   Snapshot *snapshot = new Snapshot;
+   snapshot->Pid = process->Pid;
+   snapshot->Modules = process->Modules;
+   for (size_t i = 0; i < snapshot->Modules.size(); ++i) {
+      ElfImage::Acquire(snapshot->Modules[i].Image);
+   }
+
+   if (SigInfo) {
+      snapshot->HaveSigInfo = true;
+      snapshot->SigInfo = *SigInfo;
+   }
+
+   const Thread *current = process->FindThread(CurrentTid);
+   if (!current) {
+      current = process->FindThread(process->Pid);
+   }
+   if (!current && !process->Threads.empty()) {
+      current = &process->Threads.begin()->second;
+   }
+
+   if (current) {
+      snapshot->CurrentTid = current->Tid;
+      snapshot->CodeAddress = current->Regs.rip;
+      snapshot->Code.resize(SNAPSHOT_CODE_SIZE);
+      snapshot->Code.resize(process->ReadMemory(current->Regs.rip, &snapshot->Code[0],
+                                                SNAPSHOT_CODE_SIZE));
+   }
+
+   std::vector<const Thread *> threads;
+   std::map<pid_t, Thread>::const_iterator it;
+   for (it = process->Threads.begin(); it != process->Threads.end(); ++it) {
+      threads.push_back(&it->second);
+   }
+
+   PrefetchStacks(process, threads);
+
+   snapshot->Threads.resize(threads.size());
+
+   auto unwind = [&](size_t i) {
+      const Thread &thread = *threads[i];
+      SnapshotThread &snap = snapshot->Threads[i];
+      uint64_t regs[DW_REG_COUNT];
+
+      snap.Tid = thread.Tid;
+      snap.Name = ThreadName(process->Pid, thread.Tid);
+      snap.Regs = thread.Regs;
+
+      RegistersToDwarf(thread.Regs, regs);
+      UnwindStack(process, regs, snap.Frames);
+   };
+
+   /* Threads are independent, and the memory cache is thread-safe. */
+   if (Pool && threads.size() >= SNAPSHOT_PARALLEL_THREADS) {
+      for (size_t i = 0; i < threads.size(); ++i) {
+         Pool->Submit([&unwind, i]() { unwind(i); });
+      }
+      Pool->Wait();
+   } else {
+      for (size_t i = 0; i < threads.size(); ++i) {
+         unwind(i);
+      }
+   }
+
+   return snapshot;
+}
+
+
+/**************************************************************************
+ *
+ * Serialization
+ *
+ **************************************************************************/
+
+bool
+Snapshot::Write(const char *Path) const
+{
+   FILE *fp = fopen(Path, "wb");
+   if (!fp) {
+      fprintf(stderr, "error: failed to create %s (%s)\n", Path, strerror(errno));
+      return false;
+   }
+
+   SnapshotHeader header;
+   memset(&header, 0, sizeof header);
+   memcpy(header.Magic, SNAPSHOT_MAGIC, sizeof header.Magic);
+   header.Version = SNAPSHOT_VERSION;
+   header.Pid = Pid;
+   header.CurrentTid = CurrentTid;
+   header.HaveSigInfo = HaveSigInfo;
+   header.ModuleCount = (uint32_t)Modules.size();
+   header.ThreadCount = (uint32_t)Threads.size();
+   header.CodeAddress = CodeAddress;
+   header.CodeSize = (uint32_t)Code.size();
+   memcpy(header.SigInfo, &SigInfo, std::min(sizeof header.SigInfo, sizeof SigInfo));
+   fwrite(&header, sizeof header, 1, fp);
+
+   for (size_t i = 0; i < Modules.size(); ++i) {
+      const Module &module = Modules[i];
+      std::string buildId = module.Image ? module.Image->BuildId() : std::string();
+
+      SnapshotModuleRecord record;
+      record.Base = module.Base;
+      record.End = module.End;
+      record.Bias = module.Bias;
+      record.PathSize = (uint32_t)module.Path.size();
+      record.BuildIdSize = (uint32_t)buildId.size();
+      fwrite(&record, sizeof record, 1, fp);
+      fwrite(module.Path.data(), 1, module.Path.size(), fp);
+      fwrite(buildId.data(), 1, buildId.size(), fp);
+   }
+
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      const SnapshotThread &thread = Threads[i];
+
+      SnapshotThreadRecord record;
+      memset(&record, 0, sizeof record);
+      record.Tid = thread.Tid;
+      record.NameSize = (uint32_t)thread.Name.size();
+      record.FrameCount = (uint32_t)thread.Frames.size();
+      record.Regs = thread.Regs;
+      fwrite(&record, sizeof record, 1, fp);
+      fwrite(thread.Name.data(), 1, thread.Name.size(), fp);
+
+      for (size_t j = 0; j < thread.Frames.size(); ++j) {
+         SnapshotFrameRecord frame;
+         frame.Pc = thread.Frames[j].Pc;
+         frame.Sp = thread.Frames[j].Sp;
+         frame.Flags = thread.Frames[j].Signal ? SNAPSHOT_FRAME_SIGNAL : 0;
+         frame.Reserved = 0;
+         fwrite(&frame, sizeof frame, 1, fp);
+      }
+   }
+
+   if (!Code.empty()) {
+      fwrite(&Code[0], 1, Code.size(), fp);
+   }
+
+   bool ok = !ferror(fp);
+   ok = fclose(fp) == 0 && ok;
+   if (!ok) {
+      fprintf(stderr, "error: failed to write %s\n", Path);
+   }
+   return ok;
+}
+
+
+static bool
+ReadString(FILE *fp, uint32_t Size, std::string &String)
+{
+   /* Paths and names are short; anything else is corruption. */
+   if (Size > 0x10000) {
+      return false;
+   }
+   String.resize(Size);
+   return Size == 0 || fread(&String[0], Size, 1, fp) == 1;
+}
+
+
+static bool
+ReadContents(FILE *fp, Snapshot *snapshot, const std::vector<std::string> &DebugDirs)
+{
+   SnapshotHeader header;
+   if (fread(&header, sizeof header, 1, fp) != 1 ||
+       memcmp(header.Magic, SNAPSHOT_MAGIC, sizeof header.Magic) != 0 ||
+       header.Version != SNAPSHOT_VERSION ||
+       header.CodeSize > SNAPSHOT_CODE_SIZE) {
+      return false;
+   }
+
+   snapshot->Pid = header.Pid;
+   snapshot->CurrentTid = header.CurrentTid;
+   snapshot->HaveSigInfo = header.HaveSigInfo != 0;
+   memcpy(&snapshot->SigInfo, header.SigInfo, std::min(sizeof header.SigInfo, sizeof snapshot->SigInfo));
+   snapshot->CodeAddress = header.CodeAddress;
+
+   for (uint32_t i = 0; i < header.ModuleCount; ++i) {
+      SnapshotModuleRecord record;
+      Module module;
+      std::string buildId;
+
+      if (fread(&record, sizeof record, 1, fp) != 1 ||
+          !ReadString(fp, record.PathSize, module.Path) ||
+          !ReadString(fp, record.BuildIdSize, buildId)) {
+         return false;
+      }
+
+      module.Base = record.Base;
+      module.End = record.End;
+      module.Bias = record.Bias;
+      module.Name = ModuleNameFromPath(module.Path);
+      module.Image = NULL;
+      if (!module.Path.empty() && module.Path[0] == '/') {
+         module.Image = ElfImage::OpenShared(module.Path, buildId, DebugDirs);
+      }
+      snapshot->Modules.push_back(module);
+   }
+
+   for (uint32_t i = 0; i < header.ThreadCount; ++i) {
+      SnapshotThreadRecord record;
+
+      if (fread(&record, sizeof record, 1, fp) != 1 ||
+          record.FrameCount > UNWIND_MAX_FRAMES) {
+         return false;
+      }
+
+      snapshot->Threads.push_back(SnapshotThread());
+      SnapshotThread &thread = snapshot->Threads.back();
+      thread.Tid = record.Tid;
+      thread.Regs = record.Regs;
+      if (!ReadString(fp, record.NameSize, thread.Name)) {
+         return false;
+      }
+
+      for (uint32_t j = 0; j < record.FrameCount; ++j) {
+         SnapshotFrameRecord frame;
+         if (fread(&frame, sizeof frame, 1, fp) != 1) {
+            return false;
+         }
+         StackFrame stackFrame;
+         stackFrame.Pc = frame.Pc;
+         stackFrame.Sp = frame.Sp;
+         stackFrame.Signal = (frame.Flags & SNAPSHOT_FRAME_SIGNAL) != 0;
+         thread.Frames.push_back(stackFrame);
+      }
+   }
+
+   snapshot->Code.resize(header.CodeSize);
+   return header.CodeSize == 0 ||
+          fread(&snapshot->Code[0], header.CodeSize, 1, fp) == 1;
+}
+
+
+Snapshot *
+Snapshot::Read(const char *Path, const std::vector<std::string> &DebugDirs)
+{
+   FILE *fp = fopen(Path, "rb");
+   if (!fp) {
+      fprintf(stderr, "error: failed to open %s (%s)\n", Path, strerror(errno));
+      return NULL;
+   }
+
+   Snapshot *snapshot = new Snapshot;
+   bool ok = ReadContents(fp, snapshot, DebugDirs);
+   fclose(fp);
+
+   if (!ok) {
+      fprintf(stderr, "error: %s is not a valid snapshot\n", Path);
+      delete snapshot;
+      return NULL;
+   }
+   return snapshot;
+}
+
+
+/**************************************************************************
+ *
+ * Rendering
+ *
+ **************************************************************************/
+
+size_t
+Snapshot::ReadMemory(uint64_t Address, void *Buffer, size_t Size)
+{
+   /* Only the code bytes are kept. */
+   if (Address < CodeAddress || Address - CodeAddress >= Code.size()) {
+      return 0;
+   }
+   size_t offset = Address - CodeAddress;
+   size_t size = std::min(Size, Code.size() - offset);
+   memcpy(Buffer, &Code[offset], size);
+   return size;
+}
+
+
+const Module *
+Snapshot::FindModule(uint64_t Address)
+{
+   size_t lo = 0;
+   size_t hi = Modules.size();
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (Modules[mid].Base <= Address) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+   if (lo == 0 || Address >= Modules[lo - 1].End) {
+      return NULL;
+   }
+   return &Modules[lo - 1];
+}
+
+
+static void
+RenderRegisters(FILE *fp, const struct user_regs_struct &r)
+{
+   unsigned long long efl = r.eflags;
+
+   fprintf(fp,
+           "rax=%016llx rbx=%016llx rcx=%016llx\n"
+           "rdx=%016llx rsi=%016llx rdi=%016llx\n"
+           "rip=%016llx rsp=%016llx rbp=%016llx\n"
+           " r8=%016llx  r9=%016llx r10=%016llx\n"
+           "r11=%016llx r12=%016llx r13=%016llx\n"
+           "r14=%016llx r15=%016llx\n",
+           r.rax, r.rbx, r.rcx,
+           r.rdx, r.rsi, r.rdi,
+           r.rip, r.rsp, r.rbp,
+           r.r8, r.r9, r.r10,
+           r.r11, r.r12, r.r13,
+           r.r14, r.r15);
+
+   fprintf(fp, "iopl=%llu         %s %s %s %s %s %s %s %s\n",
+           (efl >> 12) & 3,
+           efl & 0x800 ? "ov" : "nv",
+           efl & 0x400 ? "dn" : "up",
+           efl & 0x200 ? "ei" : "di",
+           efl & 0x080 ? "ng" : "pl",
+           efl & 0x040 ? "zr" : "nz",
+           efl & 0x010 ? "ac" : "na",
+           efl & 0x004 ? "pe" : "po",
+           efl & 0x001 ? "cy" : "nc");
+
+   fprintf(fp, "cs=%04llx  ss=%04llx  ds=%04llx  es=%04llx  fs=%04llx  gs=%04llx             efl=%08llx\n",
+           r.cs, r.ss, r.ds, r.es, r.fs, r.gs, efl);
+}
+
+
+/*
+ * Equivalent of WinDbg's "~*kpn", for one thread.
+ */
+static void
+RenderThreadStack(FILE *fp, Snapshot *snapshot, unsigned Index,
+                  const SnapshotThread &thread, bool Current)
+{
+   const std::vector<StackFrame> &frames = thread.Frames;
+
+   fprintf(fp, "\n%c%3u  Id: %x.%x Name: %s\n",
+           Current ? '.' : ' ', Index, snapshot->Pid, thread.Tid,
+           thread.Name.c_str());
+
+   fputs(" # Child-SP          RetAddr           Call Site\n", fp);
+   unsigned number = 0;
+   std::vector<std::string> sites;
+   for (size_t i = 0; i < frames.size(); ++i) {
+      const StackFrame &frame = frames[i];
+      uint64_t retAddr = i + 1 < frames.size() ? frames[i + 1].Pc : 0;
+      bool exact = i == 0 || frame.Signal;
+
+      SymbolizeFrames(snapshot, frame.Pc, exact, sites);
+
+      /* Inlined calls get frames of their own, as in WinDbg. */
+      for (size_t j = 0; j + 1 < sites.size(); ++j) {
+         fprintf(fp, "%02x (Inline Function) --------`-------- %s\n",
+                 number++, sites[j].c_str());
+      }
+
+      fprintf(fp, "%02x %s %s %s\n",
+              number++,
+              FormatPointer(frame.Sp).c_str(),
+              FormatPointer(retAddr).c_str(),
+              sites.back().c_str());
+   }
+}
+
+
+void
+Snapshot::Render(FILE *fp, bool CurrentOnly)
+{
+   const SnapshotThread *current = NULL;
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      if (Threads[i].Tid == CurrentTid) {
+         current = &Threads[i];
+      }
+   }
+
+   if (CurrentOnly) {
+      if (current) {
+         RenderThreadStack(fp, this, (unsigned)(current - &Threads[0]), *current, true);
+      }
+      fflush(fp);
+      return;
+   }
+
+   if (current) {
+      RenderRegisters(fp, current->Regs);
+
+      fprintf(fp, "%s:\n", SymbolizeAddress(this, CodeAddress, true).c_str());
+      fprintf(fp, "%s ", FormatPointer(CodeAddress).c_str());
+      if (Code.empty()) {
+         fputs("????", fp);
+      }
+      for (size_t i = 0; i < Code.size(); ++i) {
+         fprintf(fp, "%02x", Code[i]);
+      }
+      fputc('\n', fp);
+   }
+
+   /* Print the call stack for all threads. */
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      RenderThreadStack(fp, this, (unsigned)i, Threads[i], &Threads[i] == current);
+   }
+   fflush(fp);
+}
+
+
+std::string
+Snapshot::Signature(unsigned Frames)
+{
+   std::string signature;
+   char buffer[64];
+
+   if (HaveSigInfo) {
+      const char *name = sigabbrev_np(SigInfo.si_signo);
+      if (name) {
+         snprintf(buffer, sizeof buffer, "SIG%s", name);
+      } else {
+         snprintf(buffer, sizeof buffer, "signal %d", SigInfo.si_signo);
+      }
+      signature = buffer;
+   } else {
+      signature = "HANG";
+   }
+
+   const SnapshotThread *current = NULL;
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      if (Threads[i].Tid == CurrentTid) {
+         current = &Threads[i];
+      }
+   }
+   if (!current) {
+      return signature;
+   }
+
+   for (size_t i = 0; i < current->Frames.size() && i < Frames; ++i) {
+      uint64_t pc = current->Frames[i].Pc;
+      const Module *module = FindModule(pc);
+      signature += i == 0 ? " " : " < ";
+      if (module) {
+         snprintf(buffer, sizeof buffer, "+0x%llx", (unsigned long long)(pc - module->Base));
+         signature += module->Name;
+         signature += buffer;
+      } else {
+         signature += "<unknown>";
+      }
+   }
+
+   return signature;
+}
+
+
+/**************************************************************************
+ *
+ * Report
+ *
+ **************************************************************************/
+
+#define REGISTER(name) { #name, offsetof(struct user_regs_struct, name) }
+
+static const struct {
+   const char *Name;
+   size_t Offset;
+} g_Registers[] = {
+   REGISTER(rax), REGISTER(rbx), REGISTER(rcx), REGISTER(rdx),
+   REGISTER(rsi), REGISTER(rdi), REGISTER(rbp), REGISTER(rsp),
+   REGISTER(r8), REGISTER(r9), REGISTER(r10), REGISTER(r11),
+   REGISTER(r12), REGISTER(r13), REGISTER(r14), REGISTER(r15),
+   REGISTER(rip), REGISTER(eflags),
+   REGISTER(cs), REGISTER(ss), REGISTER(ds), REGISTER(es),
+   REGISTER(fs), REGISTER(gs), REGISTER(fs_base), REGISTER(gs_base),
+};
+
+#undef REGISTER
+
+
+/*
+ * Signals for which si_addr is the faulting address.
+ */
+static bool
+HasFaultAddress(int sig)
+{
+   return sig == SIGSEGV || sig == SIGBUS || sig == SIGILL || sig == SIGFPE;
+}
+
+
+void
+Snapshot::Report(ReportWriter *writer, const char *Reason, int ExitCode,
+                 const OutputTail *Tail)
+{
+   const char *name = NULL;
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      if (Threads[i].Tid == Pid) {
+         name = Threads[i].Name.c_str();
+      }
+   }
+   writer->BeginProcess(Pid, name);
+
+   if (HaveSigInfo || Reason) {
+      ReportException exception;
+      exception.Code = HaveSigInfo ? SigInfo.si_signo : 0;
+      exception.Chance = 0;
+      exception.Address = HaveSigInfo && HasFaultAddress(SigInfo.si_signo) ?
+                          (uint64_t)(uintptr_t)SigInfo.si_addr : 0;
+      exception.Reason = Reason;
+      writer->Exception(exception);
+   }
+
+   for (size_t i = 0; i < Modules.size(); ++i) {
+      const Module &module = Modules[i];
+      std::string buildId = module.Image ? BuildIdToString(module.Image->BuildId()) : "";
+
+      ReportModule record;
+      record.Base = module.Base;
+      record.End = module.End;
+      record.Name = module.Name.c_str();
+      record.Path = module.Path.c_str();
+      record.BuildId = buildId.empty() ? NULL : buildId.c_str();
+      writer->Module(record);
+   }
+
+   if (Tail) {
+      Tail->Report(writer);
+   }
+
+   std::vector<SymbolFrame> sites;
+   for (size_t i = 0; i < Threads.size(); ++i) {
+      const SnapshotThread &thread = Threads[i];
+
+      writer->BeginThread(thread.Tid, thread.Name.c_str(), thread.Tid == CurrentTid);
+
+      for (size_t j = 0; j < sizeof g_Registers / sizeof g_Registers[0]; ++j) {
+         const unsigned long long *value = (const unsigned long long *)
+            ((const char *)&thread.Regs + g_Registers[j].Offset);
+         writer->Register(g_Registers[j].Name, *value);
+      }
+
+      for (size_t j = 0; j < thread.Frames.size(); ++j) {
+         const StackFrame &frame = thread.Frames[j];
+         bool exact = j == 0 || frame.Signal;
+
+         LookupFrames(this, frame.Pc, exact, sites);
+         for (size_t k = 0; k < sites.size(); ++k) {
+            const SymbolFrame &site = sites[k];
+
+            ReportFrame record;
+            record.Pc = frame.Pc;
+            record.Sp = frame.Sp;
+            record.Module = site.module ? site.module->Name.c_str() : NULL;
+            record.Offset = site.module ? frame.Pc - site.module->Base : 0;
+            record.Function = site.Function.empty() ? NULL : site.Function.c_str();
+            record.Displacement = site.Function.empty() ? 0 : site.Displacement;
+            record.File = site.Line ? site.FileName.c_str() : NULL;
+            record.Line = site.Line;
+            record.Inline = site.Inline;
+            writer->Frame(record);
+         }
+      }
+
+      writer->EndThread();
+   }
+
+   writer->EndProcess(ExitCode);
+}
+
+
+/**************************************************************************
+ *
+ * Command line
+ *
+ **************************************************************************/
+
+static void
+RenderUsage(void)
+{
+   fputs("usage: stackdump render [options] <snapshot>\n"
+         "\n"
+         "options:\n"
+         "  -c <cache-dir> symbol cache directory, empty to disable\n"
+         "                 (default ~/.cache/stackdump)\n"
+         "  -o <file> writes the stacks to a file instead of stdout\n"
+         "  -y <debug-path> colon separated debug file directories\n"
+         "                  (default /usr/lib/debug)\n",
+         stderr);
+}
+
+
+int
+RenderMain(int argc, char **argv)
+{
+   const char *output = NULL;
+   const char *debugPath = "/usr/lib/debug";
+
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         RenderUsage();
+         return 0;
+      } else if (!strcmp(*argv, "-c") || !strcmp(*argv, "-o") ||
+                 !strcmp(*argv, "-y")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: %s missing argument\n\n", *argv);
+            RenderUsage();
+            return 1;
+         }
+
+         const char *option = *argv;
+         ++argv;
+         --argc;
+
+         switch (option[1]) {
+         case 'c': SymbolCache::SetDirectory(*argv); break;
+         case 'o': output = *argv; break;
+         case 'y': debugPath = *argv; break;
+         }
+      } else {
+         break;
+      }
+   }
+
+   if (argc != 1) {
+      fprintf(stderr, "error: no snapshot given\n\n");
+      RenderUsage();
+      return 1;
+   }
+
+   std::vector<std::string> debugDirs;
+   SplitSearchPath(debugPath, debugDirs);
+
+   Snapshot *snapshot = Snapshot::Read(*argv, debugDirs);
+   if (!snapshot) {
+      return 1;
+   }
+
+   FILE *fp = stdout;
+   if (output) {
+      fp = fopen(output, "w");
+      if (!fp) {
+         fprintf(stderr, "error: failed to create %s (%s)\n", output, strerror(errno));
+         delete snapshot;
+         return 1;
+      }
+   }
+
+   if (snapshot->HaveSigInfo) {
+      fprintf(fp, "uncaught signal - %s (%d)\n",
+              strsignal(snapshot->SigInfo.si_signo), snapshot->SigInfo.si_signo);
+   }
+   snapshot->Render(fp);
+
+   if (fp != stdout) {
+      fclose(fp);
+   }
+   delete snapshot;
+   return 0;
+}
+
+
+/* vim:set sw=3 et: */
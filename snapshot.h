@@ -0,0 +1,148 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Raw snapshots of a stopped process: registers and unwound frames of
+ * every thread, without any symbols.
+ *
+ * Capturing only takes as long as unwinding, so the target can be
+ * released straight away; symbolizing and printing happen afterwards,
+ * possibly offline with "stackdump render".
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <signal.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include <string>
+#include <vector>
+
+#include "target.h"
+#include "unwind.h"
+
+
+class Process;
+class OutputTail;
+class ReportWriter;
+class ThreadPool;
+
+
+struct SnapshotThread
+{
+   pid_t Tid;
+   std::string Name;
+   struct user_regs_struct Regs;
+   std::vector<StackFrame> Frames;
+};
+
+
+class Snapshot : public Target
+{
+public:
+   Snapshot();
+   ~Snapshot();
+
+   pid_t Pid;
+   pid_t CurrentTid;
+   bool HaveSigInfo;
+   siginfo_t SigInfo;
+
+   /* Code bytes at the program counter of the current thread. */
+   uint64_t CodeAddress;
+   std::vector<uint8_t> Code;
+
+   std::vector<SnapshotThread> Threads;
+   std::vector<Module> Modules;      /* sorted by address */
+
+   /*
+    * Capture the stopped threads of a process, whose registers and
+    * modules must be up to date.  The snapshot holds its own references
+    * to the module images.  Many threads are unwound in parallel on Pool,
+    * if given.
+    */
+   static Snapshot *
+   Capture(Process *process, pid_t CurrentTid, const siginfo_t *SigInfo,
+           ThreadPool *Pool = NULL);
+
+   bool
+   Write(const char *Path) const;
+
+   /*
+    * Load a snapshot, locating the module images by path and build-id.
+    */
+   static Snapshot *
+   Read(const char *Path, const std::vector<std::string> &DebugDirs);
+
+   /*
+    * Print registers and all stacks, as "r", "u" and "~*kpn" would, or
+    * only the stack of the current thread, as "kpn" would.
+    */
+   void
+   Render(FILE *fp, bool CurrentOnly = false);
+
+   /*
+    * Crash signature: the signal, or HANG, followed by the module and
+    * offset of the top frames of the current thread.  Independent of
+    * where modules were loaded, so that it identifies the crash across
+    * runs of the same build.
+    */
+   std::string
+   Signature(unsigned Frames);
+
+   /*
+    * Stream a structured report.  Reason says why the process was dumped,
+    * and ExitCode is the status stackdump reports for it.  Tail, if any,
+    * is the program's last output.
+    */
+   void
+   Report(ReportWriter *writer, const char *Reason, int ExitCode,
+          const OutputTail *Tail = NULL);
+
+   /* Target */
+   size_t
+   ReadMemory(uint64_t Address, void *Buffer, size_t Size);
+
+   const Module *
+   FindModule(uint64_t Address);
+};
+
+
+/*
+ * Entry point of "stackdump render [options] <snapshot>".  Arguments start
+ * after the "render" word.
+ */
+int
+RenderMain(int argc, char **argv);
+
+
+#endif /* _SNAPSHOT_H_ */
+
+/* vim:set sw=3 et: */
@@ -38,10 +38,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 #include <windows.h>
 #include <dbgeng.h>
 
+#include <string>
+
+#include "outputtail.h"
+#include "report.h"
+#include "signatures.h"
+
 /**************************************************************************
  *
  * Defines
@@ -105,9 +112,16 @@
 static BOOL g_Verbose = FALSE;
 static ULONG g_OutputMask = DEBUG_OUTPUT_DEBUGGEE;
 static PCSTR g_SymbolPath = NULL;
+static PCSTR g_CachePath = NULL;
 static ULONG g_TimeOut = 0;
 static PCSTR g_DumpPath = NULL;
+static PCSTR g_ReportPath = NULL;
+static OutputTail *g_DebugTail = NULL;   /* OutputDebugString, for --report */
+static DWORD g_StartTick = 0;
+static PCSTR g_SignaturePath = NULL;     /* crash signature database */
+static ULONG g_DumpEvery = 0;
 static ULONG g_DumpFormatFlags = DEBUG_DUMP_SMALL;
+static ULONG g_DumpFormatQualifiers = 0;    /* DEBUG_FORMAT_XXX */
 static char g_CommandLine[4096];
 static ULONG g_ExitCode = STILL_ACTIVE;
 static HANDLE g_hTimer = NULL;
@@ -117,9 +131,39 @@ static BOOL g_TimerIgnore = FALSE;
 static const DWORD g_Period = 1000;
 static BOOL g_Wow64Process = FALSE;
 
+/*
+ * With -f child processes are debugged too.  Their ids are only appended,
+ * as the timer thread reads them without locking.
+ */
+#define MAX_PROCESSES 1024
+static BOOL g_Follow = FALSE;
+static DWORD g_ProcessIds[MAX_PROCESSES];
+static volatile LONG g_ProcessCount = 0;
+
+/*
+ * Engine output, buffered for a writer thread.  See BufferOutput.
+ */
+#define OUTPUT_BUFFER_SIZE (1024*1024)   /* a power of two */
+static char g_OutputBuffer[OUTPUT_BUFFER_SIZE];
+static volatile LONG g_OutputHead = 0;   /* advanced by the engine thread */
+static volatile LONG g_OutputTail = 0;   /* advanced by the writer thread */
+static HANDLE g_hOutputEvent = NULL;
+static HANDLE g_hOutputThread = NULL;
+
 static IDebugClient* g_Client = NULL;
 static IDebugControl* g_Control = NULL;
 static IDebugSymbols* g_Symbols = NULL;
+static IDebugSystemObjects* g_System = NULL;
+static IDebugRegisters* g_Registers = NULL;
+
+/*
+ * What the report says about the dump: the exception, if any, and why the
+ * target was interrupted otherwise.
+ */
+static BOOL g_HaveException = FALSE;
+static EXCEPTION_RECORD64 g_Exception;
+static ULONG g_ExceptionChance = 0;
+static PCSTR g_DumpReason = NULL;
 
 /**************************************************************************
  *
@@ -127,6 +171,8 @@ static IDebugSymbols* g_Symbols = NULL;
  *
  **************************************************************************/
 
+static void FlushOutput(void);
+
 static void
 Cleanup(void)
 {
@@ -142,10 +188,20 @@ Cleanup(void)
       g_Symbols->Release();
    }
 
+   if (g_System) {
+      g_System->Release();
+   }
+
+   if (g_Registers) {
+      g_Registers->Release();
+   }
+
    if (g_Client) {
       g_Client->EndSession(DEBUG_END_PASSIVE);
       g_Client->Release();
    }
+
+   FlushOutput();
 }
 
 static void
@@ -204,11 +260,288 @@ AddWildcardBreakpoint(PCSTR ModuleName, PCSTR SymbolName)
    return AddBreakpoint(expression);
 }
 
+static ULONG
+CurrentProcessId(void)
+{
+   ULONG SystemId = 0;
+
+   if (g_System) {
+      g_System->GetCurrentProcessSystemId(&SystemId);
+   }
+   return SystemId;
+}
+
+/*
+ * Replace %p in a dump or report file name with the id of the current
+ * process, and %% with %.
+ */
+static void
+ExpandDumpPath(PCSTR Pattern, PSTR Buffer, size_t Size)
+{
+   size_t length = 0;
+
+   for (PCSTR p = Pattern; *p && length + 1 < Size; ++p) {
+      if (p[0] == '%' && p[1] == 'p') {
+         /* _snprintf returns -1 when truncating. */
+         size_t room = Size - length - 1;
+         int written = _snprintf(Buffer + length, room, "%lu", CurrentProcessId());
+         length += written < 0 || (size_t)written > room ? room : (size_t)written;
+         ++p;
+      } else if (p[0] == '%' && p[1] == '%') {
+         Buffer[length++] = '%';
+         ++p;
+      } else {
+         Buffer[length++] = *p;
+      }
+   }
+   Buffer[length < Size ? length : Size - 1] = 0;
+}
+
+/*
+ * Registers reported for each thread, by effective machine.
+ */
+static PCSTR g_Amd64Registers[] = {
+   "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+   "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+   "rip", "efl", "cs", "ss", "ds", "es", "fs", "gs", NULL
+};
+
+static PCSTR g_X86Registers[] = {
+   "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp",
+   "eip", "efl", "cs", "ss", "ds", "es", "fs", "gs", NULL
+};
+
+#define REPORT_MAX_FRAMES 256
+
+static void
+ReportThread(ReportWriter *writer, PCSTR *Registers)
+{
+   HRESULT status;
+
+   if (g_Registers) {
+      for (PCSTR *name = Registers; *name; ++name) {
+         ULONG index;
+         DEBUG_VALUE value;
+         memset(&value, 0, sizeof value);
+         if (g_Registers->GetIndexByName(*name, &index) == S_OK &&
+             g_Registers->GetValue(index, &value) == S_OK) {
+            writer->Register(*name, value.I64);
+         }
+      }
+   }
+
+   static DEBUG_STACK_FRAME frames[REPORT_MAX_FRAMES];
+   ULONG count = 0;
+   status = g_Control->GetStackTrace(0, 0, 0, frames, REPORT_MAX_FRAMES, &count);
+   if (status != S_OK) {
+      return;
+   }
+
+   for (ULONG i = 0; i < count; ++i) {
+      ULONG64 pc = frames[i].InstructionOffset;
+      char moduleName[MAX_PATH];
+      char symbolName[1024];
+      char fileName[MAX_PATH];
+      ULONG moduleIndex;
+      ULONG64 moduleBase = 0;
+      ULONG64 displacement = 0;
+      ULONG line = 0;
+
+      ReportFrame frame;
+      frame.Pc = pc;
+      frame.Sp = frames[i].StackOffset;
+      frame.Module = NULL;
+      frame.Offset = 0;
+      frame.Function = NULL;
+      frame.Displacement = 0;
+      frame.File = NULL;
+      frame.Line = 0;
+      frame.Inline = false;
+
+      if (g_Symbols->GetModuleByOffset(pc, 0, &moduleIndex, &moduleBase) == S_OK &&
+          g_Symbols->GetModuleNames(moduleIndex, 0, NULL, 0, NULL,
+                                    moduleName, sizeof moduleName, NULL,
+                                    NULL, 0, NULL) == S_OK) {
+         frame.Module = moduleName;
+         frame.Offset = pc - moduleBase;
+      }
+
+      /* Names come as module!function. */
+      if (g_Symbols->GetNameByOffset(pc, symbolName, sizeof symbolName, NULL,
+                                     &displacement) == S_OK) {
+         PCSTR bang = strchr(symbolName, '!');
+         frame.Function = bang ? bang + 1 : symbolName;
+         frame.Displacement = displacement;
+      }
+
+      if (g_Symbols->GetLineByOffset(pc, &line, fileName, sizeof fileName,
+                                     NULL, NULL) == S_OK) {
+         frame.File = fileName;
+         frame.Line = line;
+      }
+
+      writer->Frame(frame);
+   }
+}
+
+/*
+ * Crash signature: the exception code, or HANG, followed by the module
+ * and offset of the top frames of the current thread.
+ */
+static std::string
+CrashSignature(void)
+{
+   std::string signature;
+   char buffer[64];
+
+   if (g_HaveException) {
+      _snprintf(buffer, sizeof buffer, "%08lx", (unsigned long)g_Exception.ExceptionCode);
+      buffer[sizeof buffer - 1] = 0;
+      signature = buffer;
+   } else {
+      signature = "HANG";
+   }
+
+   DEBUG_STACK_FRAME frames[SIGNATURE_FRAMES];
+   ULONG filled = 0;
+   if (g_Control->GetStackTrace(0, 0, 0, frames, SIGNATURE_FRAMES, &filled) != S_OK) {
+      return signature;
+   }
+
+   for (ULONG i = 0; i < filled; ++i) {
+      ULONG index;
+      ULONG64 base;
+      char moduleName[MAX_PATH];
+
+      signature += i == 0 ? " " : " < ";
+      if (g_Symbols->GetModuleByOffset(frames[i].InstructionOffset, 0, &index, &base) == S_OK &&
+          g_Symbols->GetModuleNames(index, 0, NULL, 0, NULL,
+                                    moduleName, sizeof moduleName, NULL,
+                                    NULL, 0, NULL) == S_OK) {
+         _snprintf(buffer, sizeof buffer, "+0x%I64x", frames[i].InstructionOffset - base);
+         buffer[sizeof buffer - 1] = 0;
+         signature += moduleName;
+         signature += buffer;
+      } else {
+         signature += "<unknown>";
+      }
+   }
+
+   return signature;
+}
+
+/*
+ * Write a structured report of the current process, which is about to be
+ * terminated by Abort().
+ */
+static void
+WriteReport(void)
+{
+   char reportPath[MAX_PATH];
+   ExpandDumpPath(g_ReportPath, reportPath, sizeof reportPath);
+
+   size_t length = strlen(reportPath);
+   BOOL json = length >= 5 && _stricmp(reportPath + length - 5, ".json") == 0;
+
+   FILE *fp = fopen(reportPath, json ? "wt" : "wb");
+   if (!fp) {
+      fprintf(stderr, "warning: failed to create %s\n", reportPath);
+      return;
+   }
+
+   ReportWriter *writer = ReportWriter::Create(fp, json ? REPORT_JSON : REPORT_BINARY);
+
+   char name[MAX_PATH];
+   ULONG size = 0;
+   if (g_System->GetCurrentProcessExecutableName(name, sizeof name, &size) != S_OK) {
+      name[0] = 0;
+   }
+   writer->BeginProcess(CurrentProcessId(), name[0] ? name : NULL);
+
+   if (g_HaveException || g_DumpReason) {
+      ReportException exception;
+      exception.Code = g_HaveException ? g_Exception.ExceptionCode : 0;
+      exception.Chance = g_HaveException ? (g_ExceptionChance ? 1 : 2) : 0;
+      exception.Address = g_HaveException ? g_Exception.ExceptionAddress : 0;
+      exception.Reason = g_DumpReason;
+      writer->Exception(exception);
+   }
+
+   ULONG loaded = 0, unloaded = 0;
+   g_Symbols->GetNumberModules(&loaded, &unloaded);
+   for (ULONG i = 0; i < loaded; ++i) {
+      ULONG64 base;
+      DEBUG_MODULE_PARAMETERS params;
+      char imageName[MAX_PATH];
+      char moduleName[MAX_PATH];
+
+      if (g_Symbols->GetModuleByIndex(i, &base) != S_OK ||
+          g_Symbols->GetModuleParameters(1, &base, 0, &params) != S_OK ||
+          g_Symbols->GetModuleNames(i, 0, imageName, sizeof imageName, NULL,
+                                    moduleName, sizeof moduleName, NULL,
+                                    NULL, 0, NULL) != S_OK) {
+         continue;
+      }
+
+      ReportModule module;
+      module.Base = base;
+      module.End = base + params.Size;
+      module.Name = moduleName;
+      module.Path = imageName;
+      module.BuildId = NULL;
+      writer->Module(module);
+   }
+
+   if (g_DebugTail) {
+      g_DebugTail->Report(writer);
+   }
+
+   ULONG machine = IMAGE_FILE_MACHINE_I386;
+   g_Control->GetEffectiveProcessorType(&machine);
+   PCSTR *registers = machine == IMAGE_FILE_MACHINE_AMD64 ? g_Amd64Registers : g_X86Registers;
+
+   ULONG eventThread = 0;
+   ULONG count = 0;
+   g_System->GetEventThread(&eventThread);
+   g_System->GetNumberThreads(&count);
+   for (ULONG i = 0; i < count; ++i) {
+      ULONG engineId, systemId;
+      if (g_System->GetThreadIdsByIndex(i, 1, &engineId, &systemId) != S_OK ||
+          g_System->SetCurrentThreadId(engineId) != S_OK) {
+         continue;
+      }
+
+      writer->BeginThread(systemId, NULL, engineId == eventThread);
+      ReportThread(writer, registers);
+      writer->EndThread();
+   }
+   g_System->SetCurrentThreadId(eventThread);
+
+   /* Abort() follows. */
+   writer->EndProcess(1);
+   delete writer;
+
+   if (fclose(fp) != 0) {
+      fprintf(stderr, "warning: failed to write %s\n", reportPath);
+   } else if (g_Verbose) {
+      fprintf(stderr, "info: %s created\n", reportPath);
+   }
+}
+
 static void
 DumpStack(void)
 {
    HRESULT status;
 
+   /* A crash seen before is only counted, unless due for a dump. */
+   std::string signature;
+   long seen = 0;
+   if (g_SignaturePath) {
+      signature = CrashSignature();
+      seen = CountSignature(g_SignaturePath, signature);
+   }
+   BOOL known = seen > 0 && !(g_DumpEvery && seen % g_DumpEvery == 0);
+
    g_OutputMask = ~0;
 
    status = g_Control->OutputCurrentState(DEBUG_OUTCTL_ALL_CLIENTS,
@@ -228,20 +561,175 @@ DumpStack(void)
    }
 #endif
 
-   /* Print the call stack for all threads. */
-   status = g_Control->Execute(DEBUG_OUTCTL_ALL_CLIENTS, "~*kpn", DEBUG_EXECUTE_NOT_LOGGED);
+   /* Print the call stack for all threads, or just this one if known. */
+   if (known) {
+      FlushOutput();
+      fprintf(stderr, "known crash, seen %ld times before: %s\n", seen, signature.c_str());
+   }
+   status = g_Control->Execute(DEBUG_OUTCTL_ALL_CLIENTS, known ? "kpn" : "~*kpn",
+                               DEBUG_EXECUTE_NOT_LOGGED);
+   FlushOutput();
    if (status != S_OK) {
       fprintf(stderr, "warning: failed to output a stack trace (0x%08x)\n", status);
    }
 
-   if (g_DumpPath) {
-      status = g_Client->WriteDumpFile(g_DumpPath, g_DumpFormatFlags);
+   if (g_DumpPath && !known) {
+      char dumpPath[MAX_PATH];
+      ExpandDumpPath(g_DumpPath, dumpPath, sizeof dumpPath);
+
+      if (g_DumpFormatQualifiers) {
+         IDebugClient2 *client2 = NULL;
+         status = g_Client->QueryInterface(__uuidof(IDebugClient2), (void **)&client2);
+         if (status == S_OK) {
+            status = client2->WriteDumpFile2(dumpPath, g_DumpFormatFlags,
+                                             g_DumpFormatQualifiers, NULL);
+            client2->Release();
+         }
+      } else {
+         status = g_Client->WriteDumpFile(dumpPath, g_DumpFormatFlags);
+      }
       if (status != S_OK) {
          fprintf(stderr, "warning: failed to create dump file (0x%08x)\n", status);
       }
       if (g_Verbose) {
-         fprintf(stderr, "info: %s created\n", g_DumpPath);
+         fprintf(stderr, "info: %s created\n", dumpPath);
+      }
+   }
+
+   if (g_ReportPath) {
+      WriteReport();
+   }
+}
+
+/**************************************************************************
+ *
+ * Output buffer
+ *
+ **************************************************************************/
+
+/*
+ * The engine emits output in tiny fragments, and a "~*kpn" of thousands
+ * of threads makes hundreds of thousands of them, far too many to write
+ * one at a time into a pipe.  Fragments are instead appended to a ring
+ * buffer, which a writer thread empties into stderr in large writes.
+ *
+ * The output callbacks are only ever called on the thread which owns the
+ * debug client, so there is a single producer and a single consumer, and
+ * the head and tail counters need no lock.  They count bytes since the
+ * start and are only reduced modulo the buffer size when indexing.
+ */
+
+static DWORD WINAPI
+OutputThread(LPVOID lpParam)
+{
+   HANDLE hStdErr = GetStdHandle(STD_ERROR_HANDLE);
+
+   UNREFERENCED_PARAMETER(lpParam);
+
+   for (;;) {
+      ULONG tail = (ULONG)g_OutputTail;
+      ULONG head = (ULONG)g_OutputHead;
+
+      if (head == tail) {
+         WaitForSingleObject(g_hOutputEvent, INFINITE);
+         continue;
+      }
+
+      ULONG offset = tail & (OUTPUT_BUFFER_SIZE - 1);
+      ULONG count = head - tail;
+      if (count > OUTPUT_BUFFER_SIZE - offset) {
+         count = OUTPUT_BUFFER_SIZE - offset;
+      }
+
+      DWORD written = 0;
+      if (!WriteFile(hStdErr, g_OutputBuffer + offset, count, &written, NULL) ||
+          written == 0) {
+         /* Drop what cannot be written rather than spin. */
+         written = count;
+      }
+
+      /* Full barrier, so that the head is read again afterwards. */
+      InterlockedExchange(&g_OutputTail, (LONG)(tail + written));
+   }
+
+   return 0;
+}
+
+static void
+StartOutput(void)
+{
+   g_hOutputEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+   if (!g_hOutputEvent) {
+      return;
+   }
+
+   g_hOutputThread = CreateThread(NULL, 0, OutputThread, NULL, 0, NULL);
+   if (!g_hOutputThread) {
+      fprintf(stderr, "warning: failed to create output thread (%lu)\n", GetLastError());
+   }
+}
+
+static void
+BufferOutput(PCSTR Text)
+{
+   size_t length = strlen(Text);
+
+   if (!g_hOutputThread) {
+      fputs(Text, stderr);
+      fflush(stderr);
+      return;
+   }
+
+   while (length) {
+      ULONG head = (ULONG)g_OutputHead;
+      ULONG space = OUTPUT_BUFFER_SIZE - (head - (ULONG)g_OutputTail);
+      if (!space) {
+         /* Full: let the writer catch up. */
+         SetEvent(g_hOutputEvent);
+         Sleep(1);
+         continue;
+      }
+
+      ULONG offset = head & (OUTPUT_BUFFER_SIZE - 1);
+      ULONG count = OUTPUT_BUFFER_SIZE - offset;
+      if (count > space) {
+         count = space;
+      }
+      if (count > length) {
+         count = (ULONG)length;
+      }
+
+      memcpy(g_OutputBuffer + offset, Text, count);
+      InterlockedExchange(&g_OutputHead, (LONG)(head + count));
+
+      /*
+       * The writer only waits once it has caught up, so wake it only when
+       * the buffer was empty.  Both sides publish their counter before
+       * reading the other's, so a wake up cannot be missed.
+       */
+      if ((ULONG)g_OutputTail == head) {
+         SetEvent(g_hOutputEvent);
       }
+
+      Text += count;
+      length -= count;
+   }
+}
+
+/*
+ * Wait for the writer thread to write everything buffered so far.  Safe to
+ * call from any thread.
+ */
+static void
+FlushOutput(void)
+{
+   if (!g_hOutputThread) {
+      return;
+   }
+
+   SetEvent(g_hOutputEvent);
+   while (g_OutputTail != g_OutputHead) {
+      Sleep(1);
    }
 }
 
@@ -293,8 +781,10 @@ HRESULT STDMETHODCALLTYPE
 StdioOutputCallbacks::Output(ULONG Mask, PCSTR Text)
 {
    if (Mask & g_OutputMask) {
-      fputs(Text, stderr);
-      fflush(stderr);
+      BufferOutput(Text);
+   }
+   if ((Mask & DEBUG_OUTPUT_DEBUGGEE) && g_DebugTail) {
+      g_DebugTail->Append(OUTPUT_DEBUG, GetTickCount() - g_StartTick, Text, strlen(Text));
    }
    return S_OK;
 }
@@ -427,6 +917,13 @@ EventCallbacks::Exception(PEXCEPTION_RECORD64 Exception, ULONG FirstChance)
       }
    }
 
+   /* Keep the message after the program's own output. */
+   FlushOutput();
+
+   g_HaveException = TRUE;
+   g_Exception = *Exception;
+   g_ExceptionChance = FirstChance;
+
    if (!g_Verbose) {
       fprintf(stderr, "uncaught exception - code %08lx (%s chance)\n",
               Exception->ExceptionCode, FirstChance ? "first" : "second");
@@ -449,12 +946,23 @@ EnumWindowCallback(HWND hWnd, LPARAM lParam)
    DWORD dwProcessId = 0;
    HRESULT status;
 
+   UNREFERENCED_PARAMETER(lParam);
+
    GetWindowThreadProcessId(hWnd, &dwProcessId);
    if (GetWindowLong(hWnd, GWL_STYLE) & DS_MODALFRAME) {
-      if (dwProcessId == lParam) {
+      BOOL debugged = FALSE;
+      LONG count = g_ProcessCount;
+      for (LONG i = 0; i < count && i < MAX_PROCESSES; ++i) {
+         if (g_ProcessIds[i] == dwProcessId) {
+            debugged = TRUE;
+         }
+      }
+
+      if (debugged) {
          fprintf(stderr, "message dialog detected\n");
 
          g_TimerIgnore = TRUE;
+         g_DumpReason = "message dialog";
 
          status = g_Control->SetInterrupt(DEBUG_INTERRUPT_ACTIVE);
          if (status != S_OK) {
@@ -472,14 +980,15 @@ EnumWindowCallback(HWND hWnd, LPARAM lParam)
 static VOID CALLBACK
 TimeOutCallback(PVOID lpParam, BOOLEAN TimerOrWaitFired)
 {
-   DWORD dwProcessId = (DWORD)lpParam;
    HRESULT status;
 
+   UNREFERENCED_PARAMETER(lpParam);
+
    if (g_TimerIgnore) {
       return;
    }
 
-   EnumWindows(EnumWindowCallback, (LPARAM)dwProcessId);
+   EnumWindows(EnumWindowCallback, 0);
 
    g_ElapsedTime += g_Period;
 
@@ -490,6 +999,7 @@ TimeOutCallback(PVOID lpParam, BOOLEAN TimerOrWaitFired)
    fprintf(stderr, "time out (%lu sec) exceeded\n", g_TimeOut);
 
    g_TimerIgnore = TRUE;
+   g_DumpReason = "time out";
 
    status = g_Control->SetInterrupt(DEBUG_INTERRUPT_ACTIVE);
    if (status != S_OK) {
@@ -526,6 +1036,21 @@ EventCallbacks::CreateProcess(ULONG64 ImageFileHandle,
    UNREFERENCED_PARAMETER(ThreadDataOffset);
    UNREFERENCED_PARAMETER(StartOffset);
 
+   dwProcessId = GetProcessId(hProcess);
+
+   LONG index = InterlockedIncrement(&g_ProcessCount) - 1;
+   if (index < MAX_PROCESSES) {
+      g_ProcessIds[index] = dwProcessId;
+   }
+
+   /* One timer serves all processes. */
+   if (g_hTimerQueue) {
+      if (g_Verbose) {
+         fprintf(stderr, "info: following process %lu\n", dwProcessId);
+      }
+      return DEBUG_STATUS_GO;
+   }
+
 #ifdef _WIN64
    IsWow64Process(hProcess, &g_Wow64Process);
 #endif
@@ -536,11 +1061,9 @@ EventCallbacks::CreateProcess(ULONG64 ImageFileHandle,
       Abort();
    }
 
-   dwProcessId = GetProcessId(hProcess);
-
    if (!CreateTimerQueueTimer(&g_hTimer, g_hTimerQueue,
                              (WAITORTIMERCALLBACK)TimeOutCallback,
-                             (PVOID)dwProcessId, g_Period, g_Period, 0)) {
+                             NULL, g_Period, g_Period, 0)) {
       fprintf(stderr, "error: failed to CreateTimerQueueTimer failed (%d)\n", GetLastError());
       Abort();
    }
@@ -551,6 +1074,15 @@ EventCallbacks::CreateProcess(ULONG64 ImageFileHandle,
 HRESULT STDMETHODCALLTYPE
 EventCallbacks::ExitProcess(ULONG ExitCode)
 {
+   /* The first process is the one we report the exit code of. */
+   if (g_ProcessCount > 1 && CurrentProcessId() != g_ProcessIds[0]) {
+      if (g_Verbose) {
+         fprintf(stderr, "info: process %lu exited with code (0x%0lx)\n",
+                 CurrentProcessId(), ExitCode);
+      }
+      return DEBUG_STATUS_GO;
+   }
+
    if (g_Verbose) {
       fprintf(stderr, "info: program exited with code (0x%0lx)\n", ExitCode);
    }
@@ -595,11 +1127,25 @@ Usage()
          "\n"
          "options:\n"
          "  -? displays command line help text\n"
+         "  -c <cache-dir> caches symbol files locally (cache* symbol path element)\n"
+         "  --dump-every <count> still dumps every that many recurrences of a known\n"
+         "                       --signatures crash (default only the first time)\n"
+         "  -f debugs child processes too\n"
          "  -ma create a full dump file (default is a minidump)\n"
+         "  -mi create a minidump with the memory the stacks point to (.dump /mi)\n"
+         "  --report <report-file> writes a structured report of the crash, as JSON if\n"
+         "                        the name ends in .json, or else in binary\n"
+         "                        (%p is replaced by the process id)\n"
+         "  --signatures <file> counts crashes by signature in that file, shared by all\n"
+         "                      stackdump processes, and only prints the crashing\n"
+         "                      thread without a dump file for those seen before\n"
          "  -v enables verbose output from the debugger\n"
          "  -y <symbols-path> specifies the symbol search path (same as _NT_SYMBOL_PATH)\n"
          "  -z <crash-dump-file> specifies the name of a crash dump file to create\n"
-         "  -t <seconds> specifies a timeout in seconds \n",
+         "                       (%p is replaced by the process id)\n"
+         "  -t <seconds> specifies a timeout in seconds \n"
+         "  --tail <megabytes> keeps that much of the last OutputDebugString output\n"
+         "                     for --report\n",
          stderr);
 }
 
@@ -637,6 +1183,17 @@ main(int argc, char** argv)
          --argc;
 
          g_TimeOut = atoi(*argv);
+      } else if (!strcmp(*argv, "-c")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -c missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_CachePath = *argv;
       } else if (!strcmp(*argv, "-y")) {
          if (argc < 2) {
             fprintf(stderr, "error: -y missing argument\n\n");
@@ -659,8 +1216,69 @@ main(int argc, char** argv)
          --argc;
 
          g_DumpPath = *argv;
+      } else if (!strcmp(*argv, "--report")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --report missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ReportPath = *argv;
+      } else if (!strcmp(*argv, "--signatures")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --signatures missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_SignaturePath = *argv;
+      } else if (!strcmp(*argv, "--dump-every")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --dump-every missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_DumpEvery = strtoul(*argv, NULL, 0);
+         if (!g_DumpEvery) {
+            fprintf(stderr, "error: invalid dump count %s\n\n", *argv);
+            Usage();
+            return 1;
+         }
+      } else if (!strcmp(*argv, "--tail")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --tail missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         unsigned long megabytes = strtoul(*argv, NULL, 0);
+         if (!megabytes || megabytes > 1024) {
+            fprintf(stderr, "error: invalid tail size %s (1-1024 MiB)\n\n", *argv);
+            Usage();
+            return 1;
+         }
+         g_DebugTail = new OutputTail(megabytes << 20);
       } else if (!strcmp(*argv, "-ma")) {
          g_DumpFormatFlags = DEBUG_DUMP_DEFAULT;
+         g_DumpFormatQualifiers = 0;
+      } else if (!strcmp(*argv, "-mi")) {
+         g_DumpFormatFlags = DEBUG_DUMP_SMALL;
+         g_DumpFormatQualifiers = DEBUG_FORMAT_USER_SMALL_INDIRECT_MEMORY;
+      } else if (!strcmp(*argv, "-f")) {
+         g_Follow = TRUE;
       } else {
          break;
       }
@@ -734,6 +1352,20 @@ main(int argc, char** argv)
       Abort();
    }
 
+   status = g_Client->QueryInterface(__uuidof(IDebugSystemObjects),
+                                     (void**)&g_System);
+   if (status != S_OK) {
+      fprintf(stderr, "error: failed to start debugging engine (0x%08x)\n", status);
+      Abort();
+   }
+
+   status = g_Client->QueryInterface(__uuidof(IDebugRegisters),
+                                     (void**)&g_Registers);
+   if (status != S_OK) {
+      fprintf(stderr, "warning: failed to access registers (0x%08x)\n", status);
+      g_Registers = NULL;
+   }
+
    status = g_Symbols->AddSymbolOptions(0x10 /* SYMOPT_LOAD_LINES */);
    if (status != S_OK) {
       fprintf(stderr, "warning: failed to add symbol options (0x%08x)\n", status);
@@ -746,6 +1378,8 @@ main(int argc, char** argv)
    g_Control->SetEngineOptions(DEBUG_ENGOPT_ALLOW_NETWORK_PATHS);
    g_Control->SetCodeLevel(DEBUG_LEVEL_SOURCE);
 
+   StartOutput();
+
    status = g_Client->SetOutputCallbacks(&g_OutputCb);
    if (status != S_OK) {
       fprintf(stderr, "warning: failed to redirect debugger output (0x%08x)\n", status);
@@ -761,13 +1395,35 @@ main(int argc, char** argv)
       }
    }
 
+   if (g_CachePath != NULL) {
+      /*
+       * Symbol files are keyed by PDB signature and age under the cache
+       * directory, so later runs load them without going back to the
+       * (possibly remote) symbol path.
+       */
+      char symbolPath[4096];
+      char cachedPath[4096 + MAX_PATH + 16];
+      ULONG size = 0;
+      symbolPath[0] = 0;
+      g_Symbols->GetSymbolPath(symbolPath, sizeof symbolPath, &size);
+      _snprintf(cachedPath, sizeof cachedPath, "cache*%s;%s", g_CachePath, symbolPath);
+      cachedPath[sizeof cachedPath - 1] = 0;
+      status = g_Symbols->SetSymbolPath(cachedPath);
+      if (status != S_OK) {
+         fprintf(stderr, "warning: failed to set symbol cache (0x%08x)\n", status);
+      }
+   }
+
    status = g_Client->SetEventCallbacks(&g_EventCb);
    if (status != S_OK) {
       fprintf(stderr, "error: failed to capture debug events (0x%08x)\n", status);
       Abort();
    }
 
-   status = g_Client->CreateProcess(0, g_CommandLine, DEBUG_ONLY_THIS_PROCESS);
+   g_StartTick = GetTickCount();
+
+   status = g_Client->CreateProcess(0, g_CommandLine,
+                                    g_Follow ? DEBUG_PROCESS : DEBUG_ONLY_THIS_PROCESS);
    if (status != S_OK) {
       fprintf(stderr, "error: failed to create the process (0x%08x)\n", status);
       Abort();
@@ -0,0 +1,2951 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Linux port of stackdump: runs a child process under ptrace and dumps the
+ * stack of all its threads when it dies of a fatal signal or times out.
+ *
+ * To keep the overhead on a healthy child close to zero the child is only
+ * stopped on thread creation, thread exit and signal delivery.  Signals are
+ * handed straight back; whether a signal was fatal is only decided when the
+ * thread is about to exit (PTRACE_EVENT_EXIT), at which point all of its
+ * registers and memory are still intact.
+ *
+ * In lazy mode (-l) the child is not traced at all until it times out or
+ * a preloaded agent reports a fatal signal; until then the supervisor just
+ * waits on a pidfd.  Signals the program handles itself are chained to its
+ * handlers in process, so they cost nothing, unlike when traced, where
+ * every signal stops the thread for the tracer.
+ *
+ * With -w a watchdog samples the CPU time and wake-ups of every thread a
+ * few times per window, and dumps a child which spins, or stays blocked in
+ * the same system calls, long before the -t time out.  Spinning is told
+ * apart from number crunching by interrupting busy threads for their PC,
+ * so in lazy mode only sleeping hangs are caught.
+ *
+ * With -r/-g the resident size is sampled from /proc/<pid>/statm, so that
+ * a leaking child is dumped while it still fits in memory, rather than
+ * silently taken by the OOM killer.
+ *
+ * With -f forked children are followed too, each process with its own
+ * time out, limits and dump file (%p in the file name stands for the
+ * process id).  A crashing child is dumped and killed while the rest of
+ * the process tree carries on.
+ *
+ * With --profile the threads are also stopped and unwound a number of
+ * times per second, and the stacks written out as folded stacks for
+ * flamegraph.pl once the program exits.
+ *
+ * With --jobs/--manifest many command lines are run, a few at a time,
+ * under the one supervisor, sharing the loaded images and symbols.  A
+ * report of all jobs is printed at the end.
+ *
+ * With --tail the output of the child goes through pipes of ours, and is
+ * forwarded to our own while its last few megabytes are kept for the
+ * report.
+ *
+ * With --signatures crashes are counted by signature in a database shared
+ * by all stackdump processes, and only new ones are dumped in full.  With
+ * --server dump files are handed to a local dump server to write.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/ptrace.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "agent.h"
+#include "dumpserver.h"
+#include "dumpstore.h"
+#include "dumpwriter.h"
+#include "jobs.h"
+#include "outputtail.h"
+#include "process.h"
+#include "profile.h"
+#include "report.h"
+#include "signatures.h"
+#include "snapshot.h"
+#include "symbolize.h"
+#include "symcache.h"
+#include "threadpool.h"
+#include "triage.h"
+#include "unwind.h"
+#include "watchdog.h"
+
+/* Memory sampling period and growth rate window, in ms */
+#define MEMORY_PERIOD 100
+#define MEMORY_RATE_WINDOW 1000
+
+/* Largest read from an output pipe, and the size asked of the pipes */
+#define CAPTURE_READ_SIZE (64*1024)
+#define CAPTURE_PIPE_SIZE (1024*1024)
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/**************************************************************************
+ *
+ * Globals
+ *
+ **************************************************************************/
+
+static bool g_Verbose = false;
+static const char *g_SymbolPath = NULL;
+static unsigned long g_TimeOut = 0;
+static const char *g_DumpPath = NULL;
+static const char *g_SnapshotPath = NULL;
+static DumpFormat g_DumpFormat = DUMP_SMALL;
+static unsigned long g_ReachableDepth = REACHABLE_DEPTH;
+static unsigned long g_ReachableBudget = REACHABLE_BUDGET;     /* bytes */
+static bool g_Compress = false;
+static bool g_KeepRunning = false;
+static int g_ExitCode = 0;
+static bool g_TimerIgnore = false;
+static unsigned long g_Period = 1000;
+static struct timespec g_StartTime;
+
+/* Hang detection window in ms, or zero */
+static unsigned long g_HangWindow = 0;
+
+/* Threads interrupted to sample their PC */
+static std::set<pid_t> g_PcSamples;
+
+/* Memory limits in MiB and MiB/s, or zero */
+static unsigned long g_RssLimit = 0;
+static unsigned long g_GrowthLimit = 0;
+
+struct MemorySample
+{
+   unsigned long Time;     /* ms */
+   uint64_t Rss;           /* bytes */
+};
+
+static bool g_Lazy = false;
+static bool g_Attached = false;
+static int g_AgentFd = -1;
+
+/* Follow forked children */
+static bool g_Follow = false;
+
+/*
+ * A command line of the manifest.
+ */
+struct Job
+{
+   JobSpec Spec;
+   unsigned Number;           /* from 1 */
+   pid_t Pid;                 /* zero until started */
+   bool Done;
+   unsigned long StartTime;   /* ms */
+   unsigned long EndTime;
+   siginfo_t Exit;
+   std::string Failure;       /* crash, time out, etc. */
+   std::string Stacks;
+};
+
+/* Sampling profiler */
+static unsigned long g_ProfileRate = 0;      /* Hz */
+static unsigned long g_ProfilePeriod = 0;    /* ms */
+static unsigned long g_NextProfile = 0;
+static const char *g_ProfilePath = "stackdump.folded";
+
+/* Structured report, JSON if the name ends in .json */
+static const char *g_ReportPath = NULL;
+static FoldedStacks g_Folded;
+
+/*
+ * Crash signature database.  A crash seen before is only counted, and
+ * dumped again every g_DumpEvery times, if at all.
+ */
+static const char *g_SignaturePath = NULL;
+static unsigned long g_DumpEvery = 0;
+
+/* Dump server socket, to hand dump files to instead of writing them */
+static const char *g_ServerPath = NULL;
+
+/* Content addressed dump store, to add dump files to instead (--store) */
+static const char *g_StorePath = NULL;
+
+/*
+ * Output of a command line (--tail), shared by all its processes.  Pipes
+ * are read as soon as there is anything, so that the tail is up to date
+ * when a process crashes; to our own stdout/stderr being pipes too the
+ * bytes are tee'd, and only copied once, into the tail.
+ */
+struct Capture
+{
+   int Fds[2];                /* read ends for stdout and stderr, or -1 */
+   int WriteFds[2];           /* until handed over to the child */
+   OutputTail *Tail;
+};
+
+enum ForwardMode {
+   FORWARD_TEE,
+   FORWARD_WRITE,
+   FORWARD_NONE               /* the reader went away */
+};
+
+static size_t g_TailSize = 0;                   /* bytes, or zero */
+static Capture *g_Capture = NULL;               /* of the command line */
+static std::vector<Capture *> g_Captures;
+static std::map<int, Capture *> g_CaptureFds;   /* by read end */
+static ForwardMode g_Forward[2];
+static int g_EpollFd = -1;
+
+static std::vector<Job> g_Jobs;
+static size_t g_NextJob = 0;
+static unsigned g_MaxJobs = 0;
+static unsigned g_RunningJobs = 0;
+
+/*
+ * Per-process state.  Without -f there is only the one child.
+ */
+struct Tracee
+{
+   Process *process;
+   unsigned long StartTime;   /* ms */
+
+   /* Settings, inherited by children */
+   Job *job;
+   unsigned long TimeOut;     /* s, or zero */
+   const char *DumpPath;
+   DumpFormat Format;
+
+   /* While set, threads reporting a stop are left stopped. */
+   bool Stopping;
+
+   /* Already dumped, and being killed. */
+   bool Dumped;
+
+   /* Dumped with --keep-running, and left running. */
+   bool LiveDumped;
+
+   Watchdog *watchdog;
+   int StatmFd;
+   std::deque<MemorySample> RssHistory;
+
+   Profile *profile;          /* NULL unless profiling */
+   bool ModulesStale;         /* to be reloaded before the next sample */
+
+   Capture *capture;          /* NULL unless --tail */
+};
+
+static pid_t g_Pid = 0;
+static std::map<pid_t, Tracee *> g_Tracees;     /* by pid */
+static std::map<pid_t, Tracee *> g_Owners;      /* by tid */
+static std::vector<Tracee *> g_Exited;          /* to be deleted */
+static std::vector<std::string> g_DebugDirs;
+
+/*
+ * Timers of all processes are kept in a single heap, so that a single
+ * timerfd serves any number of them.
+ */
+struct Deadline
+{
+   unsigned long Time;     /* ms */
+   pid_t Pid;
+
+   bool
+   operator > (const Deadline &other) const {
+      return Time > other.Time;
+   }
+};
+
+static std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline> > g_Deadlines;
+static unsigned long g_NextSample = 0;
+static int g_TimerFd = -1;
+
+/**************************************************************************
+ *
+ * Utility
+ *
+ **************************************************************************/
+
+/*
+ * Symbolize the samples of a process while its modules are still known,
+ * i.e., before it execs or goes away.
+ */
+static void
+FlushProfile(Tracee *tracee)
+{
+   if (tracee->profile && tracee->profile->Samples()) {
+      tracee->profile->Fold(tracee->process, g_Folded);
+   }
+}
+
+static void
+DeleteTracee(Tracee *tracee)
+{
+   FlushProfile(tracee);
+   delete tracee->profile;
+   delete tracee->watchdog;
+   if (tracee->StatmFd >= 0) {
+      close(tracee->StatmFd);
+   }
+   delete tracee->process;
+   delete tracee;
+}
+
+static void CloseCaptures(void);
+
+static void
+Cleanup(void)
+{
+   /* PTRACE_O_EXITKILL takes care of the children. */
+   std::map<pid_t, Tracee *>::iterator it;
+   for (it = g_Tracees.begin(); it != g_Tracees.end(); ++it) {
+      DeleteTracee(it->second);
+   }
+   g_Tracees.clear();
+   g_Owners.clear();
+
+   for (size_t i = 0; i < g_Exited.size(); ++i) {
+      DeleteTracee(g_Exited[i]);
+   }
+   g_Exited.clear();
+
+   if (!g_Folded.empty()) {
+      if (WriteFoldedStacks(g_ProfilePath, g_Folded) && g_Verbose) {
+         fprintf(stderr, "info: %s created\n", g_ProfilePath);
+      }
+      g_Folded.clear();
+   }
+
+   /* Whatever the program wrote before it went away is still due. */
+   CloseCaptures();
+
+   if (g_TimerFd >= 0) {
+      close(g_TimerFd);
+      g_TimerFd = -1;
+   }
+}
+
+static void
+Abort(void)
+{
+   Cleanup();
+
+   exit(1);
+}
+
+/*
+ * Signals whose default action is to terminate the process and dump core,
+ * i.e., the equivalent of an unhandled exception.
+ */
+static bool
+IsFatalSignal(int sig)
+{
+   switch (sig) {
+   case SIGQUIT:
+   case SIGILL:
+   case SIGTRAP:
+   case SIGABRT:
+   case SIGBUS:
+   case SIGFPE:
+   case SIGSEGV:
+   case SIGXCPU:
+   case SIGXFSZ:
+   case SIGSYS:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/*
+ * Milliseconds since the child was started.
+ */
+static unsigned long
+ElapsedTime(void)
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (now.tv_sec - g_StartTime.tv_sec)*1000 +
+          (now.tv_nsec - g_StartTime.tv_nsec)/1000000;
+}
+
+/*
+ * Replace %p in a file name with the process id, and %% with %.
+ */
+static std::string
+ExpandPath(const char *Path, pid_t Pid)
+{
+   std::string path;
+
+   for (const char *p = Path; *p; ++p) {
+      if (p[0] == '%' && p[1] == 'p') {
+         char pid[16];
+         snprintf(pid, sizeof pid, "%d", Pid);
+         path += pid;
+         ++p;
+      } else if (p[0] == '%' && p[1] == '%') {
+         path += '%';
+         ++p;
+      } else {
+         path += *p;
+      }
+   }
+
+   return path;
+}
+
+/*
+ * Write out a dump file held in memory.
+ */
+static void
+WriteDumpCopy(int Fd, const std::string &Path)
+{
+   struct stat st;
+   off_t offset = 0;
+   int out = open(Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (out < 0 || fstat(Fd, &st) != 0) {
+      fprintf(stderr, "warning: failed to create %s (%s)\n", Path.c_str(), strerror(errno));
+   } else {
+      while (offset < st.st_size && sendfile(out, Fd, &offset, st.st_size - offset) > 0)
+         ;
+      if (offset < st.st_size) {
+         fprintf(stderr, "warning: failed to write %s (%s)\n", Path.c_str(), strerror(errno));
+      }
+   }
+   if (out >= 0) {
+      close(out);
+   }
+}
+
+/*
+ * Pass a dump file, written into memory, on to the dump server; or write
+ * it out ourselves if the server cannot be reached.
+ */
+static void
+SubmitToServer(int Fd, pid_t Pid, const std::string &Path, const std::string &Signature)
+{
+   switch (SubmitDump(g_ServerPath, Fd, Pid, Path.c_str(), Signature)) {
+   case DUMP_QUEUED:
+      if (g_Verbose) {
+         fprintf(stderr, "info: dump of process %d handed to %s\n", Pid, g_ServerPath);
+      }
+      return;
+   case DUMP_DUPLICATE:
+      if (g_Verbose) {
+         fprintf(stderr, "info: dump of process %d dropped, crash already known to the server\n",
+                 Pid);
+      }
+      return;
+   case DUMP_REFUSED:
+      fprintf(stderr, "warning: dump of process %d refused by the server, which is full\n", Pid);
+      return;
+   default:
+      break;
+   }
+
+   fprintf(stderr, "warning: dump server %s not reachable, writing %s\n",
+           g_ServerPath, Path.c_str());
+   WriteDumpCopy(Fd, Path);
+}
+
+/*
+ * Add a dump file, written into memory, to the dump store, named after the
+ * dump file; or write it out if that fails.
+ */
+static void
+AddToStore(int Fd, const std::string &Path)
+{
+   char path[64];
+   snprintf(path, sizeof path, "/proc/self/fd/%d", Fd);
+
+   size_t slash = Path.rfind('/');
+   std::string name = slash == std::string::npos ? Path : Path.substr(slash + 1);
+
+   StoreStats stats;
+   if (StoreDump(g_StorePath, path, name, &stats)) {
+      if (g_Verbose) {
+         fprintf(stderr, "info: %s stored in %s, adding %llu of %llu bytes\n",
+                 name.c_str(), g_StorePath,
+                 (unsigned long long)stats.NewBytes, (unsigned long long)stats.Size);
+      }
+      return;
+   }
+
+   fprintf(stderr, "warning: failed to store dump in %s, writing %s\n",
+           g_StorePath, Path.c_str());
+   WriteDumpCopy(Fd, Path);
+}
+
+/*
+ * Suffix for messages about a process, when there may be several.
+ */
+static const char *
+ProcessSuffix(const Tracee *tracee)
+{
+   static char suffix[64];
+
+   if (tracee->job && tracee->job->Pid != tracee->process->Pid) {
+      snprintf(suffix, sizeof suffix, " in job %u (process %d)",
+               tracee->job->Number, tracee->process->Pid);
+   } else if (tracee->job) {
+      snprintf(suffix, sizeof suffix, " in job %u", tracee->job->Number);
+   } else if (g_Follow) {
+      snprintf(suffix, sizeof suffix, " in process %d", tracee->process->Pid);
+   } else {
+      return "";
+   }
+   return suffix;
+}
+
+/*
+ * Write all of a buffer, waiting for the reader if need be.  Returns
+ * false once the reader is gone.
+ */
+static bool
+WriteAll(int Fd, const char *Data, size_t Size)
+{
+   while (Size) {
+      ssize_t ret = write(Fd, Data, Size);
+      if (ret < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         if (errno == EAGAIN) {
+            struct pollfd pfd;
+            pfd.fd = Fd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, -1);
+            continue;
+         }
+         return false;
+      }
+      Data += ret;
+      Size -= ret;
+   }
+   return true;
+}
+
+/*
+ * Create the pipes a command line's output will go through.
+ */
+static Capture *
+NewCapture(void)
+{
+   int fds[2][2];
+
+   if (pipe2(fds[0], O_CLOEXEC) != 0) {
+      fprintf(stderr, "error: failed to create a pipe (%s)\n", strerror(errno));
+      return NULL;
+   }
+   if (pipe2(fds[1], O_CLOEXEC) != 0) {
+      fprintf(stderr, "error: failed to create a pipe (%s)\n", strerror(errno));
+      close(fds[0][0]);
+      close(fds[0][1]);
+      return NULL;
+   }
+
+   Capture *capture = new Capture;
+   for (unsigned i = 0; i < 2; ++i) {
+      capture->Fds[i] = fds[i][0];
+      capture->WriteFds[i] = fds[i][1];
+
+      /* A chatty program should rarely find the pipe full. */
+      fcntl(fds[i][0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+      fcntl(fds[i][0], F_SETFL, fcntl(fds[i][0], F_GETFL) | O_NONBLOCK);
+      g_CaptureFds[fds[i][0]] = capture;
+   }
+   capture->Tail = new OutputTail(g_TailSize);
+   g_Captures.push_back(capture);
+   return capture;
+}
+
+/*
+ * Have the event loop read the pipes, once there is one.
+ */
+static void
+WatchCapture(Capture *capture)
+{
+   if (g_EpollFd < 0) {
+      return;
+   }
+
+   struct epoll_event event;
+   memset(&event, 0, sizeof event);
+   event.events = EPOLLIN;
+   for (unsigned i = 0; i < 2; ++i) {
+      if (capture->Fds[i] >= 0) {
+         event.data.fd = capture->Fds[i];
+         epoll_ctl(g_EpollFd, EPOLL_CTL_ADD, capture->Fds[i], &event);
+      }
+   }
+}
+
+static void
+CloseCapture(Capture *capture, unsigned Index)
+{
+   int fd = capture->Fds[Index];
+   if (g_EpollFd >= 0) {
+      epoll_ctl(g_EpollFd, EPOLL_CTL_DEL, fd, NULL);
+   }
+   g_CaptureFds.erase(fd);
+   close(fd);
+   capture->Fds[Index] = -1;
+}
+
+/*
+ * Move what is in a pipe to our own stdout/stderr and into the tail.
+ * Returns the number of bytes moved, zero if there was nothing, or -1 at
+ * the end of the output.
+ */
+static ssize_t
+ForwardOutput(Capture *capture, unsigned Index)
+{
+   int fd = capture->Fds[Index];
+   int out = Index ? STDERR_FILENO : STDOUT_FILENO;
+   OutputStream stream = Index ? OUTPUT_STDERR : OUTPUT_STDOUT;
+   ssize_t ret;
+
+   if (fd < 0) {
+      return -1;
+   }
+
+   int available = 0;
+   if (ioctl(fd, FIONREAD, &available) != 0 || available <= 0) {
+      available = CAPTURE_READ_SIZE;
+   }
+   size_t size = std::min((size_t)available, (size_t)CAPTURE_READ_SIZE);
+   char *space = capture->Tail->Reserve(&size);
+
+   if (g_Forward[Index] == FORWARD_TEE) {
+      /*
+       * Duplicate the bytes into our pipe without copying them, then take
+       * them out of the program's.  A full pipe holds back the program,
+       * just like it would have without us.
+       */
+      do {
+         ret = tee(fd, out, size, SPLICE_F_NONBLOCK);
+      } while (ret < 0 && errno == EINTR);
+
+      if (ret > 0) {
+         ssize_t got = read(fd, space, ret);
+         if (got > 0) {
+            capture->Tail->Commit(stream, ElapsedTime(), got);
+         }
+         return ret;
+      }
+      if (ret < 0 && errno == EPIPE) {
+         g_Forward[Index] = FORWARD_NONE;
+      } else if (ret < 0 && errno != EAGAIN) {
+         g_Forward[Index] = FORWARD_WRITE;
+      }
+      /*
+       * Otherwise either pipe is empty or full respectively; reading
+       * tells which, and writing waits for room.
+       */
+   }
+
+   do {
+      ret = read(fd, space, size);
+   } while (ret < 0 && errno == EINTR);
+
+   if (ret == 0) {
+      CloseCapture(capture, Index);
+      return -1;
+   }
+   if (ret < 0) {
+      return 0;
+   }
+
+   capture->Tail->Commit(stream, ElapsedTime(), ret);
+
+   if (g_Forward[Index] != FORWARD_NONE && !WriteAll(out, space, ret)) {
+      g_Forward[Index] = FORWARD_NONE;
+   }
+   return ret;
+}
+
+/*
+ * Forward everything written so far, e.g., before a dump.
+ */
+static void
+DrainCapture(Capture *capture)
+{
+   for (unsigned i = 0; i < 2; ++i) {
+      while (ForwardOutput(capture, i) > 0)
+         ;
+   }
+}
+
+static void
+CloseCaptures(void)
+{
+   for (size_t i = 0; i < g_Captures.size(); ++i) {
+      Capture *capture = g_Captures[i];
+      DrainCapture(capture);
+      for (unsigned j = 0; j < 2; ++j) {
+         if (capture->Fds[j] >= 0) {
+            CloseCapture(capture, j);
+         }
+         if (capture->WriteFds[j] >= 0) {
+            close(capture->WriteFds[j]);
+         }
+      }
+      delete capture->Tail;
+      delete capture;
+   }
+   g_Captures.clear();
+   g_Capture = NULL;
+}
+
+/*
+ * ptrace options for all traced threads.
+ */
+static long
+TraceOptions(void)
+{
+   long options = PTRACE_O_TRACECLONE |
+                  PTRACE_O_TRACEEXEC |
+                  PTRACE_O_TRACEEXIT |
+                  PTRACE_O_EXITKILL;
+
+   if (g_Follow) {
+      options |= PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK;
+   }
+
+   return options;
+}
+
+static void ArmTimer(void);
+
+static Tracee *
+FindTracee(pid_t Pid)
+{
+   std::map<pid_t, Tracee *>::iterator it = g_Tracees.find(Pid);
+   return it == g_Tracees.end() ? NULL : it->second;
+}
+
+static void
+ScheduleTimeOut(Tracee *tracee)
+{
+   if (tracee->TimeOut) {
+      Deadline deadline;
+      deadline.Time = tracee->StartTime + tracee->TimeOut*1000;
+      deadline.Pid = tracee->process->Pid;
+      g_Deadlines.push(deadline);
+      ArmTimer();
+   }
+}
+
+/*
+ * Give a process the settings of the one which forked it.  A child may
+ * report before the fork event, so this may also happen after the fact.
+ */
+static void
+InheritSettings(Tracee *tracee, const Tracee *Parent)
+{
+   if (tracee->job == Parent->job &&
+       tracee->TimeOut == Parent->TimeOut &&
+       tracee->DumpPath == Parent->DumpPath &&
+       tracee->Format == Parent->Format &&
+       tracee->capture == Parent->capture) {
+      return;
+   }
+
+   tracee->job = Parent->job;
+   tracee->capture = Parent->capture;
+   tracee->DumpPath = Parent->DumpPath;
+   tracee->Format = Parent->Format;
+   if (tracee->TimeOut != Parent->TimeOut) {
+      /* The old deadline no longer matches, and will be ignored. */
+      tracee->TimeOut = Parent->TimeOut;
+      ScheduleTimeOut(tracee);
+   }
+}
+
+/*
+ * Start keeping track of a new process, whose threads are yet to be
+ * added.  Settings come from the parent process if known, or else from
+ * the command line.
+ */
+static Tracee *
+AddTracee(pid_t Pid, const Tracee *Parent = NULL)
+{
+   Tracee *tracee = FindTracee(Pid);
+   if (tracee) {
+      if (Parent) {
+         InheritSettings(tracee, Parent);
+      }
+      return tracee;
+   }
+
+   tracee = new Tracee;
+   tracee->process = new Process(Pid);
+   tracee->StartTime = ElapsedTime();
+   tracee->job = Parent ? Parent->job : NULL;
+   tracee->TimeOut = Parent ? Parent->TimeOut : g_TimeOut;
+   tracee->DumpPath = Parent ? Parent->DumpPath : g_DumpPath;
+   tracee->Format = Parent ? Parent->Format : g_DumpFormat;
+   tracee->Stopping = false;
+   tracee->Dumped = false;
+   tracee->LiveDumped = false;
+   tracee->watchdog = g_HangWindow ? new Watchdog(Pid, g_HangWindow) : NULL;
+   tracee->StatmFd = -1;
+   tracee->profile = g_ProfileRate ? new Profile : NULL;
+   tracee->ModulesStale = true;
+   tracee->capture = Parent ? Parent->capture : g_Capture;
+   g_Tracees[Pid] = tracee;
+
+   ScheduleTimeOut(tracee);
+
+   if (g_Verbose && Pid != g_Pid) {
+      fprintf(stderr, "info: following process %d\n", Pid);
+   }
+
+   return tracee;
+}
+
+static Thread *
+AddThread(Tracee *tracee, pid_t Tid)
+{
+   g_Owners[Tid] = tracee;
+   return tracee->process->AddThread(Tid);
+}
+
+/*
+ * Forget a thread, and its process along with its last thread.  The
+ * process state is only deleted later, as callers up the stack may still
+ * refer to it.
+ */
+static void
+RemoveThread(Tracee *tracee, pid_t Tid)
+{
+   tracee->process->RemoveThread(Tid);
+   g_Owners.erase(Tid);
+   g_PcSamples.erase(Tid);
+
+   if (tracee->process->Threads.empty() &&
+       FindTracee(tracee->process->Pid) == tracee) {
+      g_Tracees.erase(tracee->process->Pid);
+      g_Exited.push_back(tracee);
+   }
+}
+
+/*
+ * Thread group (i.e., process) id of a thread.
+ */
+static pid_t
+ThreadGroup(pid_t Tid)
+{
+   char path[64];
+   char line[128];
+   pid_t tgid = 0;
+
+   snprintf(path, sizeof path, "/proc/%d/status", Tid);
+   FILE *fp = fopen(path, "r");
+   if (!fp) {
+      return 0;
+   }
+   while (fgets(line, sizeof line, fp)) {
+      if (sscanf(line, "Tgid: %d", &tgid) == 1) {
+         break;
+      }
+   }
+   fclose(fp);
+
+   return tgid;
+}
+
+/*
+ * Find the process a thread belongs to.  Threads and processes may report
+ * before the clone or fork event which announces them.
+ */
+static Tracee *
+FindOwner(pid_t Tid, bool Create)
+{
+   std::map<pid_t, Tracee *>::iterator it = g_Owners.find(Tid);
+   if (it != g_Owners.end()) {
+      return it->second;
+   }
+
+   if (!g_Follow && g_Jobs.empty()) {
+      return FindTracee(g_Pid);
+   }
+   if (!Create) {
+      return NULL;
+   }
+
+   pid_t tgid = ThreadGroup(Tid);
+   if (tgid <= 0) {
+      return NULL;
+   }
+   if (!g_Follow) {
+      return FindTracee(tgid);
+   }
+   return AddTracee(tgid);
+}
+
+static ThreadPool *g_UnwindPool = NULL;
+
+/*
+ * Pool unwinding the threads of large processes, started on first use and
+ * kept for all later captures.  NULL on a single core.
+ */
+static ThreadPool *
+UnwindPool(void)
+{
+   if (!g_UnwindPool && std::thread::hardware_concurrency() > 1) {
+      g_UnwindPool = new ThreadPool;
+   }
+   return g_UnwindPool;
+}
+
+static void ResumeAllThreads(Tracee *tracee);
+static void DetachAllThreads(Tracee *tracee);
+
+static double
+Milliseconds(const struct timespec &Start, const struct timespec &End)
+{
+   return (End.tv_sec - Start.tv_sec)*1e3 + (End.tv_nsec - Start.tv_nsec)*1e-6;
+}
+
+/*
+ * Fork a frozen copy-on-write snapshot of the process and let the original
+ * go, so that a live dump holds the target only for as long as the fork
+ * takes.  Memory is read from the snapshot from then on, whereas the thread
+ * registers were already fetched.  Returns the snapshot pid, or -1.
+ */
+static pid_t
+ForkSnapshot(Tracee *tracee)
+{
+   Process *process = tracee->process;
+
+   /* Any stopped thread will do, preferably the main one. */
+   pid_t tid = 0;
+   Thread *main = process->FindThread(process->Pid);
+   if (main && main->State == THREAD_STOPPED) {
+      tid = main->Tid;
+   } else {
+      std::map<pid_t, Thread>::iterator it;
+      for (it = process->Threads.begin(); it != process->Threads.end(); ++it) {
+         if (it->second.State == THREAD_STOPPED) {
+            tid = it->first;
+            break;
+         }
+      }
+   }
+
+   pid_t snapshot = tid ? process->ForkSnapshot(tid) : -1;
+   if (snapshot < 0) {
+      fprintf(stderr, "warning: failed to fork a snapshot, dumping the stopped process\n");
+      return -1;
+   }
+
+   /* Only the registers are kept, so threads must not be refreshed until
+    * the snapshot is released. */
+   if (g_Lazy) {
+      DetachAllThreads(tracee);
+   } else {
+      ResumeAllThreads(tracee);
+   }
+   process->Memory.Retarget(snapshot);
+
+   return snapshot;
+}
+
+/*
+ * Dump all threads of a process.  All threads must be stopped.
+ * SignalContext is the address of the ucontext_t of a thread parked in the
+ * agent's handler.
+ *
+ * Only the raw frames are captured while the target is frozen; the target
+ * is killed before the (much slower) symbolization.  Live dumps leave the
+ * target running instead, and are taken from a snapshot of it.
+ */
+static void
+DumpStack(Tracee *tracee, const char *Reason, pid_t CurrentTid, const siginfo_t *SigInfo,
+          uint64_t SignalContext = 0, bool Live = false)
+{
+   Process *process = tracee->process;
+
+   struct timespec stopped;
+   clock_gettime(CLOCK_MONOTONIC, &stopped);
+
+   process->LoadModules(g_DebugDirs);
+   process->GetThreadRegisters();
+
+   Thread *current = process->FindThread(CurrentTid);
+   if (current && SignalContext) {
+      if (!process->ReadSignalContext(current, SignalContext)) {
+         fprintf(stderr, "warning: failed to read signal context\n");
+      }
+   }
+
+   pid_t snapshotPid = Live ? ForkSnapshot(tracee) : -1;
+
+   /* The target is running again from here on, if live. */
+   struct timespec start, end;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+
+   Snapshot *snapshot = Snapshot::Capture(process, CurrentTid, SigInfo, UnwindPool());
+
+   if (g_Verbose) {
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      fprintf(stderr, "info: captured %u threads in %.1f ms\n",
+              (unsigned)snapshot->Threads.size(), Milliseconds(start, end));
+      fprintf(stderr, "info: memory cache: %lu hits, %lu misses, %lu syscalls\n",
+              process->Memory.Hits.load(), process->Memory.Misses.load(),
+              process->Memory.Syscalls.load());
+   }
+
+   std::string signature;
+   long seen = 0;
+   if (g_SignaturePath || g_ServerPath) {
+      signature = snapshot->Signature(SIGNATURE_FRAMES);
+   }
+   if (g_SignaturePath) {
+      seen = CountSignature(g_SignaturePath, signature);
+   }
+   bool known = seen > 0 && !(g_DumpEvery && seen % g_DumpEvery == 0);
+
+   std::string dumpPath;
+   int dumpFd = -1;
+   if (tracee->DumpPath && !known) {
+      dumpPath = ExpandPath(tracee->DumpPath, process->Pid);
+      if (g_ServerPath || g_StorePath) {
+         /* Into memory while the target is frozen, to the server or store after. */
+         char path[64];
+         dumpFd = memfd_create("stackdump", MFD_CLOEXEC);
+         snprintf(path, sizeof path, "/proc/self/fd/%d", dumpFd);
+         if (dumpFd < 0 ||
+             !WriteMinidump(path, process, tracee->Format, SigInfo ? CurrentTid : 0, SigInfo,
+                            g_ReachableDepth, g_ReachableBudget, g_Compress)) {
+            fprintf(stderr, "warning: failed to create dump file\n");
+            if (dumpFd >= 0) {
+               close(dumpFd);
+               dumpFd = -1;
+            }
+         }
+      } else if (!WriteMinidump(dumpPath.c_str(), process, tracee->Format,
+                                SigInfo ? CurrentTid : 0, SigInfo,
+                                g_ReachableDepth, g_ReachableBudget, g_Compress)) {
+         fprintf(stderr, "warning: failed to create dump file\n");
+      } else if (g_Verbose) {
+         fprintf(stderr, "info: %s created\n", dumpPath.c_str());
+      }
+   }
+
+   if (snapshotPid > 0) {
+      Process::ReleaseSnapshot(snapshotPid);
+      process->Memory.Retarget(process->Pid);
+
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      fprintf(stderr, "info: target stopped for %.1f ms, dump taken in %.1f ms more\n",
+              Milliseconds(stopped, start), Milliseconds(start, end));
+   } else if (!Live) {
+      kill(process->Pid, SIGKILL);
+   }
+
+   if (dumpFd >= 0) {
+      if (g_ServerPath) {
+         SubmitToServer(dumpFd, process->Pid, dumpPath, signature);
+      } else {
+         AddToStore(dumpFd, dumpPath);
+      }
+      close(dumpFd);
+   }
+
+   /* Have the last words out before the stacks, and in the report. */
+   if (tracee->capture) {
+      DrainCapture(tracee->capture);
+   }
+
+   if (g_SnapshotPath) {
+      std::string path = ExpandPath(g_SnapshotPath, process->Pid);
+      if (snapshot->Write(path.c_str()) && g_Verbose) {
+         fprintf(stderr, "info: %s created\n", path.c_str());
+      }
+   } else {
+      /*
+       * stderr is unbuffered, so render into memory first rather than make
+       * a write per line, which takes long with many threads and a pipe.
+       */
+      char *text = NULL;
+      size_t size = 0;
+      FILE *fp = open_memstream(&text, &size);
+      if (fp) {
+         if (known) {
+            /* Its full stacks are in an earlier dump. */
+            fprintf(fp, "known crash, seen %ld times before: %s\n", seen, signature.c_str());
+         }
+         snapshot->Render(fp, known);
+         fclose(fp);
+         if (tracee->job) {
+            /* Kept for the report. */
+            tracee->job->Stacks.append(text, size);
+         } else {
+            fwrite(text, 1, size, stderr);
+         }
+         free(text);
+      } else if (!tracee->job) {
+         snapshot->Render(stderr, known);
+      }
+   }
+
+   if (g_ReportPath) {
+      std::string path = ExpandPath(g_ReportPath, process->Pid);
+      size_t length = path.size();
+      bool json = length >= 5 && path.compare(length - 5, 5, ".json") == 0;
+
+      FILE *fp = fopen(path.c_str(), json ? "wt" : "wb");
+      if (!fp) {
+         fprintf(stderr, "warning: failed to create %s (%s)\n", path.c_str(), strerror(errno));
+      } else {
+         /* The root takes stackdump down with it; others were just killed. */
+         int exitCode = Live ? 0 : process->Pid == g_Pid ? 1 : 128 + SIGKILL;
+
+         ReportWriter *writer = ReportWriter::Create(fp, json ? REPORT_JSON : REPORT_BINARY);
+         snapshot->Report(writer, Reason, exitCode,
+                          tracee->capture ? tracee->capture->Tail : NULL);
+         delete writer;
+
+         if (fclose(fp) != 0) {
+            fprintf(stderr, "warning: failed to write %s (%s)\n", path.c_str(), strerror(errno));
+         } else if (g_Verbose) {
+            fprintf(stderr, "info: %s created\n", path.c_str());
+         }
+      }
+   }
+
+   delete snapshot;
+}
+
+/**************************************************************************
+ *
+ * Event handling
+ *
+ **************************************************************************/
+
+static void
+Resume(Tracee *tracee, Thread *thread, int sig)
+{
+   if (tracee->Stopping) {
+      /* Kept stopped for now, but the signal must not be lost. */
+      if (sig) {
+         thread->PendingSignal = sig;
+      }
+      return;
+   }
+
+   if (ptrace(PTRACE_CONT, thread->Tid, NULL, (void *)(intptr_t)sig) != 0 &&
+       errno != ESRCH) {
+      fprintf(stderr, "warning: failed to resume thread %d (%s)\n",
+              thread->Tid, strerror(errno));
+   }
+   thread->State = THREAD_RUNNING;
+}
+
+static void AttachProcess(Tracee *tracee);
+static void StopAllThreads(Tracee *tracee);
+
+/*
+ * Let go of the threads stopped by StopAllThreads.
+ */
+static void
+ResumeAllThreads(Tracee *tracee)
+{
+   tracee->Stopping = false;
+   std::map<pid_t, Thread>::iterator it;
+   for (it = tracee->process->Threads.begin(); it != tracee->process->Threads.end(); ++it) {
+      Thread &thread = it->second;
+      if (thread.State != THREAD_RUNNING) {
+         int sig = thread.PendingSignal;
+         thread.PendingSignal = 0;
+         Resume(tracee, &thread, sig);
+      }
+   }
+}
+
+/*
+ * Let go of the threads stopped by StopAllThreads for good, undoing
+ * AttachProcess.  The lazy event loop reaps no ptrace stops, so a process
+ * left running must not be left traced either.  The threads, and their
+ * registers, are kept until forgotten by the caller.
+ */
+static void
+DetachAllThreads(Tracee *tracee)
+{
+   tracee->Stopping = false;
+   std::map<pid_t, Thread>::iterator it;
+   for (it = tracee->process->Threads.begin(); it != tracee->process->Threads.end(); ++it) {
+      Thread &thread = it->second;
+      if (thread.State != THREAD_RUNNING) {
+         if (ptrace(PTRACE_DETACH, thread.Tid, NULL, (void *)(intptr_t)thread.PendingSignal) != 0 &&
+             errno != ESRCH) {
+            fprintf(stderr, "warning: failed to detach from thread %d (%s)\n",
+                    thread.Tid, strerror(errno));
+         }
+         thread.PendingSignal = 0;
+         thread.State = THREAD_RUNNING;
+      }
+   }
+   g_Attached = false;
+}
+
+/*
+ * Stop, dump and kill a process.  Only the root process takes the
+ * supervisor down with it.  With --keep-running, processes which did not
+ * crash are dumped once and left running.
+ */
+static void
+DumpProcess(Tracee *tracee, const char *Reason, pid_t CurrentTid,
+            const siginfo_t *SigInfo, uint64_t SignalContext = 0)
+{
+   bool live = g_KeepRunning && !SigInfo;
+   bool root = tracee->process->Pid == g_Pid && !live;
+
+   if (tracee->job && tracee->job->Failure.empty()) {
+      tracee->job->Failure = Reason;
+   }
+
+   if (root) {
+      g_TimerIgnore = true;
+   }
+   if (live) {
+      tracee->LiveDumped = true;
+   } else {
+      tracee->Dumped = true;
+   }
+
+   AttachProcess(tracee);
+   StopAllThreads(tracee);
+   DumpStack(tracee, Reason, CurrentTid, SigInfo, SignalContext, live);
+
+   if (root) {
+      Abort();
+   }
+
+   if (live && g_Lazy) {
+      /* Back to lazy supervision, until a crash attaches again. */
+      DetachAllThreads(tracee);
+      std::map<pid_t, Thread>::iterator it;
+      for (it = tracee->process->Threads.begin(); it != tracee->process->Threads.end(); ++it) {
+         g_Owners.erase(it->first);
+         g_PcSamples.erase(it->first);
+      }
+      tracee->process->Threads.clear();
+      return;
+   }
+
+   /* Let go of the threads, parked in exit stops or about to be killed. */
+   ResumeAllThreads(tracee);
+}
+
+static void
+OnExitProcess(Tracee *tracee, const siginfo_t &info)
+{
+   int code = info.si_code == CLD_EXITED ? info.si_status : 128 + info.si_status;
+
+   Job *job = tracee->job;
+   if (job && job->Pid == tracee->process->Pid) {
+      job->Exit = info;
+      job->EndTime = ElapsedTime();
+      job->Done = true;
+      --g_RunningJobs;
+   }
+
+   if (tracee->process->Pid != g_Pid) {
+      if (g_Verbose) {
+         if (info.si_code == CLD_EXITED) {
+            fprintf(stderr, "info: process %d exited with code (0x%0x)\n",
+                    tracee->process->Pid, info.si_status);
+         } else {
+            fprintf(stderr, "info: process %d killed by signal %d\n",
+                    tracee->process->Pid, info.si_status);
+         }
+      }
+      return;
+   }
+
+   g_ExitCode = code;
+   if (g_Verbose) {
+      if (info.si_code == CLD_EXITED) {
+         fprintf(stderr, "info: program exited with code (0x%0x)\n", info.si_status);
+      } else {
+         fprintf(stderr, "info: program killed by signal %d\n", info.si_status);
+      }
+   }
+}
+
+/*
+ * A thread is about to exit.  If the whole process is being killed by a
+ * fatal signal, this is the last chance to look at it.
+ */
+static void
+OnExit(Tracee *tracee, Thread *thread)
+{
+   unsigned long status = 0;
+
+   thread->State = THREAD_EXITING;
+
+   ptrace(PTRACE_GETEVENTMSG, thread->Tid, NULL, &status);
+   if (tracee->Stopping || tracee->Dumped ||
+       !WIFSIGNALED(status) || !IsFatalSignal(WTERMSIG(status))) {
+      Resume(tracee, thread, 0);
+      return;
+   }
+
+   int sig = WTERMSIG(status);
+
+   StopAllThreads(tracee);
+
+   /* Find the thread which received the signal. */
+   const Thread *faulting = thread;
+   std::map<pid_t, Thread>::iterator it;
+   for (it = tracee->process->Threads.begin(); it != tracee->process->Threads.end(); ++it) {
+      if (it->second.HaveSigInfo && it->second.SigInfo.si_signo == sig) {
+         faulting = &it->second;
+         break;
+      }
+   }
+
+   siginfo_t info = faulting->SigInfo;
+   if (!faulting->HaveSigInfo) {
+      memset(&info, 0, sizeof info);
+      info.si_signo = sig;
+   }
+
+   if (g_Verbose) {
+      fprintf(stderr, "info: uncaught signal - %s (%d) in thread %d\n",
+              strsignal(sig), sig, faulting->Tid);
+   } else {
+      fprintf(stderr, "uncaught signal - %s (%d)%s\n",
+              strsignal(sig), sig, ProcessSuffix(tracee));
+   }
+
+   DumpProcess(tracee, strsignal(sig), faulting->Tid, &info);
+}
+
+/*
+ * Handle a single wait notification.
+ */
+static void
+HandleEvent(const siginfo_t &info)
+{
+   pid_t tid = info.si_pid;
+   Thread *thread;
+
+   bool stopped = info.si_code == CLD_TRAPPED || info.si_code == CLD_STOPPED;
+   Tracee *tracee = FindOwner(tid, stopped);
+   if (!tracee) {
+      return;
+   }
+
+   switch (info.si_code) {
+   case CLD_EXITED:
+   case CLD_KILLED:
+   case CLD_DUMPED:
+      if (tid == tracee->process->Pid) {
+         OnExitProcess(tracee, info);
+      }
+      RemoveThread(tracee, tid);
+      return;
+
+   case CLD_TRAPPED:
+   case CLD_STOPPED:
+      break;
+
+   default:
+      return;
+   }
+
+   /* New threads may report before the clone event of their creator. */
+   thread = AddThread(tracee, tid);
+   thread->State = THREAD_STOPPED;
+
+   int sig = info.si_status & 0xff;
+   int event = (info.si_status >> 8) & 0xff;
+
+   switch (event) {
+   case PTRACE_EVENT_CLONE: {
+      unsigned long newTid = 0;
+      if (ptrace(PTRACE_GETEVENTMSG, tid, NULL, &newTid) == 0) {
+         AddThread(tracee, (pid_t)newTid);
+      }
+      Resume(tracee, thread, 0);
+      break;
+   }
+
+   case PTRACE_EVENT_FORK:
+   case PTRACE_EVENT_VFORK: {
+      unsigned long newPid = 0;
+      if (ptrace(PTRACE_GETEVENTMSG, tid, NULL, &newPid) == 0) {
+         AddThread(AddTracee((pid_t)newPid, tracee), (pid_t)newPid);
+      }
+      Resume(tracee, thread, 0);
+      break;
+   }
+
+   case PTRACE_EVENT_EXEC: {
+      FlushProfile(tracee);
+      tracee->ModulesStale = true;
+
+      /* The other threads are gone, and the execing one took the leader's id. */
+      unsigned long formerTid = 0;
+      ptrace(PTRACE_GETEVENTMSG, tid, NULL, &formerTid);
+      if ((pid_t)formerTid != tid) {
+         RemoveThread(tracee, (pid_t)formerTid);
+      }
+      Resume(tracee, thread, 0);
+      break;
+   }
+
+   case PTRACE_EVENT_EXIT:
+      OnExit(tracee, thread);
+      break;
+
+   case PTRACE_EVENT_STOP:
+      if (sig == SIGSTOP || sig == SIGTSTP || sig == SIGTTIN || sig == SIGTTOU) {
+         /* Group-stop: keep it stopped without blocking ptrace requests. */
+         if (!tracee->Stopping) {
+            ptrace(PTRACE_LISTEN, tid, NULL, NULL);
+            thread->State = THREAD_RUNNING;
+         }
+      } else {
+         /* New thread or PTRACE_INTERRUPT, possibly for a PC sample. */
+         if (g_PcSamples.erase(tid) && tracee->watchdog) {
+            struct user_regs_struct regs;
+            if (ptrace(PTRACE_GETREGS, tid, NULL, &regs) == 0) {
+               tracee->watchdog->AddPc(tid, regs.rip, regs.rsp);
+            }
+         }
+         Resume(tracee, thread, 0);
+      }
+      break;
+
+   case 0:
+      /* Signal-delivery-stop. */
+      if (IsFatalSignal(sig)) {
+         thread->HaveSigInfo =
+            ptrace(PTRACE_GETSIGINFO, tid, NULL, &thread->SigInfo) == 0;
+      }
+      Resume(tracee, thread, sig);
+      break;
+
+   default:
+      Resume(tracee, thread, 0);
+      break;
+   }
+}
+
+/*
+ * Wait for the next notification.  With WNOHANG, si_pid is zero when there
+ * is none.
+ */
+static bool
+WaitForEvent(siginfo_t *info, int Flags = 0)
+{
+   memset(info, 0, sizeof *info);
+   if (waitid(P_ALL, 0, info, WEXITED | WSTOPPED | __WALL | Flags) != 0) {
+      if (errno == EINTR) {
+         return false;
+      }
+      if (errno == ECHILD) {
+         /* Nothing left to trace. */
+         std::map<pid_t, Tracee *>::iterator it;
+         for (it = g_Tracees.begin(); it != g_Tracees.end(); ++it) {
+            it->second->process->Threads.clear();
+            g_Exited.push_back(it->second);
+         }
+         g_Tracees.clear();
+         g_Owners.clear();
+         return false;
+      }
+      fprintf(stderr, "error: unexpected error (%s)\n", strerror(errno));
+      Abort();
+   }
+   return true;
+}
+
+/*
+ * Attach to all threads of a child which was started untraced.
+ */
+static void
+AttachProcess(Tracee *tracee)
+{
+   char path[64];
+   bool found;
+
+   if (g_Attached) {
+      return;
+   }
+   g_Attached = true;
+
+   snprintf(path, sizeof path, "/proc/%d/task", tracee->process->Pid);
+
+   /* Threads may be created while we attach, so repeat until stable. */
+   do {
+      DIR *dir = opendir(path);
+      struct dirent *entry;
+
+      if (!dir) {
+         fprintf(stderr, "error: failed to open %s (%s)\n", path, strerror(errno));
+         Abort();
+      }
+
+      found = false;
+      while ((entry = readdir(dir)) != NULL) {
+         pid_t tid = atoi(entry->d_name);
+         if (tid <= 0 || tracee->process->FindThread(tid)) {
+            continue;
+         }
+
+         if (ptrace(PTRACE_SEIZE, tid, NULL, (void *)TraceOptions()) != 0) {
+            if (errno != ESRCH) {
+               fprintf(stderr, "warning: failed to attach to thread %d (%s)\n",
+                       tid, strerror(errno));
+            }
+            continue;
+         }
+
+         AddThread(tracee, tid);
+         found = true;
+      }
+      closedir(dir);
+   } while (found);
+}
+
+/*
+ * Bring every thread of a process to a ptrace-stop, so that registers can
+ * be read.  Other processes carry on.
+ */
+static void
+StopAllThreads(Tracee *tracee)
+{
+   std::map<pid_t, Thread> &threads = tracee->process->Threads;
+   std::map<pid_t, Thread>::iterator it;
+
+   tracee->Stopping = true;
+
+   for (it = threads.begin(); it != threads.end(); ) {
+      Thread &thread = it->second;
+      ++it;
+      if (thread.State == THREAD_RUNNING &&
+          ptrace(PTRACE_INTERRUPT, thread.Tid, NULL, NULL) != 0 &&
+          errno == ESRCH) {
+         /* Already gone, e.g., a leader which called pthread_exit. */
+         RemoveThread(tracee, thread.Tid);
+      }
+   }
+
+   for (;;) {
+      bool running = false;
+      for (it = threads.begin(); it != threads.end(); ++it) {
+         if (it->second.State == THREAD_RUNNING) {
+            running = true;
+            break;
+         }
+      }
+      if (!running) {
+         break;
+      }
+
+      siginfo_t info;
+      if (WaitForEvent(&info)) {
+         HandleEvent(info);
+      }
+   }
+}
+
+/**************************************************************************
+ *
+ * Time out
+ *
+ **************************************************************************/
+
+/*
+ * Arm the timer for the earliest of the next sample and the first
+ * deadline.
+ */
+static void
+ArmTimer(void)
+{
+   struct itimerspec spec;
+   unsigned long next = g_NextSample;
+
+   if (g_TimerFd < 0) {
+      return;
+   }
+
+   if (g_NextProfile && (!next || g_NextProfile < next)) {
+      next = g_NextProfile;
+   }
+
+   if (!g_Deadlines.empty() && (!next || g_Deadlines.top().Time < next)) {
+      next = g_Deadlines.top().Time;
+   }
+
+   /* A zero time disarms the timer. */
+   memset(&spec, 0, sizeof spec);
+   if (next) {
+      spec.it_value.tv_sec = g_StartTime.tv_sec + next / 1000;
+      spec.it_value.tv_nsec = g_StartTime.tv_nsec + (next % 1000) * 1000000;
+      if (spec.it_value.tv_nsec >= 1000000000) {
+         spec.it_value.tv_sec += 1;
+         spec.it_value.tv_nsec -= 1000000000;
+      }
+   }
+   timerfd_settime(g_TimerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/*
+ * Interrupt the threads the watchdog wants a PC of; HandleEvent passes
+ * their registers on.
+ */
+static void
+SamplePcs(Tracee *tracee)
+{
+   std::vector<pid_t> tids;
+
+   tracee->watchdog->BusyThreads(tids);
+   for (size_t i = 0; i < tids.size(); ++i) {
+      Thread *thread = tracee->process->FindThread(tids[i]);
+      if (thread && thread->State == THREAD_RUNNING &&
+          !g_PcSamples.count(tids[i]) &&
+          ptrace(PTRACE_INTERRUPT, tids[i], NULL, NULL) == 0) {
+         g_PcSamples.insert(tids[i]);
+      }
+   }
+}
+
+/*
+ * Take a profile sample of every thread.  The threads are only kept
+ * stopped while their stacks are unwound; symbols are looked up when the
+ * profile is folded.
+ */
+static void
+ProfileProcess(Tracee *tracee)
+{
+   Process *process = tracee->process;
+
+   /* /proc/<pid>/maps can be read while the process runs. */
+   if (tracee->ModulesStale) {
+      process->LoadModules(g_DebugDirs);
+      tracee->ModulesStale = false;
+   }
+
+   StopAllThreads(tracee);
+   if (process->Threads.empty()) {
+      tracee->Stopping = false;
+      return;
+   }
+   process->GetThreadRegisters();
+   /* The pool is long lived, so as not to start threads at the sampling rate. */
+   Snapshot *snapshot = Snapshot::Capture(process, 0, NULL, UnwindPool());
+   ResumeAllThreads(tracee);
+
+   for (size_t i = 0; i < snapshot->Threads.size(); ++i) {
+      const SnapshotThread &thread = snapshot->Threads[i];
+      tracee->profile->Add(thread.Name, thread.Frames);
+
+      /* Something was mapped since, e.g., with dlopen. */
+      if (!thread.Frames.empty() && !process->FindModule(thread.Frames[0].Pc)) {
+         tracee->ModulesStale = true;
+      }
+   }
+
+   delete snapshot;
+}
+
+static void
+OnHang(Tracee *tracee, WatchdogVerdict Verdict)
+{
+   pid_t tid = tracee->process->Pid;
+
+   if (Verdict == WATCHDOG_SPINNING) {
+      tid = tracee->watchdog->SpinningTid;
+      fprintf(stderr, "hang detected - thread %d spinning for %lu ms%s\n",
+              tid, g_HangWindow, ProcessSuffix(tracee));
+   } else {
+      fprintf(stderr, "hang detected - no progress for %lu ms%s\n",
+              g_HangWindow * WATCHDOG_IDLE_WINDOWS, ProcessSuffix(tracee));
+   }
+
+   DumpProcess(tracee, "hang", tid, NULL);
+}
+
+/*
+ * Resident set size of a process, in bytes, or zero if unknown.
+ */
+static uint64_t
+ResidentSize(Tracee *tracee)
+{
+   char buffer[128];
+   unsigned long long size, resident;
+
+   if (tracee->StatmFd < 0) {
+      char path[64];
+      snprintf(path, sizeof path, "/proc/%d/statm", tracee->process->Pid);
+      tracee->StatmFd = open(path, O_RDONLY | O_CLOEXEC);
+      if (tracee->StatmFd < 0) {
+         return 0;
+      }
+   }
+
+   ssize_t ret = pread(tracee->StatmFd, buffer, sizeof buffer - 1, 0);
+   if (ret <= 0) {
+      return 0;
+   }
+   buffer[ret] = 0;
+   if (sscanf(buffer, "%llu %llu", &size, &resident) != 2) {
+      return 0;
+   }
+
+   static const long pageSize = sysconf(_SC_PAGESIZE);
+   return resident * pageSize;
+}
+
+/*
+ * The thread which faulted in the most pages, i.e., most likely the one
+ * allocating.
+ */
+static pid_t
+AllocatingThread(pid_t Pid)
+{
+   char path[64];
+   pid_t best = Pid;
+   unsigned long long bestFaults = 0;
+
+   snprintf(path, sizeof path, "/proc/%d/task", Pid);
+   DIR *dir = opendir(path);
+   if (!dir) {
+      return best;
+   }
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      pid_t tid = atoi(entry->d_name);
+      if (tid <= 0) {
+         continue;
+      }
+
+      char buffer[1024];
+      snprintf(path, sizeof path, "/proc/%d/task/%d/stat", Pid, tid);
+      FILE *fp = fopen(path, "r");
+      if (!fp) {
+         continue;
+      }
+      size_t size = fread(buffer, 1, sizeof buffer - 1, fp);
+      fclose(fp);
+      buffer[size] = 0;
+
+      /* The command name may contain anything, even parentheses. */
+      char *fields = strrchr(buffer, ')');
+      unsigned long long faults;
+      if (fields &&
+          sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %llu", &faults) == 1 &&
+          faults > bestFaults) {
+         best = tid;
+         bestFaults = faults;
+      }
+   }
+   closedir(dir);
+
+   return best;
+}
+
+static void
+OnMemoryLimit(Tracee *tracee, const char *Reason)
+{
+   fprintf(stderr, "memory limit exceeded - %s%s\n", Reason, ProcessSuffix(tracee));
+
+   DumpProcess(tracee, "memory limit", AllocatingThread(tracee->process->Pid), NULL);
+}
+
+static void
+CheckMemory(Tracee *tracee, unsigned long Now)
+{
+   char reason[128];
+   uint64_t rss = ResidentSize(tracee);
+
+   if (g_RssLimit && rss >= (uint64_t)g_RssLimit << 20) {
+      snprintf(reason, sizeof reason, "%llu MiB resident",
+               (unsigned long long)(rss >> 20));
+      OnMemoryLimit(tracee, reason);
+      return;
+   }
+
+   if (!g_GrowthLimit) {
+      return;
+   }
+
+   /* Growth is measured over the last MEMORY_RATE_WINDOW ms. */
+   std::deque<MemorySample> &history = tracee->RssHistory;
+   MemorySample sample;
+   sample.Time = Now;
+   sample.Rss = rss;
+   history.push_back(sample);
+   while (history.size() > 2 &&
+          Now - history[1].Time >= MEMORY_RATE_WINDOW) {
+      history.pop_front();
+   }
+
+   const MemorySample &oldest = history.front();
+   if (Now - oldest.Time < MEMORY_RATE_WINDOW || rss <= oldest.Rss) {
+      return;
+   }
+
+   uint64_t rate = (rss - oldest.Rss) * 1000 / (Now - oldest.Time);
+   if (rate >= (uint64_t)g_GrowthLimit << 20) {
+      snprintf(reason, sizeof reason, "growing by %llu MiB/s (%llu MiB resident)",
+               (unsigned long long)(rate >> 20), (unsigned long long)(rss >> 20));
+      OnMemoryLimit(tracee, reason);
+   }
+}
+
+static void
+OnTimeOut(Tracee *tracee)
+{
+   fprintf(stderr, "time out (%lu sec) exceeded%s\n", tracee->TimeOut, ProcessSuffix(tracee));
+
+   DumpProcess(tracee, "time out", tracee->process->Pid, NULL);
+}
+
+static void
+TimeOutCallback(void)
+{
+   unsigned long now = ElapsedTime();
+
+   while (!g_Deadlines.empty() && g_Deadlines.top().Time <= now) {
+      Deadline deadline = g_Deadlines.top();
+      g_Deadlines.pop();
+
+      /* The process may be gone, and its pid reused. */
+      Tracee *tracee = FindTracee(deadline.Pid);
+      if (tracee && !tracee->Dumped && !tracee->LiveDumped && !g_TimerIgnore &&
+          tracee->StartTime + tracee->TimeOut*1000 == deadline.Time) {
+         OnTimeOut(tracee);
+      }
+   }
+
+   if (g_NextSample && now >= g_NextSample) {
+      /* Dumps retire processes, so iterate over a copy. */
+      std::vector<pid_t> pids;
+      std::map<pid_t, Tracee *>::iterator it;
+      for (it = g_Tracees.begin(); it != g_Tracees.end(); ++it) {
+         pids.push_back(it->first);
+      }
+
+      for (size_t i = 0; i < pids.size(); ++i) {
+         Tracee *tracee = FindTracee(pids[i]);
+         if (!tracee || tracee->Dumped || tracee->LiveDumped || g_TimerIgnore) {
+            continue;
+         }
+
+         if (g_RssLimit || g_GrowthLimit) {
+            CheckMemory(tracee, now);
+            if (tracee->Dumped || tracee->LiveDumped) {
+               continue;
+            }
+         }
+
+         if (tracee->watchdog) {
+            WatchdogVerdict verdict = tracee->watchdog->Sample();
+            if (verdict != WATCHDOG_PROGRESS) {
+               OnHang(tracee, verdict);
+            } else if (g_Attached) {
+               SamplePcs(tracee);
+            }
+         }
+      }
+
+      g_NextSample = now + g_Period;
+   }
+
+   if (g_NextProfile && now >= g_NextProfile) {
+      std::vector<pid_t> pids;
+      std::map<pid_t, Tracee *>::iterator it;
+      for (it = g_Tracees.begin(); it != g_Tracees.end(); ++it) {
+         pids.push_back(it->first);
+      }
+
+      for (size_t i = 0; i < pids.size(); ++i) {
+         Tracee *tracee = FindTracee(pids[i]);
+         if (tracee && tracee->profile && !tracee->Dumped && !g_TimerIgnore) {
+            ProfileProcess(tracee);
+         }
+      }
+
+      /* Skip the samples missed, rather than catching up. */
+      g_NextProfile += g_ProfilePeriod;
+      if (g_NextProfile <= now) {
+         g_NextProfile = now + g_ProfilePeriod;
+      }
+   }
+
+   ArmTimer();
+}
+
+/**************************************************************************
+ *
+ * Process creation
+ *
+ **************************************************************************/
+
+/*
+ * Find the agent library, next to our own executable.
+ */
+static std::string
+AgentPath(void)
+{
+   char exe[4096];
+   ssize_t len = readlink("/proc/self/exe", exe, sizeof exe - 1);
+   if (len <= 0) {
+      return std::string();
+   }
+   exe[len] = 0;
+
+   std::string path(exe);
+   path = path.substr(0, path.rfind('/') + 1) + AGENT_LIBRARY;
+   if (access(path.c_str(), R_OK) != 0) {
+      return std::string();
+   }
+   return path;
+}
+
+/*
+ * Fork and execute the command line.  Unless in lazy mode, attach to the
+ * child before it runs any code of its own.
+ */
+static pid_t
+CreateProcess(char **argv, Capture *capture = NULL)
+{
+   int syncPipe[2];
+   int errorPipe[2];
+   int agentSocket[2] = {-1, -1};
+   std::string agentPath;
+   pid_t pid;
+   char c = 0;
+
+   if (pipe2(syncPipe, O_CLOEXEC) != 0 || pipe2(errorPipe, O_CLOEXEC) != 0) {
+      fprintf(stderr, "error: failed to create a pipe (%s)\n", strerror(errno));
+      return -1;
+   }
+
+   if (g_Lazy) {
+      agentPath = AgentPath();
+      if (agentPath.empty()) {
+         fprintf(stderr, "warning: %s not found, fatal signals will not be caught\n",
+                 AGENT_LIBRARY);
+      } else if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, agentSocket) != 0) {
+         fprintf(stderr, "error: failed to create a socket (%s)\n", strerror(errno));
+         return -1;
+      }
+   }
+
+   pid = fork();
+   if (pid < 0) {
+      fprintf(stderr, "error: failed to fork (%s)\n", strerror(errno));
+      return -1;
+   }
+
+   if (pid == 0) {
+      close(syncPipe[1]);
+      close(errorPipe[0]);
+
+      /* Jobs are started after SIGCHLD was blocked for the signalfd. */
+      sigset_t mask;
+      sigemptyset(&mask);
+      sigaddset(&mask, SIGCHLD);
+      sigaddset(&mask, SIGPIPE);
+      sigprocmask(SIG_UNBLOCK, &mask, NULL);
+
+      if (capture) {
+         dup2(capture->WriteFds[0], STDOUT_FILENO);
+         dup2(capture->WriteFds[1], STDERR_FILENO);
+      }
+
+      /* Wait for the tracer to attach. */
+      while (read(syncPipe[0], &c, 1) < 0 && errno == EINTR)
+         ;
+
+      if (agentSocket[1] >= 0) {
+         char fd[16];
+         std::string preload = agentPath;
+         const char *old = getenv("LD_PRELOAD");
+
+         if (old && *old) {
+            preload += ":";
+            preload += old;
+         }
+         snprintf(fd, sizeof fd, "%d", agentSocket[1]);
+
+         fcntl(agentSocket[1], F_SETFD, 0);
+         setenv(AGENT_FD_ENV, fd, 1);
+         setenv("LD_PRELOAD", preload.c_str(), 1);
+      }
+
+      execvp(argv[0], argv);
+
+      int error = errno;
+      if (write(errorPipe[1], &error, sizeof error) < 0) {
+         /* nothing we can do */
+      }
+      _exit(127);
+   }
+
+   close(syncPipe[0]);
+   close(errorPipe[1]);
+
+   if (capture) {
+      /* Only the program may hold the write ends, so that EOF comes. */
+      for (unsigned i = 0; i < 2; ++i) {
+         close(capture->WriteFds[i]);
+         capture->WriteFds[i] = -1;
+      }
+   }
+
+   if (agentSocket[1] >= 0) {
+      close(agentSocket[1]);
+      g_AgentFd = agentSocket[0];
+   }
+
+   if (!g_Lazy &&
+       ptrace(PTRACE_SEIZE, pid, NULL, (void *)TraceOptions()) != 0) {
+      fprintf(stderr, "error: failed to attach to the process (%s)\n", strerror(errno));
+      kill(pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      return -1;
+   }
+
+   if (write(syncPipe[1], &c, 1) != 1) {
+      fprintf(stderr, "error: failed to start the process (%s)\n", strerror(errno));
+      return -1;
+   }
+   close(syncPipe[1]);
+
+   /* The error pipe is closed on a successful exec. */
+   int error = 0;
+   ssize_t ret;
+   do {
+      ret = read(errorPipe[0], &error, sizeof error);
+   } while (ret < 0 && errno == EINTR);
+   close(errorPipe[0]);
+
+   if (ret == (ssize_t)sizeof error) {
+      fprintf(stderr, "error: failed to create the process (%s)\n", strerror(error));
+      /* Reap it, as other processes may still be supervised. */
+      int status;
+      while (waitpid(pid, &status, __WALL) == pid && WIFSTOPPED(status)) {
+         ptrace(PTRACE_CONT, pid, NULL, NULL);
+      }
+      return -1;
+   }
+
+   return pid;
+}
+
+/**************************************************************************
+ *
+ * Lazy attach
+ *
+ **************************************************************************/
+
+/*
+ * A thread of the untraced child is parked in the agent's signal handler.
+ */
+static void
+OnAgentMessage(void)
+{
+   struct AgentMessage message;
+   ssize_t ret;
+
+   ret = recv(g_AgentFd, &message, sizeof message, 0);
+   if (ret != (ssize_t)sizeof message) {
+      return;
+   }
+
+   Tracee *tracee = FindTracee(g_Pid);
+   if (!tracee) {
+      return;
+   }
+
+   /* Forked children keep the agent, but must not get the root dumped. */
+   char path[64];
+   struct stat st;
+   snprintf(path, sizeof path, "/proc/%d/task/%d", g_Pid, message.Tid);
+   if (stat(path, &st) != 0) {
+      if (g_Verbose) {
+         fprintf(stderr, "info: ignoring agent message from thread %d\n", message.Tid);
+      }
+      return;
+   }
+
+   int sig = message.SigInfo.si_signo;
+
+   if (g_Verbose) {
+      fprintf(stderr, "info: uncaught signal - %s (%d) in thread %d\n",
+              strsignal(sig), sig, message.Tid);
+   } else {
+      fprintf(stderr, "uncaught signal - %s (%d)\n", strsignal(sig), sig);
+   }
+
+   DumpProcess(tracee, strsignal(sig), message.Tid, &message.SigInfo, message.Context);
+}
+
+/**************************************************************************
+ *
+ * Jobs
+ *
+ **************************************************************************/
+
+static std::string
+JobCommand(const Job &job)
+{
+   std::string command;
+   for (size_t i = 0; i < job.Spec.Args.size(); ++i) {
+      if (i) {
+         command += ' ';
+      }
+      command += job.Spec.Args[i];
+   }
+   return command;
+}
+
+/*
+ * Start jobs in manifest order while there are free slots, so that no
+ * job waits behind one listed after it.
+ */
+static void
+StartJobs(void)
+{
+   while (g_RunningJobs < g_MaxJobs && g_NextJob < g_Jobs.size()) {
+      Job &job = g_Jobs[g_NextJob++];
+
+      std::vector<char *> argv;
+      for (size_t i = 0; i < job.Spec.Args.size(); ++i) {
+         argv.push_back(const_cast<char *>(job.Spec.Args[i].c_str()));
+      }
+      argv.push_back(NULL);
+
+      job.StartTime = ElapsedTime();
+
+      Capture *capture = g_TailSize ? NewCapture() : NULL;
+
+      pid_t pid = CreateProcess(&argv[0], capture);
+      if (pid < 0) {
+         job.EndTime = job.StartTime;
+         job.Done = true;
+         job.Failure = "not started";
+         continue;
+      }
+
+      job.Pid = pid;
+      ++g_RunningJobs;
+
+      if (capture) {
+         WatchCapture(capture);
+      }
+
+      if (g_Verbose) {
+         fprintf(stderr, "info: started job %u (process %d): %s\n",
+                 job.Number, pid, JobCommand(job).c_str());
+      }
+
+      Tracee *tracee = AddTracee(pid);
+      tracee->job = &job;
+      tracee->capture = capture;
+      if (!job.Spec.DumpPath.empty()) {
+         tracee->DumpPath = job.Spec.DumpPath.c_str();
+      }
+      if (job.Spec.FullDump) {
+         tracee->Format = DUMP_FULL;
+      } else if (job.Spec.ReachableDump) {
+         tracee->Format = DUMP_REACHABLE;
+      }
+      if (job.Spec.HaveTimeOut && job.Spec.TimeOut != tracee->TimeOut) {
+         tracee->TimeOut = job.Spec.TimeOut;
+         ScheduleTimeOut(tracee);
+      }
+      AddThread(tracee, pid);
+   }
+}
+
+/*
+ * Summarize all jobs, followed by the stacks of the failed ones.  Returns
+ * the exit code of stackdump.
+ */
+static int
+PrintReport(void)
+{
+   unsigned failed = 0;
+
+   fprintf(stderr, "\n%4s  %-24s %9s  %s\n", "job", "status", "time", "command");
+
+   for (size_t i = 0; i < g_Jobs.size(); ++i) {
+      const Job &job = g_Jobs[i];
+      char status[64];
+
+      if (!job.Failure.empty()) {
+         snprintf(status, sizeof status, "%s", job.Failure.c_str());
+      } else if (!job.Done) {
+         snprintf(status, sizeof status, "lost");
+      } else if (job.Exit.si_code == CLD_EXITED && job.Exit.si_status == 0) {
+         snprintf(status, sizeof status, "ok");
+      } else if (job.Exit.si_code == CLD_EXITED) {
+         snprintf(status, sizeof status, "exit %d", job.Exit.si_status);
+      } else {
+         snprintf(status, sizeof status, "%s", strsignal(job.Exit.si_status));
+      }
+
+      bool ok = job.Done && job.Failure.empty() &&
+                job.Exit.si_code == CLD_EXITED && job.Exit.si_status == 0;
+      if (!ok) {
+         ++failed;
+      }
+
+      fprintf(stderr, "%4u  %-24s %8.2fs  %s\n",
+              job.Number, status, (job.EndTime - job.StartTime) / 1000.0,
+              JobCommand(job).c_str());
+   }
+
+   fprintf(stderr, "\n%u jobs, %u passed, %u failed\n",
+           (unsigned)g_Jobs.size(), (unsigned)g_Jobs.size() - failed, failed);
+
+   for (size_t i = 0; i < g_Jobs.size(); ++i) {
+      const Job &job = g_Jobs[i];
+      if (!job.Stacks.empty()) {
+         fprintf(stderr, "\njob %u (%s):\n%s", job.Number, job.Failure.c_str(),
+                 job.Stacks.c_str());
+      }
+   }
+
+   return failed ? 1 : 0;
+}
+
+/**************************************************************************
+ *
+ * Event loop
+ *
+ **************************************************************************/
+
+/*
+ * Handle all pending ptrace notifications.
+ */
+static void
+DrainEvents(void)
+{
+   siginfo_t info;
+
+   while (!g_Tracees.empty() &&
+          WaitForEvent(&info, WNOHANG) && info.si_pid) {
+      HandleEvent(info);
+   }
+}
+
+/*
+ * Wait on the children until they all exit.  Traced children report
+ * through SIGCHLD, read from a signalfd, however many there are; an
+ * untraced one through a pidfd and the agent socket.  A single timerfd
+ * serves the time outs of all processes, the watchdog and the memory
+ * limits.
+ */
+static void
+EventLoop(void)
+{
+   struct epoll_event event;
+   int pidFd = -1, signalFd = -1, epollFd;
+
+   epollFd = epoll_create1(EPOLL_CLOEXEC);
+   if (epollFd < 0) {
+      fprintf(stderr, "error: failed to create an epoll instance (%s)\n", strerror(errno));
+      Abort();
+   }
+
+   memset(&event, 0, sizeof event);
+   event.events = EPOLLIN;
+
+   if (g_Lazy) {
+      pidFd = (int)syscall(SYS_pidfd_open, g_Pid, 0);
+      if (pidFd < 0) {
+         fprintf(stderr, "error: failed to open a pidfd (%s)\n", strerror(errno));
+         Abort();
+      }
+      event.data.fd = pidFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, pidFd, &event);
+
+      if (g_AgentFd >= 0) {
+         event.data.fd = g_AgentFd;
+         epoll_ctl(epollFd, EPOLL_CTL_ADD, g_AgentFd, &event);
+      }
+   } else {
+      sigset_t mask;
+      sigemptyset(&mask);
+      sigaddset(&mask, SIGCHLD);
+      sigprocmask(SIG_BLOCK, &mask, NULL);
+
+      signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+      if (signalFd < 0) {
+         fprintf(stderr, "error: failed to create a signalfd (%s)\n", strerror(errno));
+         Abort();
+      }
+      event.data.fd = signalFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event);
+   }
+
+   if (g_TimeOut || g_NextSample || g_NextProfile || !g_Jobs.empty()) {
+      g_TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+      if (g_TimerFd < 0) {
+         fprintf(stderr, "error: failed to create a timer (%s)\n", strerror(errno));
+         Abort();
+      }
+      event.data.fd = g_TimerFd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, g_TimerFd, &event);
+      ArmTimer();
+   }
+
+   g_EpollFd = epollFd;
+   for (size_t i = 0; i < g_Captures.size(); ++i) {
+      WatchCapture(g_Captures[i]);
+   }
+
+   /* Notifications may predate the signalfd. */
+   if (!g_Lazy) {
+      DrainEvents();
+   }
+
+   for (;;) {
+      /* Nothing refers to exited processes between events. */
+      for (size_t i = 0; i < g_Exited.size(); ++i) {
+         DeleteTracee(g_Exited[i]);
+      }
+      g_Exited.clear();
+
+      if (!g_Jobs.empty()) {
+         StartJobs();
+      }
+      if (g_Tracees.empty()) {
+         break;
+      }
+
+      int count = epoll_wait(epollFd, &event, 1, -1);
+      if (count < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         fprintf(stderr, "error: unexpected error (%s)\n", strerror(errno));
+         Abort();
+      }
+      if (count == 0) {
+         continue;
+      }
+
+      if (event.data.fd == signalFd) {
+         struct signalfd_siginfo si;
+         while (read(signalFd, &si, sizeof si) == sizeof si)
+            ;
+         DrainEvents();
+      } else if (event.data.fd == g_AgentFd) {
+         if (event.events & (EPOLLHUP | EPOLLERR)) {
+            /* The program exec'ed something else or closed the socket. */
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, g_AgentFd, NULL);
+         } else {
+            OnAgentMessage();
+         }
+      } else if (event.data.fd == g_TimerFd) {
+         uint64_t expirations = 0;
+         if (read(g_TimerFd, &expirations, sizeof expirations) == sizeof expirations) {
+            TimeOutCallback();
+         }
+      } else if (g_CaptureFds.count(event.data.fd)) {
+         Capture *capture = g_CaptureFds[event.data.fd];
+         ForwardOutput(capture, event.data.fd == capture->Fds[0] ? 0 : 1);
+      } else if (event.data.fd == pidFd) {
+         siginfo_t info;
+         memset(&info, 0, sizeof info);
+         Tracee *tracee = FindTracee(g_Pid);
+         if (waitid(P_PID, g_Pid, &info, WEXITED) == 0 && tracee) {
+            OnExitProcess(tracee, info);
+         }
+         break;
+      }
+   }
+
+   if (signalFd >= 0) {
+      close(signalFd);
+   }
+   if (pidFd >= 0) {
+      close(pidFd);
+   }
+   close(epollFd);
+   g_EpollFd = -1;
+}
+
+/**************************************************************************
+ *
+ * Main function
+ *
+ **************************************************************************/
+
+static void
+Usage()
+{
+   fputs("usage: stackdump [options] <command-line>\n"
+         "       stackdump [options] [--jobs <count>] --manifest <file>\n"
+         "       stackdump render [options] <snapshot>\n"
+         "       stackdump triage [options] <directory>\n"
+         "       stackdump report [options] <report>\n"
+         "       stackdump inflate <dump> <output>\n"
+         "       stackdump store [-r] <store-dir> [dump...]\n"
+         "       stackdump rehydrate <store-dir> <name> <output>\n"
+         "       stackdump server [options] <socket> <spool-dir>\n"
+         "\n"
+         "options:\n"
+         "  -? displays command line help text\n"
+         "  -c <cache-dir> specifies the symbol cache directory, empty to disable\n"
+         "               (default ~/.cache/stackdump)\n"
+         "  --compress writes the dump file compressed, in blocks compressed on all cores\n"
+         "             (read by \"stackdump triage\", or expanded by \"stackdump inflate\")\n"
+         "  --dump-every <count> still dumps every that many recurrences of a known\n"
+         "                       --signatures crash (default only the first time)\n"
+         "  -f follows forked children, dumping any process which crashes or times out\n"
+         "  --jobs <count> runs that many manifest jobs at once (default one per CPU)\n"
+         "  --keep-running dumps programs which time out, hang or exceed a memory limit\n"
+         "                 once, from a copy-on-write snapshot, and leaves them running\n"
+         "  --manifest <file> runs the command lines listed in the file, - for stdin,\n"
+         "                    and reports on all of them\n"
+         "  -g <megabytes> dumps the program once its resident size grows faster than that\n"
+         "                 per second\n"
+         "  -l attaches lazily, only on time out or on a fatal signal, leaving signals the\n"
+         "     program handles (e.g., SIGSEGV for guard pages) at full speed\n"
+         "  -ma create a full dump file (default is a minidump)\n"
+         "  -mi create a minidump with the heap and data pages reachable by following\n"
+         "      pointers from the stacks and registers\n"
+         "  --dump-depth <levels> pointer levels followed for -mi (default 2)\n"
+         "  --dump-budget <megabytes> memory taken at most for -mi (default 64)\n"
+         "  -o <folded-file> names the --profile output (default stackdump.folded)\n"
+         "  --profile <hz> samples the stacks of all threads that many times per second,\n"
+         "                 writing them as folded stacks for flamegraph.pl on exit\n"
+         "  --report <report-file> writes a structured report of each dump, as JSON if\n"
+         "                        the name ends in .json, or else in binary for\n"
+         "                        \"stackdump report\" (%p is replaced by the process id)\n"
+         "  -r <megabytes> dumps the program once its resident size exceeds that\n"
+         "  --server <socket> hands dump files to a \"stackdump server\" to write, within\n"
+         "                    its limits, rather than writing them straight away\n"
+         "  -s <snapshot-file> saves the raw stacks for \"stackdump render\" instead of\n"
+         "                     printing them\n"
+         "  --signatures <file> counts crashes by signature in that file, shared by all\n"
+         "                      stackdump processes, and only prints the crashing\n"
+         "                      thread without a dump file for those seen before\n"
+         "  --store <store-dir> adds dump files to a \"stackdump store\" store, named after\n"
+         "                      the -z file, where what they have in common is kept once\n"
+         "  -v enables verbose output from the debugger\n"
+         "  -w <milliseconds> dumps the program once it makes no progress for that long,\n"
+         "                    i.e., spins in the same loop, or, for three times as\n"
+         "                    long, stays blocked in the same system calls\n"
+         "  -y <symbols-path> specifies the debug file search path\n"
+         "                    (default /usr/lib/debug)\n"
+         "  -z <crash-dump-file> specifies the name of a crash dump file to create\n"
+         "                       (%p is replaced by the process id)\n"
+         "  -t <seconds> specifies a timeout in seconds \n"
+         "  --tail <megabytes> passes the program's stdout and stderr through, keeping\n"
+         "                     that much of the last output for --report\n",
+         stderr);
+}
+
+int
+main(int argc, char** argv)
+{
+   const char *manifest = NULL;
+
+   if (argc > 1 && !strcmp(argv[1], "render")) {
+      return RenderMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "triage")) {
+      return TriageMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "store")) {
+      return StoreMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "rehydrate")) {
+      return RehydrateMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "inflate")) {
+      return InflateMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "server")) {
+      return ServerMain(argc - 1, argv + 1);
+   }
+   if (argc > 1 && !strcmp(argv[1], "report")) {
+      return ReportMain(argc - 1, argv + 1);
+   }
+
+   /*
+    * Parse command line arguments
+    */
+
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         Usage();
+         return 0;
+      } else if (!strcmp(*argv, "-v")) {
+         g_Verbose = true;
+      } else if (!strcmp(*argv, "-t")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -t missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_TimeOut = atoi(*argv);
+      } else if (!strcmp(*argv, "-w")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -w missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_HangWindow = strtoul(*argv, NULL, 0);
+      } else if (!strcmp(*argv, "-r") || !strcmp(*argv, "-g")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: %s missing argument\n\n", *argv);
+            Usage();
+            return 1;
+         }
+
+         bool rss = !strcmp(*argv, "-r");
+
+         ++argv;
+         --argc;
+
+         if (rss) {
+            g_RssLimit = strtoul(*argv, NULL, 0);
+         } else {
+            g_GrowthLimit = strtoul(*argv, NULL, 0);
+         }
+      } else if (!strcmp(*argv, "-c")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -c missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         SymbolCache::SetDirectory(*argv);
+      } else if (!strcmp(*argv, "-y")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -y missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_SymbolPath = *argv;
+      } else if (!strcmp(*argv, "-s")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -s missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_SnapshotPath = *argv;
+      } else if (!strcmp(*argv, "-z")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -z missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_DumpPath = *argv;
+      } else if (!strcmp(*argv, "-l")) {
+         g_Lazy = true;
+      } else if (!strcmp(*argv, "-f")) {
+         g_Follow = true;
+      } else if (!strcmp(*argv, "-ma")) {
+         g_DumpFormat = DUMP_FULL;
+      } else if (!strcmp(*argv, "-mi")) {
+         g_DumpFormat = DUMP_REACHABLE;
+      } else if (!strcmp(*argv, "--compress")) {
+         g_Compress = true;
+      } else if (!strcmp(*argv, "--keep-running")) {
+         g_KeepRunning = true;
+      } else if (!strcmp(*argv, "--dump-depth")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --dump-depth missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ReachableDepth = strtoul(*argv, NULL, 0);
+      } else if (!strcmp(*argv, "--dump-budget")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --dump-budget missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         /* Memory list sizes are 32-bit. */
+         unsigned long megabytes = strtoul(*argv, NULL, 0);
+         if (!megabytes || megabytes > 4095) {
+            fprintf(stderr, "error: invalid dump budget %s (1-4095 MiB)\n\n", *argv);
+            Usage();
+            return 1;
+         }
+         g_ReachableBudget = megabytes << 20;
+      } else if (!strcmp(*argv, "--profile")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --profile missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ProfileRate = strtoul(*argv, NULL, 0);
+         if (!g_ProfileRate || g_ProfileRate > 1000) {
+            fprintf(stderr, "error: invalid profile rate %s (1-1000 Hz)\n\n", *argv);
+            Usage();
+            return 1;
+         }
+      } else if (!strcmp(*argv, "--report")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --report missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ReportPath = *argv;
+      } else if (!strcmp(*argv, "--signatures")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --signatures missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_SignaturePath = *argv;
+      } else if (!strcmp(*argv, "--server")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --server missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ServerPath = *argv;
+      } else if (!strcmp(*argv, "--store")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --store missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_StorePath = *argv;
+      } else if (!strcmp(*argv, "--dump-every")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --dump-every missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_DumpEvery = strtoul(*argv, NULL, 0);
+         if (!g_DumpEvery) {
+            fprintf(stderr, "error: invalid dump count %s\n\n", *argv);
+            Usage();
+            return 1;
+         }
+      } else if (!strcmp(*argv, "--tail")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --tail missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         unsigned long megabytes = strtoul(*argv, NULL, 0);
+         if (!megabytes || megabytes > 1024) {
+            fprintf(stderr, "error: invalid tail size %s (1-1024 MiB)\n\n", *argv);
+            Usage();
+            return 1;
+         }
+         g_TailSize = megabytes << 20;
+      } else if (!strcmp(*argv, "-o")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: -o missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_ProfilePath = *argv;
+      } else if (!strcmp(*argv, "--jobs")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --jobs missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         g_MaxJobs = strtoul(*argv, NULL, 0);
+         if (!g_MaxJobs) {
+            fprintf(stderr, "error: invalid job count %s\n\n", *argv);
+            Usage();
+            return 1;
+         }
+      } else if (!strcmp(*argv, "--manifest")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: --manifest missing argument\n\n");
+            Usage();
+            return 1;
+         }
+
+         ++argv;
+         --argc;
+
+         manifest = *argv;
+      } else {
+         break;
+      }
+   }
+
+   if (manifest && argc > 0) {
+      fprintf(stderr, "error: both a command line and a manifest given\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (!manifest && argc <= 0) {
+      fprintf(stderr, "error: no command line given\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (!manifest && g_MaxJobs) {
+      fprintf(stderr, "error: --jobs requires --manifest\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (g_Follow && g_Lazy) {
+      fprintf(stderr, "error: -f and -l are mutually exclusive\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (g_ProfileRate && g_Lazy) {
+      fprintf(stderr, "error: --profile and -l are mutually exclusive\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (g_DumpEvery && !g_SignaturePath) {
+      fprintf(stderr, "error: --dump-every requires --signatures\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (g_ServerPath && g_StorePath) {
+      fprintf(stderr, "error: --server and --store are mutually exclusive\n\n");
+      Usage();
+      return 1;
+   }
+
+   if (manifest && g_Lazy) {
+      fprintf(stderr, "error: --manifest and -l are mutually exclusive\n\n");
+      Usage();
+      return 1;
+   }
+
+   SplitSearchPath(g_SymbolPath ? g_SymbolPath : "/usr/lib/debug", g_DebugDirs);
+
+   if (manifest) {
+      std::vector<JobSpec> specs;
+      if (!ReadManifest(manifest, specs)) {
+         return 1;
+      }
+      if (specs.empty()) {
+         fprintf(stderr, "error: no jobs in %s\n", manifest);
+         return 1;
+      }
+
+      g_Jobs.resize(specs.size());
+      for (size_t i = 0; i < specs.size(); ++i) {
+         Job &job = g_Jobs[i];
+         job.Spec = specs[i];
+         job.Number = i + 1;
+         job.Pid = 0;
+         job.Done = false;
+         job.StartTime = 0;
+         job.EndTime = 0;
+         memset(&job.Exit, 0, sizeof job.Exit);
+      }
+
+      if (!g_MaxJobs) {
+         long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+         g_MaxJobs = cpus > 0 ? cpus : 1;
+      }
+   }
+
+   if (g_TailSize) {
+      /*
+       * tee only works between pipes; and a closed reader of ours should
+       * fail the writes rather than kill us (children unblock it).
+       */
+      for (unsigned i = 0; i < 2; ++i) {
+         struct stat st;
+         bool pipe = fstat(i ? STDERR_FILENO : STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode);
+         g_Forward[i] = pipe ? FORWARD_TEE : FORWARD_WRITE;
+      }
+
+      sigset_t mask;
+      sigemptyset(&mask);
+      sigaddset(&mask, SIGPIPE);
+      sigprocmask(SIG_BLOCK, &mask, NULL);
+   }
+
+   /*
+    * Create the process
+    */
+
+   if (!manifest) {
+      if (g_TailSize) {
+         g_Capture = NewCapture();
+         if (!g_Capture) {
+            Abort();
+         }
+      }
+
+      g_Pid = CreateProcess(argv, g_Capture);
+      if (g_Pid < 0) {
+         Abort();
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &g_StartTime);
+
+   if (g_HangWindow) {
+      g_Period = std::max(g_HangWindow / WATCHDOG_SAMPLES, 1UL);
+   }
+   if (g_RssLimit || g_GrowthLimit) {
+      g_Period = std::min(g_Period, (unsigned long)MEMORY_PERIOD);
+   }
+   if (g_HangWindow || g_RssLimit || g_GrowthLimit) {
+      g_NextSample = g_Period;
+   }
+   if (g_ProfileRate) {
+      g_ProfilePeriod = std::max(1000 / g_ProfileRate, 1UL);
+      g_NextProfile = g_ProfilePeriod;
+   }
+
+   if (manifest) {
+      /* Every job is attached from the start. */
+      g_Attached = true;
+   } else {
+      Tracee *root = AddTracee(g_Pid);
+      if (!g_Lazy) {
+         AddThread(root, g_Pid);
+         g_Attached = true;
+      }
+   }
+
+   EventLoop();
+
+   Cleanup();
+
+   if (manifest) {
+      return PrintReport();
+   }
+
+   return g_ExitCode;
+}
+
+/* vim:set sw=3 et: */
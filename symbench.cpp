@@ -0,0 +1,128 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Micro-benchmark of address to line lookups: the .debug_line scan per
+ * address against the Eytzinger index of the symbol cache.
+ *
+ *    symbench <elf-file> [frames]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "dwarf.h"
+#include "elfimage.h"
+#include "symcache.h"
+
+
+static double
+Now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   if (argc < 2) {
+      fputs("usage: symbench <elf-file> [frames]\n", stderr);
+      return 1;
+   }
+
+   unsigned frames = argc > 2 ? atoi(argv[2]) : 1000;
+
+   std::vector<std::string> debugDirs;
+   debugDirs.push_back("/usr/lib/debug");
+   ElfImage *image = ElfImage::OpenShared(argv[1], std::string(), debugDirs);
+   if (!image) {
+      fprintf(stderr, "error: failed to open %s\n", argv[1]);
+      return 1;
+   }
+
+   double start = Now();
+   DwarfLineTable table;
+   DwarfReadLineTable(image, table);
+   DwarfReadInlines(image, table);
+   std::vector<ElfSymbol> symbols;
+   SymbolCache *cache = SymbolCache::Create(std::string(), symbols, table);
+   double build = Now() - start;
+
+   if (!cache || table.Lines.empty()) {
+      fprintf(stderr, "error: no line table in %s\n", argv[1]);
+      return 1;
+   }
+
+   /* Addresses spread over the whole table, as in a deep stack. */
+   std::vector<uint64_t> addresses(frames);
+   srand(1);
+   for (unsigned i = 0; i < frames; ++i) {
+      addresses[i] = table.Lines[rand() % table.Lines.size()].Address;
+   }
+
+   std::string fileName;
+   unsigned line;
+   unsigned found = 0;
+
+   start = Now();
+   for (unsigned i = 0; i < frames; ++i) {
+      found += DwarfLookupLine(image, addresses[i], fileName, &line);
+   }
+   double scan = Now() - start;
+
+   unsigned repeat = 1000;
+   unsigned indexed = 0;
+   start = Now();
+   for (unsigned r = 0; r < repeat; ++r) {
+      for (unsigned i = 0; i < frames; ++i) {
+         indexed += cache->LookupLine(addresses[i], fileName, &line);
+      }
+   }
+   double index = (Now() - start) / repeat;
+
+   printf("%zu rows, %zu files, %zu inlines, %u frames\n",
+          table.Lines.size(), table.Files.size(), table.Inlines.size(), frames);
+   printf("scan:   %10.3f ms  (%.3f us/frame, %u found)\n",
+          scan*1e3, scan*1e6/frames, found);
+   printf("build:  %10.3f ms  (once per module)\n", build*1e3);
+   printf("index:  %10.3f ms  (%.3f us/frame, %u found)\n",
+          index*1e3, index*1e6/frames, indexed / repeat);
+
+   delete cache;
+   ElfImage::Release(image);
+   return 0;
+}
+
+
+/* vim:set sw=3 et: */
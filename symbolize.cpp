@@ -0,0 +1,227 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cxxabi.h>
+
+#include "elfimage.h"
+#include "symbolize.h"
+
+
+std::string
+DemangleSymbol(const char *Name)
+{
+   if (Name[0] != '_' || Name[1] != 'Z') {
+      return Name;
+   }
+
+   int status = 0;
+   char *demangled = abi::__cxa_demangle(Name, NULL, NULL, &status);
+   if (!demangled || status != 0) {
+      free(demangled);
+      return Name;
+   }
+
+   std::string result(demangled);
+   free(demangled);
+   return result;
+}
+
+
+std::string
+FormatPointer(uint64_t Value)
+{
+   char buffer[32];
+   snprintf(buffer, sizeof buffer, "%08x`%08x",
+            (unsigned)(Value >> 32), (unsigned)Value);
+   return buffer;
+}
+
+
+static std::string
+FormatLocation(const std::string &FileName, unsigned Line)
+{
+   char buffer[32];
+   snprintf(buffer, sizeof buffer, " @ %u]", Line);
+   return " [" + FileName + buffer;
+}
+
+
+/*
+ * module!symbol+0xoffset, or module+0xoffset without symbols.
+ */
+static std::string
+FormatSymbol(const Module *module, uint64_t Address, uint64_t Lookup)
+{
+   char buffer[64];
+   std::string result = module->Name;
+
+   ElfSymbol symbol;
+   if (module->Image &&
+       module->Image->LookupSymbol(Lookup - module->Bias, &symbol)) {
+      result += '!';
+      result += DemangleSymbol(symbol.Name);
+      snprintf(buffer, sizeof buffer, "+0x%llx",
+               (unsigned long long)(Address - module->Bias - symbol.Address));
+   } else {
+      snprintf(buffer, sizeof buffer, "+0x%llx",
+               (unsigned long long)(Address - module->Base));
+   }
+   result += buffer;
+
+   return result;
+}
+
+
+std::string
+SymbolizeAddress(Target *target, uint64_t Address, bool Exact)
+{
+   char buffer[64];
+   uint64_t lookup = Exact ? Address : Address - 1;
+
+   const Module *module = target->FindModule(lookup);
+   if (!module) {
+      snprintf(buffer, sizeof buffer, "0x%llx", (unsigned long long)Address);
+      return buffer;
+   }
+
+   std::string result = FormatSymbol(module, Address, lookup);
+
+   std::string fileName;
+   unsigned line;
+   if (module->Image &&
+       module->Image->LookupLine(lookup - module->Bias, fileName, &line)) {
+      result += FormatLocation(fileName, line);
+   }
+
+   return result;
+}
+
+
+void
+LookupFrames(Target *target, uint64_t Address, bool Exact,
+             std::vector<SymbolFrame> &Frames)
+{
+   uint64_t lookup = Exact ? Address : Address - 1;
+
+   Frames.clear();
+
+   SymbolFrame outer;
+   outer.module = target->FindModule(lookup);
+   outer.Displacement = 0;
+   outer.Line = 0;
+   outer.Inline = false;
+
+   const Module *module = outer.module;
+   if (!module) {
+      Frames.push_back(outer);
+      return;
+   }
+   outer.Displacement = Address - module->Base;
+   if (!module->Image) {
+      Frames.push_back(outer);
+      return;
+   }
+
+   std::string fileName;
+   unsigned line = 0;
+   bool haveLine = module->Image->LookupLine(lookup - module->Bias, fileName, &line);
+
+   /* Each inlined call sits at the call site of the one it contains. */
+   std::vector<ElfInline> inlines;
+   module->Image->LookupInlines(lookup - module->Bias, inlines);
+   for (size_t i = 0; i < inlines.size(); ++i) {
+      SymbolFrame frame;
+      frame.module = module;
+      frame.Function = DemangleSymbol(inlines[i].Name);
+      frame.Displacement = 0;
+      frame.Line = 0;
+      frame.Inline = true;
+      if (haveLine) {
+         frame.FileName = fileName;
+         frame.Line = line;
+      }
+      Frames.push_back(frame);
+
+      fileName = inlines[i].CallFile;
+      line = inlines[i].CallLine;
+      haveLine = !fileName.empty() && line != 0;
+   }
+
+   ElfSymbol symbol;
+   if (module->Image->LookupSymbol(lookup - module->Bias, &symbol)) {
+      outer.Function = DemangleSymbol(symbol.Name);
+      outer.Displacement = Address - module->Bias - symbol.Address;
+   }
+   if (haveLine) {
+      outer.FileName = fileName;
+      outer.Line = line;
+   }
+   Frames.push_back(outer);
+}
+
+
+void
+SymbolizeFrames(Target *target, uint64_t Address, bool Exact,
+                std::vector<std::string> &Frames)
+{
+   std::vector<SymbolFrame> frames;
+   LookupFrames(target, Address, Exact, frames);
+
+   Frames.clear();
+   for (size_t i = 0; i < frames.size(); ++i) {
+      const SymbolFrame &frame = frames[i];
+      char buffer[64];
+      std::string site;
+
+      if (!frame.module) {
+         snprintf(buffer, sizeof buffer, "0x%llx", (unsigned long long)Address);
+         Frames.push_back(buffer);
+         continue;
+      }
+
+      site = frame.module->Name;
+      if (!frame.Function.empty()) {
+         site += '!';
+         site += frame.Function;
+      }
+      if (!frame.Inline) {
+         snprintf(buffer, sizeof buffer, "+0x%llx", (unsigned long long)frame.Displacement);
+         site += buffer;
+      }
+      if (frame.Line) {
+         site += FormatLocation(frame.FileName, frame.Line);
+      }
+      Frames.push_back(site);
+   }
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,102 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Translation of code addresses into module!symbol+offset [file @ line]
+ * strings, in the style of the Debugging Tools for Windows.
+ */
+
+#ifndef _SYMBOLIZE_H_
+#define _SYMBOLIZE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "target.h"
+
+
+/*
+ * Demangle a C++ symbol name, returning the name unchanged when it is not
+ * a mangled name.
+ */
+std::string
+DemangleSymbol(const char *Name);
+
+
+/*
+ * Describe a code address.  Exact must be false for return addresses, so
+ * that the call instruction rather than the following one gets looked up.
+ */
+std::string
+SymbolizeAddress(Target *target, uint64_t Address, bool Exact);
+
+
+/*
+ * A source level frame at a code address.
+ */
+struct SymbolFrame
+{
+   const Module *module;      /* NULL outside of any module */
+   std::string Function;      /* demangled, or empty if unknown */
+   uint64_t Displacement;     /* from the function, or else the module start */
+   std::string FileName;
+   unsigned Line;             /* zero if unknown */
+   bool Inline;
+};
+
+
+/*
+ * Look up the frames at a code address: the calls inlined there,
+ * innermost first, and then the function containing it.  There is always
+ * at least one frame.
+ */
+void
+LookupFrames(Target *target, uint64_t Address, bool Exact,
+             std::vector<SymbolFrame> &Frames);
+
+
+/*
+ * Describe a code address as one string per frame: the calls inlined at
+ * the address, innermost first, and then the function containing it.
+ */
+void
+SymbolizeFrames(Target *target, uint64_t Address, bool Exact,
+                std::vector<std::string> &Frames);
+
+
+/*
+ * Format a 64-bit value as WinDbg does, e.g., 00007fff`12345678.
+ */
+std::string
+FormatPointer(uint64_t Value);
+
+
+#endif /* _SYMBOLIZE_H_ */
+
+/* vim:set sw=3 et: */
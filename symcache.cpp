@@ -0,0 +1,522 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "dwarf.h"
+#include "elfimage.h"
+#include "eytzinger.h"
+#include "symcache.h"
+
+
+/**************************************************************************
+ *
+ * File format
+ *
+ **************************************************************************/
+
+#define SYMCACHE_MAGIC     "SDSYMC\0"
+#define SYMCACHE_VERSION   2
+
+/*
+ * Tables follow the header in this order, all 8-byte aligned.  Searched
+ * tables hold Count + 1 elements in Eytzinger order.
+ */
+struct CacheHeader
+{
+   char Magic[8];
+   uint32_t Version;
+   uint32_t SymbolCount;
+   uint32_t LineCount;
+   uint32_t InlineRangeCount;
+   uint32_t InlineCount;
+   uint32_t FileCount;
+   uint32_t NameCount;
+   uint32_t Reserved;
+   uint64_t SymbolsOffset;       /* CacheSymbol[], searched */
+   uint64_t LinesOffset;         /* DwarfLine[], searched */
+   uint64_t InlineRangesOffset;  /* DwarfInlineRange[], searched */
+   uint64_t InlinesOffset;       /* DwarfInline[] */
+   uint64_t FilesOffset;         /* uint32_t[], offsets into the strings */
+   uint64_t NamesOffset;         /* uint32_t[], offsets into the strings */
+   uint64_t StringsOffset;
+   uint64_t StringsSize;
+};
+
+struct CacheSymbol
+{
+   uint64_t Address;
+   uint64_t Size;
+   uint32_t Name;             /* offset into the strings */
+   uint32_t Reserved;
+};
+
+
+/* Inline call chains deeper than this are assumed to be corrupt. */
+#define MAX_INLINE_DEPTH 64
+
+
+static std::string g_Directory = SymbolCache::DefaultDirectory();
+
+
+/**************************************************************************
+ *
+ * SymbolCache
+ *
+ **************************************************************************/
+
+SymbolCache::SymbolCache() :
+   m_Data(NULL),
+   m_Size(0),
+   m_Mapped(false),
+   m_Symbols(NULL),
+   m_SymbolCount(0),
+   m_Lines(NULL),
+   m_LineCount(0),
+   m_InlineRanges(NULL),
+   m_InlineRangeCount(0),
+   m_Inlines(NULL),
+   m_InlineCount(0),
+   m_Files(NULL),
+   m_FileCount(0),
+   m_Names(NULL),
+   m_NameCount(0),
+   m_Strings(NULL),
+   m_StringsSize(0)
+{
+}
+
+
+SymbolCache::~SymbolCache()
+{
+   if (m_Data) {
+      if (m_Mapped) {
+         munmap((void *)m_Data, m_Size);
+      } else {
+         free((void *)m_Data);
+      }
+   }
+}
+
+
+void
+SymbolCache::SetDirectory(const std::string &Dir)
+{
+   g_Directory = Dir;
+}
+
+
+const std::string &
+SymbolCache::Directory(void)
+{
+   return g_Directory;
+}
+
+
+std::string
+SymbolCache::DefaultDirectory(void)
+{
+   const char *dir = getenv("XDG_CACHE_HOME");
+   if (dir && *dir) {
+      return std::string(dir) + "/stackdump";
+   }
+
+   dir = getenv("HOME");
+   if (dir && *dir) {
+      return std::string(dir) + "/.cache/stackdump";
+   }
+
+   return std::string();
+}
+
+
+std::string
+SymbolCache::PathFor(const std::string &Key)
+{
+   /* Same fan-out as the .build-id directories. */
+   return g_Directory + "/" + Key.substr(0, 2) + "/" + Key.substr(2) + ".symcache";
+}
+
+
+static bool
+InRange(size_t Size, uint64_t Offset, uint64_t Count, size_t ElementSize)
+{
+   return Offset <= Size && Count <= (Size - Offset) / ElementSize;
+}
+
+
+/*
+ * Validate the header and locate the tables.  Takes ownership of the data.
+ */
+bool
+SymbolCache::Attach(const uint8_t *Data, size_t Size)
+{
+   m_Data = Data;
+   m_Size = Size;
+
+   const CacheHeader *header = (const CacheHeader *)Data;
+   if (Size < sizeof *header ||
+       memcmp(header->Magic, SYMCACHE_MAGIC, sizeof header->Magic) != 0 ||
+       header->Version != SYMCACHE_VERSION ||
+       !InRange(Size, header->SymbolsOffset, header->SymbolCount + 1ULL, sizeof(CacheSymbol)) ||
+       !InRange(Size, header->LinesOffset, header->LineCount + 1ULL, sizeof(DwarfLine)) ||
+       !InRange(Size, header->InlineRangesOffset, header->InlineRangeCount + 1ULL, sizeof(DwarfInlineRange)) ||
+       !InRange(Size, header->InlinesOffset, header->InlineCount, sizeof(DwarfInline)) ||
+       !InRange(Size, header->FilesOffset, header->FileCount, sizeof(uint32_t)) ||
+       !InRange(Size, header->NamesOffset, header->NameCount, sizeof(uint32_t)) ||
+       !InRange(Size, header->StringsOffset, header->StringsSize, 1) ||
+       header->StringsSize == 0 ||
+       Data[header->StringsOffset + header->StringsSize - 1] != 0) {
+      return false;
+   }
+
+   m_Symbols = Data + header->SymbolsOffset;
+   m_SymbolCount = header->SymbolCount;
+   m_Lines = Data + header->LinesOffset;
+   m_LineCount = header->LineCount;
+   m_InlineRanges = Data + header->InlineRangesOffset;
+   m_InlineRangeCount = header->InlineRangeCount;
+   m_Inlines = Data + header->InlinesOffset;
+   m_InlineCount = header->InlineCount;
+   m_Files = (const uint32_t *)(Data + header->FilesOffset);
+   m_FileCount = header->FileCount;
+   m_Names = (const uint32_t *)(Data + header->NamesOffset);
+   m_NameCount = header->NameCount;
+   m_Strings = (const char *)Data + header->StringsOffset;
+   m_StringsSize = header->StringsSize;
+
+   return true;
+}
+
+
+SymbolCache *
+SymbolCache::Open(const std::string &Key)
+{
+   struct stat st;
+   void *data;
+   int fd;
+
+   if (g_Directory.empty() || Key.size() < 3) {
+      return NULL;
+   }
+
+   fd = open(PathFor(Key).c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0) {
+      return NULL;
+   }
+
+   if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(CacheHeader)) {
+      close(fd);
+      return NULL;
+   }
+
+   data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (data == MAP_FAILED) {
+      return NULL;
+   }
+
+   SymbolCache *cache = new SymbolCache;
+   cache->m_Mapped = true;
+   if (!cache->Attach((const uint8_t *)data, st.st_size)) {
+      delete cache;
+      return NULL;
+   }
+
+   return cache;
+}
+
+
+static bool
+MakeDirectories(const std::string &Path)
+{
+   for (size_t i = 1; i <= Path.size(); ++i) {
+      if (i == Path.size() || Path[i] == '/') {
+         std::string dir = Path.substr(0, i);
+         if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+
+static bool
+WriteAll(int fd, const void *Data, size_t Size)
+{
+   const uint8_t *p = (const uint8_t *)Data;
+   while (Size) {
+      ssize_t ret = write(fd, p, Size);
+      if (ret < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      p += ret;
+      Size -= ret;
+   }
+   return true;
+}
+
+
+bool
+SymbolCache::WriteFile(const std::string &Key, const std::string &Data)
+{
+   /*
+    * Write to a private file and rename it into place, so that concurrent
+    * readers and writers never see a partial file.
+    */
+
+   std::string path = PathFor(Key);
+   if (!MakeDirectories(path.substr(0, path.rfind('/')))) {
+      return false;
+   }
+
+   char suffix[64];
+   snprintf(suffix, sizeof suffix, ".%d.%ld.tmp", getpid(), (long)syscall(SYS_gettid));
+   std::string temp = path + suffix;
+
+   int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0) {
+      return false;
+   }
+
+   bool ok = WriteAll(fd, Data.data(), Data.size());
+   ok = close(fd) == 0 && ok;
+
+   if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+      unlink(temp.c_str());
+      return false;
+   }
+
+   return true;
+}
+
+
+/*
+ * Append a table in Eytzinger order, returning its offset.
+ */
+template <class T>
+static uint64_t
+AppendSearched(std::string &Data, const std::vector<T> &Sorted)
+{
+   std::vector<T> tree(Sorted.size() + 1);
+   if (!Sorted.empty()) {
+      EytzingerLayout(&Sorted[0], Sorted.size(), &tree[0]);
+   }
+
+   uint64_t offset = Data.size();
+   Data.append((const char *)&tree[0], tree.size() * sizeof tree[0]);
+   return offset;
+}
+
+
+template <class T>
+static uint64_t
+AppendPlain(std::string &Data, const std::vector<T> &Table)
+{
+   uint64_t offset = Data.size();
+   if (!Table.empty()) {
+      Data.append((const char *)&Table[0], Table.size() * sizeof Table[0]);
+   }
+   Data.resize((Data.size() + 7) & ~(size_t)7);
+   return offset;
+}
+
+
+static uint32_t
+AppendString(std::string &Strings, const char *String)
+{
+   uint32_t offset = (uint32_t)Strings.size();
+   Strings.append(String, strlen(String) + 1);
+   return offset;
+}
+
+
+SymbolCache *
+SymbolCache::Create(const std::string &Key,
+                    const std::vector<ElfSymbol> &Symbols,
+                    const DwarfLineTable &Lines)
+{
+   std::string strings(1, '\0');
+
+   /* Only the preferred symbol at each address can ever be found. */
+   std::vector<CacheSymbol> symbols;
+   symbols.reserve(Symbols.size());
+   for (size_t i = 0; i < Symbols.size(); ++i) {
+      if (!symbols.empty() && symbols.back().Address == Symbols[i].Address) {
+         continue;
+      }
+      CacheSymbol symbol;
+      symbol.Address = Symbols[i].Address;
+      symbol.Size = Symbols[i].Size;
+      symbol.Name = AppendString(strings, Symbols[i].Name);
+      symbol.Reserved = 0;
+      symbols.push_back(symbol);
+   }
+
+   std::vector<uint32_t> files(Lines.Files.size());
+   for (size_t i = 0; i < Lines.Files.size(); ++i) {
+      files[i] = AppendString(strings, Lines.Files[i].c_str());
+   }
+
+   std::vector<uint32_t> names(Lines.Names.size());
+   for (size_t i = 0; i < Lines.Names.size(); ++i) {
+      names[i] = AppendString(strings, Lines.Names[i].c_str());
+   }
+
+   CacheHeader header;
+   memset(&header, 0, sizeof header);
+   memcpy(header.Magic, SYMCACHE_MAGIC, sizeof header.Magic);
+   header.Version = SYMCACHE_VERSION;
+   header.SymbolCount = (uint32_t)symbols.size();
+   header.LineCount = (uint32_t)Lines.Lines.size();
+   header.InlineRangeCount = (uint32_t)Lines.InlineRanges.size();
+   header.InlineCount = (uint32_t)Lines.Inlines.size();
+   header.FileCount = (uint32_t)files.size();
+   header.NameCount = (uint32_t)names.size();
+
+   std::string data(sizeof header, '\0');
+   header.SymbolsOffset = AppendSearched(data, symbols);
+   header.LinesOffset = AppendSearched(data, Lines.Lines);
+   header.InlineRangesOffset = AppendSearched(data, Lines.InlineRanges);
+   header.InlinesOffset = AppendPlain(data, Lines.Inlines);
+   header.FilesOffset = AppendPlain(data, files);
+   header.NamesOffset = AppendPlain(data, names);
+   header.StringsOffset = data.size();
+   header.StringsSize = strings.size();
+   data += strings;
+   memcpy(&data[0], &header, sizeof header);
+
+   if (!Key.empty() && !g_Directory.empty() && Key.size() >= 3) {
+      WriteFile(Key, data);
+   }
+
+   uint8_t *copy = (uint8_t *)malloc(data.size());
+   if (!copy) {
+      return NULL;
+   }
+   memcpy(copy, data.data(), data.size());
+
+   SymbolCache *cache = new SymbolCache;
+   if (!cache->Attach(copy, data.size())) {
+      delete cache;
+      return NULL;
+   }
+   return cache;
+}
+
+
+const char *
+SymbolCache::String(uint32_t Offset) const
+{
+   return Offset < m_StringsSize ? m_Strings + Offset : "";
+}
+
+
+const char *
+SymbolCache::FileName(uint32_t File) const
+{
+   return File < m_FileCount ? String(m_Files[File]) : "";
+}
+
+
+bool
+SymbolCache::LookupSymbol(uint64_t Address, ElfSymbol *Symbol) const
+{
+   const CacheSymbol *symbols = (const CacheSymbol *)m_Symbols;
+
+   size_t k = EytzingerFind(symbols, m_SymbolCount, Address);
+   if (k == 0) {
+      return false;
+   }
+
+   const CacheSymbol &symbol = symbols[k];
+   if (symbol.Size && Address >= symbol.Address + symbol.Size) {
+      return false;
+   }
+
+   Symbol->Address = symbol.Address;
+   Symbol->Size = symbol.Size;
+   Symbol->Name = String(symbol.Name);
+   return true;
+}
+
+
+bool
+SymbolCache::LookupLine(uint64_t Address, std::string &FileName, unsigned *Line) const
+{
+   const DwarfLine *lines = (const DwarfLine *)m_Lines;
+
+   size_t k = EytzingerFind(lines, m_LineCount, Address);
+   if (k == 0 || lines[k].File == DWARF_LINE_END || lines[k].File >= m_FileCount) {
+      return false;
+   }
+
+   FileName = this->FileName(lines[k].File);
+   *Line = lines[k].Line;
+   return true;
+}
+
+
+void
+SymbolCache::LookupInlines(uint64_t Address, std::vector<ElfInline> &Inlines) const
+{
+   const DwarfInlineRange *ranges = (const DwarfInlineRange *)m_InlineRanges;
+   const DwarfInline *inlines = (const DwarfInline *)m_Inlines;
+
+   Inlines.clear();
+
+   size_t k = EytzingerFind(ranges, m_InlineRangeCount, Address);
+   if (k == 0) {
+      return;
+   }
+
+   uint32_t index = ranges[k].Inline;
+   while (index < m_InlineCount && Inlines.size() < MAX_INLINE_DEPTH) {
+      const DwarfInline &inl = inlines[index];
+      ElfInline frame;
+      frame.Name = inl.Name < m_NameCount ? String(m_Names[inl.Name]) : "";
+      frame.CallFile = FileName(inl.CallFile);
+      frame.CallLine = inl.CallLine;
+      Inlines.push_back(frame);
+      index = inl.Parent;
+   }
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,141 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Persistent cache of pre-digested symbol, line and inline tables.
+ *
+ * Tables are keyed by ELF build-id and stored as flat arrays in Eytzinger
+ * order (see eytzinger.h), which are memory mapped and searched in place,
+ * so a warm cache needs neither the debug file nor any DWARF decoding.
+ * The same layout serves as the in-memory index when caching is disabled.
+ */
+
+#ifndef _SYMCACHE_H_
+#define _SYMCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+struct ElfSymbol;
+struct ElfInline;
+struct DwarfLineTable;
+
+
+class SymbolCache
+{
+public:
+   ~SymbolCache();
+
+   /*
+    * Where cache files live.  An empty directory disables the cache.
+    */
+   static void
+   SetDirectory(const std::string &Dir);
+
+   static const std::string &
+   Directory(void);
+
+   /*
+    * $XDG_CACHE_HOME/stackdump, or ~/.cache/stackdump.
+    */
+   static std::string
+   DefaultDirectory(void);
+
+   /*
+    * Open the cache entry for an image.  Key identifies the image (its
+    * build-id plus how it was symbolized).  Returns NULL when absent.
+    */
+   static SymbolCache *
+   Open(const std::string &Key);
+
+   /*
+    * Index the tables of an image, storing them under Key unless it is
+    * empty.  Symbols must be sorted, preferred aliases first.
+    */
+   static SymbolCache *
+   Create(const std::string &Key,
+          const std::vector<ElfSymbol> &Symbols,
+          const DwarfLineTable &Lines);
+
+   bool
+   LookupSymbol(uint64_t Address, ElfSymbol *Symbol) const;
+
+   bool
+   LookupLine(uint64_t Address, std::string &FileName, unsigned *Line) const;
+
+   /*
+    * Inlined calls at the address, innermost first.
+    */
+   void
+   LookupInlines(uint64_t Address, std::vector<ElfInline> &Inlines) const;
+
+private:
+   SymbolCache();
+
+   static std::string
+   PathFor(const std::string &Key);
+
+   static bool
+   WriteFile(const std::string &Key, const std::string &Data);
+
+   bool
+   Attach(const uint8_t *Data, size_t Size);
+
+   const char *
+   String(uint32_t Offset) const;
+
+   const char *
+   FileName(uint32_t File) const;
+
+   const uint8_t *m_Data;
+   size_t m_Size;
+   bool m_Mapped;
+
+   const void *m_Symbols;
+   uint32_t m_SymbolCount;
+   const void *m_Lines;
+   uint32_t m_LineCount;
+   const void *m_InlineRanges;
+   uint32_t m_InlineRangeCount;
+   const void *m_Inlines;
+   uint32_t m_InlineCount;
+   const uint32_t *m_Files;
+   uint32_t m_FileCount;
+   const uint32_t *m_Names;
+   uint32_t m_NameCount;
+   const char *m_Strings;
+   uint64_t m_StringsSize;
+};
+
+
+#endif /* _SYMCACHE_H_ */
+
+/* vim:set sw=3 et: */
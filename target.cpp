@@ -0,0 +1,98 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <string.h>
+
+#include "elfimage.h"
+#include "target.h"
+
+
+/*
+ * Derive the short module name from a path, the same way the debugger
+ * engine does: the base name without any extension, e.g. "libc" for
+ * /lib/x86_64-linux-gnu/libc.so.6.
+ */
+std::string
+ModuleNameFromPath(const std::string &Path)
+{
+   std::string name = Path;
+
+   size_t slash = name.find_last_of("/\\");
+   if (slash != std::string::npos) {
+      name = name.substr(slash + 1);
+   }
+
+   if (!name.empty() && name[0] == '[') {
+      /* [vdso] and friends */
+      return name.substr(1, name.find(']') - 1);
+   }
+
+   size_t dot = name.find('.');
+   if (dot != std::string::npos && dot > 0) {
+      name = name.substr(0, dot);
+   }
+
+   /* Characters that would be ambiguous in a module!symbol expression. */
+   for (size_t i = 0; i < name.size(); ++i) {
+      if (name[i] == '-' || name[i] == '+' || name[i] == '!') {
+         name[i] = '_';
+      }
+   }
+
+   return name;
+}
+
+
+void
+ReleaseModules(std::vector<Module> &Modules)
+{
+   for (size_t i = 0; i < Modules.size(); ++i) {
+      ElfImage::Release(Modules[i].Image);
+   }
+   Modules.clear();
+}
+
+
+void
+SplitSearchPath(const char *Path, std::vector<std::string> &Dirs)
+{
+   const char *p = Path;
+
+   while (*p) {
+      const char *end = strchr(p, ':');
+      if (!end) {
+         end = p + strlen(p);
+      }
+      if (end != p) {
+         Dirs.push_back(std::string(p, end));
+      }
+      p = *end ? end + 1 : end;
+   }
+}
+
+
+/* vim:set sw=3 et: */
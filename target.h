@@ -0,0 +1,119 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Abstract view of a debug target (a live process or a dump file), as seen
+ * by the stack unwinder and the symbolizer.
+ */
+
+#ifndef _TARGET_H_
+#define _TARGET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+class ElfImage;
+
+
+/*
+ * x86-64 registers, in DWARF numbering.
+ */
+enum {
+   DW_REG_RAX = 0,
+   DW_REG_RDX = 1,
+   DW_REG_RCX = 2,
+   DW_REG_RBX = 3,
+   DW_REG_RSI = 4,
+   DW_REG_RDI = 5,
+   DW_REG_RBP = 6,
+   DW_REG_RSP = 7,
+   DW_REG_R8 = 8,
+   DW_REG_R9 = 9,
+   DW_REG_R10 = 10,
+   DW_REG_R11 = 11,
+   DW_REG_R12 = 12,
+   DW_REG_R13 = 13,
+   DW_REG_R14 = 14,
+   DW_REG_R15 = 15,
+   DW_REG_RIP = 16,
+   DW_REG_COUNT = 17
+};
+
+
+struct Module
+{
+   uint64_t Base;       /* lowest mapped address */
+   uint64_t End;        /* highest mapped address (exclusive) */
+   uint64_t Bias;       /* difference between run-time and link-time addresses */
+   std::string Path;
+   std::string Name;    /* short name, as used in module!symbol expressions */
+   ElfImage *Image;     /* may be NULL when the file could not be read */
+};
+
+
+class Target
+{
+public:
+   virtual ~Target() {}
+
+   /*
+    * Read target memory.  Returns the number of bytes actually read.
+    */
+   virtual size_t ReadMemory(uint64_t Address, void *Buffer, size_t Size) = 0;
+
+   /*
+    * Find the module containing the given address, or NULL.
+    */
+   virtual const Module *FindModule(uint64_t Address) = 0;
+};
+
+
+std::string
+ModuleNameFromPath(const std::string &Path);
+
+
+/*
+ * Drop the modules' image references and clear them.
+ */
+void
+ReleaseModules(std::vector<Module> &Modules);
+
+
+/*
+ * Split a colon separated list of directories.
+ */
+void
+SplitSearchPath(const char *Path, std::vector<std::string> &Dirs);
+
+
+#endif /* _TARGET_H_ */
+
+/* vim:set sw=3 et: */
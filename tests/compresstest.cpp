@@ -0,0 +1,281 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the LZ4 block codec and the block compressed (MDLZ) minidump
+ * layout.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include "compress.h"
+#include "minidumpbuilder.h"
+#include "minidumpreader.h"
+#include "test.h"
+
+
+static uint32_t g_Seed = 1;
+
+/* Deterministic pseudo-random bytes, which do not compress. */
+static uint8_t
+RandomByte(void)
+{
+   g_Seed ^= g_Seed << 13;
+   g_Seed ^= g_Seed >> 17;
+   g_Seed ^= g_Seed << 5;
+   return (uint8_t)g_Seed;
+}
+
+
+static std::vector<uint8_t>
+Compress(const std::vector<uint8_t> &Data)
+{
+   std::vector<uint8_t> compressed(LZ4_BOUND(Data.size()));
+   size_t size = LZ4Compress(Data.data(), Data.size(), compressed.data());
+   CHECK(size <= compressed.size());
+   compressed.resize(size);
+   return compressed;
+}
+
+
+/*
+ * Compress and decompress, also checking that the exact size is required.
+ * Returns the compressed size.
+ */
+static size_t
+RoundTrip(const std::vector<uint8_t> &Data)
+{
+   std::vector<uint8_t> compressed = Compress(Data);
+
+   std::vector<uint8_t> output(Data.size() + 1, 0xcc);
+   CHECK(LZ4Decompress(compressed.data(), compressed.size(), output.data(), Data.size()));
+   CHECK(memcmp(output.data(), Data.data(), Data.size()) == 0);
+   CHECK(output[Data.size()] == 0xcc);
+
+   CHECK(!LZ4Decompress(compressed.data(), compressed.size(), output.data(), Data.size() + 1));
+   if (!Data.empty()) {
+      CHECK(!LZ4Decompress(compressed.data(), compressed.size(), output.data(), Data.size() - 1));
+   }
+
+   return compressed.size();
+}
+
+
+static void
+TestEmpty(void)
+{
+   std::vector<uint8_t> data;
+   CHECK(RoundTrip(data) == 1);
+}
+
+
+static void
+TestIncompressible(void)
+{
+   std::vector<uint8_t> data(BLOCK_SIZE);
+   for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = RandomByte();
+   }
+   CHECK(RoundTrip(data) <= LZ4_BOUND(data.size()));
+
+   /* Short inputs, all literals. */
+   for (size_t size = 1; size <= 300; ++size) {
+      std::vector<uint8_t> prefix(data.begin(), data.begin() + size);
+      RoundTrip(prefix);
+   }
+}
+
+
+static void
+TestZeros(void)
+{
+   std::vector<uint8_t> data(BLOCK_SIZE, 0);
+   CHECK(RoundTrip(data) < data.size() / 200);
+
+   /* Matches overlapping their own output, one byte behind. */
+   data.assign(1000, 'a');
+   data[0] = 'b';
+   RoundTrip(data);
+}
+
+
+static void
+TestShortMatches(void)
+{
+   /* Minimum length matches, separated by single literals. */
+   std::vector<uint8_t> data;
+   while (data.size() < 64*1024) {
+      const char pattern[] = "abcd";
+      data.insert(data.end(), pattern, pattern + 4);
+      data.push_back(RandomByte());
+   }
+   CHECK(RoundTrip(data) < data.size());
+
+   /* Matches at the largest distance, and just beyond it. */
+   std::vector<uint8_t> random(70000);
+   for (size_t i = 0; i < random.size(); ++i) {
+      random[i] = RandomByte();
+   }
+   for (size_t distance = 65534; distance <= 65537; ++distance) {
+      data.assign(random.begin(), random.begin() + distance);
+      data.insert(data.end(), random.begin(), random.begin() + 100);
+      RoundTrip(data);
+   }
+
+   /* Matches and literal runs around the 15 and 255 length codes. */
+   for (size_t length = 13; length <= 280; length += 1) {
+      data.clear();
+      for (size_t i = 0; i < length; ++i) {
+         data.push_back(RandomByte());
+      }
+      data.insert(data.end(), data.begin(), data.begin() + length);
+      for (size_t i = 0; i < 16; ++i) {
+         data.push_back(RandomByte());
+      }
+      RoundTrip(data);
+   }
+}
+
+
+static void
+TestTruncated(void)
+{
+   std::vector<uint8_t> data;
+   for (size_t i = 0; i < 4096; ++i) {
+      data.push_back(i % 7 ? (uint8_t)(i / 64) : RandomByte());
+   }
+   std::vector<uint8_t> compressed = Compress(data);
+   CHECK(compressed.size() < data.size());
+
+   std::vector<uint8_t> output(data.size());
+   for (size_t size = 0; size < compressed.size(); ++size) {
+      /* A copy, so that reads past the end are out of bounds. */
+      std::vector<uint8_t> truncated(compressed.begin(), compressed.begin() + size);
+      CHECK(!LZ4Decompress(truncated.data(), truncated.size(), output.data(), output.size()));
+   }
+
+   /* Corrupted input may decode to garbage, but must stay in bounds. */
+   for (unsigned i = 0; i < 2000; ++i) {
+      std::vector<uint8_t> corrupted(compressed);
+      corrupted[RandomByte() * compressed.size() / 256] ^= RandomByte() | 1;
+      LZ4Decompress(corrupted.data(), corrupted.size(), output.data(), output.size());
+   }
+}
+
+
+static void
+TestBlockIndex(const std::string &Dir)
+{
+   const uint32_t blockSize = 4096;
+
+   /*
+    * A minidump without streams, followed by alternately compressible and
+    * random blocks, the last one partial.
+    */
+   std::vector<uint8_t> data(blockSize * 7 + 100);
+   for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = (i / blockSize) % 2 ? RandomByte() : (uint8_t)(i / 100);
+   }
+   MDRawHeader header;
+   memset(&header, 0, sizeof header);
+   header.Signature = MD_HEADER_SIGNATURE;
+   header.Version = MD_HEADER_VERSION;
+   header.StreamDirectoryRva = sizeof header;
+   memcpy(data.data(), &header, sizeof header);
+
+   std::vector<uint8_t> file = CompressBlocks(data, blockSize);
+   std::string path = Dir + "/blocks.dmp";
+   CHECK(WriteFile(path, file.data(), file.size()));
+
+   MinidumpFile *dump = MinidumpFile::Open(path.c_str());
+   CHECK(dump != NULL);
+   if (dump) {
+      CHECK(dump->Compressed());
+      CHECK(dump->Size() == data.size());
+
+      /* Ranges within, across and at the end of blocks. */
+      const uint64_t ranges[][2] = {
+         {blockSize * 3 + 10, 50},
+         {blockSize - 1, 2},
+         {blockSize * 2 - 100, blockSize + 200},
+         {data.size() - 100, 100},
+         {0, data.size()},
+      };
+      for (size_t i = 0; i < sizeof ranges / sizeof ranges[0]; ++i) {
+         const void *p = dump->GetData(ranges[i][0], ranges[i][1]);
+         CHECK(p && memcmp(p, data.data() + ranges[i][0], ranges[i][1]) == 0);
+      }
+      CHECK(dump->GetData(data.size() - 10, 11) == NULL);
+      delete dump;
+   }
+
+   /* The index must be complete. */
+   std::vector<uint8_t> truncated(file.begin(), file.end() - 1);
+   CHECK(WriteFile(path, truncated.data(), truncated.size()));
+   dump = MinidumpFile::Open(path.c_str());
+   CHECK(dump == NULL);
+   delete dump;
+
+   /* A truncated block fails on its own. */
+   std::vector<uint8_t> corrupted(file);
+   BlockHeader blockHeader;
+   memcpy(&blockHeader, corrupted.data(), sizeof blockHeader);
+   BlockIndexEntry *index = (BlockIndexEntry *)(corrupted.data() + blockHeader.IndexOffset);
+   CHECK(index[2].Flags == 0);
+   index[2].Size -= 1;
+   CHECK(WriteFile(path, corrupted.data(), corrupted.size()));
+   dump = MinidumpFile::Open(path.c_str());
+   CHECK(dump != NULL);
+   if (dump) {
+      CHECK(dump->GetData(blockSize * 2, 10) == NULL);
+      const void *p = dump->GetData(blockSize * 4, 10);
+      CHECK(p && memcmp(p, data.data() + blockSize * 4, 10) == 0);
+      delete dump;
+   }
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestEmpty();
+   TestIncompressible();
+   TestZeros();
+   TestShortMatches();
+   TestTruncated();
+   TestBlockIndex(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
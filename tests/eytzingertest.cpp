@@ -0,0 +1,123 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the Eytzinger search, against a plain binary search.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "eytzinger.h"
+#include "test.h"
+
+
+struct Entry
+{
+   uint64_t Address;
+   size_t Index;        /* in sorted order */
+
+   bool
+   operator < (const Entry &other) const { return Address < other.Address; }
+};
+
+
+static void
+CheckTable(std::vector<Entry> &Sorted, const std::vector<uint64_t> &Addresses)
+{
+   std::stable_sort(Sorted.begin(), Sorted.end());
+   for (size_t i = 0; i < Sorted.size(); ++i) {
+      Sorted[i].Index = i;
+   }
+
+   std::vector<Entry> tree(Sorted.size() + 1);
+   EytzingerLayout(Sorted.data(), Sorted.size(), tree.data());
+
+   for (size_t i = 0; i < Addresses.size(); ++i) {
+      Entry key;
+      key.Address = Addresses[i];
+      std::vector<Entry>::const_iterator it = std::upper_bound(Sorted.begin(), Sorted.end(), key);
+
+      size_t k = EytzingerFind(tree.data(), Sorted.size(), Addresses[i]);
+      if (it == Sorted.begin()) {
+         CHECK(k == 0);
+      } else {
+         CHECK(k >= 1 && k <= Sorted.size() && tree[k].Index == (it - 1)->Index);
+      }
+   }
+}
+
+
+int
+main(void)
+{
+   /* Every size of the first few tree levels, probing each gap. */
+   for (size_t count = 0; count <= 70; ++count) {
+      std::vector<Entry> sorted(count);
+      std::vector<uint64_t> addresses;
+      for (size_t i = 0; i < count; ++i) {
+         sorted[i].Address = 10 * (i + 1);
+      }
+      for (uint64_t address = 0; address <= 10 * (count + 2); ++address) {
+         addresses.push_back(address);
+      }
+      addresses.push_back(~0ULL);
+      CheckTable(sorted, addresses);
+   }
+
+   /* Duplicate addresses resolve to the last of them. */
+   std::vector<Entry> sorted(40);
+   std::vector<uint64_t> addresses;
+   for (size_t i = 0; i < sorted.size(); ++i) {
+      sorted[i].Address = 100 * (i / 4);
+      addresses.push_back(sorted[i].Address);
+      addresses.push_back(sorted[i].Address + 1);
+   }
+   CheckTable(sorted, addresses);
+
+   /* Large random tables, including the extremes of the address space. */
+   srand(1);
+   for (unsigned round = 0; round < 4; ++round) {
+      sorted.resize(100000 + round * 12345);
+      addresses.clear();
+      for (size_t i = 0; i < sorted.size(); ++i) {
+         sorted[i].Address = ((uint64_t)rand() << 33) ^ ((uint64_t)rand() << 2);
+         addresses.push_back(sorted[i].Address);
+         addresses.push_back(((uint64_t)rand() << 33) ^ rand());
+      }
+      sorted[0].Address = 0;
+      sorted[1].Address = ~0ULL;
+      addresses.push_back(0);
+      addresses.push_back(~0ULL);
+      CheckTable(sorted, addresses);
+   }
+
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
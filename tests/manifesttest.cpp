@@ -0,0 +1,184 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the job manifest parser.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include "jobs.h"
+#include "test.h"
+
+
+static bool
+ReadText(const std::string &Dir, const std::string &Text, std::vector<JobSpec> &Jobs)
+{
+   std::string path = Dir + "/manifest";
+   CHECK(WriteFile(path, Text.data(), Text.size()));
+   Jobs.clear();
+   return ReadManifest(path.c_str(), Jobs);
+}
+
+
+static bool
+ArgsAre(const JobSpec &Job, const char *First, const char *Second = NULL, const char *Third = NULL)
+{
+   const char *expected[] = {First, Second, Third};
+   size_t count = Third ? 3 : Second ? 2 : 1;
+   if (Job.Args.size() != count) {
+      return false;
+   }
+   for (size_t i = 0; i < count; ++i) {
+      if (Job.Args[i] != expected[i]) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
+static void
+TestWords(const std::string &Dir)
+{
+   std::vector<JobSpec> jobs;
+   CHECK(ReadText(Dir,
+                  "# comment\n"
+                  "\n"
+                  "   \t\n"
+                  "./a --quick\n"
+                  "  ./b 'single quoted' \"double \\\"quoted\\\"\"\r\n"
+                  "./c one\\ word 'it'\\''s' \"\\$x\" ''\n"
+                  "./d no-newline",
+                  jobs));
+   CHECK(jobs.size() == 4);
+   if (jobs.size() != 4) {
+      return;
+   }
+
+   CHECK(ArgsAre(jobs[0], "./a", "--quick"));
+   CHECK(jobs[0].Line == 4);
+   CHECK(!jobs[0].HaveTimeOut && jobs[0].DumpPath.empty());
+   CHECK(!jobs[0].FullDump && !jobs[0].ReachableDump);
+
+   CHECK(ArgsAre(jobs[1], "./b", "single quoted", "double \"quoted\""));
+   CHECK(jobs[1].Line == 5);
+
+   CHECK(jobs[2].Args.size() == 5);
+   if (jobs[2].Args.size() == 5) {
+      CHECK(jobs[2].Args[1] == "one word");
+      CHECK(jobs[2].Args[2] == "it's");
+      CHECK(jobs[2].Args[3] == "$x");
+      CHECK(jobs[2].Args[4] == "");
+   }
+
+   CHECK(ArgsAre(jobs[3], "./d", "no-newline"));
+   CHECK(jobs[3].Line == 7);
+}
+
+
+static void
+TestOptions(const std::string &Dir)
+{
+   std::vector<JobSpec> jobs;
+   CHECK(ReadText(Dir,
+                  "-t 60 -z slow.%p.dmp -ma ./slow -t 5\n"
+                  "-mi -t 0x10 ./reachable\n"
+                  "./plain -ma\n",
+                  jobs));
+   CHECK(jobs.size() == 3);
+   if (jobs.size() != 3) {
+      return;
+   }
+
+   /* Options only count before the command. */
+   CHECK(jobs[0].HaveTimeOut && jobs[0].TimeOut == 60);
+   CHECK(jobs[0].DumpPath == "slow.%p.dmp");
+   CHECK(jobs[0].FullDump && !jobs[0].ReachableDump);
+   CHECK(ArgsAre(jobs[0], "./slow", "-t", "5"));
+
+   CHECK(jobs[1].HaveTimeOut && jobs[1].TimeOut == 16);
+   CHECK(jobs[1].ReachableDump && !jobs[1].FullDump);
+   CHECK(ArgsAre(jobs[1], "./reachable"));
+
+   CHECK(!jobs[2].FullDump);
+   CHECK(ArgsAre(jobs[2], "./plain", "-ma"));
+}
+
+
+static void
+TestErrors(const std::string &Dir)
+{
+   std::vector<JobSpec> jobs;
+
+   /* Bad lines fail the manifest, but the others are still read. */
+   CHECK(!ReadText(Dir,
+                   "./a 'unterminated\n"
+                   "./b\n"
+                   "-t 10 -ma\n"
+                   "./c \"unterminated\n",
+                   jobs));
+   CHECK(jobs.size() == 1 && ArgsAre(jobs[0], "./b") && jobs[0].Line == 2);
+
+   /* Long lines are not split into several jobs. */
+   std::string text = "./long " + std::string(20000, 'x') + "\n./after\n";
+   CHECK(!ReadText(Dir, text, jobs));
+   CHECK(jobs.size() == 1 && ArgsAre(jobs[0], "./after") && jobs[0].Line == 2);
+
+   /* As long as the buffer, but no longer. */
+   text = "./fits " + std::string(16383 - 8, 'y') + "\n./after\n";
+   CHECK(ReadText(Dir, text, jobs));
+   CHECK(jobs.size() == 2 && jobs[0].Args.size() == 2 && ArgsAre(jobs[1], "./after"));
+   text.erase(text.find('\n'));
+   text += 'y';
+   CHECK(ReadText(Dir, text, jobs));
+   CHECK(jobs.size() == 1);
+
+   CHECK(ReadText(Dir, "", jobs) && jobs.empty());
+
+   std::string missing = Dir + "/missing";
+   CHECK(!ReadManifest(missing.c_str(), jobs));
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestWords(dir);
+   TestOptions(dir);
+   TestErrors(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
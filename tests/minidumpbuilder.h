@@ -0,0 +1,162 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Minidumps laid out by hand, for the tests.
+ */
+
+#ifndef _MINIDUMPBUILDER_H_
+#define _MINIDUMPBUILDER_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "compress.h"
+#include "minidump.h"
+
+
+/*
+ * Lays out a minidump: the header, then data and streams as added, then
+ * the stream directory.
+ */
+class MinidumpBuilder
+{
+public:
+   MinidumpBuilder() :
+      m_File(sizeof(MDRawHeader))
+   {
+   }
+
+   uint32_t
+   Size(void) const { return (uint32_t)m_File.size(); }
+
+   uint32_t
+   Add(const void *Data, size_t Size)
+   {
+      uint32_t rva = (uint32_t)m_File.size();
+      m_File.insert(m_File.end(), (const uint8_t *)Data, (const uint8_t *)Data + Size);
+      return rva;
+   }
+
+   void
+   AddStream(uint32_t StreamType, const void *Data, size_t Size)
+   {
+      MDRawDirectory entry;
+      entry.StreamType = StreamType;
+      entry.Location.DataSize = (uint32_t)Size;
+      entry.Location.Rva = Add(Data, Size);
+      m_Directory.push_back(entry);
+   }
+
+   /*
+    * A memory list stream, with the contents of each range after it.
+    */
+   void
+   AddMemoryList(const std::vector<uint64_t> &Starts,
+                 const std::vector<std::vector<uint8_t> > &Contents)
+   {
+      std::vector<MDMemoryDescriptor> descriptors(Starts.size());
+      for (size_t i = 0; i < Starts.size(); ++i) {
+         descriptors[i].StartOfMemoryRange = Starts[i];
+         descriptors[i].Memory.DataSize = (uint32_t)Contents[i].size();
+         descriptors[i].Memory.Rva = Add(Contents[i].data(), Contents[i].size());
+      }
+
+      std::vector<uint8_t> list(sizeof(MDRawMemoryList));
+      uint32_t count = (uint32_t)descriptors.size();
+      memcpy(list.data(), &count, sizeof count);
+      const uint8_t *p = (const uint8_t *)descriptors.data();
+      list.insert(list.end(), p, p + descriptors.size() * sizeof(MDMemoryDescriptor));
+      AddStream(MD_MEMORY_LIST_STREAM, list.data(), list.size());
+   }
+
+   std::vector<uint8_t>
+   Finish(void)
+   {
+      MDRawHeader header;
+      memset(&header, 0, sizeof header);
+      header.Signature = MD_HEADER_SIGNATURE;
+      header.Version = MD_HEADER_VERSION;
+      header.NumberOfStreams = (uint32_t)m_Directory.size();
+      header.StreamDirectoryRva = Add(m_Directory.data(), m_Directory.size() * sizeof(MDRawDirectory));
+      memcpy(m_File.data(), &header, sizeof header);
+      return m_File;
+   }
+
+private:
+   std::vector<uint8_t> m_File;
+   std::vector<MDRawDirectory> m_Directory;
+};
+
+
+/*
+ * Block compress a minidump into an MDLZ file, storing the blocks
+ * backwards and those that do not compress as they are, as the writer may.
+ */
+static inline std::vector<uint8_t>
+CompressBlocks(const std::vector<uint8_t> &Data, uint32_t BlockSize)
+{
+   BlockHeader header;
+   header.Signature = BLOCK_SIGNATURE;
+   header.Version = BLOCK_VERSION;
+   header.BlockSize = BlockSize;
+   header.BlockCount = (uint32_t)((Data.size() + BlockSize - 1) / BlockSize);
+   header.Size = Data.size();
+
+   std::vector<uint8_t> file(sizeof header);
+   std::vector<BlockIndexEntry> index(header.BlockCount);
+   std::vector<uint8_t> compressed(LZ4_BOUND(BlockSize));
+   for (size_t i = header.BlockCount; i-- > 0; ) {
+      size_t offset = i * BlockSize;
+      size_t size = std::min((size_t)BlockSize, Data.size() - offset);
+      size_t compressedSize = LZ4Compress(Data.data() + offset, size, compressed.data());
+
+      index[i].Offset = file.size();
+      if (compressedSize < size) {
+         index[i].Size = (uint32_t)compressedSize;
+         index[i].Flags = 0;
+         file.insert(file.end(), compressed.begin(), compressed.begin() + compressedSize);
+      } else {
+         index[i].Size = (uint32_t)size;
+         index[i].Flags = BLOCK_STORED;
+         file.insert(file.end(), Data.begin() + offset, Data.begin() + offset + size);
+      }
+   }
+
+   header.IndexOffset = file.size();
+   memcpy(file.data(), &header, sizeof header);
+   const uint8_t *entries = (const uint8_t *)index.data();
+   file.insert(file.end(), entries, entries + index.size() * sizeof(BlockIndexEntry));
+   return file;
+}
+
+
+#endif /* _MINIDUMPBUILDER_H_ */
+
+/* vim:set sw=3 et: */
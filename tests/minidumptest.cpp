@@ -0,0 +1,305 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for MinidumpFile, on minidumps built by hand.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <vector>
+
+#include "minidumpbuilder.h"
+#include "minidumpreader.h"
+#include "test.h"
+
+
+/* Memory contents tell which block they came from. */
+static uint8_t
+Contents(char Tag, uint64_t Address)
+{
+   return (uint8_t)(Tag ^ (Address >> 4) ^ Address);
+}
+
+
+struct Range
+{
+   char Tag;
+   uint64_t Start;
+   uint64_t Size;
+};
+
+
+static const Range g_Ranges[] = {
+   {'A', 0x1000, 0x2000},
+   {'B', 0x2000, 0x800},     /* inside A */
+   {'C', 0x1000, 0x800},     /* same start as A, listed after it */
+   {'D', 0x2f00, 0x1100},    /* overlaps the end of A */
+   {'F', 0x6000, 0x100},     /* right after E */
+};
+
+static const Range g_Ranges64[] = {
+   {'E', 0x5000, 0x1000},
+   {'G', 0x5800, 0x100},     /* inside E, in another list */
+};
+
+
+/* Which block each address must be read from, or 0 when not captured. */
+static char
+ExpectedTag(uint64_t Address)
+{
+   if (Address >= 0x1000 && Address < 0x3000) {
+      return 'A';
+   }
+   if (Address >= 0x3000 && Address < 0x4000) {
+      return 'D';
+   }
+   if (Address >= 0x5000 && Address < 0x6000) {
+      return 'E';
+   }
+   if (Address >= 0x6000 && Address < 0x6100) {
+      return 'F';
+   }
+   return 0;
+}
+
+
+static std::vector<uint8_t>
+BuildMemoryDump(void)
+{
+   MinidumpBuilder builder;
+
+   std::vector<MDMemoryDescriptor> descriptors;
+   for (size_t i = 0; i < sizeof g_Ranges / sizeof g_Ranges[0]; ++i) {
+      const Range &range = g_Ranges[i];
+      std::vector<uint8_t> data(range.Size);
+      for (uint64_t j = 0; j < range.Size; ++j) {
+         data[j] = Contents(range.Tag, range.Start + j);
+      }
+      MDMemoryDescriptor descriptor;
+      descriptor.StartOfMemoryRange = range.Start;
+      descriptor.Memory.DataSize = (uint32_t)range.Size;
+      descriptor.Memory.Rva = builder.Add(data.data(), data.size());
+      descriptors.push_back(descriptor);
+   }
+
+   std::vector<uint8_t> list(sizeof(MDRawMemoryList));
+   uint32_t count = (uint32_t)descriptors.size();
+   memcpy(list.data(), &count, sizeof count);
+   const uint8_t *p = (const uint8_t *)descriptors.data();
+   list.insert(list.end(), p, p + descriptors.size() * sizeof(MDMemoryDescriptor));
+   builder.AddStream(MD_MEMORY_LIST_STREAM, list.data(), list.size());
+
+   /* The 64-bit list has its contents in one run, after the descriptors. */
+   const size_t count64 = sizeof g_Ranges64 / sizeof g_Ranges64[0];
+   MDRawMemory64List header64;
+   header64.NumberOfMemoryRanges = count64;
+   std::vector<uint8_t> list64((const uint8_t *)&header64, (const uint8_t *)(&header64 + 1));
+   std::vector<uint8_t> contents64;
+   for (size_t i = 0; i < count64; ++i) {
+      const Range &range = g_Ranges64[i];
+      MDMemoryDescriptor64 descriptor;
+      descriptor.StartOfMemoryRange = range.Start;
+      descriptor.DataSize = range.Size;
+      p = (const uint8_t *)&descriptor;
+      list64.insert(list64.end(), p, p + sizeof descriptor);
+      for (uint64_t j = 0; j < range.Size; ++j) {
+         contents64.push_back(Contents(range.Tag, range.Start + j));
+      }
+   }
+   uint32_t baseRva = builder.Size() + (uint32_t)list64.size();
+   memcpy(list64.data() + offsetof(MDRawMemory64List, BaseRva), &baseRva, sizeof baseRva);
+   builder.AddStream(MD_MEMORY_64_LIST_STREAM, list64.data(), list64.size());
+   builder.Add(contents64.data(), contents64.size());
+
+   /* A module, named with characters outside the BMP. */
+   const uint16_t name[] = {'l', 'i', 'b', 0xd83d, 0xde00, 0xe9, '.', 's', 'o'};
+   uint32_t length = sizeof name;
+   uint32_t nameRva = builder.Add(&length, sizeof length);
+   builder.Add(name, sizeof name);
+
+   struct {
+      uint32_t NumberOfModules;
+      MDRawModule Module;
+   } modules;
+   memset(&modules, 0, sizeof modules);
+   modules.NumberOfModules = 1;
+   modules.Module.BaseOfImage = 0x400000;
+   modules.Module.SizeOfImage = 0x1000;
+   modules.Module.ModuleNameRva = nameRva;
+   builder.AddStream(MD_MODULE_LIST_STREAM, &modules, sizeof modules);
+
+   return builder.Finish();
+}
+
+
+static MinidumpFile *
+OpenBuffer(const std::string &Dir, const std::vector<uint8_t> &File)
+{
+   std::string path = Dir + "/test.dmp";
+   CHECK(WriteFile(path, File.data(), File.size()));
+   return MinidumpFile::Open(path.c_str());
+}
+
+
+static void
+TestMemory(const std::string &Dir)
+{
+   MinidumpFile *dump = OpenBuffer(Dir, BuildMemoryDump());
+   CHECK(dump != NULL);
+   if (!dump) {
+      return;
+   }
+
+   CHECK(!dump->Compressed());
+   CHECK(dump->MemoryRanges().size() == 5);
+   CHECK(dump->Memory64Ranges().size() == 2);
+
+   /* Every byte, from the block that must win. */
+   for (uint64_t address = 0xf00; address < 0x6200; ++address) {
+      uint8_t byte = 0;
+      char tag = ExpectedTag(address);
+      size_t read = dump->ReadMemory(address, &byte, 1);
+      CHECK(read == (tag ? 1U : 0U));
+      if (tag && read) {
+         CHECK(byte == Contents(tag, address));
+      }
+      const uint8_t *p = dump->GetMemory(address, 1);
+      CHECK((p != NULL) == (tag != 0));
+      if (p && tag) {
+         CHECK(*p == Contents(tag, address));
+      }
+   }
+
+   /* Reads span adjacent blocks, and stop at gaps. */
+   std::vector<uint8_t> buffer(0x4000);
+   CHECK(dump->ReadMemory(0x1000, buffer.data(), 0x3000) == 0x3000);
+   CHECK(buffer[0x1fff] == Contents('A', 0x2fff));
+   CHECK(buffer[0x2000] == Contents('D', 0x3000));
+   CHECK(dump->ReadMemory(0x3f00, buffer.data(), 0x200) == 0x100);
+   CHECK(dump->ReadMemory(0x5f00, buffer.data(), 0x200) == 0x200);
+   CHECK(dump->ReadMemory(0xfff, buffer.data(), 2) == 0);
+
+   /* Pointers only within a single block. */
+   CHECK(dump->GetMemory(0x2f80, 0x100) == NULL);
+   CHECK(dump->GetMemory(0x3000, 0x1000) != NULL);
+   CHECK(dump->GetMemory(0x3000, 0x1001) == NULL);
+
+   MinidumpArray<MDRawModule> modules = dump->Modules();
+   CHECK(modules.size() == 1);
+   if (modules.size() == 1) {
+      CHECK(dump->ModuleName(modules[0]) == "lib\xf0\x9f\x98\x80\xc3\xa9.so");
+   }
+   CHECK(dump->Threads().empty());
+   CHECK(dump->Exception() == NULL);
+
+   delete dump;
+}
+
+
+static void
+TestMalformed(const std::string &Dir)
+{
+   std::vector<uint8_t> file = BuildMemoryDump();
+   MDRawHeader header;
+   memcpy(&header, file.data(), sizeof header);
+
+   /* Truncated files lose their directory. */
+   std::vector<uint8_t> truncated(file.begin(), file.end() - 1);
+   MinidumpFile *dump = OpenBuffer(Dir, truncated);
+   CHECK(dump == NULL);
+   delete dump;
+
+   truncated.assign(file.begin(), file.begin() + sizeof header - 1);
+   dump = OpenBuffer(Dir, truncated);
+   CHECK(dump == NULL);
+   delete dump;
+
+   std::vector<uint8_t> bad(file);
+   bad[0] ^= 1;
+   dump = OpenBuffer(Dir, bad);
+   CHECK(dump == NULL);
+   delete dump;
+
+   /* Lists claiming more entries than their stream holds are ignored. */
+   bad = file;
+   const MDRawDirectory *directory = (const MDRawDirectory *)(bad.data() + header.StreamDirectoryRva);
+   for (uint32_t i = 0; i < header.NumberOfStreams; ++i) {
+      uint8_t *stream = bad.data() + directory[i].Location.Rva;
+      if (directory[i].StreamType == MD_MEMORY_LIST_STREAM) {
+         uint32_t count = 6;
+         memcpy(stream, &count, sizeof count);
+      } else if (directory[i].StreamType == MD_MEMORY_64_LIST_STREAM) {
+         uint64_t count = 0x1000000000000000ULL;
+         memcpy(stream, &count, sizeof count);
+      }
+   }
+   dump = OpenBuffer(Dir, bad);
+   CHECK(dump != NULL);
+   if (dump) {
+      uint8_t byte;
+      CHECK(dump->MemoryRanges().empty());
+      CHECK(dump->Memory64Ranges().empty());
+      CHECK(dump->ReadMemory(0x1000, &byte, 1) == 0);
+      delete dump;
+   }
+
+   /* Blocks pointing outside the file are dropped. */
+   bad = file;
+   for (uint32_t i = 0; i < header.NumberOfStreams; ++i) {
+      if (directory[i].StreamType == MD_MEMORY_LIST_STREAM) {
+         MDMemoryDescriptor *descriptors = (MDMemoryDescriptor *)
+            (bad.data() + directory[i].Location.Rva + sizeof(MDRawMemoryList));
+         descriptors[3].Memory.Rva = (uint32_t)bad.size() - 0x10;
+      }
+   }
+   dump = OpenBuffer(Dir, bad);
+   CHECK(dump != NULL);
+   if (dump) {
+      uint8_t byte;
+      CHECK(dump->ReadMemory(0x3000, &byte, 1) == 0);
+      CHECK(dump->ReadMemory(0x2fff, &byte, 1) == 1);
+      delete dump;
+   }
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestMemory(dir);
+   TestMalformed(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,347 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the structured report encodings.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "outputtail.h"
+#include "report.h"
+#include "test.h"
+
+
+/*
+ * Logs the calls made on it, one per line.
+ */
+class LogWriter : public ReportWriter
+{
+public:
+   std::string Log;
+
+   void
+   BeginProcess(uint32_t Pid, const char *Name)
+   {
+      Printf("process %u %s\n", Pid, Str(Name));
+   }
+
+   void
+   Exception(const ReportException &exception)
+   {
+      Printf("exception %u %u %llx %s\n", exception.Code, exception.Chance,
+             (unsigned long long)exception.Address, Str(exception.Reason));
+   }
+
+   void
+   Module(const ReportModule &module)
+   {
+      Printf("module %llx %llx %s %s %s\n",
+             (unsigned long long)module.Base, (unsigned long long)module.End,
+             Str(module.Name), Str(module.Path), Str(module.BuildId));
+   }
+
+   void
+   Output(uint64_t Time, unsigned Stream, const char *Text, size_t Size)
+   {
+      Printf("output %llu %u %zu ", (unsigned long long)Time, Stream, Size);
+      Log.append(Text, Size);
+      Log += '\n';
+   }
+
+   void
+   BeginThread(uint32_t Tid, const char *Name, bool Current)
+   {
+      Printf("thread %u %s %d\n", Tid, Str(Name), Current);
+   }
+
+   void
+   Register(const char *Name, uint64_t Value)
+   {
+      Printf("register %s %llx\n", Str(Name), (unsigned long long)Value);
+   }
+
+   void
+   Frame(const ReportFrame &frame)
+   {
+      Printf("frame %llx %llx %s %llx %s %llx %s %u %d\n",
+             (unsigned long long)frame.Pc, (unsigned long long)frame.Sp,
+             Str(frame.Module), (unsigned long long)frame.Offset,
+             Str(frame.Function), (unsigned long long)frame.Displacement,
+             Str(frame.File), frame.Line, frame.Inline);
+   }
+
+   void
+   EndThread(void)
+   {
+      Log += "end thread\n";
+   }
+
+   void
+   EndProcess(int ExitCode)
+   {
+      Printf("end %d\n", ExitCode);
+   }
+
+private:
+   static const char *
+   Str(const char *s)
+   {
+      return s ? s : "(null)";
+   }
+
+   void
+   Printf(const char *Format, ...)
+   {
+      char buffer[1024];
+      va_list ap;
+      va_start(ap, Format);
+      vsnprintf(buffer, sizeof buffer, Format, ap);
+      va_end(ap);
+      Log += buffer;
+   }
+};
+
+
+static std::string g_Output;
+
+
+static void
+WriteSample(ReportWriter *writer)
+{
+   writer->BeginProcess(1234, "crasher");
+
+   ReportException exception = {11, 0, ~0ULL, "Segmentation fault"};
+   writer->Exception(exception);
+
+   ReportModule module = {0x400000, 0x401000, "crasher", "/tmp/crasher", "0123abcd"};
+   writer->Module(module);
+   ReportModule anonymous = {0x7f0000000000ULL, 0x7f0000001000ULL, NULL, NULL, NULL};
+   writer->Module(anonymous);
+
+   /* Output of all sizes and contents, embedded NULs included. */
+   g_Output.assign("a\"b\\c\n\t\x01\x7f\xc3\xa9");
+   g_Output += '\0';
+   writer->Output(5, OUTPUT_STDOUT, g_Output.data(), g_Output.size());
+   std::string large(200000, 'x');
+   writer->Output(~0ULL, OUTPUT_STDERR, large.data(), large.size());
+
+   writer->BeginThread(1234, "main", true);
+   writer->Register("rip", 0x401234);
+   writer->Register("rsp", ~0ULL);
+   ReportFrame inlined = {0x401234, 0x7ffc0000, "crasher", 0x1234, "inner", 0, "a.c", 12, true};
+   writer->Frame(inlined);
+   ReportFrame unknown = {0x1, 0x2, NULL, 0, NULL, 0, NULL, 0, false};
+   writer->Frame(unknown);
+   writer->EndThread();
+
+   writer->BeginThread(1235, NULL, false);
+   writer->EndThread();
+
+   writer->EndProcess(-1);
+}
+
+
+static std::string
+ExpectedLog(void)
+{
+   LogWriter log;
+   WriteSample(&log);
+   return log.Log;
+}
+
+
+static std::string
+EncodeBinary(void)
+{
+   FILE *fp = tmpfile();
+   ReportWriter *writer = ReportWriter::Create(fp, REPORT_BINARY);
+   WriteSample(writer);
+   delete writer;
+
+   std::string data;
+   rewind(fp);
+   int c;
+   while ((c = fgetc(fp)) != EOF) {
+      data += (char)c;
+   }
+   fclose(fp);
+   return data;
+}
+
+
+static bool
+Decode(const std::string &Data, std::string &Log)
+{
+   FILE *fp = tmpfile();
+   fwrite(Data.data(), 1, Data.size(), fp);
+   rewind(fp);
+   LogWriter log;
+   bool ok = ReadReport(fp, &log);
+   fclose(fp);
+   Log = log.Log;
+   return ok;
+}
+
+
+static void
+TestBinary(void)
+{
+   std::string expected = ExpectedLog();
+   std::string data = EncodeBinary();
+   CHECK(data.compare(0, 5, REPORT_MAGIC "\x01") == 0);
+
+   /* Unknown strings come back as NULL, as they are encoded empty. */
+   std::string log;
+   CHECK(Decode(data, log));
+   CHECK(log == expected);
+
+   /* Records of later versions are skipped. */
+   std::string newer = data;
+   newer.insert(5, std::string("\xc8\x03xyz", 5));
+   CHECK(Decode(newer, log) && log == expected);
+
+   /* So are fields appended to known records. */
+   size_t process = 5;
+   CHECK(data[process] == REPORT_TAG_PROCESS);
+   std::string longer = data;
+   longer[process + 1] += 2;
+   longer.insert(process + 2 + data[process + 1], "\x05\x06", 2);
+   CHECK(Decode(longer, log) && log == expected);
+
+   for (size_t size = 0; size < data.size(); size += size < 100 ? 1 : 997) {
+      CHECK(!Decode(data.substr(0, size), log));
+   }
+
+   std::string bad = data;
+   bad[0] = 'X';
+   CHECK(!Decode(bad, log));
+   bad = data;
+   bad[4] = REPORT_VERSION + 1;
+   CHECK(!Decode(bad, log));
+   bad = data.substr(0, 5) + std::string("\x01\xff\xff\xff\xff\x0f", 6);
+   CHECK(!Decode(bad, log));
+}
+
+
+/*
+ * Whether brackets nest, outside of strings.
+ */
+static bool
+Balanced(const std::string &Json)
+{
+   std::string stack;
+   bool inString = false;
+   for (size_t i = 0; i < Json.size(); ++i) {
+      char c = Json[i];
+      if (inString) {
+         if (c == '\\') {
+            ++i;
+         } else if (c == '"') {
+            inString = false;
+         } else if ((unsigned char)c < 0x20) {
+            return false;
+         }
+      } else if (c == '"') {
+         inString = true;
+      } else if (c == '{' || c == '[') {
+         stack += c == '{' ? '}' : ']';
+      } else if (c == '}' || c == ']') {
+         if (stack.empty() || stack[stack.size() - 1] != c) {
+            return false;
+         }
+         stack.erase(stack.size() - 1);
+      }
+   }
+   return stack.empty() && !inString;
+}
+
+
+static bool
+Contains(const std::string &Json, const char *Text)
+{
+   return Json.find(Text) != std::string::npos;
+}
+
+
+static void
+TestJson(void)
+{
+   char *buffer = NULL;
+   size_t size = 0;
+   FILE *fp = open_memstream(&buffer, &size);
+   ReportWriter *writer = ReportWriter::Create(fp, REPORT_JSON);
+   WriteSample(writer);
+   delete writer;
+   fclose(fp);
+   std::string json(buffer, size);
+   free(buffer);
+
+   CHECK(Balanced(json));
+   CHECK(json.compare(0, 9, "{\"pid\": 1") == 0);
+   CHECK(json[json.size() - 2] == '}' && json[json.size() - 1] == '\n');
+   CHECK(Contains(json, "\"address\": \"0xffffffffffffffff\""));
+   CHECK(Contains(json, "\"name\": null, \"path\": null, \"build_id\": null"));
+   CHECK(Contains(json, "\"text\": \"a\\\"b\\\\c\\n\\t\\u0001\x7f\xc3\xa9\\u0000\""));
+   CHECK(Contains(json, "\"stream\": \"stderr\""));
+   CHECK(Contains(json, "\"time\": 18446744073709551615"));
+   CHECK(Contains(json, "\"registers\": { \"rip\": \"0x401234\", \"rsp\": \"0xffffffffffffffff\"}"));
+   CHECK(Contains(json, "\"line\": 12, \"inline\": true}"));
+   CHECK(Contains(json, "{\"tid\": 1235, \"name\": null, \"current\": false}"));
+   CHECK(Contains(json, "\"exit_code\": -1}"));
+
+   /* Converting the binary encoding gives the same. */
+   std::string data = EncodeBinary();
+   FILE *in = tmpfile();
+   fwrite(data.data(), 1, data.size(), in);
+   rewind(in);
+   fp = open_memstream(&buffer, &size);
+   writer = ReportWriter::Create(fp, REPORT_JSON);
+   CHECK(ReadReport(in, writer));
+   delete writer;
+   fclose(fp);
+   fclose(in);
+   CHECK(std::string(buffer, size) == json);
+   free(buffer);
+}
+
+
+int
+main(void)
+{
+   TestBinary();
+   TestJson();
+
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
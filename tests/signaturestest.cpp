@@ -0,0 +1,163 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the crash signature database.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <string>
+#include <vector>
+
+#include "signatures.h"
+#include "test.h"
+
+
+static std::string
+ReadText(const std::string &Path)
+{
+   std::string text;
+   FILE *fp = fopen(Path.c_str(), "r");
+   if (fp) {
+      int c;
+      while ((c = fgetc(fp)) != EOF) {
+         text += (char)c;
+      }
+      fclose(fp);
+   }
+   return text;
+}
+
+
+static void
+TestCounts(const std::string &Dir)
+{
+   std::string path = Dir + "/signatures";
+   const char *db = path.c_str();
+
+   CHECK(CountSignature(db, "SIGSEGV foo!main+0x10") == 0);
+   CHECK(CountSignature(db, "SIGSEGV foo!main+0x10") == 1);
+   CHECK(CountSignature(db, "SIGABRT libc!abort") == 0);
+   CHECK(CountSignature(db, "SIGSEGV foo!main+0x10") == 2);
+
+   /* Signatures are matched whole, blanks included. */
+   CHECK(CountSignature(db, "SIGSEGV foo!main+0x1") == 0);
+   CHECK(CountSignature(db, " SIGSEGV foo!main+0x10") == 0);
+   CHECK(CountSignature(db, " SIGSEGV foo!main+0x10") == 1);
+   CHECK(CountSignature(db, "") == 0);
+   CHECK(CountSignature(db, "") == 1);
+
+   /* Line breaks cannot split an entry. */
+   CHECK(CountSignature(db, "HANG a\nb\r\nc") == 0);
+   CHECK(CountSignature(db, "HANG a b  c") == 1);
+
+   /* Longer than the read buffer. */
+   std::string longSignature = "SIGBUS " + std::string(5000, 'z');
+   CHECK(CountSignature(db, longSignature) == 0);
+   CHECK(CountSignature(db, longSignature) == 1);
+
+   std::string text = ReadText(path);
+   CHECK(text.compare(0, 2, "3 ") == 0);
+   size_t lines = 0;
+   for (size_t i = 0; i < text.size(); ++i) {
+      lines += text[i] == '\n';
+   }
+   CHECK(lines == 7);
+
+   /* Lines that do not parse are dropped, the others kept. */
+   FILE *fp = fopen(db, "a");
+   CHECK(fp != NULL);
+   if (fp) {
+      fputs("garbage\n1 2\n\n", fp);
+      fclose(fp);
+   }
+   CHECK(CountSignature(db, "SIGABRT libc!abort") == 1);
+   CHECK(CountSignature(db, "garbage") == 0);
+
+   std::string missing = Dir + "/missing/signatures";
+   CHECK(CountSignature(missing.c_str(), "SIGSEGV") == -1);
+}
+
+
+/*
+ * Processes counting at the same time all get counted.
+ */
+static void
+TestConcurrency(const std::string &Dir)
+{
+   std::string path = Dir + "/shared";
+   const unsigned processes = 8;
+   const unsigned counts = 25;
+
+   std::vector<pid_t> children;
+   for (unsigned i = 0; i < processes; ++i) {
+      pid_t pid = fork();
+      if (pid == 0) {
+         bool ok = true;
+         for (unsigned j = 0; j < counts; ++j) {
+            ok = ok && CountSignature(path.c_str(), "SIGSEGV shared") >= 0;
+            ok = ok && CountSignature(path.c_str(), i % 2 ? "odd" : "even") >= 0;
+         }
+         _exit(ok ? 0 : 1);
+      }
+      CHECK(pid > 0);
+      children.push_back(pid);
+   }
+
+   for (size_t i = 0; i < children.size(); ++i) {
+      int status = 0;
+      CHECK(waitpid(children[i], &status, 0) == children[i]);
+      CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   }
+
+   CHECK(CountSignature(path.c_str(), "SIGSEGV shared") == processes * counts);
+   CHECK(CountSignature(path.c_str(), "odd") == processes / 2 * counts);
+   CHECK(CountSignature(path.c_str(), "even") == processes / 2 * counts);
+
+   /* No temporary files left behind. */
+   std::string command = "test -z \"$(ls '" + Dir + "' | grep tmp)\"";
+   CHECK(system(command.c_str()) == 0);
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestCounts(dir);
+   TestConcurrency(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,337 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the snapshot file format.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "elfimage.h"
+#include "snapshot.h"
+#include "test.h"
+
+
+static std::string
+SelfPath(void)
+{
+   char path[4096];
+   ssize_t length = readlink("/proc/self/exe", path, sizeof path - 1);
+   if (length < 0) {
+      return std::string();
+   }
+   return std::string(path, length);
+}
+
+
+static std::string
+ReadText(const std::string &Path)
+{
+   std::string text;
+   FILE *fp = fopen(Path.c_str(), "rb");
+   if (fp) {
+      char buffer[65536];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof buffer, fp)) > 0) {
+         text.append(buffer, size);
+      }
+      fclose(fp);
+   }
+   return text;
+}
+
+
+static bool
+CopyFile(const std::string &From, const std::string &To)
+{
+   std::string data = ReadText(From);
+   return !data.empty() && WriteFile(To, data.data(), data.size());
+}
+
+
+static void
+FillRegs(struct user_regs_struct &Regs, unsigned Seed)
+{
+   unsigned char *bytes = (unsigned char *)&Regs;
+   for (size_t i = 0; i < sizeof Regs; ++i) {
+      bytes[i] = (unsigned char)(Seed * 31 + i);
+   }
+}
+
+
+static SnapshotThread
+MakeThread(pid_t Tid, const char *Name, unsigned FrameCount)
+{
+   SnapshotThread thread;
+   thread.Tid = Tid;
+   thread.Name = Name;
+   FillRegs(thread.Regs, Tid);
+   for (unsigned i = 0; i < FrameCount; ++i) {
+      StackFrame frame;
+      frame.Pc = 0x400000 + Tid * 0x1000 + i * 0x10;
+      frame.Sp = 0x7ffd0000 + i * 0x40;
+      frame.Signal = i == 1;
+      thread.Frames.push_back(frame);
+   }
+   return thread;
+}
+
+
+/*
+ * A snapshot of a made-up process, whose main module is a copy of this
+ * test at ModulePath.
+ */
+static Snapshot *
+MakeSnapshot(const std::string &ModulePath)
+{
+   std::vector<std::string> debugDirs;
+   Snapshot *snapshot = new Snapshot;
+
+   snapshot->Pid = 1234;
+   snapshot->CurrentTid = 1236;
+   snapshot->HaveSigInfo = true;
+   memset(&snapshot->SigInfo, 0, sizeof snapshot->SigInfo);
+   snapshot->SigInfo.si_signo = SIGSEGV;
+   snapshot->SigInfo.si_code = SEGV_MAPERR;
+   snapshot->SigInfo.si_addr = (void *)0xdeadbeef;
+   snapshot->CodeAddress = 0x401234;
+   for (unsigned i = 0; i < 16; ++i) {
+      snapshot->Code.push_back((uint8_t)(0xc0 + i));
+   }
+
+   Module module;
+   module.Base = 0x400000;
+   module.End = 0x480000;
+   module.Bias = 0;
+   module.Path = ModulePath;
+   module.Name = "main";
+   module.Image = ElfImage::OpenShared(ModulePath, std::string(), debugDirs);
+   snapshot->Modules.push_back(module);
+
+   module.Base = 0x7fff0000;
+   module.End = 0x7fff2000;
+   module.Bias = 0x7fff0000;
+   module.Path = "[vdso]";
+   module.Name = "vdso";
+   module.Image = NULL;
+   snapshot->Modules.push_back(module);
+
+   snapshot->Threads.push_back(MakeThread(1234, "main", 5));
+   snapshot->Threads.push_back(MakeThread(1236, "worker", 3));
+   snapshot->Threads.push_back(MakeThread(1237, "", 0));
+
+   return snapshot;
+}
+
+
+static void
+TestRoundTrip(const std::string &Dir)
+{
+   std::vector<std::string> debugDirs;
+   std::string modulePath = Dir + "/a.out";
+   std::string path = Dir + "/round.snap";
+
+   CHECK(CopyFile(SelfPath(), modulePath));
+
+   Snapshot *original = MakeSnapshot(modulePath);
+   CHECK(original->Modules[0].Image != NULL);
+   CHECK(original->Write(path.c_str()));
+
+   Snapshot *copy = Snapshot::Read(path.c_str(), debugDirs);
+   CHECK(copy != NULL);
+   if (!copy) {
+      delete original;
+      return;
+   }
+
+   CHECK(copy->Pid == original->Pid);
+   CHECK(copy->CurrentTid == original->CurrentTid);
+   CHECK(copy->HaveSigInfo);
+   CHECK(copy->SigInfo.si_signo == SIGSEGV);
+   CHECK(copy->SigInfo.si_code == SEGV_MAPERR);
+   CHECK(copy->SigInfo.si_addr == (void *)0xdeadbeef);
+   CHECK(copy->CodeAddress == original->CodeAddress);
+   CHECK(copy->Code == original->Code);
+
+   CHECK(copy->Modules.size() == original->Modules.size());
+   for (size_t i = 0; i < copy->Modules.size() && i < original->Modules.size(); ++i) {
+      const Module &a = original->Modules[i];
+      const Module &b = copy->Modules[i];
+      CHECK(b.Base == a.Base);
+      CHECK(b.End == a.End);
+      CHECK(b.Bias == a.Bias);
+      CHECK(b.Path == a.Path);
+      CHECK(!b.Name.empty());
+   }
+
+   /* Absolute paths are opened again, and share the writer's image. */
+   if (copy->Modules.size() == 2) {
+      CHECK(copy->Modules[0].Image == original->Modules[0].Image);
+      CHECK(copy->Modules[1].Image == NULL);
+   }
+
+   CHECK(copy->Threads.size() == original->Threads.size());
+   for (size_t i = 0; i < copy->Threads.size() && i < original->Threads.size(); ++i) {
+      const SnapshotThread &a = original->Threads[i];
+      const SnapshotThread &b = copy->Threads[i];
+      CHECK(b.Tid == a.Tid);
+      CHECK(b.Name == a.Name);
+      CHECK(memcmp(&b.Regs, &a.Regs, sizeof a.Regs) == 0);
+      CHECK(b.Frames.size() == a.Frames.size());
+      for (size_t j = 0; j < b.Frames.size() && j < a.Frames.size(); ++j) {
+         CHECK(b.Frames[j].Pc == a.Frames[j].Pc);
+         CHECK(b.Frames[j].Sp == a.Frames[j].Sp);
+         CHECK(b.Frames[j].Signal == a.Frames[j].Signal);
+      }
+   }
+
+   /* The current thread's code is all the memory a snapshot holds. */
+   uint8_t byte = 0;
+   CHECK(copy->ReadMemory(0x401234 + 3, &byte, 1) == 1 && byte == 0xc3);
+   CHECK(copy->ReadMemory(0x401234 + 16, &byte, 1) == 0);
+   CHECK(copy->ReadMemory(0x401233, &byte, 1) == 0);
+
+   delete copy;
+   delete original;
+}
+
+
+/*
+ * A module whose file was since replaced by a different build must not be
+ * symbolized with the wrong image.
+ */
+static void
+TestBuildIdMismatch(const std::string &Dir)
+{
+   std::vector<std::string> debugDirs;
+   std::string modulePath = Dir + "/b.out";
+   std::string path = Dir + "/mismatch.snap";
+
+   CHECK(CopyFile(SelfPath(), modulePath));
+
+   Snapshot *original = MakeSnapshot(modulePath);
+   CHECK(original->Modules[0].Image != NULL);
+   CHECK(!original->Modules[0].Image->BuildId().empty());
+   CHECK(original->Write(path.c_str()));
+   delete original;
+
+   CHECK(CopyFile("/bin/true", modulePath));
+
+   Snapshot *copy = Snapshot::Read(path.c_str(), debugDirs);
+   CHECK(copy != NULL);
+   if (copy) {
+      CHECK(copy->Modules.size() == 2);
+      CHECK(copy->Modules.size() != 2 || copy->Modules[0].Image == NULL);
+      CHECK(copy->Threads.size() == 3);
+      delete copy;
+   }
+}
+
+
+static void
+TestMalformed(const std::string &Dir)
+{
+   std::vector<std::string> debugDirs;
+   std::string modulePath = Dir + "/c.out";
+   std::string path = Dir + "/good.snap";
+   std::string bad = Dir + "/bad.snap";
+
+   CHECK(CopyFile(SelfPath(), modulePath));
+
+   Snapshot *original = MakeSnapshot(modulePath);
+   CHECK(original->Write(path.c_str()));
+   delete original;
+
+   std::string data = ReadText(path);
+   CHECK(!data.empty());
+
+   /* Every truncation is rejected. */
+   bool allRejected = true;
+   for (size_t size = 0; size < data.size(); ++size) {
+      WriteFile(bad, data.data(), size);
+      Snapshot *snapshot = Snapshot::Read(bad.c_str(), debugDirs);
+      if (snapshot) {
+         fprintf(stderr, "error: snapshot truncated to %zu bytes was accepted\n", size);
+         allRejected = false;
+         delete snapshot;
+      }
+   }
+   CHECK(allRejected);
+
+   /* Header fields: magic, version and code size. */
+   static const size_t offsets[] = { 0, 8, 40 };
+   for (size_t i = 0; i < sizeof offsets / sizeof offsets[0]; ++i) {
+      std::string corrupt = data;
+      corrupt[offsets[i]] ^= 0x7f;
+      WriteFile(bad, corrupt.data(), corrupt.size());
+      Snapshot *snapshot = Snapshot::Read(bad.c_str(), debugDirs);
+      CHECK(snapshot == NULL);
+      delete snapshot;
+   }
+
+   /* Huge counts and string sizes fail without allocating them. */
+   static const size_t countOffsets[] = { 24, 28 };
+   for (size_t i = 0; i < sizeof countOffsets / sizeof countOffsets[0]; ++i) {
+      std::string corrupt = data;
+      memset(&corrupt[countOffsets[i]], 0xff, 4);
+      WriteFile(bad, corrupt.data(), corrupt.size());
+      Snapshot *snapshot = Snapshot::Read(bad.c_str(), debugDirs);
+      CHECK(snapshot == NULL);
+      delete snapshot;
+   }
+
+   /* The first module's path size follows the header and three addresses. */
+   std::string corrupt = data;
+   memset(&corrupt[176 + 24], 0xff, 4);
+   WriteFile(bad, corrupt.data(), corrupt.size());
+   Snapshot *snapshot = Snapshot::Read(bad.c_str(), debugDirs);
+   CHECK(snapshot == NULL);
+   delete snapshot;
+
+   CHECK(Snapshot::Read((Dir + "/missing.snap").c_str(), debugDirs) == NULL);
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestRoundTrip(dir);
+   TestBuildIdMismatch(dir);
+   TestMalformed(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
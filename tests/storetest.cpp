@@ -0,0 +1,252 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the content addressed dump store.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#include "dumpstore.h"
+#include "minidumpbuilder.h"
+#include "test.h"
+
+
+static uint32_t g_Seed = 1;
+
+static std::vector<uint8_t>
+RandomBytes(size_t Size)
+{
+   std::vector<uint8_t> data(Size);
+   for (size_t i = 0; i < Size; ++i) {
+      g_Seed = g_Seed * 1103515245 + 12345;
+      data[i] = (uint8_t)(g_Seed >> 16);
+   }
+   return data;
+}
+
+
+static std::string
+ReadText(const std::string &Path)
+{
+   std::string text;
+   FILE *fp = fopen(Path.c_str(), "rb");
+   if (fp) {
+      char buffer[65536];
+      size_t size;
+      while ((size = fread(buffer, 1, sizeof buffer, fp)) > 0) {
+         text.append(buffer, size);
+      }
+      fclose(fp);
+   }
+   return text;
+}
+
+
+static bool
+FileExists(const std::string &Path)
+{
+   struct stat st;
+   return stat(Path.c_str(), &st) == 0;
+}
+
+
+/*
+ * Memory ranges shared by the dumps: pages of code, a run of zero pages,
+ * and a range larger than a chunk, starting off a page boundary.
+ */
+struct Memory
+{
+   std::vector<uint64_t> Starts;
+   std::vector<std::vector<uint8_t> > Contents;
+};
+
+static Memory
+SampleMemory(void)
+{
+   Memory memory;
+   memory.Starts.push_back(0x400000);
+   memory.Contents.push_back(RandomBytes(5 * 4096));
+   memory.Starts.push_back(0x7f0000000000ULL);
+   memory.Contents.push_back(std::vector<uint8_t>(16 * 4096, 0));
+   memory.Starts.push_back(0x601800);
+   memory.Contents.push_back(RandomBytes(200 * 1024 + 123));
+   return memory;
+}
+
+
+/*
+ * A minidump of the memory, preceded by Padding bytes, so that it lands
+ * at other file offsets.
+ */
+static std::vector<uint8_t>
+BuildDump(const Memory &memory, size_t Padding)
+{
+   MinidumpBuilder builder;
+   std::vector<uint8_t> padding = RandomBytes(Padding);
+   builder.AddStream(0xffff, padding.data(), padding.size());
+   builder.AddMemoryList(memory.Starts, memory.Contents);
+   return builder.Finish();
+}
+
+
+static bool
+StoreBuffer(const std::string &Dir, const std::string &Store, const std::vector<uint8_t> &Dump,
+            const char *Name, StoreStats *Stats)
+{
+   std::string path = Dir + "/input.dmp";
+   CHECK(WriteFile(path, Dump.data(), Dump.size()));
+   return StoreDump(Store.c_str(), path.c_str(), Name, Stats);
+}
+
+
+static bool
+Rehydrates(const std::string &Dir, const std::string &Store, const char *Name,
+           const std::vector<uint8_t> &Expected)
+{
+   std::string output = Dir + "/output.dmp";
+   unlink(output.c_str());
+   if (!RehydrateDump(Store.c_str(), Name, output.c_str())) {
+      CHECK(!FileExists(output));
+      return false;
+   }
+   std::string text = ReadText(output);
+   return text.size() == Expected.size() &&
+          memcmp(text.data(), Expected.data(), text.size()) == 0;
+}
+
+
+static void
+TestDedup(const std::string &Dir)
+{
+   std::string store = Dir + "/store";
+   Memory memory = SampleMemory();
+   std::vector<uint8_t> one = BuildDump(memory, 100);
+   std::vector<uint8_t> two = BuildDump(memory, 777);
+
+   StoreStats stats;
+   CHECK(StoreBuffer(Dir, store, one, "one", &stats));
+   CHECK(stats.Size == one.size());
+   CHECK(stats.Chunks > stats.NewChunks);
+   CHECK(stats.NewBytes < one.size());
+   CHECK(Rehydrates(Dir, store, "one", one));
+
+   /* The same pages at other offsets are not stored again. */
+   CHECK(StoreBuffer(Dir, store, two, "two", &stats));
+   CHECK(stats.NewChunks <= 4);
+   CHECK(stats.NewBytes < 8192);
+   CHECK(Rehydrates(Dir, store, "two", two));
+   CHECK(Rehydrates(Dir, store, "one", one));
+
+   /* Block compressed dumps are stored as the minidump they hold. */
+   std::vector<uint8_t> compressed = CompressBlocks(two, 4096);
+   CHECK(StoreBuffer(Dir, store, compressed, "compressed", &stats));
+   CHECK(stats.Size == two.size() && stats.NewChunks == 0);
+   CHECK(Rehydrates(Dir, store, "compressed", two));
+
+   /* Names are replaced. */
+   CHECK(StoreBuffer(Dir, store, two, "one", &stats));
+   CHECK(Rehydrates(Dir, store, "one", two));
+
+   CHECK(!StoreBuffer(Dir, store, one, "", &stats));
+   CHECK(!StoreBuffer(Dir, store, one, ".hidden", &stats));
+   CHECK(!StoreBuffer(Dir, store, one, "a/b", &stats));
+   CHECK(!Rehydrates(Dir, store, "missing", one));
+   CHECK(!Rehydrates(Dir, store, "../lock", one));
+
+   std::string notADump = "not a minidump";
+   CHECK(!StoreBuffer(Dir, store, std::vector<uint8_t>(notADump.begin(), notADump.end()),
+                      "bad", &stats));
+}
+
+
+static void
+TestDamage(const std::string &Dir)
+{
+   std::string store = Dir + "/damaged";
+   Memory memory = SampleMemory();
+   std::vector<uint8_t> one = BuildDump(memory, 10);
+
+   StoreStats stats;
+   CHECK(StoreBuffer(Dir, store, one, "one", &stats));
+
+   /* A writer died in the middle of an index record. */
+   struct stat st;
+   std::string index = store + "/index";
+   CHECK(stat(index.c_str(), &st) == 0);
+   CHECK(truncate(index.c_str(), st.st_size - 10) == 0);
+   CHECK(!Rehydrates(Dir, store, "one", one));
+   CHECK(StoreBuffer(Dir, store, one, "again", &stats));
+   CHECK(stats.NewChunks == 1);
+   CHECK(Rehydrates(Dir, store, "one", one));
+   CHECK(Rehydrates(Dir, store, "again", one));
+
+   /* Corrupt chunks are detected, not passed on. */
+   std::string data = store + "/data";
+   FILE *fp = fopen(data.c_str(), "r+b");
+   CHECK(fp != NULL);
+   if (fp) {
+      fseek(fp, 100, SEEK_SET);
+      int c = fgetc(fp);
+      fseek(fp, 100, SEEK_SET);
+      fputc(c ^ 0xff, fp);
+      fclose(fp);
+   }
+   CHECK(!Rehydrates(Dir, store, "one", one));
+
+   /* As are manifests claiming more entries than they hold. */
+   std::string manifest = store + "/dumps/again";
+   fp = fopen(manifest.c_str(), "r+b");
+   CHECK(fp != NULL);
+   if (fp) {
+      uint32_t count = 0xffffffff;
+      fseek(fp, offsetof(ManifestHeader, Count), SEEK_SET);
+      fwrite(&count, sizeof count, 1, fp);
+      fclose(fp);
+   }
+   CHECK(!Rehydrates(Dir, store, "again", one));
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestDedup(dir);
+   TestDamage(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,315 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Tests for the symbol cache and for sharing ELF images.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <vector>
+
+#include "dwarf.h"
+#include "elfimage.h"
+#include "symcache.h"
+#include "test.h"
+
+
+static bool
+CopyFile(const std::string &From, const std::string &To)
+{
+   std::string command = "cp '" + From + "' '" + To + "'";
+   return system(command.c_str()) == 0;
+}
+
+
+/* This test program, with its own build-id and symbols. */
+static std::string
+SelfPath(void)
+{
+   char path[4096];
+   ssize_t length = readlink("/proc/self/exe", path, sizeof path - 1);
+   if (length < 0) {
+      return std::string();
+   }
+   return std::string(path, length);
+}
+
+
+static bool
+FileExists(const std::string &Path)
+{
+   struct stat st;
+   return stat(Path.c_str(), &st) == 0;
+}
+
+
+/* Whether the file is mapped into this process. */
+static bool
+IsMapped(const std::string &Path)
+{
+   FILE *fp = fopen("/proc/self/maps", "r");
+   if (!fp) {
+      return false;
+   }
+   char line[4096 + 128];
+   bool found = false;
+   while (!found && fgets(line, sizeof line, fp)) {
+      found = strstr(line, Path.c_str()) != NULL;
+   }
+   fclose(fp);
+   return found;
+}
+
+
+static void
+TestSerialization(const std::string &Dir)
+{
+   std::vector<ElfSymbol> symbols;
+   ElfSymbol symbol;
+   symbol.Address = 0x1000; symbol.Size = 0x100; symbol.Name = "first";
+   symbols.push_back(symbol);
+   symbol.Address = 0x1000; symbol.Size = 0; symbol.Name = "alias";
+   symbols.push_back(symbol);
+   symbol.Address = 0x2000; symbol.Size = 0; symbol.Name = "unsized";
+   symbols.push_back(symbol);
+
+   /* f() inlined into g(), inlined in turn at 0x1040..0x1060. */
+   DwarfLineTable lines;
+   lines.Files.push_back("a.c");
+   lines.Files.push_back("b.h");
+   DwarfLine line;
+   line.Address = 0x1000; line.File = 0; line.Line = 10;
+   lines.Lines.push_back(line);
+   line.Address = 0x1040; line.File = 1; line.Line = 20;
+   lines.Lines.push_back(line);
+   line.Address = 0x1100; line.File = DWARF_LINE_END; line.Line = 0;
+   lines.Lines.push_back(line);
+   lines.Names.push_back("g");
+   lines.Names.push_back("f");
+   DwarfInline inl;
+   inl.Parent = DWARF_INLINE_NONE; inl.Name = 0; inl.CallFile = 0; inl.CallLine = 11;
+   lines.Inlines.push_back(inl);
+   inl.Parent = 0; inl.Name = 1; inl.CallFile = 1; inl.CallLine = 21;
+   lines.Inlines.push_back(inl);
+   DwarfInlineRange range;
+   range.Address = 0x1000; range.Inline = DWARF_INLINE_NONE;
+   lines.InlineRanges.push_back(range);
+   range.Address = 0x1040; range.Inline = 1;
+   lines.InlineRanges.push_back(range);
+   range.Address = 0x1060; range.Inline = DWARF_INLINE_NONE;
+   lines.InlineRanges.push_back(range);
+
+   SymbolCache::SetDirectory(Dir);
+   const std::string key = "0123abcd";
+   SymbolCache *created = SymbolCache::Create(key, symbols, lines);
+   CHECK(created != NULL);
+   CHECK(FileExists(Dir + "/01/23abcd.symcache"));
+   SymbolCache *opened = SymbolCache::Open(key);
+   CHECK(opened != NULL);
+   CHECK(SymbolCache::Open("0123abce") == NULL);
+
+   SymbolCache *caches[] = {created, opened};
+   for (unsigned i = 0; i < 2; ++i) {
+      SymbolCache *cache = caches[i];
+      if (!cache) {
+         continue;
+      }
+
+      ElfSymbol found;
+      CHECK(!cache->LookupSymbol(0xfff, &found));
+      CHECK(cache->LookupSymbol(0x1000, &found) && strcmp(found.Name, "first") == 0);
+      CHECK(cache->LookupSymbol(0x10ff, &found) && found.Address == 0x1000);
+      CHECK(!cache->LookupSymbol(0x1100, &found));
+      CHECK(cache->LookupSymbol(0x12345, &found) && strcmp(found.Name, "unsized") == 0);
+
+      std::string fileName;
+      unsigned lineNumber = 0;
+      CHECK(!cache->LookupLine(0xfff, fileName, &lineNumber));
+      CHECK(cache->LookupLine(0x1020, fileName, &lineNumber) &&
+            fileName == "a.c" && lineNumber == 10);
+      CHECK(cache->LookupLine(0x1050, fileName, &lineNumber) &&
+            fileName == "b.h" && lineNumber == 20);
+      CHECK(!cache->LookupLine(0x1100, fileName, &lineNumber));
+
+      std::vector<ElfInline> inlines;
+      cache->LookupInlines(0x1050, inlines);
+      CHECK(inlines.size() == 2);
+      if (inlines.size() == 2) {
+         CHECK(strcmp(inlines[0].Name, "f") == 0 && strcmp(inlines[0].CallFile, "b.h") == 0 &&
+               inlines[0].CallLine == 21);
+         CHECK(strcmp(inlines[1].Name, "g") == 0 && strcmp(inlines[1].CallFile, "a.c") == 0 &&
+               inlines[1].CallLine == 11);
+      }
+      cache->LookupInlines(0x1060, inlines);
+      CHECK(inlines.empty());
+   }
+   delete created;
+   delete opened;
+
+   /* Damaged entries are not used. */
+   std::string path = Dir + "/01/23abcd.symcache";
+   struct stat st;
+   CHECK(stat(path.c_str(), &st) == 0);
+   for (off_t size = st.st_size - 1; size > 0; size /= 2) {
+      CHECK(truncate(path.c_str(), size) == 0);
+      SymbolCache *cache = SymbolCache::Open(key);
+      CHECK(cache == NULL);
+      delete cache;
+   }
+}
+
+
+static void
+TestBuildIdKey(const std::string &Dir)
+{
+   std::vector<std::string> debugDirs;
+   std::string cacheDir = Dir + "/cache";
+   SymbolCache::SetDirectory(cacheDir);
+
+   std::string pathA = Dir + "/a.out";
+   CHECK(CopyFile(SelfPath(), pathA));
+   ElfImage *a = ElfImage::OpenShared(pathA, std::string(), debugDirs);
+   CHECK(a != NULL);
+   if (!a) {
+      return;
+   }
+   CHECK(!a->BuildId().empty());
+
+   ElfSection text;
+   CHECK(a->FindSection(".text", &text));
+   std::vector<std::string> names;
+   bool foundMain = false;
+   for (uint64_t address = text.Address; address < text.Address + text.Size; address += 16) {
+      ElfSymbol symbol;
+      names.push_back(a->LookupSymbol(address, &symbol) ? symbol.Name : "");
+      foundMain = foundMain || names.back() == "main";
+   }
+   CHECK(foundMain);
+
+   std::string key = BuildIdToString(a->BuildId()) + "-nodebug";
+   CHECK(FileExists(cacheDir + "/" + key.substr(0, 2) + "/" + key.substr(2) + ".symcache"));
+
+   /* Another file with the same build-id is served from the cache entry. */
+   std::string pathB = Dir + "/b.out";
+   CHECK(CopyFile(pathA, pathB));
+   ElfImage *b = ElfImage::OpenShared(pathB, a->BuildId(), debugDirs);
+   CHECK(b != NULL && b != a);
+   if (b) {
+      size_t i = 0;
+      for (uint64_t address = text.Address; address < text.Address + text.Size; address += 16) {
+         ElfSymbol symbol;
+         CHECK(names[i++] == (b->LookupSymbol(address, &symbol) ? symbol.Name : ""));
+      }
+   }
+   ElfImage::Release(b);
+   ElfImage::Release(a);
+}
+
+
+static void
+TestSharing(const std::string &Dir)
+{
+   std::vector<std::string> debugDirs;
+   std::string path = Dir + "/shared";
+
+   /* Failures are not remembered. */
+   CHECK(ElfImage::OpenShared(path, std::string(), debugDirs) == NULL);
+   CHECK(CopyFile("/bin/true", path));
+   ElfImage *first = ElfImage::OpenShared(path, std::string(), debugDirs);
+   CHECK(first != NULL);
+   if (!first) {
+      return;
+   }
+   std::string buildId = first->BuildId();
+
+   ElfImage *again = ElfImage::OpenShared(path, std::string(), debugDirs);
+   CHECK(again == first);
+   ElfImage::Release(again);
+
+   CHECK(ElfImage::OpenShared(path, "mismatch", debugDirs) == NULL);
+
+   /* A file rebuilt in place is opened afresh. */
+   std::string other = Dir + "/other";
+   CHECK(CopyFile(SelfPath(), other));
+   CHECK(CopyFile(other, path));
+   struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+   CHECK(utimensat(AT_FDCWD, path.c_str(), times, 0) == 0);
+   ElfImage *rebuilt = ElfImage::OpenShared(path, std::string(), debugDirs);
+   CHECK(rebuilt != NULL && rebuilt != first);
+   CHECK(rebuilt && rebuilt->BuildId() != buildId);
+   CHECK(first->BuildId() == buildId);
+   ElfImage::Release(rebuilt);
+   ElfImage::Release(first);
+
+   /* Gone, but found by build-id in the debug directories. */
+   std::string hex = BuildIdToString(buildId);
+   std::string debugDir = Dir + "/debug";
+   std::string buildIdDir = debugDir + "/.build-id/" + hex.substr(0, 2);
+   CHECK(system(("mkdir -p '" + buildIdDir + "'").c_str()) == 0);
+   CHECK(CopyFile("/bin/true", buildIdDir + "/" + hex.substr(2) + ".debug"));
+   debugDirs.push_back(debugDir);
+   ElfImage *byBuildId = ElfImage::OpenShared(Dir + "/missing", buildId, debugDirs);
+   CHECK(byBuildId != NULL && byBuildId->BuildId() == buildId);
+   ElfImage::Release(byBuildId);
+   debugDirs.clear();
+
+   /* Unreferenced images are evicted once enough others were released. */
+   ElfImage *held = ElfImage::OpenShared(other, std::string(), debugDirs);
+   ElfImage *idle = ElfImage::OpenShared(path, std::string(), debugDirs);
+   CHECK(held && idle);
+   ElfImage::Release(idle);
+   CHECK(IsMapped(path));
+   for (unsigned i = 0; i < 100; ++i) {
+      char name[32];
+      snprintf(name, sizeof name, "/copy%u", i);
+      CHECK(CopyFile("/bin/true", Dir + name));
+      ElfImage::Release(ElfImage::OpenShared(Dir + name, std::string(), debugDirs));
+   }
+   CHECK(!IsMapped(path));
+   CHECK(IsMapped(other));
+   ElfImage::Release(held);
+}
+
+
+int
+main(void)
+{
+   std::string dir = MakeTempDir();
+
+   TestSerialization(dir);
+   TestBuildIdKey(dir);
+   TestSharing(dir);
+
+   RemoveTempDir(dir);
+   return TestResult();
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,105 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Minimal checks for the unit tests, which are plain programs run by ctest:
+ * every failed CHECK is reported, and the exit code tells whether any did.
+ */
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+
+static int g_Failures = 0;
+
+
+#define CHECK(Condition) \
+   do { \
+      if (!(Condition)) { \
+         fprintf(stderr, "%s:%d: error: check failed: %s\n", __FILE__, __LINE__, #Condition); \
+         ++g_Failures; \
+      } \
+   } while (0)
+
+
+static inline int
+TestResult(void)
+{
+   if (g_Failures) {
+      fprintf(stderr, "%d checks failed\n", g_Failures);
+      return EXIT_FAILURE;
+   }
+   return EXIT_SUCCESS;
+}
+
+
+/*
+ * Create a scratch directory, to be removed with RemoveTempDir().
+ */
+static inline std::string
+MakeTempDir(void)
+{
+   char path[] = "/tmp/stackdump-test.XXXXXX";
+   if (!mkdtemp(path)) {
+      perror("mkdtemp");
+      exit(EXIT_FAILURE);
+   }
+   return path;
+}
+
+
+static inline void
+RemoveTempDir(const std::string &Path)
+{
+   std::string command = "rm -rf '" + Path + "'";
+   if (system(command.c_str()) != 0) {
+      fprintf(stderr, "warning: failed to remove %s\n", Path.c_str());
+   }
+}
+
+
+static inline bool
+WriteFile(const std::string &Path, const void *Data, size_t Size)
+{
+   FILE *fp = fopen(Path.c_str(), "wb");
+   if (!fp) {
+      return false;
+   }
+   bool ok = fwrite(Data, 1, Size, fp) == Size;
+   return fclose(fp) == 0 && ok;
+}
+
+
+#endif /* _TEST_H_ */
+
+/* vim:set sw=3 et: */
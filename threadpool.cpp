@@ -0,0 +1,208 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdint.h>
+
+#include "threadpool.h"
+
+
+static thread_local ThreadPool *t_Pool = NULL;
+static thread_local int t_WorkerIndex = -1;
+
+
+ThreadPool::ThreadPool(unsigned Threads) :
+   m_NextQueue(0),
+   m_Pending(0),
+   m_WaitLimit(SIZE_MAX),
+   m_Submitted(0),
+   m_Sleeping(0),
+   m_Quit(false)
+{
+   if (!Threads) {
+      Threads = std::thread::hardware_concurrency();
+      if (!Threads) {
+         Threads = 1;
+      }
+   }
+
+   for (unsigned i = 0; i < Threads; ++i) {
+      m_Queues.push_back(new Queue);
+   }
+   for (unsigned i = 0; i < Threads; ++i) {
+      m_Workers.push_back(std::thread(&ThreadPool::WorkerMain, this, i));
+   }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+   Wait();
+
+   {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Quit = true;
+   }
+   m_WorkAvailable.notify_all();
+
+   for (size_t i = 0; i < m_Workers.size(); ++i) {
+      m_Workers[i].join();
+   }
+   for (size_t i = 0; i < m_Queues.size(); ++i) {
+      delete m_Queues[i];
+   }
+}
+
+
+int
+ThreadPool::CurrentWorker(void)
+{
+   return t_WorkerIndex;
+}
+
+
+void
+ThreadPool::Submit(const Task &task)
+{
+   unsigned index;
+
+   if (t_Pool == this) {
+      index = t_WorkerIndex;
+   } else {
+      index = m_NextQueue++ % m_Queues.size();
+   }
+
+   ++m_Pending;
+
+   {
+      std::lock_guard<std::mutex> lock(m_Queues[index]->Mutex);
+      m_Queues[index]->Tasks.push_back(task);
+   }
+
+   /* Only pay for a notification when somebody is asleep. */
+   std::lock_guard<std::mutex> lock(m_Mutex);
+   ++m_Submitted;
+   if (m_Sleeping) {
+      m_WorkAvailable.notify_one();
+   }
+}
+
+
+void
+ThreadPool::Wait(size_t MaxPending)
+{
+   std::unique_lock<std::mutex> lock(m_Mutex);
+   while (m_Pending > MaxPending) {
+      m_WaitLimit = MaxPending;
+      m_TaskDone.wait(lock);
+   }
+   m_WaitLimit = SIZE_MAX;
+}
+
+
+bool
+ThreadPool::TakeTask(unsigned Index, Task &task)
+{
+   unsigned count = (unsigned)m_Queues.size();
+
+   /* Own queue first, newest task. */
+   {
+      Queue *queue = m_Queues[Index];
+      std::lock_guard<std::mutex> lock(queue->Mutex);
+      if (!queue->Tasks.empty()) {
+         task = queue->Tasks.back();
+         queue->Tasks.pop_back();
+         return true;
+      }
+   }
+
+   /* Then steal the oldest task of somebody else. */
+   for (unsigned i = 1; i < count; ++i) {
+      Queue *queue = m_Queues[(Index + i) % count];
+      std::lock_guard<std::mutex> lock(queue->Mutex);
+      if (!queue->Tasks.empty()) {
+         task = queue->Tasks.front();
+         queue->Tasks.pop_front();
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+void
+ThreadPool::RunTask(Task &task)
+{
+   task();
+   task = Task();
+
+   if (--m_Pending <= m_WaitLimit) {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_TaskDone.notify_all();
+   }
+}
+
+
+void
+ThreadPool::WorkerMain(unsigned Index)
+{
+   t_Pool = this;
+   t_WorkerIndex = Index;
+
+   for (;;) {
+      Task task;
+
+      if (TakeTask(Index, task)) {
+         RunTask(task);
+         continue;
+      }
+
+      /*
+       * Sleep, unless something was submitted since the queues were last
+       * looked at.
+       */
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      if (m_Quit) {
+         break;
+      }
+      unsigned long submitted = m_Submitted;
+      lock.unlock();
+      if (TakeTask(Index, task)) {
+         RunTask(task);
+         continue;
+      }
+      lock.lock();
+      ++m_Sleeping;
+      while (submitted == m_Submitted && !m_Quit) {
+         m_WorkAvailable.wait(lock);
+      }
+      --m_Sleeping;
+   }
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,120 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Every worker owns a task deque.  Tasks submitted from a worker go to its
+ * own deque and are taken LIFO, which keeps related work on the same core;
+ * idle workers steal FIFO from the other deques.
+ */
+
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool
+{
+public:
+   typedef std::function<void (void)> Task;
+
+   /*
+    * Start the given number of workers, or one per core when zero.
+    */
+   ThreadPool(unsigned Threads = 0);
+
+   /*
+    * Finish all pending tasks and stop the workers.
+    */
+   ~ThreadPool();
+
+   unsigned
+   Size(void) const { return (unsigned)m_Workers.size(); }
+
+   void
+   Submit(const Task &task);
+
+   /*
+    * Block until at most MaxPending submitted tasks are unfinished.  With
+    * a non-zero limit this throttles a producer, bounding the queues.
+    */
+   void
+   Wait(size_t MaxPending = 0);
+
+   /*
+    * Index of the calling worker within its pool, or -1 when called from
+    * any other thread.
+    */
+   static int
+   CurrentWorker(void);
+
+private:
+   struct Queue
+   {
+      std::mutex Mutex;
+      std::deque<Task> Tasks;
+   };
+
+   void
+   WorkerMain(unsigned Index);
+
+   bool
+   TakeTask(unsigned Index, Task &task);
+
+   void
+   RunTask(Task &task);
+
+   std::vector<std::thread> m_Workers;
+   std::vector<Queue *> m_Queues;
+   std::atomic<unsigned> m_NextQueue;
+
+   /* Submitted but unfinished tasks. */
+   std::atomic<size_t> m_Pending;
+   std::atomic<size_t> m_WaitLimit;
+
+   std::mutex m_Mutex;
+   std::condition_variable m_WorkAvailable;
+   std::condition_variable m_TaskDone;
+   unsigned long m_Submitted;
+   unsigned m_Sleeping;
+   bool m_Quit;
+};
+
+
+#endif /* _THREADPOOL_H_ */
+
+/* vim:set sw=3 et: */
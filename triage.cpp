@@ -0,0 +1,532 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Dumps are spread over a work-stealing thread pool.  Every worker
+ * accumulates its own buckets, which are only merged at the end, so
+ * workers never contend on shared state; the directory walker throttles
+ * itself on the pool so that memory use does not depend on the number of
+ * dumps.
+ */
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dumptarget.h"
+#include "elfimage.h"
+#include "minidumpreader.h"
+#include "symbolize.h"
+#include "symcache.h"
+#include "threadpool.h"
+#include "unwind.h"
+#include "triage.h"
+
+
+/* Frames making up a signature. */
+#define SIGNATURE_FRAMES 5
+
+/* Frames looked at when skipping the signal raising machinery. */
+#define TRIAGE_MAX_FRAMES 32
+
+/* Bytes of stack scanned when there is nothing to unwind with. */
+#define STACK_SCAN_SIZE (64*1024)
+
+
+struct Bucket
+{
+   unsigned long Count;
+   std::string Example;    /* lexicographically first dump, for stable output */
+};
+
+typedef std::unordered_map<std::string, Bucket> BucketMap;
+
+
+static std::vector<std::string> g_DebugDirs;
+static unsigned g_SignatureFrames = SIGNATURE_FRAMES;
+
+
+static const char *
+SignalName(unsigned sig)
+{
+   switch (sig) {
+   case SIGQUIT: return "SIGQUIT";
+   case SIGILL: return "SIGILL";
+   case SIGTRAP: return "SIGTRAP";
+   case SIGABRT: return "SIGABRT";
+   case SIGBUS: return "SIGBUS";
+   case SIGFPE: return "SIGFPE";
+   case SIGSEGV: return "SIGSEGV";
+   case SIGXCPU: return "SIGXCPU";
+   case SIGXFSZ: return "SIGXFSZ";
+   case SIGSYS: return "SIGSYS";
+   default: return NULL;
+   }
+}
+
+
+/*
+ * Modules whose frames only tell how the crash was raised, not where.
+ */
+static bool
+IsNoiseModule(const std::string &Name)
+{
+   static const char *names[] = {
+      "libc", "libpthread", "libstdc++", "libgcc_s",
+      "ntdll", "kernel32", "kernelbase", "ucrtbase", "msvcrt",
+   };
+
+   std::string lower(Name);
+   for (size_t i = 0; i < lower.size(); ++i) {
+      lower[i] = (char)tolower((unsigned char)lower[i]);
+   }
+
+   for (size_t i = 0; i < sizeof names / sizeof names[0]; ++i) {
+      if (lower == names[i]) {
+         return true;
+      }
+   }
+   return lower.compare(0, 6, "msvcr") == 0 || lower.compare(0, 6, "msvcp") == 0;
+}
+
+
+/*
+ * Normalized description of a frame: no offsets within functions, so that
+ * unrelated code changes don't split buckets, and just the module for
+ * frames without a symbol, whose offsets change with every build.
+ */
+static std::string
+FrameName(Target *target, uint64_t Pc, bool Exact, bool *Noise)
+{
+   uint64_t lookup = Exact ? Pc : Pc - 1;
+   const Module *module = target->FindModule(lookup);
+
+   *Noise = false;
+   if (!module) {
+      return "???";
+   }
+   *Noise = IsNoiseModule(module->Name);
+
+   ElfSymbol symbol;
+   if (module->Image &&
+       module->Image->LookupSymbol(lookup - module->Bias, &symbol)) {
+      return module->Name + "!" + DemangleSymbol(symbol.Name);
+   }
+
+   return module->Name;
+}
+
+
+/*
+ * Heuristic stack walk: every stack slot pointing into a module is taken
+ * as a return address.  Used for x86 dumps and when unwinding fails.
+ */
+static void
+ScanStack(DumpTarget &target, uint64_t Pc, uint64_t Sp, unsigned WordSize,
+          std::vector<StackFrame> &Frames)
+{
+   std::vector<uint8_t> stack(STACK_SCAN_SIZE);
+   size_t size = target.ReadMemory(Sp, &stack[0], stack.size());
+
+   Frames.clear();
+
+   StackFrame frame;
+   frame.Pc = Pc;
+   frame.Sp = Sp;
+   frame.Signal = false;
+   Frames.push_back(frame);
+
+   for (size_t offset = 0; offset + WordSize <= size && Frames.size() < TRIAGE_MAX_FRAMES;
+        offset += WordSize) {
+      uint64_t value = 0;
+      memcpy(&value, &stack[offset], WordSize);
+      if (value && target.FindModule(value - 1)) {
+         frame.Pc = value;
+         frame.Sp = Sp + offset;
+         Frames.push_back(frame);
+      }
+   }
+}
+
+
+static std::string
+ComputeSignature(const MinidumpFile *dump)
+{
+   DumpTarget target(dump, g_DebugDirs);
+   std::vector<StackFrame> frames;
+   uint32_t threadId;
+   MDLocationDescriptor context;
+   char buffer[32];
+
+   if (!target.GetFaultingThread(&threadId, &context)) {
+      return "<no threads>";
+   }
+
+   /* Exception code */
+   std::string signature;
+   const MDRawExceptionStream *exception = dump->Exception();
+   const MDRawSystemInfo *systemInfo = dump->SystemInfo();
+   if (!exception) {
+      signature = "HANG";
+   } else {
+      uint32_t code = exception->ExceptionRecord.ExceptionCode;
+      const char *name = NULL;
+      if (systemInfo && systemInfo->PlatformId == MD_OS_LINUX) {
+         name = SignalName(code);
+      }
+      if (!name) {
+         snprintf(buffer, sizeof buffer, "%08x", code);
+         name = buffer;
+      }
+      signature = name;
+   }
+
+   /* Stack */
+   uint64_t regs[DW_REG_COUNT];
+   const MDRawContextX86 *context32;
+   if (target.GetRegisters(context, regs)) {
+      UnwindStack(&target, regs, frames, TRIAGE_MAX_FRAMES);
+      if (frames.size() < 2) {
+         ScanStack(target, regs[DW_REG_RIP], regs[DW_REG_RSP], 8, frames);
+      }
+   } else if ((context32 = dump->ContextX86(context)) != NULL) {
+      ScanStack(target, context32->Eip, context32->Esp, 4, frames);
+   } else {
+      return signature + " <no context>";
+   }
+
+   /* Skip leading frames in the C runtime and the like (abort, raise...). */
+   std::vector<std::string> names;
+   size_t first = 0;
+   for (size_t i = 0; i < frames.size(); ++i) {
+      bool noise;
+      names.push_back(FrameName(&target, frames[i].Pc, i == 0 || frames[i].Signal, &noise));
+      if (noise && first == i && i + 1 < frames.size()) {
+         first = i + 1;
+      }
+   }
+
+   for (size_t i = first; i < names.size() && i < first + g_SignatureFrames; ++i) {
+      signature += i == first ? " " : " < ";
+      signature += names[i];
+   }
+
+   return signature;
+}
+
+
+static void
+TriageDump(const std::string &Path, std::vector<BucketMap> *Buckets)
+{
+   std::string signature;
+
+   MinidumpFile *dump = MinidumpFile::Open(Path.c_str());
+   if (dump) {
+      signature = ComputeSignature(dump);
+      delete dump;
+   } else {
+      signature = "<unreadable>";
+   }
+
+   Bucket &bucket = (*Buckets)[ThreadPool::CurrentWorker()][signature];
+   if (!bucket.Count++ || Path < bucket.Example) {
+      bucket.Example = Path;
+   }
+}
+
+
+static bool
+IsDumpFile(const char *Name)
+{
+   size_t length = strlen(Name);
+   return length > 4 && strcasecmp(Name + length - 4, ".dmp") == 0;
+}
+
+
+/*
+ * Walk a directory tree, feeding dumps to the pool a few at a time.
+ */
+static unsigned long
+SubmitDumps(ThreadPool &pool, const std::string &Root, std::vector<BucketMap> *Buckets)
+{
+   std::vector<std::string> dirs;
+   unsigned long count = 0;
+
+   dirs.push_back(Root);
+   while (!dirs.empty()) {
+      std::string dir = dirs.back();
+      dirs.pop_back();
+
+      DIR *dp = opendir(dir.c_str());
+      if (!dp) {
+         fprintf(stderr, "warning: failed to open %s (%s)\n", dir.c_str(), strerror(errno));
+         continue;
+      }
+
+      struct dirent *entry;
+      while ((entry = readdir(dp)) != NULL) {
+         if (entry->d_name[0] == '.') {
+            continue;
+         }
+
+         std::string path = dir + "/" + entry->d_name;
+         unsigned char type = entry->d_type;
+         if (type == DT_UNKNOWN || type == DT_LNK) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+               continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+         }
+
+         if (type == DT_DIR) {
+            dirs.push_back(path);
+         } else if (type == DT_REG && IsDumpFile(entry->d_name)) {
+            pool.Wait(4 * pool.Size());
+            pool.Submit([path, Buckets]() { TriageDump(path, Buckets); });
+            ++count;
+         }
+      }
+      closedir(dp);
+   }
+
+   return count;
+}
+
+
+struct SortedBucket
+{
+   const std::string *Signature;
+   const Bucket *Data;
+
+   bool
+   operator < (const SortedBucket &other) const
+   {
+      if (Data->Count != other.Data->Count) {
+         return Data->Count > other.Data->Count;
+      }
+      return *Signature < *other.Signature;
+   }
+};
+
+
+static void
+TriageUsage(void)
+{
+   fputs("usage: stackdump triage [options] <directory>\n"
+         "\n"
+         "options:\n"
+         "  -c <cache-dir> symbol cache directory, empty to disable\n"
+         "                 (default ~/.cache/stackdump)\n"
+         "  -j <jobs> number of worker threads (default is one per core)\n"
+         "  -n <frames> number of frames in a signature (default 5)\n"
+         "  -o <file> writes the summary to a file instead of stdout (-)\n"
+         "  -y <debug-path> colon separated debug file directories\n"
+         "                  (default /usr/lib/debug)\n",
+         stderr);
+}
+
+
+int
+TriageMain(int argc, char **argv)
+{
+   unsigned jobs = 0;
+   const char *output = NULL;
+   const char *debugPath = "/usr/lib/debug";
+
+   while (--argc > 0) {
+      ++argv;
+
+      if (!strcmp(*argv, "-?")) {
+         TriageUsage();
+         return 0;
+      } else if (!strcmp(*argv, "-c") ||
+                 !strcmp(*argv, "-j") || !strcmp(*argv, "-n") ||
+                 !strcmp(*argv, "-o") || !strcmp(*argv, "-y")) {
+         if (argc < 2) {
+            fprintf(stderr, "error: %s missing argument\n\n", *argv);
+            TriageUsage();
+            return 1;
+         }
+
+         const char *option = *argv;
+         ++argv;
+         --argc;
+
+         switch (option[1]) {
+         case 'c': SymbolCache::SetDirectory(*argv); break;
+         case 'j': jobs = atoi(*argv); break;
+         case 'n': g_SignatureFrames = atoi(*argv); break;
+         case 'o': output = *argv; break;
+         case 'y': debugPath = *argv; break;
+         }
+      } else {
+         break;
+      }
+   }
+
+   if (argc != 1) {
+      fprintf(stderr, "error: no directory given\n\n");
+      TriageUsage();
+      return 1;
+   }
+
+   SplitSearchPath(debugPath, g_DebugDirs);
+
+   /*
+    * Bucket
+    */
+
+   unsigned long count;
+   std::vector<BucketMap> buckets;
+   {
+      ThreadPool pool(jobs);
+      buckets.resize(pool.Size());
+      count = SubmitDumps(pool, *argv, &buckets);
+      pool.Wait();
+   }
+
+   BucketMap merged;
+   for (size_t i = 0; i < buckets.size(); ++i) {
+      BucketMap::const_iterator it;
+      for (it = buckets[i].begin(); it != buckets[i].end(); ++it) {
+         Bucket &bucket = merged[it->first];
+         if (!bucket.Count || it->second.Example < bucket.Example) {
+            bucket.Example = it->second.Example;
+         }
+         bucket.Count += it->second.Count;
+      }
+      buckets[i].clear();
+   }
+
+   std::vector<SortedBucket> sorted;
+   BucketMap::const_iterator it;
+   for (it = merged.begin(); it != merged.end(); ++it) {
+      SortedBucket entry;
+      entry.Signature = &it->first;
+      entry.Data = &it->second;
+      sorted.push_back(entry);
+   }
+   std::sort(sorted.begin(), sorted.end());
+
+   /*
+    * Summary
+    */
+
+   FILE *fp = stdout;
+   if (output && strcmp(output, "-") != 0) {
+      fp = fopen(output, "w");
+      if (!fp) {
+         fprintf(stderr, "error: failed to create %s (%s)\n", output, strerror(errno));
+         return 1;
+      }
+   }
+
+   fprintf(fp, "%lu dumps, %lu buckets\n", count, (unsigned long)sorted.size());
+   for (size_t i = 0; i < sorted.size(); ++i) {
+      fprintf(fp, "\n%8lu  %s\n          %s\n",
+              sorted[i].Data->Count,
+              sorted[i].Signature->c_str(),
+              sorted[i].Data->Example.c_str());
+   }
+
+   if (fp != stdout) {
+      fclose(fp);
+   }
+
+   return 0;
+}
+
+
+static void
+InflateUsage(void)
+{
+   fputs("usage: stackdump inflate <dump> <output>\n"
+         "\n"
+         "Writes a compressed dump (--compress) out as a plain minidump, for other\n"
+         "debuggers.\n",
+         stderr);
+}
+
+
+int
+InflateMain(int argc, char **argv)
+{
+   if (argc != 3) {
+      InflateUsage();
+      return 1;
+   }
+
+   MinidumpFile *dump = MinidumpFile::Open(argv[1]);
+   if (!dump) {
+      fprintf(stderr, "error: failed to read %s\n", argv[1]);
+      return 1;
+   }
+
+   FILE *fp = fopen(argv[2], "wb");
+   if (!fp) {
+      fprintf(stderr, "error: failed to create %s (%s)\n", argv[2], strerror(errno));
+      delete dump;
+      return 1;
+   }
+
+   bool ok = true;
+   for (uint64_t offset = 0; ok && offset < dump->Size(); offset += BLOCK_SIZE) {
+      uint64_t size = dump->Size() - offset < BLOCK_SIZE ? dump->Size() - offset : BLOCK_SIZE;
+      const void *data = dump->GetData(offset, size);
+      if (!data) {
+         fprintf(stderr, "error: %s is corrupt at offset 0x%llx\n",
+                 argv[1], (unsigned long long)offset);
+         ok = false;
+      } else if (fwrite(data, 1, (size_t)size, fp) != size) {
+         fprintf(stderr, "error: failed to write %s (%s)\n", argv[2], strerror(errno));
+         ok = false;
+      }
+   }
+
+   if (fclose(fp) != 0 && ok) {
+      fprintf(stderr, "error: failed to write %s (%s)\n", argv[2], strerror(errno));
+      ok = false;
+   }
+   delete dump;
+
+   return ok ? 0 : 1;
+}
+
+
+/* vim:set sw=3 et: */
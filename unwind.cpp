@@ -0,0 +1,1278 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * See the DWARF Debugging Information Format, section "Call Frame
+ * Information", and the Linux Standard Base Core Specification, section
+ * "Exception Frames", for the .eh_frame specifics.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "elfimage.h"
+#include "dwarf.h"
+#include "unwind.h"
+
+
+/**************************************************************************
+ *
+ * Defines
+ *
+ **************************************************************************/
+
+#define DW_EH_PE_absptr    0x00
+#define DW_EH_PE_uleb128   0x01
+#define DW_EH_PE_udata2    0x02
+#define DW_EH_PE_udata4    0x03
+#define DW_EH_PE_udata8    0x04
+#define DW_EH_PE_sleb128   0x09
+#define DW_EH_PE_sdata2    0x0a
+#define DW_EH_PE_sdata4    0x0b
+#define DW_EH_PE_sdata8    0x0c
+#define DW_EH_PE_pcrel     0x10
+#define DW_EH_PE_datarel   0x30
+#define DW_EH_PE_indirect  0x80
+#define DW_EH_PE_omit      0xff
+
+#define DW_CFA_advance_loc         0x40
+#define DW_CFA_offset              0x80
+#define DW_CFA_restore             0xc0
+#define DW_CFA_nop                 0x00
+#define DW_CFA_set_loc             0x01
+#define DW_CFA_advance_loc1        0x02
+#define DW_CFA_advance_loc2        0x03
+#define DW_CFA_advance_loc4        0x04
+#define DW_CFA_offset_extended     0x05
+#define DW_CFA_restore_extended    0x06
+#define DW_CFA_undefined           0x07
+#define DW_CFA_same_value          0x08
+#define DW_CFA_register            0x09
+#define DW_CFA_remember_state      0x0a
+#define DW_CFA_restore_state       0x0b
+#define DW_CFA_def_cfa             0x0c
+#define DW_CFA_def_cfa_register    0x0d
+#define DW_CFA_def_cfa_offset      0x0e
+#define DW_CFA_def_cfa_expression  0x0f
+#define DW_CFA_expression          0x10
+#define DW_CFA_offset_extended_sf  0x11
+#define DW_CFA_def_cfa_sf          0x12
+#define DW_CFA_def_cfa_offset_sf   0x13
+#define DW_CFA_val_offset          0x14
+#define DW_CFA_val_offset_sf       0x15
+#define DW_CFA_val_expression      0x16
+#define DW_CFA_GNU_args_size       0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+#define DW_OP_addr         0x03
+#define DW_OP_deref        0x06
+#define DW_OP_const1u      0x08
+#define DW_OP_const1s      0x09
+#define DW_OP_const2u      0x0a
+#define DW_OP_const2s      0x0b
+#define DW_OP_const4u      0x0c
+#define DW_OP_const4s      0x0d
+#define DW_OP_const8u      0x0e
+#define DW_OP_const8s      0x0f
+#define DW_OP_constu       0x10
+#define DW_OP_consts       0x11
+#define DW_OP_dup          0x12
+#define DW_OP_drop         0x13
+#define DW_OP_over         0x14
+#define DW_OP_pick         0x15
+#define DW_OP_swap         0x16
+#define DW_OP_rot          0x17
+#define DW_OP_abs          0x19
+#define DW_OP_and          0x1a
+#define DW_OP_div          0x1b
+#define DW_OP_minus        0x1c
+#define DW_OP_mod          0x1d
+#define DW_OP_mul          0x1e
+#define DW_OP_neg          0x1f
+#define DW_OP_not          0x20
+#define DW_OP_or           0x21
+#define DW_OP_plus         0x22
+#define DW_OP_plus_uconst  0x23
+#define DW_OP_shl          0x24
+#define DW_OP_shr          0x25
+#define DW_OP_shra         0x26
+#define DW_OP_xor          0x27
+#define DW_OP_bra          0x28
+#define DW_OP_eq           0x29
+#define DW_OP_ge           0x2a
+#define DW_OP_gt           0x2b
+#define DW_OP_le           0x2c
+#define DW_OP_lt           0x2d
+#define DW_OP_ne           0x2e
+#define DW_OP_skip         0x2f
+#define DW_OP_lit0         0x30
+#define DW_OP_lit31        0x4f
+#define DW_OP_breg0        0x70
+#define DW_OP_breg31       0x8f
+#define DW_OP_bregx        0x92
+#define DW_OP_deref_size   0x94
+#define DW_OP_nop          0x96
+
+
+/**************************************************************************
+ *
+ * Call frame information tables
+ *
+ **************************************************************************/
+
+struct FdeEntry
+{
+   uint64_t Start;
+   uint64_t End;
+   size_t Offset;       /* offset of the FDE within its section */
+
+   bool operator < (const FdeEntry &other) const { return Start < other.Start; }
+};
+
+
+/*
+ * The CFI sections of an image, plus a sorted FDE index for the sections
+ * that lack a binary search table (.eh_frame_hdr).
+ */
+struct CfiTable
+{
+   ElfSection EhFrame;
+   ElfSection EhFrameHdr;
+   ElfSection DebugFrame;
+   bool HaveEhFrame;
+   bool HaveEhFrameHdr;
+   bool HaveDebugFrame;
+
+   std::vector<FdeEntry> EhFrameIndex;
+   std::vector<FdeEntry> DebugFrameIndex;
+};
+
+
+struct CieRecord
+{
+   uint64_t CodeAlign;
+   int64_t DataAlign;
+   uint64_t ReturnRegister;
+   uint8_t FdeEncoding;
+   uint8_t LsdaEncoding;
+   bool HasAugmentationData;
+   bool Signal;
+   const uint8_t *Instructions;
+   const uint8_t *InstructionsEnd;
+};
+
+
+struct Fde
+{
+   CieRecord Cie;
+   uint64_t Start;
+   uint64_t End;
+   const uint8_t *Instructions;
+   const uint8_t *InstructionsEnd;
+};
+
+
+static bool
+ReadEncodedPointer(DwarfReader &r, uint8_t Encoding, const ElfSection &Section, uint64_t *Value)
+{
+   uint64_t fieldAddress = Section.Address + r.Offset();
+   uint64_t value;
+
+   if (Encoding == DW_EH_PE_omit) {
+      *Value = 0;
+      return true;
+   }
+
+   switch (Encoding & 0x0f) {
+   case DW_EH_PE_absptr:
+      value = r.U64();
+      break;
+   case DW_EH_PE_uleb128:
+      value = r.ULEB128();
+      break;
+   case DW_EH_PE_udata2:
+      value = r.U16();
+      break;
+   case DW_EH_PE_udata4:
+      value = r.U32();
+      break;
+   case DW_EH_PE_udata8:
+      value = r.U64();
+      break;
+   case DW_EH_PE_sleb128:
+      value = r.SLEB128();
+      break;
+   case DW_EH_PE_sdata2:
+      value = (int16_t)r.U16();
+      break;
+   case DW_EH_PE_sdata4:
+      value = (int32_t)r.U32();
+      break;
+   case DW_EH_PE_sdata8:
+      value = r.U64();
+      break;
+   default:
+      return false;
+   }
+
+   switch (Encoding & 0x70) {
+   case 0:
+      break;
+   case DW_EH_PE_pcrel:
+      value += fieldAddress;
+      break;
+   case DW_EH_PE_datarel:
+      value += Section.Address;
+      break;
+   default:
+      /* textrel, funcrel and aligned are not used on x86-64 */
+      return false;
+   }
+
+   *Value = value;
+   return !r.Overflow;
+}
+
+
+static bool
+ParseCie(const ElfSection &Section, bool IsEhFrame, size_t Offset, CieRecord &cie)
+{
+   if (Offset >= Section.Size) {
+      return false;
+   }
+
+   DwarfReader r(Section.Data, Section.Size);
+   r.Ptr += Offset;
+
+   bool is64;
+   uint64_t length = r.InitialLength(&is64);
+   if (length == 0 || length > r.Remaining()) {
+      return false;
+   }
+   const uint8_t *end = r.Ptr + length;
+
+   uint64_t id = r.SectionOffset(is64);
+   if (IsEhFrame ? id != 0 : id != (is64 ? ~(uint64_t)0 : 0xffffffff)) {
+      return false;
+   }
+
+   uint8_t version = r.U8();
+   if (version != 1 && version != 3 && version != 4) {
+      return false;
+   }
+
+   const char *augmentation = r.String();
+
+   if (version == 4) {
+      r.U8();     /* address_size */
+      r.U8();     /* segment_size */
+   }
+
+   cie.CodeAlign = r.ULEB128();
+   cie.DataAlign = r.SLEB128();
+   cie.ReturnRegister = version == 1 ? r.U8() : r.ULEB128();
+   cie.FdeEncoding = DW_EH_PE_absptr;
+   cie.LsdaEncoding = DW_EH_PE_omit;
+   cie.HasAugmentationData = false;
+   cie.Signal = false;
+
+   if (augmentation[0] == 'z') {
+      uint64_t augLength = r.ULEB128();
+      const uint8_t *augEnd = r.Ptr + augLength;
+
+      cie.HasAugmentationData = true;
+
+      for (const char *a = augmentation + 1; *a; ++a) {
+         switch (*a) {
+         case 'L':
+            cie.LsdaEncoding = r.U8();
+            break;
+         case 'R':
+            cie.FdeEncoding = r.U8();
+            break;
+         case 'P': {
+            uint8_t encoding = r.U8();
+            uint64_t personality;
+            if (!ReadEncodedPointer(r, encoding & ~DW_EH_PE_indirect, Section, &personality)) {
+               return false;
+            }
+            break;
+         }
+         case 'S':
+            cie.Signal = true;
+            break;
+         default:
+            /* Unknown augmentation; the length lets us skip the data. */
+            break;
+         }
+      }
+
+      r.Ptr = augEnd;
+   } else if (augmentation[0] != 0 && strcmp(augmentation, "eh") != 0) {
+      return false;
+   }
+
+   if (r.Overflow || r.Ptr > end) {
+      return false;
+   }
+
+   cie.Instructions = r.Ptr;
+   cie.InstructionsEnd = end;
+   return true;
+}
+
+
+/*
+ * Parse the FDE at the given offset.  Returns false for CIEs, terminators
+ * and malformed entries.
+ */
+static bool
+ParseFde(const ElfSection &Section, bool IsEhFrame, size_t Offset, Fde &fde, size_t *Next)
+{
+   if (Offset >= Section.Size) {
+      return false;
+   }
+
+   DwarfReader r(Section.Data, Section.Size);
+   r.Ptr += Offset;
+
+   bool is64;
+   uint64_t length = r.InitialLength(&is64);
+   if (r.Overflow || length > r.Remaining()) {
+      *Next = Section.Size;
+      return false;
+   }
+   const uint8_t *end = r.Ptr + length;
+   *Next = end - Section.Data;
+
+   if (length == 0) {
+      /* .eh_frame terminator */
+      if (IsEhFrame) {
+         *Next = Section.Size;
+      }
+      return false;
+   }
+
+   size_t idOffset = r.Offset();
+   uint64_t id = r.SectionOffset(is64);
+   size_t cieOffset;
+
+   if (IsEhFrame) {
+      if (id == 0) {
+         return false;
+      }
+      cieOffset = idOffset - id;
+   } else {
+      if (id == (is64 ? ~(uint64_t)0 : 0xffffffff)) {
+         return false;
+      }
+      cieOffset = id;
+   }
+
+   if (!ParseCie(Section, IsEhFrame, cieOffset, fde.Cie)) {
+      return false;
+   }
+
+   uint64_t start, range;
+   if (!ReadEncodedPointer(r, fde.Cie.FdeEncoding, Section, &start) ||
+       !ReadEncodedPointer(r, fde.Cie.FdeEncoding & 0x0f, Section, &range)) {
+      return false;
+   }
+
+   if (fde.Cie.HasAugmentationData) {
+      r.Skip(r.ULEB128());
+   }
+
+   if (r.Overflow || r.Ptr > end) {
+      return false;
+   }
+
+   fde.Start = start;
+   fde.End = start + range;
+   fde.Instructions = r.Ptr;
+   fde.InstructionsEnd = end;
+   return true;
+}
+
+
+static void
+IndexSection(const ElfSection &Section, bool IsEhFrame, std::vector<FdeEntry> &Index)
+{
+   size_t offset = 0;
+
+   while (offset < Section.Size) {
+      Fde fde;
+      size_t next;
+
+      if (ParseFde(Section, IsEhFrame, offset, fde, &next) && fde.Start != fde.End) {
+         FdeEntry entry;
+         entry.Start = fde.Start;
+         entry.End = fde.End;
+         entry.Offset = offset;
+         Index.push_back(entry);
+      }
+
+      if (next <= offset) {
+         break;
+      }
+      offset = next;
+   }
+
+   std::sort(Index.begin(), Index.end());
+}
+
+
+static void *
+CreateCfiTable(const ElfImage *Image)
+{
+   CfiTable *table = new CfiTable;
+   table->HaveEhFrame = Image->FindSection(".eh_frame", &table->EhFrame);
+   table->HaveEhFrameHdr = table->HaveEhFrame &&
+                           Image->FindSection(".eh_frame_hdr", &table->EhFrameHdr);
+   table->HaveDebugFrame = Image->FindSection(".debug_frame", &table->DebugFrame);
+
+   if (table->HaveEhFrame && !table->HaveEhFrameHdr) {
+      IndexSection(table->EhFrame, true, table->EhFrameIndex);
+   }
+   if (table->HaveDebugFrame) {
+      IndexSection(table->DebugFrame, false, table->DebugFrameIndex);
+   }
+
+   return table;
+}
+
+
+static void
+DestroyCfiTable(void *Table)
+{
+   delete (CfiTable *)Table;
+}
+
+
+/*
+ * The table lives with the image, so it goes when the image is evicted.
+ */
+static CfiTable *
+GetCfiTable(const ElfImage *Image)
+{
+   return (CfiTable *)Image->UnwindData(CreateCfiTable, DestroyCfiTable);
+}
+
+
+static bool
+SearchIndex(const std::vector<FdeEntry> &Index, uint64_t Address, size_t *Offset)
+{
+   std::vector<FdeEntry>::const_iterator it;
+   FdeEntry key;
+
+   key.Start = Address;
+   it = std::upper_bound(Index.begin(), Index.end(), key);
+   if (it == Index.begin()) {
+      return false;
+   }
+   --it;
+   if (Address >= it->End) {
+      return false;
+   }
+
+   *Offset = it->Offset;
+   return true;
+}
+
+
+/*
+ * Binary search the .eh_frame_hdr table.
+ */
+static bool
+SearchEhFrameHdr(const CfiTable *Table, uint64_t Address, size_t *Offset)
+{
+   const ElfSection &hdr = Table->EhFrameHdr;
+   DwarfReader r(hdr.Data, hdr.Size);
+
+   uint8_t version = r.U8();
+   uint8_t ehFramePtrEnc = r.U8();
+   uint8_t fdeCountEnc = r.U8();
+   uint8_t tableEnc = r.U8();
+   uint64_t ehFramePtr, fdeCount;
+
+   if (version != 1 ||
+       !ReadEncodedPointer(r, ehFramePtrEnc, hdr, &ehFramePtr) ||
+       !ReadEncodedPointer(r, fdeCountEnc, hdr, &fdeCount)) {
+      return false;
+   }
+
+   /* Only the canonical encoding allows constant time indexing. */
+   if (tableEnc != (DW_EH_PE_datarel | DW_EH_PE_sdata4) ||
+       fdeCount > r.Remaining() / 8) {
+      return false;
+   }
+
+   const uint8_t *entries = r.Ptr;
+   size_t lo = 0;
+   size_t hi = fdeCount;
+
+   while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      int32_t start;
+      memcpy(&start, entries + mid*8, 4);
+      if (hdr.Address + (int64_t)start <= Address) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   if (lo == 0) {
+      return false;
+   }
+
+   int32_t fdeAddress;
+   memcpy(&fdeAddress, entries + (lo - 1)*8 + 4, 4);
+   uint64_t fdeOffset = hdr.Address + (int64_t)fdeAddress - Table->EhFrame.Address;
+   if (fdeOffset >= Table->EhFrame.Size) {
+      return false;
+   }
+
+   *Offset = fdeOffset;
+   return true;
+}
+
+
+/*
+ * Find the FDE covering the given link-time address.
+ */
+static bool
+FindFde(const ElfImage *Image, uint64_t Address, Fde &fde)
+{
+   CfiTable *table = GetCfiTable(Image);
+   size_t offset, next;
+
+   if (table->HaveEhFrame) {
+      bool found = table->HaveEhFrameHdr
+                 ? SearchEhFrameHdr(table, Address, &offset)
+                 : SearchIndex(table->EhFrameIndex, Address, &offset);
+      if (found &&
+          ParseFde(table->EhFrame, true, offset, fde, &next) &&
+          fde.Start <= Address && Address < fde.End) {
+         return true;
+      }
+   }
+
+   if (table->HaveDebugFrame &&
+       SearchIndex(table->DebugFrameIndex, Address, &offset) &&
+       ParseFde(table->DebugFrame, false, offset, fde, &next) &&
+       fde.Start <= Address && Address < fde.End) {
+      return true;
+   }
+
+   return false;
+}
+
+
+/**************************************************************************
+ *
+ * Call frame instructions
+ *
+ **************************************************************************/
+
+enum RuleType {
+   RULE_SAME_VALUE = 0,
+   RULE_UNDEFINED,
+   RULE_OFFSET,
+   RULE_VAL_OFFSET,
+   RULE_REGISTER,
+   RULE_EXPRESSION,
+   RULE_VAL_EXPRESSION
+};
+
+
+struct Rule
+{
+   RuleType Type;
+   int64_t Offset;
+   uint64_t Register;
+   const uint8_t *Expression;
+   size_t ExpressionSize;
+};
+
+
+struct CfaRow
+{
+   uint64_t CfaRegister;
+   int64_t CfaOffset;
+   const uint8_t *CfaExpression;
+   size_t CfaExpressionSize;
+   Rule Rules[DW_REG_COUNT];
+};
+
+
+#define MAX_REMEMBERED_STATES 16
+
+
+class CfaMachine
+{
+public:
+   CfaRow Row;
+   CfaRow Initial;
+
+   CfaMachine()
+   {
+      memset(&Row, 0, sizeof Row);
+      memset(&Initial, 0, sizeof Initial);
+      m_StackDepth = 0;
+   }
+
+   /*
+    * Execute instructions until the location exceeds the target address.
+    */
+   bool
+   Execute(const CieRecord &cie, const uint8_t *Start, const uint8_t *End,
+           uint64_t Location, uint64_t Target)
+   {
+      DwarfReader r(Start, End - Start);
+
+      while (!r.AtEnd()) {
+         uint8_t opcode = r.U8();
+         uint8_t operand = opcode & 0x3f;
+         uint64_t reg;
+         int64_t offset;
+
+         switch (opcode & 0xc0) {
+         case DW_CFA_advance_loc:
+            Location += operand * cie.CodeAlign;
+            if (Location > Target) {
+               return true;
+            }
+            continue;
+         case DW_CFA_offset:
+            SetRule(operand, RULE_OFFSET, (int64_t)r.ULEB128() * cie.DataAlign);
+            continue;
+         case DW_CFA_restore:
+            Restore(operand);
+            continue;
+         default:
+            break;
+         }
+
+         switch (opcode) {
+         case DW_CFA_nop:
+            break;
+         case DW_CFA_set_loc:
+            Location = r.U64();
+            if (Location > Target) {
+               return true;
+            }
+            break;
+         case DW_CFA_advance_loc1:
+            Location += r.U8() * cie.CodeAlign;
+            if (Location > Target) {
+               return true;
+            }
+            break;
+         case DW_CFA_advance_loc2:
+            Location += r.U16() * cie.CodeAlign;
+            if (Location > Target) {
+               return true;
+            }
+            break;
+         case DW_CFA_advance_loc4:
+            Location += r.U32() * cie.CodeAlign;
+            if (Location > Target) {
+               return true;
+            }
+            break;
+         case DW_CFA_offset_extended:
+            reg = r.ULEB128();
+            SetRule(reg, RULE_OFFSET, (int64_t)r.ULEB128() * cie.DataAlign);
+            break;
+         case DW_CFA_restore_extended:
+            Restore(r.ULEB128());
+            break;
+         case DW_CFA_undefined:
+            SetRule(r.ULEB128(), RULE_UNDEFINED, 0);
+            break;
+         case DW_CFA_same_value:
+            SetRule(r.ULEB128(), RULE_SAME_VALUE, 0);
+            break;
+         case DW_CFA_register:
+            reg = r.ULEB128();
+            if (reg < DW_REG_COUNT) {
+               Row.Rules[reg].Type = RULE_REGISTER;
+               Row.Rules[reg].Register = r.ULEB128();
+            } else {
+               r.ULEB128();
+            }
+            break;
+         case DW_CFA_remember_state:
+            if (m_StackDepth >= MAX_REMEMBERED_STATES) {
+               return false;
+            }
+            m_Stack[m_StackDepth++] = Row;
+            break;
+         case DW_CFA_restore_state:
+            if (m_StackDepth == 0) {
+               return false;
+            }
+            /* GCC relies on the CFA rule being restored as well. */
+            Row = m_Stack[--m_StackDepth];
+            break;
+         case DW_CFA_def_cfa:
+            Row.CfaRegister = r.ULEB128();
+            Row.CfaOffset = r.ULEB128();
+            Row.CfaExpression = NULL;
+            break;
+         case DW_CFA_def_cfa_sf:
+            Row.CfaRegister = r.ULEB128();
+            Row.CfaOffset = r.SLEB128() * cie.DataAlign;
+            Row.CfaExpression = NULL;
+            break;
+         case DW_CFA_def_cfa_register:
+            Row.CfaRegister = r.ULEB128();
+            Row.CfaExpression = NULL;
+            break;
+         case DW_CFA_def_cfa_offset:
+            Row.CfaOffset = r.ULEB128();
+            break;
+         case DW_CFA_def_cfa_offset_sf:
+            Row.CfaOffset = r.SLEB128() * cie.DataAlign;
+            break;
+         case DW_CFA_def_cfa_expression: {
+            uint64_t size = r.ULEB128();
+            Row.CfaExpression = r.Ptr;
+            Row.CfaExpressionSize = size;
+            r.Skip(size);
+            break;
+         }
+         case DW_CFA_expression:
+         case DW_CFA_val_expression: {
+            reg = r.ULEB128();
+            uint64_t size = r.ULEB128();
+            if (reg < DW_REG_COUNT) {
+               Row.Rules[reg].Type = opcode == DW_CFA_expression ? RULE_EXPRESSION : RULE_VAL_EXPRESSION;
+               Row.Rules[reg].Expression = r.Ptr;
+               Row.Rules[reg].ExpressionSize = size;
+            }
+            r.Skip(size);
+            break;
+         }
+         case DW_CFA_offset_extended_sf:
+            reg = r.ULEB128();
+            SetRule(reg, RULE_OFFSET, r.SLEB128() * cie.DataAlign);
+            break;
+         case DW_CFA_val_offset:
+            reg = r.ULEB128();
+            SetRule(reg, RULE_VAL_OFFSET, (int64_t)r.ULEB128() * cie.DataAlign);
+            break;
+         case DW_CFA_val_offset_sf:
+            reg = r.ULEB128();
+            SetRule(reg, RULE_VAL_OFFSET, r.SLEB128() * cie.DataAlign);
+            break;
+         case DW_CFA_GNU_args_size:
+            r.ULEB128();
+            break;
+         case DW_CFA_GNU_negative_offset_extended:
+            reg = r.ULEB128();
+            offset = -(int64_t)r.ULEB128();
+            SetRule(reg, RULE_OFFSET, offset * cie.DataAlign);
+            break;
+         default:
+            return false;
+         }
+
+         if (r.Overflow) {
+            return false;
+         }
+      }
+
+      return !r.Overflow;
+   }
+
+private:
+   CfaRow m_Stack[MAX_REMEMBERED_STATES];
+   unsigned m_StackDepth;
+
+   void
+   SetRule(uint64_t Reg, RuleType Type, int64_t Offset)
+   {
+      if (Reg < DW_REG_COUNT) {
+         Row.Rules[Reg].Type = Type;
+         Row.Rules[Reg].Offset = Offset;
+      }
+   }
+
+   void
+   Restore(uint64_t Reg)
+   {
+      if (Reg < DW_REG_COUNT) {
+         Row.Rules[Reg] = Initial.Rules[Reg];
+      }
+   }
+};
+
+
+/**************************************************************************
+ *
+ * DWARF expressions
+ *
+ **************************************************************************/
+
+#define MAX_EXPRESSION_STACK 64
+
+
+static bool
+ReadWord(Target *target, uint64_t Address, uint64_t *Value)
+{
+   return target->ReadMemory(Address, Value, sizeof *Value) == sizeof *Value;
+}
+
+
+static bool
+EvaluateExpression(Target *target, const uint64_t Regs[DW_REG_COUNT],
+                   const uint8_t *Expression, size_t Size,
+                   bool PushCfa, uint64_t Cfa, uint64_t *Result)
+{
+   uint64_t stack[MAX_EXPRESSION_STACK];
+   unsigned sp = 0;
+   DwarfReader r(Expression, Size);
+
+   if (PushCfa) {
+      stack[sp++] = Cfa;
+   }
+
+#define NEED(n) do { if (sp < (n)) return false; } while (0)
+#define PUSH(v) do { uint64_t _v = (v); if (sp >= MAX_EXPRESSION_STACK) return false; stack[sp++] = _v; } while (0)
+
+   while (!r.AtEnd()) {
+      uint8_t op = r.U8();
+      uint64_t a, b, reg;
+
+      if (op >= DW_OP_lit0 && op <= DW_OP_lit31) {
+         PUSH(op - DW_OP_lit0);
+         continue;
+      }
+
+      if (op >= DW_OP_breg0 && op <= DW_OP_breg31) {
+         reg = op - DW_OP_breg0;
+         int64_t offset = r.SLEB128();
+         if (reg >= DW_REG_COUNT) {
+            return false;
+         }
+         PUSH(Regs[reg] + offset);
+         continue;
+      }
+
+      switch (op) {
+      case DW_OP_addr:
+      case DW_OP_const8u:
+      case DW_OP_const8s:
+         PUSH(r.U64());
+         break;
+      case DW_OP_const1u:
+         PUSH(r.U8());
+         break;
+      case DW_OP_const1s:
+         PUSH((int64_t)(int8_t)r.U8());
+         break;
+      case DW_OP_const2u:
+         PUSH(r.U16());
+         break;
+      case DW_OP_const2s:
+         PUSH((int64_t)(int16_t)r.U16());
+         break;
+      case DW_OP_const4u:
+         PUSH(r.U32());
+         break;
+      case DW_OP_const4s:
+         PUSH((int64_t)(int32_t)r.U32());
+         break;
+      case DW_OP_constu:
+         PUSH(r.ULEB128());
+         break;
+      case DW_OP_consts:
+         PUSH((uint64_t)r.SLEB128());
+         break;
+      case DW_OP_bregx: {
+         reg = r.ULEB128();
+         int64_t offset = r.SLEB128();
+         if (reg >= DW_REG_COUNT) {
+            return false;
+         }
+         PUSH(Regs[reg] + offset);
+         break;
+      }
+      case DW_OP_dup:
+         NEED(1);
+         PUSH(stack[sp - 1]);
+         break;
+      case DW_OP_drop:
+         NEED(1);
+         --sp;
+         break;
+      case DW_OP_over:
+         NEED(2);
+         PUSH(stack[sp - 2]);
+         break;
+      case DW_OP_pick: {
+         uint8_t index = r.U8();
+         NEED(index + 1u);
+         PUSH(stack[sp - 1 - index]);
+         break;
+      }
+      case DW_OP_swap:
+         NEED(2);
+         std::swap(stack[sp - 1], stack[sp - 2]);
+         break;
+      case DW_OP_rot:
+         NEED(3);
+         a = stack[sp - 1];
+         stack[sp - 1] = stack[sp - 2];
+         stack[sp - 2] = stack[sp - 3];
+         stack[sp - 3] = a;
+         break;
+      case DW_OP_deref:
+         NEED(1);
+         if (!ReadWord(target, stack[sp - 1], &stack[sp - 1])) {
+            return false;
+         }
+         break;
+      case DW_OP_deref_size: {
+         uint8_t size = r.U8();
+         NEED(1);
+         if (size == 0 || size > 8) {
+            return false;
+         }
+         a = 0;
+         if (target->ReadMemory(stack[sp - 1], &a, size) != size) {
+            return false;
+         }
+         stack[sp - 1] = a;
+         break;
+      }
+      case DW_OP_abs:
+         NEED(1);
+         if ((int64_t)stack[sp - 1] < 0) {
+            stack[sp - 1] = -stack[sp - 1];
+         }
+         break;
+      case DW_OP_neg:
+         NEED(1);
+         stack[sp - 1] = -stack[sp - 1];
+         break;
+      case DW_OP_not:
+         NEED(1);
+         stack[sp - 1] = ~stack[sp - 1];
+         break;
+      case DW_OP_plus_uconst:
+         NEED(1);
+         stack[sp - 1] += r.ULEB128();
+         break;
+      case DW_OP_and:
+      case DW_OP_div:
+      case DW_OP_minus:
+      case DW_OP_mod:
+      case DW_OP_mul:
+      case DW_OP_or:
+      case DW_OP_plus:
+      case DW_OP_shl:
+      case DW_OP_shr:
+      case DW_OP_shra:
+      case DW_OP_xor:
+      case DW_OP_eq:
+      case DW_OP_ge:
+      case DW_OP_gt:
+      case DW_OP_le:
+      case DW_OP_lt:
+      case DW_OP_ne:
+         NEED(2);
+         b = stack[--sp];
+         a = stack[sp - 1];
+         switch (op) {
+         case DW_OP_and:   a &= b; break;
+         case DW_OP_div:   if (!b) return false; a = (int64_t)a / (int64_t)b; break;
+         case DW_OP_minus: a -= b; break;
+         case DW_OP_mod:   if (!b) return false; a %= b; break;
+         case DW_OP_mul:   a *= b; break;
+         case DW_OP_or:    a |= b; break;
+         case DW_OP_plus:  a += b; break;
+         case DW_OP_shl:   a = b < 64 ? a << b : 0; break;
+         case DW_OP_shr:   a = b < 64 ? a >> b : 0; break;
+         case DW_OP_shra:  a = b < 64 ? (uint64_t)((int64_t)a >> b) : 0; break;
+         case DW_OP_xor:   a ^= b; break;
+         case DW_OP_eq:    a = (int64_t)a == (int64_t)b; break;
+         case DW_OP_ge:    a = (int64_t)a >= (int64_t)b; break;
+         case DW_OP_gt:    a = (int64_t)a > (int64_t)b; break;
+         case DW_OP_le:    a = (int64_t)a <= (int64_t)b; break;
+         case DW_OP_lt:    a = (int64_t)a < (int64_t)b; break;
+         case DW_OP_ne:    a = (int64_t)a != (int64_t)b; break;
+         }
+         stack[sp - 1] = a;
+         break;
+      case DW_OP_skip: {
+         int16_t offset = (int16_t)r.U16();
+         if (offset < 0 ? (size_t)-offset > r.Offset() : (size_t)offset > r.Remaining()) {
+            return false;
+         }
+         r.Ptr += offset;
+         break;
+      }
+      case DW_OP_bra: {
+         int16_t offset = (int16_t)r.U16();
+         NEED(1);
+         if (stack[--sp] != 0) {
+            if (offset < 0 ? (size_t)-offset > r.Offset() : (size_t)offset > r.Remaining()) {
+               return false;
+            }
+            r.Ptr += offset;
+         }
+         break;
+      }
+      case DW_OP_nop:
+         break;
+      default:
+         return false;
+      }
+
+      if (r.Overflow) {
+         return false;
+      }
+   }
+
+#undef NEED
+#undef PUSH
+
+   if (sp == 0) {
+      return false;
+   }
+
+   *Result = stack[sp - 1];
+   return true;
+}
+
+
+/**************************************************************************
+ *
+ * Unwinding
+ *
+ **************************************************************************/
+
+/*
+ * Compute the caller's registers using call frame information.
+ */
+static bool
+StepCfi(Target *target, const Module *module, uint64_t LookupPc,
+        const uint64_t Regs[DW_REG_COUNT], uint64_t NewRegs[DW_REG_COUNT],
+        bool *Signal)
+{
+   uint64_t address = LookupPc - module->Bias;
+   Fde fde;
+
+   if (!FindFde(module->Image, address, fde) ||
+       fde.Cie.ReturnRegister >= DW_REG_COUNT) {
+      return false;
+   }
+
+   CfaMachine machine;
+   if (!machine.Execute(fde.Cie, fde.Cie.Instructions, fde.Cie.InstructionsEnd,
+                        0, ~(uint64_t)0)) {
+      return false;
+   }
+   machine.Initial = machine.Row;
+   if (!machine.Execute(fde.Cie, fde.Instructions, fde.InstructionsEnd,
+                        fde.Start, address)) {
+      return false;
+   }
+
+   const CfaRow &row = machine.Row;
+   uint64_t cfa;
+
+   if (row.CfaExpression) {
+      if (!EvaluateExpression(target, Regs, row.CfaExpression, row.CfaExpressionSize,
+                              false, 0, &cfa)) {
+         return false;
+      }
+   } else {
+      if (row.CfaRegister >= DW_REG_COUNT) {
+         return false;
+      }
+      cfa = Regs[row.CfaRegister] + row.CfaOffset;
+   }
+
+   for (unsigned reg = 0; reg < DW_REG_COUNT; ++reg) {
+      const Rule &rule = row.Rules[reg];
+      uint64_t location;
+
+      switch (rule.Type) {
+      case RULE_SAME_VALUE:
+         NewRegs[reg] = Regs[reg];
+         break;
+      case RULE_UNDEFINED:
+         NewRegs[reg] = 0;
+         break;
+      case RULE_OFFSET:
+         if (!ReadWord(target, cfa + rule.Offset, &NewRegs[reg])) {
+            return false;
+         }
+         break;
+      case RULE_VAL_OFFSET:
+         NewRegs[reg] = cfa + rule.Offset;
+         break;
+      case RULE_REGISTER:
+         if (rule.Register >= DW_REG_COUNT) {
+            return false;
+         }
+         NewRegs[reg] = Regs[rule.Register];
+         break;
+      case RULE_EXPRESSION:
+         if (!EvaluateExpression(target, Regs, rule.Expression, rule.ExpressionSize,
+                                 true, cfa, &location) ||
+             !ReadWord(target, location, &NewRegs[reg])) {
+            return false;
+         }
+         break;
+      case RULE_VAL_EXPRESSION:
+         if (!EvaluateExpression(target, Regs, rule.Expression, rule.ExpressionSize,
+                                 true, cfa, &NewRegs[reg])) {
+            return false;
+         }
+         break;
+      }
+   }
+
+   /* The return address column gives the caller's instruction pointer. */
+   const Rule &ra = row.Rules[fde.Cie.ReturnRegister];
+   if (ra.Type == RULE_UNDEFINED) {
+      NewRegs[DW_REG_RIP] = 0;
+   } else if (fde.Cie.ReturnRegister != DW_REG_RIP) {
+      NewRegs[DW_REG_RIP] = NewRegs[fde.Cie.ReturnRegister];
+   }
+
+   /* The stack pointer is the CFA, unless stated otherwise. */
+   if (row.Rules[DW_REG_RSP].Type == RULE_SAME_VALUE) {
+      NewRegs[DW_REG_RSP] = cfa;
+   }
+
+   *Signal = fde.Cie.Signal;
+   return true;
+}
+
+
+/*
+ * Fall back to following the frame pointer chain.
+ */
+static bool
+StepFramePointer(Target *target, bool First,
+                 const uint64_t Regs[DW_REG_COUNT], uint64_t NewRegs[DW_REG_COUNT])
+{
+   uint64_t rbp = Regs[DW_REG_RBP];
+   uint64_t rsp = Regs[DW_REG_RSP];
+
+   memcpy(NewRegs, Regs, DW_REG_COUNT * sizeof Regs[0]);
+
+   /*
+    * A call through a bad function pointer leaves the return address at the
+    * top of the stack.
+    */
+   if (First && !target->FindModule(Regs[DW_REG_RIP])) {
+      if (!ReadWord(target, rsp, &NewRegs[DW_REG_RIP])) {
+         return false;
+      }
+      NewRegs[DW_REG_RSP] = rsp + 8;
+      return true;
+   }
+
+   if (rbp < rsp || (rbp & 7)) {
+      return false;
+   }
+
+   if (!ReadWord(target, rbp, &NewRegs[DW_REG_RBP]) ||
+       !ReadWord(target, rbp + 8, &NewRegs[DW_REG_RIP])) {
+      return false;
+   }
+
+   NewRegs[DW_REG_RSP] = rbp + 16;
+   return true;
+}
+
+
+void
+UnwindStack(Target *target,
+            const uint64_t Regs[DW_REG_COUNT],
+            std::vector<StackFrame> &Frames,
+            unsigned MaxFrames)
+{
+   uint64_t regs[DW_REG_COUNT];
+   bool signal = false;
+
+   memcpy(regs, Regs, sizeof regs);
+   Frames.clear();
+
+   while (Frames.size() < MaxFrames) {
+      StackFrame frame;
+      frame.Pc = regs[DW_REG_RIP];
+      frame.Sp = regs[DW_REG_RSP];
+      frame.Signal = signal;
+      Frames.push_back(frame);
+
+      if (frame.Pc == 0) {
+         break;
+      }
+
+      /*
+       * Return addresses point after the call instruction, which may be
+       * past the end of the calling function.
+       */
+      bool first = Frames.size() == 1;
+      uint64_t lookupPc = first || signal ? frame.Pc : frame.Pc - 1;
+
+      uint64_t newRegs[DW_REG_COUNT];
+      const Module *module = target->FindModule(lookupPc);
+      bool ok = false;
+
+      signal = false;
+      if (module && module->Image) {
+         ok = StepCfi(target, module, lookupPc, regs, newRegs, &signal);
+      }
+      if (!ok) {
+         ok = StepFramePointer(target, first, regs, newRegs);
+      }
+      if (!ok || newRegs[DW_REG_RIP] == 0) {
+         break;
+      }
+
+      /* Guard against loops. */
+      if (newRegs[DW_REG_RSP] < regs[DW_REG_RSP] ||
+          (newRegs[DW_REG_RSP] == regs[DW_REG_RSP] && newRegs[DW_REG_RIP] == regs[DW_REG_RIP])) {
+         break;
+      }
+
+      memcpy(regs, newRegs, sizeof regs);
+   }
+}
+
+
+/* vim:set sw=3 et: */
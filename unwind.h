@@ -0,0 +1,67 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * x86-64 stack unwinding, driven by DWARF call frame information
+ * (.eh_frame / .debug_frame), with a frame pointer fallback.
+ */
+
+#ifndef _UNWIND_H_
+#define _UNWIND_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "target.h"
+
+
+struct StackFrame
+{
+   uint64_t Pc;         /* instruction pointer, or return address for callers */
+   uint64_t Sp;         /* stack pointer on entry to this frame (Child-SP) */
+   bool Signal;         /* frame was interrupted by a signal */
+};
+
+
+#define UNWIND_MAX_FRAMES 256
+
+
+/*
+ * Walk the stack starting from the given register set (in DWARF
+ * numbering).  Always produces at least the initial frame.
+ */
+void
+UnwindStack(Target *target,
+            const uint64_t Regs[DW_REG_COUNT],
+            std::vector<StackFrame> &Frames,
+            unsigned MaxFrames = UNWIND_MAX_FRAMES);
+
+
+#endif /* _UNWIND_H_ */
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,442 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+
+#include "watchdog.h"
+
+
+/* A loop spans less code and stack than this. */
+#define WATCHDOG_PC_SPAN 4096
+#define WATCHDOG_SP_SPAN 128
+
+/* PC samples needed before calling a thread stuck. */
+#define WATCHDOG_MIN_PCS (WATCHDOG_SAMPLES/2)
+
+/* Generations of descendants looked at. */
+#define WATCHDOG_MAX_DEPTH 16
+
+
+static uint64_t
+MonotonicTime(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/*
+ * Read a small /proc file through a descriptor kept open.
+ */
+static bool
+ReadProcFile(int fd, char *Buffer, size_t Size)
+{
+   if (fd < 0) {
+      return false;
+   }
+   ssize_t ret = pread(fd, Buffer, Size - 1, 0);
+   if (ret <= 0) {
+      return false;
+   }
+   Buffer[ret] = 0;
+   return true;
+}
+
+
+/*
+ * Read a small /proc file once.
+ */
+static bool
+ReadProcPath(const char *Path, char *Buffer, size_t Size)
+{
+   int fd = open(Path, O_RDONLY | O_CLOEXEC);
+   bool ret = ReadProcFile(fd, Buffer, Size);
+   if (fd >= 0) {
+      close(fd);
+   }
+   return ret;
+}
+
+
+Watchdog::Watchdog(pid_t Pid, unsigned long Window) :
+   SpinningTid(0),
+   m_Pid(Pid),
+   m_Window((uint64_t)Window * 1000000ULL),
+   m_WindowStart(0),
+   m_ThreadsChanged(false),
+   m_IdleWindows(0)
+{
+   memset(&m_Descendants, 0, sizeof m_Descendants);
+}
+
+
+Watchdog::~Watchdog()
+{
+   std::map<pid_t, ThreadSample>::iterator it;
+   for (it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+      if (it->second.SchedFd >= 0) {
+         close(it->second.SchedFd);
+      }
+      if (it->second.SyscallFd >= 0) {
+         close(it->second.SyscallFd);
+      }
+   }
+}
+
+
+void
+Watchdog::RecordPc(ThreadSample &Sample, uint64_t Pc, uint64_t Sp)
+{
+   if (!Sample.PcCount) {
+      Sample.MinPc = Sample.MaxPc = Pc;
+      Sample.MinSp = Sample.MaxSp = Sp;
+   } else {
+      if (Pc < Sample.MinPc) Sample.MinPc = Pc;
+      if (Pc > Sample.MaxPc) Sample.MaxPc = Pc;
+      if (Sp < Sample.MinSp) Sample.MinSp = Sp;
+      if (Sp > Sample.MaxSp) Sample.MaxSp = Sp;
+   }
+   ++Sample.PcCount;
+}
+
+
+void
+Watchdog::AddPc(pid_t Tid, uint64_t Pc, uint64_t Sp)
+{
+   std::map<pid_t, ThreadSample>::iterator it = m_Threads.find(Tid);
+   if (it != m_Threads.end()) {
+      RecordPc(it->second, Pc, Sp);
+   }
+}
+
+
+void
+Watchdog::SampleThread(ThreadSample &Sample)
+{
+   char buffer[256];
+   unsigned long long runTime = 0, waitTime = 0, scheduled = 0;
+
+   /* "<run ns> <wait ns> <times scheduled>" */
+   if (ReadProcFile(Sample.SchedFd, buffer, sizeof buffer) &&
+       sscanf(buffer, "%llu %llu %llu", &runTime, &waitTime, &scheduled) == 3) {
+      Sample.Interval = runTime - Sample.RunTime;
+      Sample.RunTime = runTime;
+      Sample.Scheduled = scheduled;
+   }
+
+   /*
+    * "running", "<nr> <args...> <sp> <pc>" while blocked in a syscall, or
+    * "-1 <sp> <pc>" while preempted in user mode.
+    */
+   const char *blocked = "";
+   if (ReadProcFile(Sample.SyscallFd, buffer, sizeof buffer) &&
+       strncmp(buffer, "running", 7) != 0) {
+      long nr = strtol(buffer, NULL, 10);
+      if (nr >= 0) {
+         Sample.InSyscall = true;
+         if (nr == SYS_nanosleep || nr == SYS_clock_nanosleep) {
+            Sample.Sleeping = true;
+         }
+         buffer[strcspn(buffer, "\n")] = 0;
+         blocked = buffer;
+      } else {
+         unsigned long long sp, pc;
+         if (sscanf(buffer, "%*d %llx %llx", &sp, &pc) == 2) {
+            RecordPc(Sample, pc, sp);
+         }
+      }
+   }
+
+   /* Arguments, SP and PC included, so a loop around a call shows. */
+   if (!blocked[0] || strcmp(blocked, Sample.Blocked) != 0) {
+      Sample.Steady = false;
+   }
+   snprintf(Sample.Blocked, sizeof Sample.Blocked, "%s", blocked);
+}
+
+
+/*
+ * Add up the CPU time and wake-ups of all threads of all descendants.
+ */
+void
+Watchdog::AddDescendants(pid_t Pid, Usage &Total, unsigned Depth)
+{
+   char path[64];
+   char buffer[4096];
+
+   if (Depth >= WATCHDOG_MAX_DEPTH) {
+      return;
+   }
+
+   snprintf(path, sizeof path, "/proc/%d/task", Pid);
+   DIR *dir = opendir(path);
+   if (!dir) {
+      return;
+   }
+
+   std::vector<pid_t> children;
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      pid_t tid = atoi(entry->d_name);
+      if (tid <= 0) {
+         continue;
+      }
+
+      if (Depth) {
+         unsigned long long runTime, waitTime, scheduled;
+         snprintf(path, sizeof path, "/proc/%d/task/%d/schedstat", Pid, tid);
+         if (ReadProcPath(path, buffer, sizeof buffer) &&
+             sscanf(buffer, "%llu %llu %llu", &runTime, &waitTime, &scheduled) == 3) {
+            Total.RunTime += runTime;
+            Total.Scheduled += scheduled;
+         }
+      }
+
+      /* "<pid> <pid> ..." */
+      snprintf(path, sizeof path, "/proc/%d/task/%d/children", Pid, tid);
+      if (ReadProcPath(path, buffer, sizeof buffer)) {
+         char *p = buffer;
+         char *end;
+         long child;
+         while ((child = strtol(p, &end, 10)) > 0) {
+            children.push_back((pid_t)child);
+            p = end;
+         }
+      }
+   }
+   closedir(dir);
+
+   for (size_t i = 0; i < children.size(); ++i) {
+      ++Total.Processes;
+      AddDescendants(children[i], Total, Depth + 1);
+   }
+}
+
+
+void
+Watchdog::StartWindow(uint64_t Now)
+{
+   std::map<pid_t, ThreadSample>::iterator it;
+   for (it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+      ThreadSample &sample = it->second;
+      sample.StartRunTime = sample.RunTime;
+      sample.StartScheduled = sample.Scheduled;
+      sample.InSyscall = false;
+      sample.Sleeping = false;
+      sample.Steady = true;
+      sample.PcCount = 0;
+   }
+   m_ThreadsChanged = false;
+   m_WindowStart = Now;
+
+   memset(&m_Descendants, 0, sizeof m_Descendants);
+   AddDescendants(m_Pid, m_Descendants, 0);
+}
+
+
+WatchdogVerdict
+Watchdog::Judge(uint64_t Elapsed)
+{
+   std::map<pid_t, ThreadSample>::iterator it;
+
+   SpinningTid = 0;
+
+   /* Threads coming and going are progress. */
+   if (m_ThreadsChanged || m_Threads.empty()) {
+      m_IdleWindows = 0;
+      return WATCHDOG_PROGRESS;
+   }
+
+   uint64_t quiet = m_Window / 100;
+   unsigned active = 0;
+   pid_t spinning = 0;
+   bool steady = true;
+
+   for (it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+      const ThreadSample &sample = it->second;
+      uint64_t runTime = sample.RunTime - sample.StartRunTime;
+
+      if (!sample.Steady) {
+         steady = false;
+      }
+
+      if (runTime < quiet && sample.Scheduled == sample.StartScheduled &&
+          !sample.Sleeping) {
+         continue;
+      }
+      ++active;
+
+      if (runTime >= Elapsed/4*3 &&
+          !sample.InSyscall &&
+          sample.PcCount >= WATCHDOG_MIN_PCS &&
+          sample.MaxPc - sample.MinPc < WATCHDOG_PC_SPAN &&
+          sample.MaxSp - sample.MinSp < WATCHDOG_SP_SPAN) {
+         if (!spinning) {
+            spinning = it->first;
+         }
+         --active;
+      }
+   }
+
+   if (active) {
+      m_IdleWindows = 0;
+      return WATCHDOG_PROGRESS;
+   }
+   if (spinning) {
+      m_IdleWindows = 0;
+      SpinningTid = spinning;
+      return WATCHDOG_SPINNING;
+   }
+
+   /* Waiting on descendants which get work done. */
+   Usage usage;
+   memset(&usage, 0, sizeof usage);
+   AddDescendants(m_Pid, usage, 0);
+   if (usage.Processes != m_Descendants.Processes ||
+       usage.RunTime >= m_Descendants.RunTime + quiet ||
+       usage.Scheduled != m_Descendants.Scheduled) {
+      m_IdleWindows = 0;
+      return WATCHDOG_PROGRESS;
+   }
+
+   /* Only the very same blocked calls, window after window, are a hang. */
+   if (!steady) {
+      m_IdleWindows = 0;
+      return WATCHDOG_PROGRESS;
+   }
+   if (++m_IdleWindows < WATCHDOG_IDLE_WINDOWS) {
+      return WATCHDOG_PROGRESS;
+   }
+   m_IdleWindows = 0;
+   return WATCHDOG_IDLE;
+}
+
+
+WatchdogVerdict
+Watchdog::Sample(void)
+{
+   char path[64];
+   std::map<pid_t, ThreadSample>::iterator it;
+
+   uint64_t now = MonotonicTime();
+
+   snprintf(path, sizeof path, "/proc/%d/task", m_Pid);
+   DIR *dir = opendir(path);
+   if (!dir) {
+      return WATCHDOG_PROGRESS;
+   }
+
+   for (it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+      it->second.Alive = false;
+   }
+
+   struct dirent *entry;
+   while ((entry = readdir(dir)) != NULL) {
+      pid_t tid = atoi(entry->d_name);
+      if (tid <= 0) {
+         continue;
+      }
+
+      it = m_Threads.find(tid);
+      if (it == m_Threads.end()) {
+         ThreadSample sample;
+         memset(&sample, 0, sizeof sample);
+         snprintf(path, sizeof path, "/proc/%d/task/%d/schedstat", m_Pid, tid);
+         sample.SchedFd = open(path, O_RDONLY | O_CLOEXEC);
+         snprintf(path, sizeof path, "/proc/%d/task/%d/syscall", m_Pid, tid);
+         sample.SyscallFd = open(path, O_RDONLY | O_CLOEXEC);
+
+         it = m_Threads.insert(std::make_pair(tid, sample)).first;
+         SampleThread(it->second);
+         it->second.Interval = 0;
+         it->second.StartRunTime = it->second.RunTime;
+         it->second.StartScheduled = it->second.Scheduled;
+         it->second.Alive = true;
+         m_ThreadsChanged = true;
+         continue;
+      }
+
+      SampleThread(it->second);
+      it->second.Alive = true;
+   }
+   closedir(dir);
+
+   for (it = m_Threads.begin(); it != m_Threads.end(); ) {
+      if (it->second.Alive) {
+         ++it;
+         continue;
+      }
+      if (it->second.SchedFd >= 0) {
+         close(it->second.SchedFd);
+      }
+      if (it->second.SyscallFd >= 0) {
+         close(it->second.SyscallFd);
+      }
+      m_Threads.erase(it++);
+      m_ThreadsChanged = true;
+   }
+
+   if (!m_WindowStart) {
+      StartWindow(now);
+      return WATCHDOG_PROGRESS;
+   }
+
+   if (now - m_WindowStart < m_Window) {
+      return WATCHDOG_PROGRESS;
+   }
+
+   WatchdogVerdict verdict = Judge(now - m_WindowStart);
+   StartWindow(now);
+   return verdict;
+}
+
+
+void
+Watchdog::BusyThreads(std::vector<pid_t> &Tids) const
+{
+   /* Busy for at least half of the last interval. */
+   uint64_t busy = m_Window / WATCHDOG_SAMPLES / 2;
+
+   Tids.clear();
+   std::map<pid_t, ThreadSample>::const_iterator it;
+   for (it = m_Threads.begin(); it != m_Threads.end(); ++it) {
+      if (it->second.Interval >= busy && !it->second.InSyscall) {
+         Tids.push_back(it->first);
+      }
+   }
+}
+
+
+/* vim:set sw=3 et: */
@@ -0,0 +1,169 @@
+/**************************************************************************
+ *
+ * Copyright 2009-2010 Jose Fonseca
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. NO EVENT SHALL
+ * THE COPYRIGHT HOLDERS, AUTHORS AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM,
+ * DAMAGES OR OTHER LIABILITY, WHETHER AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OF OR CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ **************************************************************************/
+
+/*
+ * Hang detection from cheap per-thread samples of a running process.
+ *
+ * Every sample reads /proc/<pid>/task/<tid>/schedstat (CPU time and times
+ * scheduled in) and .../syscall (the syscall being waited on, if any) of
+ * each thread, through file descriptors kept open across samples.  Over a
+ * window of samples the process is deemed hung when either:
+ *
+ * - no thread used any CPU nor woke up, and every thread stayed blocked in
+ *   the same syscall, with the same arguments, for WATCHDOG_IDLE_WINDOWS
+ *   windows in a row (e.g., a deadlock), or
+ *
+ * - some thread used nearly all of the CPU without ever entering a
+ *   syscall, always within a few PCs and stack bytes of the same place, while
+ *   the other threads did nothing.
+ *
+ * PCs of running threads are not exposed by /proc, so the caller samples
+ * them (e.g., with PTRACE_INTERRUPT) for the threads BusyThreads() reports.
+ * Without PC samples only the first kind of hang is detected.
+ *
+ * Timed sleeps are not hangs, and neither is waiting on descendants which
+ * use CPU or wake up themselves (e.g., a shell waiting for its command).
+ */
+
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <vector>
+
+
+/* Samples taken per window. */
+#define WATCHDOG_SAMPLES 8
+
+/* Windows a process must stay blocked in the same syscalls for. */
+#define WATCHDOG_IDLE_WINDOWS 3
+
+
+enum WatchdogVerdict {
+   WATCHDOG_PROGRESS = 0,
+   WATCHDOG_SPINNING,      /* SpinningTid is stuck in a loop */
+   WATCHDOG_IDLE           /* no CPU, no wake-ups and the same syscalls */
+};
+
+
+class Watchdog
+{
+public:
+   /*
+    * Window is the time, in milliseconds, a process must make no progress
+    * for to be considered hung.  Sample() should be called every
+    * Window/WATCHDOG_SAMPLES milliseconds.
+    */
+   Watchdog(pid_t Pid, unsigned long Window);
+   ~Watchdog();
+
+   /*
+    * Sample all threads, and judge the window once it is complete.
+    */
+   WatchdogVerdict
+   Sample(void);
+
+   /*
+    * Threads which were busy in user mode during the last interval, and
+    * whose PC is worth sampling.
+    */
+   void
+   BusyThreads(std::vector<pid_t> &Tids) const;
+
+   /*
+    * Record the registers of a busy thread.
+    */
+   void
+   AddPc(pid_t Tid, uint64_t Pc, uint64_t Sp);
+
+   pid_t SpinningTid;
+
+private:
+   struct ThreadSample
+   {
+      int SchedFd;
+      int SyscallFd;
+      bool Alive;
+
+      uint64_t RunTime;          /* ns */
+      uint64_t Scheduled;
+      uint64_t Interval;         /* run time during the last interval */
+
+      /* Window state */
+      uint64_t StartRunTime;
+      uint64_t StartScheduled;
+      bool InSyscall;
+      bool Sleeping;             /* in a timed sleep */
+      bool Steady;               /* blocked in the same syscall all along */
+      unsigned PcCount;
+      uint64_t MinPc;
+      uint64_t MaxPc;
+      uint64_t MinSp;
+      uint64_t MaxSp;
+
+      /* The /proc syscall line while blocked, kept across windows. */
+      char Blocked[256];
+   };
+
+   struct Usage
+   {
+      uint64_t RunTime;
+      uint64_t Scheduled;
+      unsigned Processes;
+   };
+
+   void
+   AddDescendants(pid_t Pid, Usage &Total, unsigned Depth);
+
+   void
+   SampleThread(ThreadSample &Sample);
+
+   void
+   RecordPc(ThreadSample &Sample, uint64_t Pc, uint64_t Sp);
+
+   WatchdogVerdict
+   Judge(uint64_t Elapsed);
+
+   void
+   StartWindow(uint64_t Now);
+
+   pid_t m_Pid;
+   uint64_t m_Window;            /* ns */
+   uint64_t m_WindowStart;
+   bool m_ThreadsChanged;
+   std::map<pid_t, ThreadSample> m_Threads;
+   Usage m_Descendants;          /* at the start of the window */
+   unsigned m_IdleWindows;       /* in a row */
+};
+
+
+#endif /* _WATCHDOG_H_ */
+
+/* vim:set sw=3 et: */